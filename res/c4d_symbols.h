@@ -9,6 +9,10 @@ enum
 	IDS_OBJ_DIRTPLANE,
 	IDS_OBJ_CURBSTONE_GROUP,
 	IDS_OBJ_CURBSTONE,
+	IDS_OBJ_TILE,
+	IDS_OBJ_TILE_INSTANCE,
+	IDS_OBJ_COLLISION_GROUP,
+	IDS_OBJ_CHUNK,
 
 	_DUMMY_ELEMENT_
 };
@@ -11,6 +11,12 @@ enum
 	SIDEWALK_ELEMENT_SELBIAS								= 30005,
 	SIDEWALK_ELEMENT_SEED										= 30006,
 	SIDEWALK_ELEMENT_HOLEBIAS								= 30007,
+	SIDEWALK_SPLINE												= 30008,
+	SIDEWALK_FOOTPRINT											= 30009,
+	SIDEWALK_TERRAIN											= 30200,
+	SIDEWALK_LAYOUT_VERSION										= 30201,
+		SIDEWALK_LAYOUT_VERSION_SEQUENTIAL						= 0,
+		SIDEWALK_LAYOUT_VERSION_POSITIONAL						= 1,
 
 
 	SIDEWALK_PLATES													= 30010,
@@ -79,7 +85,60 @@ enum
 	SIDEWALK_CURB_MAT												= 30130,
 	SIDEWALK_CURB_MAT_LINK									= 30131,
 	SIDEWALK_CURB_MAT_SCALE									= 30132,
-	SIDEWALK_CURB_MAT_EACH									= 30133
+	SIDEWALK_CURB_MAT_EACH									= 30133,
+
+
+	SIDEWALK_TILE														= 30140,
+	SIDEWALK_TILE_ENABLE										= 30141,
+	SIDEWALK_TILE_SIZE											= 30142,
+	SIDEWALK_TILE_VARIATION									= 30143,
+		SIDEWALK_TILE_VARIATION_NONE					= 0,
+		SIDEWALK_TILE_VARIATION_FLIP					= 1,
+		SIDEWALK_TILE_VARIATION_ROTATE				= 2,
+	SIDEWALK_TILE_SEED											= 30144,
+
+
+	SIDEWALK_PERFORMANCE										= 30150,
+	SIDEWALK_PERF_ALLOCATIONS								= 30151,
+	SIDEWALK_NAMING													= 30152,
+		SIDEWALK_NAMING_FULL									= 0,
+		SIDEWALK_NAMING_GROUPS								= 1,
+		SIDEWALK_NAMING_LAZY									= 2,
+	SIDEWALK_QUANTIZE												= 30153,
+	SIDEWALK_OPTIMIZE												= 30154,
+	SIDEWALK_PERF_ACMR_ORIGINAL							= 30155,
+	SIDEWALK_PERF_ACMR_OPTIMIZED						= 30156,
+	SIDEWALK_COLLISION											= 30157,
+		SIDEWALK_COLLISION_OFF									= 0,
+		SIDEWALK_COLLISION_HIDDEN								= 1,
+		SIDEWALK_COLLISION_ONLY									= 2,
+	SIDEWALK_CACHE_SIZE											= 30158,
+	SIDEWALK_CACHE_PREFETCH									= 30159,
+	SIDEWALK_CHUNK_ENABLE										= 30190,
+	SIDEWALK_CHUNK_SIZE_X										= 30191,
+	SIDEWALK_CHUNK_SIZE_Z										= 30192,
+
+	SIDEWALK_BAKE														= 30160,
+	SIDEWALK_BAKE_ENABLE										= 30161,
+	SIDEWALK_BAKE_RESOLUTION								= 30162,
+	SIDEWALK_BAKE_FILE											= 30163,
+
+	SIDEWALK_STATISTICS											= 30170,
+	SIDEWALK_STAT_SOURCE										= 30171,
+		SIDEWALK_STAT_SOURCE_NONE						= 0,
+		SIDEWALK_STAT_SOURCE_BUILT						= 1,
+		SIDEWALK_STAT_SOURCE_UPDATED					= 2,
+		SIDEWALK_STAT_SOURCE_CACHED						= 3,
+	SIDEWALK_STAT_OBJECTS										= 30172,
+	SIDEWALK_STAT_POINTS										= 30173,
+	SIDEWALK_STAT_POLYGONS										= 30174,
+	SIDEWALK_STAT_TAGS											= 30175,
+	SIDEWALK_STAT_MEMORY										= 30176,
+	SIDEWALK_STAT_TIME_TOTAL									= 30177,
+	SIDEWALK_STAT_TIME_PLATES									= 30178,
+	SIDEWALK_STAT_TIME_COBBLE									= 30179,
+	SIDEWALK_STAT_TIME_DIRT										= 30180,
+	SIDEWALK_STAT_TIME_CURB										= 30181
 };
 
 #endif
@@ -34,6 +34,14 @@ CONTAINER oSidewalk
 		REAL	SIDEWALK_ELEMENT_SELBIAS	{ UNIT PERCENT; MIN -100.0; MAX 100.0; CUSTOMGUI REALSLIDER; }
 		REAL	SIDEWALK_ELEMENT_HOLEBIAS	{ UNIT PERCENT; MIN 0.0; MAX 100.0; CUSTOMGUI REALSLIDER; }
 		LONG	SIDEWALK_ELEMENT_SEED	{ MIN 0; }
+		
+		SEPARATOR						{ LINE; }
+		
+		LINK	SIDEWALK_SPLINE			{ ACCEPT { Obase; } }
+		LINK	SIDEWALK_FOOTPRINT		{ ACCEPT { Obase; } }
+		LINK	SIDEWALK_TERRAIN		{ ACCEPT { Obase; } }
+		
+		LONG	SIDEWALK_LAYOUT_VERSION	{ HIDDEN; }
 	}
 	
 	GROUP	SIDEWALK_PLATES
@@ -155,4 +163,88 @@ CONTAINER oSidewalk
 			BOOL	SIDEWALK_CURB_MAT_EACH		{  }
 		}
 	}
+	
+	GROUP	SIDEWALK_TILE
+	{
+		BOOL	SIDEWALK_TILE_ENABLE		{  }
+		
+		LONG	SIDEWALK_TILE_SIZE			{ MIN 2; STEP 2; }
+		LONG	SIDEWALK_TILE_VARIATION
+		{
+			CYCLE
+			{
+				SIDEWALK_TILE_VARIATION_NONE;
+				SIDEWALK_TILE_VARIATION_FLIP;
+				SIDEWALK_TILE_VARIATION_ROTATE;
+			}
+		}
+		LONG	SIDEWALK_TILE_SEED			{ MIN 0; }
+	}
+	
+	GROUP	SIDEWALK_BAKE
+	{
+		BOOL			SIDEWALK_BAKE_ENABLE				{  }
+		LONG			SIDEWALK_BAKE_RESOLUTION		{ MIN 8; MAX 1024; }
+		FILENAME	SIDEWALK_BAKE_FILE					{ SAVE; }
+	}
+	
+	GROUP	SIDEWALK_PERFORMANCE
+	{
+		LONG	SIDEWALK_NAMING
+		{
+			CYCLE
+			{
+				SIDEWALK_NAMING_FULL;
+				SIDEWALK_NAMING_GROUPS;
+				SIDEWALK_NAMING_LAZY;
+			}
+		}
+		BOOL	SIDEWALK_QUANTIZE	{  }
+		BOOL	SIDEWALK_OPTIMIZE	{  }
+		LONG	SIDEWALK_COLLISION
+		{
+			CYCLE
+			{
+				SIDEWALK_COLLISION_OFF;
+				SIDEWALK_COLLISION_HIDDEN;
+				SIDEWALK_COLLISION_ONLY;
+			}
+		}
+		BOOL	SIDEWALK_CHUNK_ENABLE	{  }
+		LONG	SIDEWALK_CHUNK_SIZE_X	{ MIN 1; }
+		LONG	SIDEWALK_CHUNK_SIZE_Z	{ MIN 1; }
+		LONG	SIDEWALK_CACHE_SIZE	{ MIN 0; ANIM OFF; }
+		BOOL	SIDEWALK_CACHE_PREFETCH	{ ANIM OFF; }
+		
+		LONG	SIDEWALK_PERF_ALLOCATIONS	{ ANIM OFF; }
+		REAL	SIDEWALK_PERF_ACMR_ORIGINAL	{ ANIM OFF; STEP 0.01; }
+		REAL	SIDEWALK_PERF_ACMR_OPTIMIZED	{ ANIM OFF; STEP 0.01; }
+	}
+	
+	GROUP	SIDEWALK_STATISTICS
+	{
+		LONG	SIDEWALK_STAT_SOURCE
+		{
+			ANIM OFF;
+			CYCLE
+			{
+				SIDEWALK_STAT_SOURCE_NONE;
+				SIDEWALK_STAT_SOURCE_BUILT;
+				SIDEWALK_STAT_SOURCE_UPDATED;
+				SIDEWALK_STAT_SOURCE_CACHED;
+			}
+		}
+		
+		LONG	SIDEWALK_STAT_OBJECTS	{ ANIM OFF; }
+		LONG	SIDEWALK_STAT_POINTS	{ ANIM OFF; }
+		LONG	SIDEWALK_STAT_POLYGONS	{ ANIM OFF; }
+		LONG	SIDEWALK_STAT_TAGS	{ ANIM OFF; }
+		REAL	SIDEWALK_STAT_MEMORY	{ ANIM OFF; STEP 0.01; }
+		
+		REAL	SIDEWALK_STAT_TIME_TOTAL	{ ANIM OFF; STEP 0.01; }
+		REAL	SIDEWALK_STAT_TIME_PLATES	{ ANIM OFF; STEP 0.01; }
+		REAL	SIDEWALK_STAT_TIME_COBBLE	{ ANIM OFF; STEP 0.01; }
+		REAL	SIDEWALK_STAT_TIME_DIRT	{ ANIM OFF; STEP 0.01; }
+		REAL	SIDEWALK_STAT_TIME_CURB	{ ANIM OFF; STEP 0.01; }
+	}
 }
@@ -0,0 +1,914 @@
+#include "c4d.h"
+#include "main.h"
+#include "sidewalk.h"
+#include "sidewalkobject.h"
+#include "osidewalk.h"
+
+
+// Command line arguments
+static const Char *ARG_BATCH = "-sidewalk-batch";
+static const Char *ARG_OUTPUT = "-sidewalk-output";
+static const Char *ARG_THREADS = "-sidewalk-threads";
+static const Char *ARG_FORMAT = "-sidewalk-format";
+static const Char *ARG_STRESS = "-sidewalk-stress";
+
+// Number of variants that are generated at the same time at most
+static const Int32 MAX_BATCH_THREADS = 64;
+
+// Offset basis and prime of the 64 bit FNV-1a hash
+static const UInt64 HASH_OFFSET_BASIS = 14695981039346656037ULL;
+static const UInt64 HASH_PRIME = 1099511628211ULL;
+
+
+/// A parameter that can be set in a sweep file
+struct SweepParameter
+{
+	const Char *name;  ///< Name in the sweep file, the description ID without "SIDEWALK_"
+	Int32 id;
+	Int32 type;        ///< DA_LONG, DA_REAL, DA_VECTOR or DA_FILENAME
+};
+
+
+static const SweepParameter SWEEP_PARAMETERS[] =
+{
+	{ "ELEMENT_SIZE", SIDEWALK_ELEMENT_SIZE, DA_VECTOR },
+	{ "COUNT_X", SIDEWALK_COUNT_X, DA_LONG },
+	{ "COUNT_Z", SIDEWALK_COUNT_Z, DA_LONG },
+	{ "SHIFT", SIDEWALK_SHIFT, DA_REAL },
+	{ "ELEMENT_SELBIAS", SIDEWALK_ELEMENT_SELBIAS, DA_REAL },
+	{ "ELEMENT_SEED", SIDEWALK_ELEMENT_SEED, DA_LONG },
+	{ "ELEMENT_HOLEBIAS", SIDEWALK_ELEMENT_HOLEBIAS, DA_REAL },
+	{ "PLATES_SPACE", SIDEWALK_PLATES_SPACE, DA_REAL },
+	{ "PLATES_FILLET_RAD", SIDEWALK_PLATES_FILLET_RAD, DA_REAL },
+	{ "PLATES_FILLET_SUBD", SIDEWALK_PLATES_FILLET_SUBD, DA_LONG },
+	{ "PLATES_PHONG", SIDEWALK_PLATES_PHONG, DA_LONG },
+	{ "PLATES_RND_ROT", SIDEWALK_PLATES_RND_ROT, DA_VECTOR },
+	{ "PLATES_RND_POS", SIDEWALK_PLATES_RND_POS, DA_VECTOR },
+	{ "PLATES_RND_SEED", SIDEWALK_PLATES_RND_SEED, DA_LONG },
+	{ "COBBLE_COUNT", SIDEWALK_COBBLE_COUNT, DA_LONG },
+	{ "COBBLE_SPACE", SIDEWALK_COBBLE_SPACE, DA_REAL },
+	{ "COBBLE_ELEVATION", SIDEWALK_COBBLE_ELEVATION, DA_REAL },
+	{ "COBBLE_CRUMPLE", SIDEWALK_COBBLE_CRUMPLE, DA_REAL },
+	{ "COBBLE_SUBD", SIDEWALK_COBBLE_SUBD, DA_LONG },
+	{ "COBBLE_FILLET_RAD", SIDEWALK_COBBLE_FILLET_RAD, DA_REAL },
+	{ "COBBLE_FILLET_SUBD", SIDEWALK_COBBLE_FILLET_SUBD, DA_LONG },
+	{ "COBBLE_PHONG", SIDEWALK_COBBLE_PHONG, DA_LONG },
+	{ "COBBLE_RND_ROT", SIDEWALK_COBBLE_RND_ROT, DA_VECTOR },
+	{ "COBBLE_RND_POS", SIDEWALK_COBBLE_RND_POS, DA_VECTOR },
+	{ "COBBLE_RND_SEED", SIDEWALK_COBBLE_RND_SEED, DA_LONG },
+	{ "USE_DIRT", SIDEWALK_USE_DIRT, DA_LONG },
+	{ "DIRT_CRUMPLE", SIDEWALK_DIRT_CRUMPLE, DA_REAL },
+	{ "DIRT_SUBD", SIDEWALK_DIRT_SUBD, DA_LONG },
+	{ "DIRT_ELEVATION", SIDEWALK_DIRT_ELEVATION, DA_REAL },
+	{ "DIRT_SEED", SIDEWALK_DIRT_SEED, DA_LONG },
+	{ "USE_CURB", SIDEWALK_USE_CURB, DA_LONG },
+	{ "CURB_COUNT", SIDEWALK_CURB_COUNT, DA_LONG },
+	{ "CURB_SIZE_X", SIDEWALK_CURB_SIZE_X, DA_REAL },
+	{ "CURB_SIZE_Y", SIDEWALK_CURB_SIZE_Y, DA_REAL },
+	{ "CURB_CRUMPLE_VAL", SIDEWALK_CURB_CRUMPLE_VAL, DA_REAL },
+	{ "CURB_FILLET_RAD", SIDEWALK_CURB_FILLET_RAD, DA_REAL },
+	{ "CURB_FILLET_SUBD", SIDEWALK_CURB_FILLET_SUBD, DA_LONG },
+	{ "CURB_VARIATION", SIDEWALK_CURB_VARIATION, DA_REAL },
+	{ "CURB_SUBD", SIDEWALK_CURB_SUBD, DA_LONG },
+	{ "CURB_ELEVATION", SIDEWALK_CURB_ELEVATION, DA_REAL },
+	{ "CURB_VARIATION_SEED", SIDEWALK_CURB_VARIATION_SEED, DA_LONG },
+	{ "TILE_ENABLE", SIDEWALK_TILE_ENABLE, DA_LONG },
+	{ "TILE_SIZE", SIDEWALK_TILE_SIZE, DA_LONG },
+	{ "TILE_VARIATION", SIDEWALK_TILE_VARIATION, DA_LONG },
+	{ "TILE_SEED", SIDEWALK_TILE_SEED, DA_LONG },
+	{ "BAKE_ENABLE", SIDEWALK_BAKE_ENABLE, DA_LONG },
+	{ "BAKE_RESOLUTION", SIDEWALK_BAKE_RESOLUTION, DA_LONG },
+	{ "BAKE_FILE", SIDEWALK_BAKE_FILE, DA_FILENAME },
+	{ "NAMING", SIDEWALK_NAMING, DA_LONG },
+	{ "QUANTIZE", SIDEWALK_QUANTIZE, DA_LONG },
+	{ "OPTIMIZE", SIDEWALK_OPTIMIZE, DA_LONG },
+	{ "COLLISION", SIDEWALK_COLLISION, DA_LONG }
+};
+
+
+/// One sidewalk to generate
+struct BatchVariant
+{
+	String name;
+	BaseContainer data;  ///< Parameters of the sidewalk object
+};
+
+
+/// Variants that are still to be generated, and workers that have finished one.
+/// Each worker takes the next variant as soon as it's done with the last one, so a slow variant doesn't hold up the others.
+/// Workers are identified by their index, results are taken by the main thread.
+class BatchQueue
+{
+public:
+	/// Start a new batch
+	/// @return False if an error occurred; otherwise true
+	Bool Init(Int32 variantCount, Int32 workerCount)
+	{
+		_nextVariant = 0;
+		_variantCount = variantCount;
+		_finishedCount = 0;
+		if (!_finishedSignal || !_finishedSignal->Init())
+			return false;
+
+		for (Int32 workerIndex = 0; workerIndex < workerCount; ++workerIndex)
+		{
+			if (!_releasedSignals[workerIndex] || !_releasedSignals[workerIndex]->Init())
+				return false;
+		}
+		return true;
+	}
+
+	/// Take the next variant to generate
+	/// @return Index of the variant; or NOTOK if all variants have been taken
+	Int32 TakeVariant()
+	{
+		_lock.Lock();
+		Int32 variantIndex = (_nextVariant < _variantCount) ? _nextVariant++ : NOTOK;
+		_lock.Unlock();
+		return variantIndex;
+	}
+
+	/// Hand a worker's result to the main thread, and wait until it has been taken
+	void Finish(Int32 workerIndex)
+	{
+		_lock.Lock();
+		_finished[_finishedCount++] = workerIndex;
+		_released[workerIndex] = false;
+		_lock.Unlock();
+		_finishedSignal->Set();
+
+		// Only this worker waits for its signal. It's cleared under the lock, so a release can't get lost in between.
+		for (;;)
+		{
+			_lock.Lock();
+			Bool released = _released[workerIndex];
+			if (!released)
+				_releasedSignals[workerIndex]->Clear();
+			_lock.Unlock();
+
+			if (released)
+				return;
+			_releasedSignals[workerIndex]->Wait(-1);
+		}
+	}
+
+	/// Wait until a worker has finished a variant. Called by the main thread.
+	/// @return Index of the worker, its result can be taken until Release() is called
+	Int32 WaitForFinished()
+	{
+		for (;;)
+		{
+			_lock.Lock();
+			Int32 workerIndex = (_finishedCount > 0) ? _finished[--_finishedCount] : NOTOK;
+			if (workerIndex == NOTOK)
+				_finishedSignal->Clear();
+			_lock.Unlock();
+
+			if (workerIndex != NOTOK)
+				return workerIndex;
+			_finishedSignal->Wait(-1);
+		}
+	}
+
+	/// Let a worker go on with the next variant, after its result has been taken
+	void Release(Int32 workerIndex)
+	{
+		_lock.Lock();
+		_released[workerIndex] = true;
+		_lock.Unlock();
+		_releasedSignals[workerIndex]->Set();
+	}
+
+private:
+	GeSpinlock _lock;                                          ///< Protects the counters and flags
+	AutoAlloc<GeSignal> _finishedSignal;                       ///< Set when a worker has finished a variant
+	AutoAlloc<GeSignal> _releasedSignals[MAX_BATCH_THREADS];   ///< Set when the main thread has taken the result of a worker
+	Bool _released[MAX_BATCH_THREADS];
+	Int32 _finished[MAX_BATCH_THREADS];                        ///< Workers whose result hasn't been taken yet
+	Int32 _finishedCount;
+	Int32 _nextVariant;
+	Int32 _variantCount;
+
+public:
+	/// Default constructor
+	BatchQueue() : _finishedCount(0), _nextVariant(0), _variantCount(0)
+	{}
+};
+
+
+/// Generates variants from a queue, and measures them
+class BatchWorker : public C4DThread
+{
+public:
+	/// Set where variants come from. Results are taken by TakeResult().
+	/// @param[in] workerIndex Identifies this worker in the queue
+	/// @param[in] plyPath If set, variants are streamed to PLY files in this directory instead
+	void Init(BatchQueue *queue, Int32 workerIndex, const maxon::BaseArray<BatchVariant> *variants, const Filename &plyPath)
+	{
+		_queue = queue;
+		_workerIndex = workerIndex;
+		_variants = variants;
+		_plyPath = plyPath;
+	}
+
+	virtual void Main()
+	{
+		for (;;)
+		{
+			Int32 variantIndex = _queue->TakeVariant();
+			if (variantIndex == NOTOK)
+				return;
+
+			Generate(variantIndex);
+			_queue->Finish(_workerIndex);
+		}
+	}
+
+	virtual const Char *GetThreadName()
+	{
+		return "SidewalkBatch";
+	}
+
+	/// Generate one variant. Called by Main(), or by the main thread if no worker could be started.
+	void Generate(Int32 variantIndex)
+	{
+		_variantIndex = variantIndex;
+		_result.Free();
+		_exported = false;
+		_milliseconds = 0.0;
+		_polygonCount = 0;
+		_objectCount = 0;
+
+		// Each worker builds in its own document, with its own state.
+		// Variants already run in parallel, so each build runs its stages on the worker thread only.
+		const BatchVariant &variant = (*_variants)[variantIndex];
+		Float startTime = GeGetMilliSeconds();
+
+		if (_document)
+		{
+			Sidewalk::Parameters params;
+			Sidewalk::GetParametersFromContainer(variant.data, *_document, params);
+			_state.threadCount = 1;
+
+			if (_plyPath.Content())
+				_exported = Sidewalk::Export(params, _state, _document, _plyPath + Filename(variant.name + ".ply"), &_polygonCount);
+			else
+				_result.Set(Sidewalk::Build(params, _state, _document));
+		}
+
+		_milliseconds = GeGetMilliSeconds() - startTime;
+		CountGeometry(_result, 0);
+	}
+
+	/// Get the index of the last generated variant
+	Int32 GetVariantIndex() const
+	{
+		return _variantIndex;
+	}
+
+	/// Get the generated sidewalk
+	/// @return Pointer to the sidewalk; or nullptr if it could not be generated. Caller owns the pointed object.
+	BaseObject *TakeResult()
+	{
+		return _result.Release();
+	}
+
+	Float GetMilliseconds() const
+	{
+		return _milliseconds;
+	}
+
+	Int GetPolygonCount() const
+	{
+		return _polygonCount;
+	}
+
+	Int GetObjectCount() const
+	{
+		return _objectCount;
+	}
+
+	/// Check if the variant has been streamed to its PLY file
+	Bool IsExported() const
+	{
+		return _exported;
+	}
+
+private:
+	/// Count objects and polygons. Tile instances count the polygons of the tile, as they're rendered.
+	void CountGeometry(BaseObject *op, Int32 depth)
+	{
+		for (; op; op = op->GetNext())
+		{
+			++_objectCount;
+
+			if (op->IsInstanceOf(Opolygon))
+			{
+				_polygonCount += ToPoly(op)->GetPolygonCount();
+			}
+			else if (op->IsInstanceOf(Oinstance) && depth < 1)
+			{
+				BaseContainer *instanceData = op->GetDataInstance();
+				BaseLink *link = instanceData ? instanceData->GetBaseLink(INSTANCEOBJECT_LINK) : nullptr;
+				BaseObject *linkedObject = link ? static_cast<BaseObject*>(link->ForceGetLink()) : nullptr;
+				if (linkedObject)
+				{
+					Int objectCount = _objectCount;
+					CountGeometry(linkedObject->GetDown(), depth + 1);
+					_objectCount = objectCount;
+				}
+			}
+
+			CountGeometry(op->GetDown(), depth);
+		}
+	}
+
+private:
+	BatchQueue *_queue;
+	Int32 _workerIndex;
+	const maxon::BaseArray<BatchVariant> *_variants;
+	Filename _plyPath;
+	Int32 _variantIndex;
+	Bool _exported;
+	AutoAlloc<BaseDocument> _document;
+	Sidewalk::State _state;
+	AutoFree<BaseObject> _result;
+	Float _milliseconds;
+	Int _polygonCount;
+	Int _objectCount;
+
+public:
+	/// Default constructor
+	BatchWorker() : _queue(nullptr), _workerIndex(0), _variants(nullptr), _variantIndex(NOTOK), _exported(false), _milliseconds(0.0), _polygonCount(0), _objectCount(0)
+	{}
+};
+
+
+/// Get the argument that follows a flag
+/// @return The argument; or nullptr if the flag is not on the command line
+static const Char *GetArgument(C4DPL_CommandLineArgs *args, const Char *flag)
+{
+	for (Int32 i = 0; i < args->argc - 1; ++i)
+	{
+		if (args->argv[i] && strcmp(args->argv[i], flag) == 0)
+			return args->argv[i + 1];
+	}
+	return nullptr;
+}
+
+
+/// Mark a flag and its argument as handled
+static void ConsumeArgument(C4DPL_CommandLineArgs *args, const Char *flag)
+{
+	for (Int32 i = 0; i < args->argc - 1; ++i)
+	{
+		if (args->argv[i] && strcmp(args->argv[i], flag) == 0)
+		{
+			args->argv[i] = nullptr;
+			args->argv[i + 1] = nullptr;
+			return;
+		}
+	}
+}
+
+
+/// Find a sweep parameter by name; or nullptr
+static const SweepParameter *FindSweepParameter(const String &name)
+{
+	for (Int32 i = 0; i < (Int32)(sizeof(SWEEP_PARAMETERS) / sizeof(SWEEP_PARAMETERS[0])); ++i)
+	{
+		if (name == String(SWEEP_PARAMETERS[i].name))
+			return &SWEEP_PARAMETERS[i];
+	}
+	return nullptr;
+}
+
+
+/// Split a string at whitespace
+/// @param[in] splitAtCommas If true, commas separate words, too
+static Bool SplitWords(const String &text, maxon::BaseArray<String> &words, Bool splitAtCommas = false)
+{
+	Int32 length = text.GetLength();
+	Int32 start = NOTOK;
+	for (Int32 i = 0; i <= length; ++i)
+	{
+		Bool isSpace = (i == length) || text[i] == ' ' || text[i] == '\t' || (splitAtCommas && text[i] == ',');
+		if (isSpace && start != NOTOK)
+		{
+			if (!words.Append(text.SubStr(start, i - start)))
+				return false;
+			start = NOTOK;
+		}
+		else if (!isSpace && start == NOTOK)
+		{
+			start = i;
+		}
+	}
+	return true;
+}
+
+
+/// Read a vector value from the words after "=". It may be written as "x y z", as "x,y,z", or as one value for all three components.
+/// @return False if the value can't be read; otherwise true
+static Bool ReadVector(const maxon::BaseArray<String> &words, Vector &value)
+{
+	String text;
+	for (Int32 i = 2; i < words.GetCount(); ++i)
+		text += words[i] + " ";
+
+	maxon::BaseArray<String> components;
+	if (!SplitWords(text, components, true) || (components.GetCount() != 1 && components.GetCount() != 3))
+		return false;
+
+	Bool errorX = false, errorY = false, errorZ = false;
+	value.x = components[0].ToFloat(&errorX);
+	value.y = (components.GetCount() == 3) ? components[1].ToFloat(&errorY) : value.x;
+	value.z = (components.GetCount() == 3) ? components[2].ToFloat(&errorZ) : value.x;
+	return !errorX && !errorY && !errorZ;
+}
+
+
+/// Add all variants of a sweep file section. Integer values may be ranges like "1..20", all combinations of them are added.
+/// @param[in] rangeIds Parameter IDs of the ranges in this section, with their bounds in rangeFirst and rangeLast
+static Bool ExpandVariant(const BatchVariant &variant, const maxon::BaseArray<Int32> &rangeIds, const maxon::BaseArray<Int32> &rangeFirst, const maxon::BaseArray<Int32> &rangeLast, Int32 rangeIndex, maxon::BaseArray<BatchVariant> &variants)
+{
+	if (rangeIndex == rangeIds.GetCount())
+		return variants.Append(variant) != nullptr;
+
+	for (Int32 value = rangeFirst[rangeIndex]; value <= rangeLast[rangeIndex]; ++value)
+	{
+		BatchVariant expanded;
+		expanded.name = variant.name + "_" + String::IntToString(value);
+		expanded.data = variant.data;
+		expanded.data.SetInt32(rangeIds[rangeIndex], value);
+		if (!ExpandVariant(expanded, rangeIds, rangeFirst, rangeLast, rangeIndex + 1, variants))
+			return false;
+	}
+	return true;
+}
+
+
+/// Read a sweep file.
+/// Each section starts with "[name]" and contains lines like "COUNT_X = 12". Parameters that are not set keep their defaults.
+/// Vectors are written like "PLATES_RND_POS = 0.1,0,0.1", angles in radians.
+/// Lines starting with "#" are comments.
+/// @param[in] defaults Parameters of a new sidewalk object
+static Bool ReadSweepFile(const Filename &file, const BaseContainer &defaults, maxon::BaseArray<BatchVariant> &variants)
+{
+	AutoAlloc<BaseFile> baseFile;
+	if (!baseFile || !baseFile->Open(file, FILEOPEN_READ, FILEDIALOG_NONE))
+	{
+		GePrint("Sidewalk batch: Can't open sweep file " + file.GetString());
+		return false;
+	}
+
+	Int length = baseFile->GetLength();
+	Char *buffer = NewMem(Char, length + 1);
+	if (!buffer)
+		return false;
+
+	Bool readOk = baseFile->ReadBytes(buffer, length) == length;
+	buffer[length] = 0;
+	String text;
+	text.SetCString(buffer, -1, STRINGENCODING_UTF8);
+	DeleteMem(buffer);
+	if (!readOk)
+		return false;
+
+	BatchVariant variant;
+	maxon::BaseArray<Int32> rangeIds, rangeFirst, rangeLast;
+	Bool inSection = false;
+	Int32 lineNumber = 0;
+
+	Int32 position = 0;
+	while (position <= text.GetLength())
+	{
+		Int32 lineEnd = NOTOK;
+		if (!text.FindFirst('\n', &lineEnd, position))
+			lineEnd = text.GetLength();
+		String line = text.SubStr(position, lineEnd - position);
+		position = lineEnd + 1;
+		++lineNumber;
+
+		// Sweep files may have Windows line endings
+		if (line.GetLength() > 0 && line[line.GetLength() - 1] == '\r')
+			line = line.SubStr(0, line.GetLength() - 1);
+
+		maxon::BaseArray<String> words;
+		if (!SplitWords(line, words))
+			return false;
+
+		if (words.GetCount() == 0 || words[0][0] == '#')
+			continue;
+
+		// New section, the previous one is complete
+		if (words[0][0] == '[')
+		{
+			if (inSection && !ExpandVariant(variant, rangeIds, rangeFirst, rangeLast, 0, variants))
+				return false;
+
+			variant.name = words[0].SubStr(1, words[0].GetLength() - 2);
+			variant.data = defaults;
+			rangeIds.Flush();
+			rangeFirst.Flush();
+			rangeLast.Flush();
+			inSection = true;
+			continue;
+		}
+
+		const SweepParameter *parameter = FindSweepParameter(words[0]);
+		if (!inSection || !parameter || words.GetCount() < 3 || words[1] != "=")
+		{
+			GePrint("Sidewalk batch: Can't read line " + String::IntToString(lineNumber) + " of " + file.GetString());
+			return false;
+		}
+
+		Bool error = false;
+		switch (parameter->type)
+		{
+			case DA_LONG:
+			{
+				Int32 separator = NOTOK;
+				if (words[2].FindFirst("..", &separator))
+				{
+					if (!rangeIds.Append(parameter->id) ||
+					    !rangeFirst.Append(words[2].SubStr(0, separator).ToInt32(&error)) ||
+					    !rangeLast.Append(words[2].SubStr(separator + 2, words[2].GetLength() - separator - 2).ToInt32(&error)))
+						return false;
+				}
+				else
+				{
+					variant.data.SetInt32(parameter->id, words[2].ToInt32(&error));
+				}
+				break;
+			}
+
+			case DA_REAL:
+				variant.data.SetFloat(parameter->id, words[2].ToFloat(&error));
+				break;
+
+			case DA_VECTOR:
+			{
+				Vector value;
+				error = !ReadVector(words, value);
+				if (!error)
+					variant.data.SetVector(parameter->id, value);
+				break;
+			}
+
+			case DA_FILENAME:
+				variant.data.SetFilename(parameter->id, Filename(words[2]));
+				break;
+		}
+
+		if (error)
+		{
+			GePrint("Sidewalk batch: Invalid value in line " + String::IntToString(lineNumber) + " of " + file.GetString());
+			return false;
+		}
+	}
+
+	if (inSection && !ExpandVariant(variant, rangeIds, rangeFirst, rangeLast, 0, variants))
+		return false;
+
+	return true;
+}
+
+
+/// Save a generated sidewalk as a new document
+static Bool SaveVariant(BaseObject *sidewalk, const Filename &file)
+{
+	AutoAlloc<BaseDocument> document;
+	if (!document)
+	{
+		BaseObject::Free(sidewalk);
+		return false;
+	}
+
+	// The document owns the sidewalk from here on
+	document->InsertObject(sidewalk, nullptr, nullptr);
+	return SaveDocument(document, file, SAVEDOCUMENTFLAGS_DONTADDTORECENTLIST, FORMAT_C4DEXPORT);
+}
+
+
+/// Append a line to the report file, and print it
+static void WriteReportLine(BaseFile *report, const String &line)
+{
+	GePrint(line);
+
+	if (!report)
+		return;
+
+	Char *cLine = line.GetCStringCopy(STRINGENCODING_UTF8);
+	if (!cLine)
+		return;
+	report->WriteBytes(cLine, strlen(cLine));
+	report->WriteBytes("\n", 1);
+	DeleteMem(cLine);
+}
+
+
+/// Receives the results of GenerateVariants(), on the main thread
+class BatchResultHandler
+{
+public:
+	/// Take the result of a variant
+	/// @param[in] worker The worker that has generated the variant
+	virtual void HandleResult(BatchWorker &worker, const BatchVariant &variant) = 0;
+
+	virtual ~BatchResultHandler()
+	{}
+};
+
+
+/// Generate variants in parallel, workers take them from a shared queue. Results are handled by this thread, one at a time.
+/// @param[in] plyPath If set, variants are streamed to PLY files in this directory instead
+/// @return False if an error occurred; otherwise true
+static Bool GenerateVariants(const maxon::BaseArray<BatchVariant> &variants, Int32 threadCount, const Filename &plyPath, BatchResultHandler &handler)
+{
+	Int32 variantCount = (Int32)variants.GetCount();
+	threadCount = Min(threadCount, Max(variantCount, (Int32)1));
+	BatchQueue queue;
+	if (!queue.Init(variantCount, threadCount))
+		return false;
+
+	BatchWorker workers[MAX_BATCH_THREADS];
+	Bool started[MAX_BATCH_THREADS];
+	Int32 startedCount = 0;
+
+	for (Int32 workerIndex = 0; workerIndex < threadCount; ++workerIndex)
+	{
+		workers[workerIndex].Init(&queue, workerIndex, &variants, plyPath);
+		started[workerIndex] = workers[workerIndex].Start(THREADMODE_ASYNC, THREADPRIORITY_NORMAL);
+		if (started[workerIndex])
+			++startedCount;
+	}
+
+	for (Int32 doneCount = 0; doneCount < variantCount; ++doneCount)
+	{
+		// Do it here, if no thread is available
+		Int32 workerIndex = 0;
+		if (startedCount > 0)
+			workerIndex = queue.WaitForFinished();
+		else
+			workers[workerIndex].Generate(queue.TakeVariant());
+
+		handler.HandleResult(workers[workerIndex], variants[workers[workerIndex].GetVariantIndex()]);
+
+		if (startedCount > 0)
+			queue.Release(workerIndex);
+	}
+
+	for (Int32 workerIndex = 0; workerIndex < threadCount; ++workerIndex)
+	{
+		if (started[workerIndex])
+			workers[workerIndex].Wait(false);
+	}
+
+	return true;
+}
+
+
+/// Saves each variant as a document, and reports its build time and size
+class SaveHandler : public BatchResultHandler
+{
+public:
+	SaveHandler(BaseFile *report, const Filename &outputPath) : _report(report), _outputPath(outputPath)
+	{}
+
+	virtual void HandleResult(BatchWorker &worker, const BatchVariant &variant)
+	{
+		BaseObject *sidewalk = worker.TakeResult();
+		Bool saved = worker.IsExported() || (sidewalk && SaveVariant(sidewalk, _outputPath + Filename(variant.name + ".c4d")));
+
+		WriteReportLine(_report, variant.name + "," + String::FloatToString(worker.GetMilliseconds()) + "," +
+		                String::IntToString(worker.GetObjectCount()) + "," + String::IntToString(worker.GetPolygonCount()) + "," +
+		                (saved ? "yes" : "no"));
+	}
+
+private:
+	BaseFile *_report;
+	Filename _outputPath;
+};
+
+
+/// Add bytes to a FNV-1a hash
+static void HashBytes(UInt64 &hash, const void *data, Int size)
+{
+	const UChar *bytes = static_cast<const UChar*>(data);
+	for (Int i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+	}
+}
+
+
+/// Add the matrices of all objects in a hierarchy to a FNV-1a hash, with the points and polygons of polygon objects and the sizes of cube primitives
+static void HashGeometry(BaseObject *op, UInt64 &hash)
+{
+	for (; op; op = op->GetNext())
+	{
+		Matrix ml = op->GetMl();
+		HashBytes(hash, &ml, sizeof(Matrix));
+
+		if (op->IsInstanceOf(Opolygon))
+		{
+			PolygonObject *polyOp = ToPoly(op);
+			if (polyOp->GetPointR())
+				HashBytes(hash, polyOp->GetPointR(), sizeof(Vector) * polyOp->GetPointCount());
+			if (polyOp->GetPolygonR())
+				HashBytes(hash, polyOp->GetPolygonR(), sizeof(CPolygon) * polyOp->GetPolygonCount());
+		}
+		else if (op->IsInstanceOf(Ocube))
+		{
+			// Plates stay primitives, their polygons are made by the cube
+			BaseContainer *opData = op->GetDataInstance();
+			Vector size = opData ? opData->GetVector(PRIM_CUBE_LEN) : Vector();
+			HashBytes(hash, &size, sizeof(Vector));
+		}
+
+		HashGeometry(op->GetDown(), hash);
+	}
+}
+
+
+/// Compares the geometry of variants that were generated concurrently with that of the same variant generated alone
+class StressHandler : public BatchResultHandler
+{
+public:
+	/// @param[in] serialHashes Geometry hash of each variant, generated alone
+	/// @param[in] copyCount Number of copies of each variant. Copies of the same variant follow each other.
+	Bool Init(const maxon::BaseArray<UInt64> *serialHashes, Int32 copyCount)
+	{
+		_serialHashes = serialHashes;
+		_copyCount = copyCount;
+		_mismatchCounts.Flush();
+		if (!_mismatchCounts.Resize(serialHashes->GetCount()))
+			return false;
+
+		for (Int i = 0; i < _mismatchCounts.GetCount(); ++i)
+			_mismatchCounts[i] = 0;
+		return true;
+	}
+
+	virtual void HandleResult(BatchWorker &worker, const BatchVariant &variant)
+	{
+		AutoFree<BaseObject> sidewalk;
+		sidewalk.Set(worker.TakeResult());
+
+		UInt64 hash = HASH_OFFSET_BASIS;
+		HashGeometry(sidewalk, hash);
+
+		Int32 variantIndex = worker.GetVariantIndex() / _copyCount;
+		if (!sidewalk || hash != (*_serialHashes)[variantIndex])
+		{
+			GePrint("Sidewalk stress: " + variant.name + " differs from its serial build");
+			++_mismatchCounts[variantIndex];
+		}
+	}
+
+	/// Get the number of copies of a variant that differ from its serial build
+	Int32 GetMismatchCount(Int32 variantIndex) const
+	{
+		return _mismatchCounts[variantIndex];
+	}
+
+private:
+	const maxon::BaseArray<UInt64> *_serialHashes;
+	Int32 _copyCount;
+	maxon::BaseArray<Int32> _mismatchCounts;  ///< One per variant
+
+public:
+	/// Default constructor
+	StressHandler() : _serialHashes(nullptr), _copyCount(1)
+	{}
+};
+
+
+/// Generate each variant alone, then several copies of it concurrently, and check that all copies have the same geometry.
+/// Catches state that's shared between builds by accident.
+/// @param[in] copyCount Number of concurrent copies of each variant
+/// @return False if an error occurred; otherwise true
+static Bool RunStressCheck(const maxon::BaseArray<BatchVariant> &variants, Int32 copyCount, Int32 threadCount, BaseFile *report)
+{
+	WriteReportLine(report, "variant,hash,copies,mismatches");
+
+	// Serial builds, one after the other on this thread
+	maxon::BaseArray<UInt64> serialHashes;
+	BatchWorker serialWorker;
+	serialWorker.Init(nullptr, 0, &variants, Filename());
+	for (Int32 variantIndex = 0; variantIndex < variants.GetCount(); ++variantIndex)
+	{
+		serialWorker.Generate(variantIndex);
+		AutoFree<BaseObject> sidewalk;
+		sidewalk.Set(serialWorker.TakeResult());
+		if (!sidewalk)
+		{
+			GePrint("Sidewalk stress: Can't build " + variants[variantIndex].name);
+			return false;
+		}
+
+		UInt64 hash = HASH_OFFSET_BASIS;
+		HashGeometry(sidewalk, hash);
+		if (!serialHashes.Append(hash))
+			return false;
+	}
+
+	// Copies of each variant, generated concurrently
+	maxon::BaseArray<BatchVariant> copies;
+	for (Int32 variantIndex = 0; variantIndex < variants.GetCount(); ++variantIndex)
+	{
+		for (Int32 copyIndex = 0; copyIndex < copyCount; ++copyIndex)
+		{
+			BatchVariant copy;
+			copy.name = variants[variantIndex].name + "_copy" + String::IntToString(copyIndex);
+			copy.data = variants[variantIndex].data;
+			if (!copies.Append(copy))
+				return false;
+		}
+	}
+
+	StressHandler handler;
+	if (!handler.Init(&serialHashes, copyCount) || !GenerateVariants(copies, threadCount, Filename(), handler))
+		return false;
+
+	Int32 mismatchCount = 0;
+	for (Int32 variantIndex = 0; variantIndex < variants.GetCount(); ++variantIndex)
+	{
+		WriteReportLine(report, variants[variantIndex].name + "," + String::HexToString(serialHashes[variantIndex]) + "," +
+		                String::IntToString(copyCount) + "," + String::IntToString(handler.GetMismatchCount(variantIndex)));
+		mismatchCount += handler.GetMismatchCount(variantIndex);
+	}
+
+	GePrint("Sidewalk stress: " + String::IntToString(mismatchCount) + " of " + String::IntToString((Int32)copies.GetCount()) + " concurrent builds differ from their serial build");
+	return true;
+}
+
+
+Bool RunSidewalkBatch(C4DPL_CommandLineArgs *args)
+{
+	if (!args)
+		return false;
+
+	const Char *sweepArgument = GetArgument(args, ARG_BATCH);
+	if (!sweepArgument)
+		return false;
+
+	Filename sweepFile(sweepArgument);
+	const Char *outputArgument = GetArgument(args, ARG_OUTPUT);
+	Filename outputPath = outputArgument ? Filename(outputArgument) : sweepFile.GetDirectory();
+
+	Int32 threadCount = GeGetCurrentThreadCount();
+	const Char *threadsArgument = GetArgument(args, ARG_THREADS);
+	if (threadsArgument)
+		threadCount = String(threadsArgument).ToInt32(nullptr);
+	threadCount = ClampValue(threadCount, (Int32)1, MAX_BATCH_THREADS);
+
+	// "ply" streams each variant to a PLY file, without building its objects
+	const Char *formatArgument = GetArgument(args, ARG_FORMAT);
+	Bool exportPly = formatArgument && String(formatArgument).ToLower() == "ply";
+
+	// A stress check builds this many copies of each variant concurrently, and compares them with a serial build
+	Int32 stressCopyCount = 0;
+	const Char *stressArgument = GetArgument(args, ARG_STRESS);
+	if (stressArgument)
+		stressCopyCount = Max(String(stressArgument).ToInt32(nullptr), (Int32)1);
+
+	ConsumeArgument(args, ARG_BATCH);
+	ConsumeArgument(args, ARG_OUTPUT);
+	ConsumeArgument(args, ARG_THREADS);
+	ConsumeArgument(args, ARG_FORMAT);
+	ConsumeArgument(args, ARG_STRESS);
+
+	// Variants start from the parameters of a new sidewalk object
+	AutoAlloc<BaseObject> defaultObject(ID_OSIDEWALK);
+	if (!defaultObject)
+		return false;
+
+	maxon::BaseArray<BatchVariant> variants;
+	if (!ReadSweepFile(sweepFile, *defaultObject->GetDataInstance(), variants))
+		return true;
+
+	AutoAlloc<BaseFile> report;
+	if (report && !report->Open(outputPath + Filename(stressCopyCount > 0 ? "sidewalk_stress.csv" : "sidewalk_report.csv"), FILEOPEN_WRITE, FILEDIALOG_NONE))
+		report.Free();
+
+	Float totalStartTime = GeGetMilliSeconds();
+
+	if (stressCopyCount > 0)
+	{
+		if (!RunStressCheck(variants, stressCopyCount, threadCount, report))
+			GePrint("Sidewalk stress: Check could not be completed");
+		return true;
+	}
+
+	WriteReportLine(report, "variant,milliseconds,objects,polygons,saved");
+
+	SaveHandler handler(report, outputPath);
+	if (!GenerateVariants(variants, threadCount, exportPly ? outputPath : Filename(), handler))
+		return true;
+
+	GePrint("Sidewalk batch: " + String::IntToString((Int32)variants.GetCount()) + " variants in " + String::FloatToString((GeGetMilliSeconds() - totalStartTime) * 0.001) + " s");
+	return true;
+}
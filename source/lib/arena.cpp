@@ -0,0 +1,73 @@
+#include "arena.h"
+
+
+void *Arena::AllocBytes(Int size, Int alignment)
+{
+	if (size <= 0 || alignment <= 0)
+		return nullptr;
+
+	_lock.Lock();
+
+	// Try the current block, then the following ones
+	for (; _blockIndex < _blocks.GetCount(); ++_blockIndex, _offset = 0)
+	{
+		Block &block = _blocks[_blockIndex];
+		Int alignedOffset = _offset + GetPadding(block.memory + _offset, alignment);
+		if (alignedOffset + size <= block.size)
+		{
+			_offset = alignedOffset + size;
+			_lock.Unlock();
+			return block.memory + alignedOffset;
+		}
+	}
+
+	// None of them has enough space left, add a new block
+	Block newBlock;
+	newBlock.size = Max(DEFAULT_BLOCK_SIZE, size + alignment);
+	newBlock.memory = NewMem(Char, newBlock.size);
+	if (!newBlock.memory || !_blocks.Append(newBlock))
+	{
+		DeleteMem(newBlock.memory);
+		_lock.Unlock();
+		return nullptr;
+	}
+
+	_blockIndex = _blocks.GetCount() - 1;
+	Int alignedOffset = GetPadding(newBlock.memory, alignment);
+	_offset = alignedOffset + size;
+	_lock.Unlock();
+	return newBlock.memory + alignedOffset;
+}
+
+
+void Arena::Reset()
+{
+	_blockIndex = 0;
+	_offset = 0;
+}
+
+
+void Arena::Free()
+{
+	for (Int i = 0; i < _blocks.GetCount(); ++i)
+		DeleteMem(_blocks[i].memory);
+
+	_blocks.Reset();
+	Reset();
+}
+
+
+Int Arena::GetCapacity() const
+{
+	Int capacity = 0;
+	for (Int i = 0; i < _blocks.GetCount(); ++i)
+		capacity += _blocks[i].size;
+
+	return capacity;
+}
+
+
+Int Arena::GetPadding(const Char *address, Int alignment)
+{
+	return (Int)((alignment - (reinterpret_cast<UInt>(address) & (alignment - 1))) & (alignment - 1));
+}
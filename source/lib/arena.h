@@ -0,0 +1,89 @@
+#ifndef ARENA_H__
+#define ARENA_H__
+
+#include "c4d.h"
+
+
+/// Bump allocator for transient data of a single build.
+/// Memory is handed out from a few large blocks in order. Reset() makes all of it available again at once, the blocks are kept for the next build.
+/// Only for trivially copyable types, no constructors or destructors are called.
+/// Alloc() may be called from several threads at once, Reset() and Free() may not.
+class Arena
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(Arena);
+
+public:
+	/// Get uninitialized memory for a number of elements
+	/// @return Pointer to the first element; or nullptr if an error occurred. The arena owns the memory.
+	template <typename T> T *Alloc(Int count)
+	{
+		return static_cast<T*>(AllocBytes(sizeof(T) * count, alignof(T)));
+	}
+
+	/// Get uninitialized memory
+	/// @param[in] size Number of bytes
+	/// @param[in] alignment Alignment in bytes, must be a power of 2
+	/// @return Pointer to the memory; or nullptr if an error occurred. The arena owns the memory.
+	void *AllocBytes(Int size, Int alignment);
+
+	/// Make all memory available again. Pointers returned before become invalid.
+	void Reset();
+
+	/// Free all blocks
+	void Free();
+
+	/// Get the number of bytes in all blocks
+	Int GetCapacity() const;
+
+private:
+	/// Get the number of bytes to skip, so that address is aligned
+	static Int GetPadding(const Char *address, Int alignment);
+
+private:
+	/// A block of memory
+	struct Block
+	{
+		Char *memory;
+		Int size;
+	};
+
+	maxon::BaseArray<Block> _blocks;
+	Int _blockIndex;  ///< Block that memory is currently taken from
+	Int _offset;      ///< Number of used bytes in the current block
+	GeSpinlock _lock; ///< Protects the blocks while allocating
+
+	static const Int DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+public:
+	/// Default constructor
+	Arena() : _blockIndex(0), _offset(0)
+	{}
+
+	/// Destructor, frees all blocks
+	~Arena()
+	{
+		Free();
+	}
+};
+
+
+/// Resets an arena when going out of scope
+class ArenaScope
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(ArenaScope);
+
+public:
+	explicit ArenaScope(Arena &arena) : _arena(arena)
+	{}
+
+	~ArenaScope()
+	{
+		_arena.Reset();
+	}
+
+private:
+	Arena &_arena;
+};
+
+
+#endif // ARENA_H__
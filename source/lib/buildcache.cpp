@@ -0,0 +1,201 @@
+#include "buildcache.h"
+
+
+void BuildCache::SetMemoryLimit(Int limit)
+{
+	_lock.Lock();
+	_memoryLimit = Max(limit, (Int)0);
+	Evict(0);
+	_lock.Unlock();
+}
+
+
+Bool BuildCache::Contains(UInt64 hash) const
+{
+	_lock.Lock();
+	Bool found = FindEntry(hash) != NOTOK;
+	_lock.Unlock();
+	return found;
+}
+
+
+BaseObject *BuildCache::Get(UInt64 hash, BaseDocument *doc)
+{
+	_lock.Lock();
+	
+	// The result is copied while locked, so it can't be dropped meanwhile
+	BaseObject *result = nullptr;
+	Int index = FindEntry(hash);
+	if (index != NOTOK)
+	{
+		_entries[index].lastUse = ++_useCounter;
+		result = CloneHierarchy(_entries[index].result, doc);
+	}
+	
+	_lock.Unlock();
+	return result;
+}
+
+
+Bool BuildCache::Put(UInt64 hash, BaseObject *result, BaseDocument *doc)
+{
+	if (!result)
+		return false;
+	
+	// Results that don't fit at all are not copied
+	Int memorySize = BuildStatistics::EstimateMemorySize(result);
+	_lock.Lock();
+	Bool fits = memorySize <= _memoryLimit && FindEntry(hash) == NOTOK;
+	_lock.Unlock();
+	if (!fits)
+		return true;
+	
+	// Copying may take a while, it happens without holding the lock
+	BaseObject *clone = CloneHierarchy(result, doc);
+	if (!clone)
+		return false;
+	
+	_lock.Lock();
+	
+	// Another thread may have stored the same result, or lowered the limit meanwhile
+	if (FindEntry(hash) != NOTOK || memorySize > _memoryLimit)
+	{
+		_lock.Unlock();
+		BaseObject::Free(clone);
+		return true;
+	}
+	
+	Evict(memorySize);
+	
+	Entry entry;
+	entry.hash = hash;
+	entry.result = clone;
+	entry.memorySize = memorySize;
+	entry.lastUse = ++_useCounter;
+	Bool appended = _entries.Append(entry) != nullptr;
+	if (appended)
+		_memorySize += memorySize;
+	
+	_lock.Unlock();
+	
+	if (!appended)
+		BaseObject::Free(clone);
+	return appended;
+}
+
+
+void BuildCache::Flush()
+{
+	_lock.Lock();
+	for (Int i = 0; i < _entries.GetCount(); ++i)
+		BaseObject::Free(_entries[i].result);
+	_entries.Reset();
+	_memorySize = 0;
+	_lock.Unlock();
+}
+
+
+Int BuildCache::GetMemorySize() const
+{
+	_lock.Lock();
+	Int memorySize = _memorySize;
+	_lock.Unlock();
+	return memorySize;
+}
+
+
+Int BuildCache::GetCount() const
+{
+	_lock.Lock();
+	Int count = _entries.GetCount();
+	_lock.Unlock();
+	return count;
+}
+
+
+Int BuildCache::FindEntry(UInt64 hash) const
+{
+	for (Int i = 0; i < _entries.GetCount(); ++i)
+	{
+		if (_entries[i].hash == hash)
+			return i;
+	}
+	return NOTOK;
+}
+
+
+void BuildCache::Evict(Int size)
+{
+	while (_entries.GetCount() > 0 && _memorySize + size > _memoryLimit)
+	{
+		// Least recently used
+		Int oldestIndex = 0;
+		for (Int i = 1; i < _entries.GetCount(); ++i)
+		{
+			if (_entries[i].lastUse < _entries[oldestIndex].lastUse)
+				oldestIndex = i;
+		}
+		
+		_memorySize -= _entries[oldestIndex].memorySize;
+		BaseObject::Free(_entries[oldestIndex].result);
+		_entries.Erase(oldestIndex);
+	}
+}
+
+
+BaseObject *BuildCache::CloneHierarchy(BaseObject *op, BaseDocument *doc)
+{
+	// Tile instances have to link the copied tile, not the original one
+	AutoAlloc<AliasTrans> aliasTrans;
+	if (!aliasTrans || !aliasTrans->Init(doc))
+		return nullptr;
+	
+	BaseObject *clone = static_cast<BaseObject*>(op->GetClone(COPYFLAGS_0, aliasTrans));
+	if (clone)
+		aliasTrans->Translate(true);
+	
+	return clone;
+}
+
+
+Bool BuildPrefetcher::Prefetch(const maxon::BaseArray<Sidewalk::Parameters> &paramsList, BuildCache *cache)
+{
+	if (!cache || !_document || IsRunning())
+		return false;
+	
+	_paramsList.Flush();
+	for (Int i = 0; i < paramsList.GetCount(); ++i)
+	{
+		if (!_paramsList.Append(paramsList[i]))
+			return false;
+	}
+	_cache = cache;
+	
+	return Start(THREADMODE_ASYNC, THREADPRIORITY_BELOW);
+}
+
+
+void BuildPrefetcher::Main()
+{
+	// The result of each build is reused for the next one
+	AutoFree<BaseObject> previousResult;
+	
+	for (Int i = 0; i < _paramsList.GetCount(); ++i)
+	{
+		if (TestBreak())
+			return;
+		
+		const Sidewalk::Parameters &params = _paramsList[i];
+		UInt64 hash = params.GetHash();
+		if (_cache->Contains(hash))
+			continue;
+		
+		BaseObject *result = Sidewalk::Build(params, _state, _document, previousResult);
+		if (!result)
+			continue;
+		
+		_cache->Put(hash, result, _document);
+		previousResult.Free();
+		previousResult.Set(result);
+	}
+}
@@ -0,0 +1,116 @@
+#ifndef BUILDCACHE_H__
+#define BUILDCACHE_H__
+
+#include "c4d.h"
+#include "sidewalk.h"
+
+
+/// Keeps copies of built sidewalks, keyed by the hash of the parameters they were built with.
+/// When the memory limit is reached, the least recently used results are dropped first.
+/// All methods may be called from different threads.
+class BuildCache
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(BuildCache);
+
+public:
+	/// Set the memory limit, dropping results that don't fit anymore
+	/// @param[in] limit Maximum memory in bytes, 0 disables the cache
+	void SetMemoryLimit(Int limit);
+
+	/// Check if a result is cached
+	Bool Contains(UInt64 hash) const;
+
+	/// Get a copy of a cached result
+	/// @return Pointer to the copy; or nullptr if there's no result for hash. Caller owns the pointed object.
+	BaseObject *Get(UInt64 hash, BaseDocument *doc);
+
+	/// Keep a copy of a result. Nothing is kept if the cache is disabled, or if the result alone exceeds the limit.
+	/// @param[in] result The result. It's copied, the caller still owns it.
+	/// @return False if an error occurred; otherwise true
+	Bool Put(UInt64 hash, BaseObject *result, BaseDocument *doc);
+
+	/// Drop all results
+	void Flush();
+
+	/// Get the memory of all cached results in bytes (estimated)
+	Int GetMemorySize() const;
+
+	/// Get the number of cached results
+	Int GetCount() const;
+
+private:
+	/// A cached result
+	struct Entry
+	{
+		UInt64 hash;
+		BaseObject *result;
+		Int memorySize;
+		UInt64 lastUse;    ///< Value of the use counter when the result was stored or taken last
+	};
+
+	/// Get the index of a result; or NOTOK. Must be called with the lock held.
+	Int FindEntry(UInt64 hash) const;
+
+	/// Drop the least recently used results until there's room for size bytes. Must be called with the lock held.
+	void Evict(Int size);
+
+	/// Copy a hierarchy, keeping the links of instances to objects inside it
+	static BaseObject *CloneHierarchy(BaseObject *op, BaseDocument *doc);
+
+private:
+	maxon::BaseArray<Entry> _entries;
+	Int _memorySize;
+	Int _memoryLimit;
+	UInt64 _useCounter;
+	mutable GeSpinlock _lock;
+
+public:
+	/// Default constructor
+	BuildCache() : _memorySize(0), _memoryLimit(0), _useCounter(0)
+	{}
+
+	/// Destructor, frees all cached results
+	~BuildCache()
+	{
+		Flush();
+	}
+};
+
+
+/// Builds sidewalks in the background and puts them into a build cache, e.g. for the neighbouring frames of an animation
+class BuildPrefetcher : public C4DThread
+{
+public:
+	/// Start building in the background. Parameter sets that are already cached are skipped.
+	/// @param[in] paramsList The parameter sets, in the order they are built
+	/// @param[in] cache Receives the results. It must stay alive until the prefetcher has stopped.
+	/// @return False if the prefetcher is still busy or an error occurred; otherwise true
+	Bool Prefetch(const maxon::BaseArray<Sidewalk::Parameters> &paramsList, BuildCache *cache);
+
+	virtual void Main();
+
+	virtual const Char *GetThreadName()
+	{
+		return "SidewalkPrefetch";
+	}
+
+private:
+	maxon::BaseArray<Sidewalk::Parameters> _paramsList;
+	BuildCache *_cache;
+	AutoAlloc<BaseDocument> _document;  ///< Builds happen in this document, not in the one the generator is in
+	Sidewalk::State _state;             ///< Builds use their own state, the generator's state is not touched
+
+public:
+	/// Default constructor
+	BuildPrefetcher() : _cache(nullptr)
+	{}
+
+	/// Destructor, waits for a running prefetch to stop
+	~BuildPrefetcher()
+	{
+		End(true);
+	}
+};
+
+
+#endif // BUILDCACHE_H__
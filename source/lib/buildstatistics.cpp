@@ -0,0 +1,61 @@
+#include "buildstatistics.h"
+
+
+// Estimated memory of an object or tag, apart from its points, polygons and UVWs
+static const Int NODE_MEMORY_SIZE = 1024;
+
+
+void BuildStatistics::Count(BaseObject *hierarchy)
+{
+	objectCount = 0;
+	pointCount = 0;
+	polygonCount = 0;
+	tagCount = 0;
+	memorySize = 0;
+
+	if (hierarchy)
+		CountObjects(hierarchy);
+}
+
+
+Int BuildStatistics::EstimateMemorySize(BaseObject *op)
+{
+	BuildStatistics statistics;
+	if (op)
+		statistics.CountObjects(op);
+	return statistics.memorySize;
+}
+
+
+void BuildStatistics::CountObjects(BaseObject *op)
+{
+	for (; op; op = op->GetNext())
+	{
+		++objectCount;
+		memorySize += NODE_MEMORY_SIZE;
+
+		// Instances only reference their geometry, it's counted where it's stored
+		if (op->IsInstanceOf(Opolygon))
+		{
+			PolygonObject *poly = ToPoly(op);
+			pointCount += poly->GetPointCount();
+			polygonCount += poly->GetPolygonCount();
+			memorySize += poly->GetPointCount() * sizeof(Vector) + poly->GetPolygonCount() * sizeof(CPolygon);
+
+			if (poly->GetTag(Tuvw))
+				memorySize += poly->GetPolygonCount() * sizeof(UVWStruct);
+		}
+
+		// Points, polygons and UVWs are variable tags, they're part of the geometry
+		for (BaseTag *tag = op->GetFirstTag(); tag; tag = tag->GetNext())
+		{
+			if (tag->IsInstanceOf(Tpoint) || tag->IsInstanceOf(Tpolygon) || tag->IsInstanceOf(Tuvw))
+				continue;
+
+			++tagCount;
+			memorySize += NODE_MEMORY_SIZE;
+		}
+
+		CountObjects(op->GetDown());
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef BUILDSTATISTICS_H__
+#define BUILDSTATISTICS_H__
+
+#include "c4d.h"
+
+
+/// Where the last result of a generator came from
+enum class BUILDSOURCE
+{
+	NONE =	0,        ///< There is no result yet
+	BUILT =	1,        ///< Built from scratch (cache miss)
+	UPDATED =	2,      ///< The previous result was updated in place
+	CACHED =	3       ///< Copied from the build cache (cache hit)
+} ENUM_END_LIST(BUILDSOURCE);
+
+
+/// Numbers about the last result of a generator: What it contains, and how long it took
+struct BuildStatistics
+{
+	// Contents of the result
+	Int objectCount;
+	Int pointCount;
+	Int polygonCount;
+	Int tagCount;
+	Int memorySize;           ///< Estimated memory in bytes
+
+	// Duration in milliseconds. Components are built concurrently, their times don't add up to the total.
+	Float totalTime;
+	Float plateTime;
+	Float cobblestoneTime;    ///< Including the prototype
+	Float dirtPlaneTime;
+	Float curbstoneTime;
+
+	BUILDSOURCE source;
+
+	/// Count the objects, points, polygons and tags of a hierarchy, and estimate its memory. Previous counts are replaced.
+	void Count(BaseObject *hierarchy);
+
+	/// Estimate the memory of an object, its siblings after it and their children
+	/// @return Memory in bytes
+	static Int EstimateMemorySize(BaseObject *op);
+
+	/// Set everything to zero
+	void Reset()
+	{
+		objectCount = 0;
+		pointCount = 0;
+		polygonCount = 0;
+		tagCount = 0;
+		memorySize = 0;
+		totalTime = 0.0;
+		plateTime = 0.0;
+		cobblestoneTime = 0.0;
+		dirtPlaneTime = 0.0;
+		curbstoneTime = 0.0;
+		source = BUILDSOURCE::NONE;
+	}
+
+	/// Default constructor
+	BuildStatistics()
+	{
+		Reset();
+	}
+
+private:
+	/// Add the counts of an object, its siblings after it and their children
+	void CountObjects(BaseObject *op);
+};
+
+
+/// Adds the time between its construction and destruction to a duration
+class StageTimer
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(StageTimer);
+
+public:
+	/// @param[in,out] duration Receives the time in milliseconds, added to its value
+	explicit StageTimer(Float &duration) : _duration(duration), _startTime(GeGetMilliSeconds())
+	{}
+
+	~StageTimer()
+	{
+		_duration += GeGetMilliSeconds() - _startTime;
+	}
+
+private:
+	Float &_duration;
+	Float _startTime;
+};
+
+
+#endif // BUILDSTATISTICS_H__
@@ -0,0 +1,312 @@
+#include "displacementbake.h"
+
+
+// Part of a tile, at each border, where displacement fades out
+static const Float BAKE_FADE_WIDTH = 0.15;
+
+// Number of threads that rasterize at most
+static const Int32 MAX_BAKE_THREADS = 64;
+
+// Number of files that may be written at the same time, by different sidewalks
+static const Int32 MAX_WRITING_FILES = 64;
+
+// Files that are being written right now, by the hash of their path. Protected by g_writingLock.
+static GeSpinlock g_writingLock;
+static UInt64 g_writingFiles[MAX_WRITING_FILES];
+static Int32 g_writingFileCount = 0;
+
+// Offset basis and prime of the 64 bit FNV-1a hash
+static const UInt64 HASH_OFFSET_BASIS = 14695981039346656037ULL;
+static const UInt64 HASH_PRIME = 1099511628211ULL;
+
+
+/// Get a FNV-1a hash of a file's path
+static UInt64 GetPathHash(const Filename &file)
+{
+	String path = file.GetString();
+	UInt64 hash = HASH_OFFSET_BASIS;
+	for (Int32 i = 0; i < path.GetLength(); ++i)
+	{
+		hash ^= (UInt64)path[i];
+		hash *= HASH_PRIME;
+	}
+	return hash;
+}
+
+
+/// Claim a file for writing
+/// @return False if another bake is writing the file, or too many files are being written; otherwise true
+static Bool BeginWriting(UInt64 pathHash)
+{
+	g_writingLock.Lock();
+
+	Bool claimed = g_writingFileCount < MAX_WRITING_FILES;
+	for (Int32 i = 0; claimed && i < g_writingFileCount; ++i)
+		claimed = g_writingFiles[i] != pathHash;
+
+	if (claimed)
+		g_writingFiles[g_writingFileCount++] = pathHash;
+
+	g_writingLock.Unlock();
+	return claimed;
+}
+
+
+/// Release a file claimed by BeginWriting()
+static void EndWriting(UInt64 pathHash)
+{
+	g_writingLock.Lock();
+
+	for (Int32 i = 0; i < g_writingFileCount; ++i)
+	{
+		if (g_writingFiles[i] == pathHash)
+		{
+			g_writingFiles[i] = g_writingFiles[--g_writingFileCount];
+			break;
+		}
+	}
+
+	g_writingLock.Unlock();
+}
+
+
+/// Get the displacement of a tile at a position, interpolated between its grid points and faded out towards its borders
+/// @param[in] u, v Position inside the tile, from 0 to 1
+static Float GetTileHeight(const BakeTile &tile, const Float *heights, Float u, Float v)
+{
+	u = ClampValue(u, 0.0, 1.0);
+	v = ClampValue(v, 0.0, 1.0);
+
+	Int32 cellCount = tile.gridSize - 1;
+	Float positionU = u * (Float)cellCount;
+	Float positionV = v * (Float)cellCount;
+	Int32 cellU = Min((Int32)positionU, cellCount - 1);
+	Int32 cellV = Min((Int32)positionV, cellCount - 1);
+	Float blendU = positionU - (Float)cellU;
+	Float blendV = positionV - (Float)cellV;
+
+	const Float *row = heights + tile.firstHeight + (Int)cellV * tile.gridSize + cellU;
+	const Float *nextRow = row + tile.gridSize;
+	Float top = row[0] + (row[1] - row[0]) * blendU;
+	Float bottom = nextRow[0] + (nextRow[1] - nextRow[0]) * blendU;
+
+	Float fade = ClampValue(Min(Min(u, 1.0 - u), Min(v, 1.0 - v)) / BAKE_FADE_WIDTH, 0.0, 1.0);
+	return (top + (bottom - top) * blendV) * fade;
+}
+
+
+/// Rasterizes a range of atlas rows
+class BakeWorker : public C4DThread
+{
+public:
+	/// Set what to rasterize
+	/// @param[out] pixels Grey values of the whole atlas, this worker writes only its rows
+	/// @param[out] normalPixels RGB values of the whole normal atlas, this worker writes only its rows
+	void Init(const maxon::BaseArray<BakeTile> *tiles, const Float *heights, Int32 tilesPerRow, Int32 tileResolution, Float maxStrength, UChar *pixels, UChar *normalPixels, Int32 firstRow, Int32 rowCount)
+	{
+		_tiles = tiles;
+		_heights = heights;
+		_tilesPerRow = tilesPerRow;
+		_tileResolution = tileResolution;
+		_maxStrength = maxStrength;
+		_pixels = pixels;
+		_normalPixels = normalPixels;
+		_firstRow = firstRow;
+		_rowCount = rowCount;
+	}
+
+	virtual void Main()
+	{
+		Int32 atlasSize = _tilesPerRow * _tileResolution;
+		Float invResolution = 1.0 / (Float)_tileResolution;
+
+		for (Int32 y = _firstRow; y < _firstRow + _rowCount; ++y)
+		{
+			UChar *row = _pixels + (Int)y * atlasSize;
+			UChar *normalRow = _normalPixels + (Int)y * atlasSize * 3;
+			Int32 tileRow = y / _tileResolution;
+			Float v = ((Float)(y % _tileResolution) + 0.5) * invResolution;
+
+			for (Int32 x = 0; x < atlasSize; ++x)
+			{
+				Int32 tileIndex = tileRow * _tilesPerRow + x / _tileResolution;
+				Float height = 0.0;
+				Vector normal(0.0, 0.0, 1.0);
+
+				// Unused tiles stay neutral
+				if (tileIndex < _tiles->GetCount())
+				{
+					const BakeTile &tile = (*_tiles)[tileIndex];
+					Float u = ((Float)(x % _tileResolution) + 0.5) * invResolution;
+					height = GetTileHeight(tile, _heights, u, v) / _maxStrength;
+
+					// Slopes from the neighbouring pixels, one-sided at the tile border
+					Float left = Max(u - invResolution, 0.0);
+					Float right = Min(u + invResolution, 1.0);
+					Float top = Max(v - invResolution, 0.0);
+					Float bottom = Min(v + invResolution, 1.0);
+					Float slopeU = (GetTileHeight(tile, _heights, right, v) - GetTileHeight(tile, _heights, left, v)) / ((right - left) * tile.size);
+					Float slopeV = (GetTileHeight(tile, _heights, u, bottom) - GetTileHeight(tile, _heights, u, top)) / ((bottom - top) * tile.size);
+					normal = Vector(-slopeU, -slopeV, 1.0).GetNormalized();
+				}
+
+				row[x] = (UChar)ClampValue(Round(127.5 + height * 127.5), 0.0, 255.0);
+				normalRow[x * 3] = (UChar)ClampValue(Round(127.5 + normal.x * 127.5), 0.0, 255.0);
+				normalRow[x * 3 + 1] = (UChar)ClampValue(Round(127.5 + normal.y * 127.5), 0.0, 255.0);
+				normalRow[x * 3 + 2] = (UChar)ClampValue(Round(127.5 + normal.z * 127.5), 0.0, 255.0);
+			}
+		}
+	}
+
+	virtual const Char *GetThreadName()
+	{
+		return "SidewalkBake";
+	}
+
+private:
+	const maxon::BaseArray<BakeTile> *_tiles;
+	const Float *_heights;
+	Int32 _tilesPerRow;
+	Int32 _tileResolution;
+	Float _maxStrength;
+	UChar *_pixels;
+	UChar *_normalPixels;
+	Int32 _firstRow;
+	Int32 _rowCount;
+
+public:
+	/// Default constructor
+	BakeWorker() : _tiles(nullptr), _heights(nullptr), _tilesPerRow(0), _tileResolution(0), _maxStrength(1.0), _pixels(nullptr), _normalPixels(nullptr), _firstRow(0), _rowCount(0)
+	{}
+};
+
+
+Int32 DisplacementAtlas::GetTilesPerRow(Int32 tileCount)
+{
+	Int32 tilesPerRow = 1;
+	while (tilesPerRow * tilesPerRow < tileCount)
+		++tilesPerRow;
+	return tilesPerRow;
+}
+
+
+Vector DisplacementAtlas::GetAtlasUVW(const Vector &uvw, Int32 tileIndex, Int32 tileCount)
+{
+	Int32 tilesPerRow = GetTilesPerRow(tileCount);
+	Float tileSize = 1.0 / (Float)tilesPerRow;
+	return Vector(((Float)(tileIndex % tilesPerRow) + uvw.x) * tileSize, ((Float)(tileIndex / tilesPerRow) + uvw.y) * tileSize, 0.0);
+}
+
+
+Filename DisplacementAtlas::GetNormalFile(const Filename &file)
+{
+	Filename name = file.GetFile();
+	name.ClearSuffix();
+	return file.GetDirectory() + Filename(name.GetString() + "_normal.tif");
+}
+
+
+Bool DisplacementAtlas::Bake(const maxon::BaseArray<BakeTile> &tiles, const maxon::BaseArray<Float> &heights, Int32 tileResolution, const Filename &file)
+{
+	Int32 tileCount = (Int32)tiles.GetCount();
+	if (tileCount == 0 || tileResolution < 1 || !file.Content())
+		return false;
+
+	// Every tile needs all of its grid points
+	for (Int32 i = 0; i < tileCount; ++i)
+	{
+		if (tiles[i].gridSize < 2 || tiles[i].size <= 0.0 || tiles[i].firstHeight < 0 || tiles[i].firstHeight + (Int)tiles[i].gridSize * tiles[i].gridSize > heights.GetCount())
+			return false;
+	}
+
+	Int32 tilesPerRow = GetTilesPerRow(tileCount);
+	tileResolution = Max(Min(tileResolution, MAX_ATLAS_SIZE / tilesPerRow), (Int32)1);
+	Int32 atlasSize = tilesPerRow * tileResolution;
+
+	Float maxStrength = 0.0;
+	for (Int32 i = 0; i < tileCount; ++i)
+		maxStrength = Max(maxStrength, Abs(tiles[i].strength));
+	if (maxStrength <= 0.0)
+		maxStrength = 1.0;
+
+	// Sidewalks that share a file would overwrite each other's half written file
+	UInt64 pathHash = GetPathHash(file);
+	if (!BeginWriting(pathHash))
+		return false;
+
+	UChar *pixels = NewMem(UChar, (Int)atlasSize * atlasSize);
+	UChar *normalPixels = NewMem(UChar, (Int)atlasSize * atlasSize * 3);
+	if (!pixels || !normalPixels)
+	{
+		DeleteMem(pixels);
+		DeleteMem(normalPixels);
+		EndWriting(pathHash);
+		return false;
+	}
+
+	// Each worker takes a block of rows
+	Int32 threadCount = ClampValue(GeGetCurrentThreadCount(), (Int32)1, Min(MAX_BAKE_THREADS, atlasSize));
+	Int32 rowsPerThread = (atlasSize + threadCount - 1) / threadCount;
+	BakeWorker workers[MAX_BAKE_THREADS];
+	Bool started[MAX_BAKE_THREADS];
+
+	for (Int32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		Int32 firstRow = threadIndex * rowsPerThread;
+		workers[threadIndex].Init(&tiles, heights.GetFirst(), tilesPerRow, tileResolution, maxStrength, pixels, normalPixels, firstRow, Max(Min(rowsPerThread, atlasSize - firstRow), (Int32)0));
+		started[threadIndex] = workers[threadIndex].Start(THREADMODE_ASYNC, THREADPRIORITY_NORMAL);
+
+		// Do it here, if no thread is available
+		if (!started[threadIndex])
+			workers[threadIndex].Main();
+	}
+
+	for (Int32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		if (started[threadIndex])
+			workers[threadIndex].Wait(false);
+	}
+
+	// Write the images
+	Bool result = SaveTexture(pixels, 1, atlasSize, file) && SaveTexture(normalPixels, 3, atlasSize, GetNormalFile(file));
+
+	DeleteMem(pixels);
+	DeleteMem(normalPixels);
+	EndWriting(pathHash);
+	return result;
+}
+
+
+Bool DisplacementAtlas::SaveTexture(const UChar *pixels, Int32 channelCount, Int32 atlasSize, const Filename &file)
+{
+	AutoAlloc<BaseBitmap> bitmap;
+	if (!bitmap || bitmap->Init(atlasSize, atlasSize, 24) != IMAGERESULT_OK)
+		return false;
+
+	for (Int32 y = 0; y < atlasSize; ++y)
+	{
+		const UChar *row = pixels + (Int)y * atlasSize * channelCount;
+		for (Int32 x = 0; x < atlasSize; ++x)
+		{
+			const UChar *pixel = row + x * channelCount;
+			if (channelCount == 3)
+				bitmap->SetPixel(x, y, pixel[0], pixel[1], pixel[2]);
+			else
+				bitmap->SetPixel(x, y, pixel[0], pixel[0], pixel[0]);
+		}
+	}
+
+	// Renderers that load the file meanwhile see the old or the new texture, never a half written one
+	Filename tempFile = file;
+	tempFile.SetSuffix("tmp");
+	if (bitmap->Save(tempFile, FILTER_TIF, nullptr, SAVEBIT_0) != IMAGERESULT_OK)
+	{
+		GeFKill(tempFile);
+		return false;
+	}
+
+	if (GeFExist(file))
+		GeFKill(file);
+
+	return GeFRename(tempFile, file);
+}
@@ -0,0 +1,56 @@
+#ifndef DISPLACEMENTBAKE_H__
+#define DISPLACEMENTBAKE_H__
+
+#include "c4d.h"
+
+
+/// One tile of a displacement atlas: crumple offsets of a stone on a regular grid, interpolated between the grid points
+struct BakeTile
+{
+	Int firstHeight;   ///< Index of the tile's first offset in the heights array, the offsets are stored row by row
+	Int32 gridSize;    ///< Grid points along each side of the tile, at least 2
+	Float strength;    ///< Largest offset of the tile
+	Float size;        ///< Edge length the tile covers on the stone, for the slopes of the normal map
+
+	/// Default constructor
+	BakeTile() : firstHeight(0), gridSize(2), strength(0.0), size(1.0)
+	{}
+};
+
+
+/// Bakes crumple detail of many stones into one displacement texture and one normal texture, one square tile per stone.
+/// Tiles are laid out in rows. Displacement fades out towards the tile borders, so the seams between faces stay closed.
+/// 50% grey means no displacement, black and white are the largest strength of all tiles.
+/// The normal texture is in tangent space and saved next to the displacement texture, see GetNormalFile().
+class DisplacementAtlas
+{
+public:
+	/// Get the number of tiles in each row and column of an atlas
+	static Int32 GetTilesPerRow(Int32 tileCount);
+
+	/// Map a UVW coordinate of a stone into its tile
+	static Vector GetAtlasUVW(const Vector &uvw, Int32 tileIndex, Int32 tileCount);
+
+	/// Get the file the normal texture of an atlas is saved to, e.g. "name_normal.tif" for "name.tif"
+	static Filename GetNormalFile(const Filename &file);
+
+	/// Rasterize all tiles in parallel, and save the displacement and normal textures as TIFF files.
+	/// Each file is written to a temporary file first and then renamed, so it's never seen half written.
+	/// If another bake in this process is writing the same file, nothing is written.
+	/// @param[in] heights Crumple offsets of all tiles, see BakeTile
+	/// @param[in] tileResolution Width and height of a tile in pixels. It's reduced if the atlas would get too large.
+	/// @return False if the file is being written by another bake, or an error occurred; otherwise true
+	static Bool Bake(const maxon::BaseArray<BakeTile> &tiles, const maxon::BaseArray<Float> &heights, Int32 tileResolution, const Filename &file);
+
+private:
+	/// Save one texture, through a temporary file
+	/// @param[in] pixels One byte per channel, pixel by pixel and row by row
+	/// @param[in] channelCount 1 for grey, 3 for RGB
+	/// @return False if an error occurred; otherwise true
+	static Bool SaveTexture(const UChar *pixels, Int32 channelCount, Int32 atlasSize, const Filename &file);
+
+	static const Int32 MAX_ATLAS_SIZE = 8192;
+};
+
+
+#endif // DISPLACEMENTBAKE_H__
@@ -0,0 +1,469 @@
+#include "elementbvh.h"
+
+
+// Instances may link to their own ancestors, so recursion into links is limited
+static const Int32 MAX_LINK_DEPTH = 16;
+
+// Hits closer than this to the ray origin are ignored
+static const Float RAY_EPSILON = 0.000001;
+
+
+/// Get a coordinate of a vector by axis index
+static Float GetAxis(const Vector &v, Int32 axis)
+{
+	return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+}
+
+
+/// Check if an object is an element of its own
+static Bool IsElement(BaseObject *op)
+{
+	return op->IsInstanceOf(Opolygon) || op->IsInstanceOf(Ocube) || op->IsInstanceOf(Oinstance);
+}
+
+
+/// Get the object an instance links to; or nullptr
+static BaseObject *GetInstanceLink(BaseObject *op)
+{
+	BaseContainer *bc = op->GetDataInstance();
+	if (!bc)
+		return nullptr;
+
+	BaseLink *link = bc->GetBaseLink(INSTANCEOBJECT_LINK);
+	if (!link)
+		return nullptr;
+
+	// Cache objects are not part of a document
+	return static_cast<BaseObject*>(link->ForceGetLink());
+}
+
+
+/// Get the half size of a cube primitive
+static Vector GetCubeHalfSize(BaseObject *op)
+{
+	BaseContainer *bc = op->GetDataInstance();
+	return bc ? bc->GetVector(PRIM_CUBE_LEN) * 0.5 : Vector();
+}
+
+
+/// Expand a box by a point
+static void AddPoint(const Vector &point, Vector &boxMin, Vector &boxMax)
+{
+	boxMin = Vector(Min(boxMin.x, point.x), Min(boxMin.y, point.y), Min(boxMin.z, point.z));
+	boxMax = Vector(Max(boxMax.x, point.x), Max(boxMax.y, point.y), Max(boxMax.z, point.z));
+}
+
+
+/// Expand a box by the geometry of an object and its children
+/// @param[in] matrix Matrix of op in the space of the box
+static void AddBounds(BaseObject *op, const Matrix &matrix, Vector &boxMin, Vector &boxMax, Int32 depth)
+{
+	if (op->IsInstanceOf(Opolygon))
+	{
+		const PolygonObject *poly = ToPoly(op);
+		const Vector *pointArr = poly->GetPointR();
+		Int32 pointCount = poly->GetPointCount();
+		for (Int32 i = 0; pointArr && i < pointCount; ++i)
+			AddPoint(matrix * pointArr[i], boxMin, boxMax);
+	}
+	else if (op->IsInstanceOf(Ocube))
+	{
+		Vector halfSize = GetCubeHalfSize(op);
+		for (Int32 corner = 0; corner < 8; ++corner)
+		{
+			Vector cornerPos((corner & 1) ? halfSize.x : -halfSize.x, (corner & 2) ? halfSize.y : -halfSize.y, (corner & 4) ? halfSize.z : -halfSize.z);
+			AddPoint(matrix * cornerPos, boxMin, boxMax);
+		}
+	}
+	else if (op->IsInstanceOf(Oinstance) && depth < MAX_LINK_DEPTH)
+	{
+		// The linked object is drawn with the instance's matrix instead of its own
+		BaseObject *link = GetInstanceLink(op);
+		if (link)
+			AddBounds(link, matrix, boxMin, boxMax, depth + 1);
+	}
+
+	for (BaseObject *child = op->GetDown(); child; child = child->GetNext())
+		AddBounds(child, matrix * child->GetMl(), boxMin, boxMax, depth);
+}
+
+
+/// Check if a ray hits a box before a certain distance
+/// @param[in] invDirection Reciprocal of each coordinate of the ray direction
+static Bool RayHitsBox(const Vector &origin, const Vector &invDirection, const Vector &boxMin, const Vector &boxMax, Float maxDistance)
+{
+	Float nearDistance = 0.0;
+	Float farDistance = maxDistance;
+	for (Int32 axis = 0; axis < 3; ++axis)
+	{
+		Float t0 = (GetAxis(boxMin, axis) - GetAxis(origin, axis)) * GetAxis(invDirection, axis);
+		Float t1 = (GetAxis(boxMax, axis) - GetAxis(origin, axis)) * GetAxis(invDirection, axis);
+		if (t0 > t1)
+		{
+			Float swap = t0;
+			t0 = t1;
+			t1 = swap;
+		}
+		nearDistance = Max(nearDistance, t0);
+		farDistance = Min(farDistance, t1);
+		if (nearDistance > farDistance)
+			return false;
+	}
+	return true;
+}
+
+
+/// Intersect a ray with a triangle, from both sides (Moeller-Trumbore)
+/// @param[out] distance Receives the distance along the ray
+static Bool IntersectTriangle(const Vector &origin, const Vector &direction, const Vector &a, const Vector &b, const Vector &c, Float &distance)
+{
+	Vector edge1 = b - a;
+	Vector edge2 = c - a;
+	Vector p = Cross(direction, edge2);
+	Float determinant = Dot(edge1, p);
+	if (Abs(determinant) < RAY_EPSILON)
+		return false;
+
+	Float invDeterminant = 1.0 / determinant;
+	Vector s = origin - a;
+	Float u = Dot(s, p) * invDeterminant;
+	if (u < 0.0 || u > 1.0)
+		return false;
+
+	Vector q = Cross(s, edge1);
+	Float v = Dot(direction, q) * invDeterminant;
+	if (v < 0.0 || u + v > 1.0)
+		return false;
+
+	distance = Dot(edge2, q) * invDeterminant;
+	return distance > RAY_EPSILON;
+}
+
+
+/// Test a ray against the geometry of an object and its children, and keep the nearest hit
+/// @param[in] matrix Matrix of op in the space of the ray
+/// @param[in,out] hit Nearest hit so far, its distance limits the ray
+static Bool RaycastObject(BaseObject *op, const Matrix &matrix, const Vector &origin, const Vector &direction, BaseObject *element, ElementHit &hit, Int32 depth)
+{
+	Bool found = false;
+
+	// Ray in object space. Distances along it are the same as along the original ray.
+	Matrix toLocal = ~matrix;
+	Vector localOrigin = toLocal * origin;
+	Vector localDirection = toLocal * (origin + direction) - localOrigin;
+
+	if (op->IsInstanceOf(Opolygon))
+	{
+		const PolygonObject *poly = ToPoly(op);
+		const Vector *pointArr = poly->GetPointR();
+		const CPolygon *polygonArr = poly->GetPolygonR();
+		Int32 polygonCount = poly->GetPolygonCount();
+		for (Int32 polygonIndex = 0; pointArr && polygonArr && polygonIndex < polygonCount; ++polygonIndex)
+		{
+			const CPolygon &polygon = polygonArr[polygonIndex];
+			Float distance = 0.0;
+			Bool isHit = IntersectTriangle(localOrigin, localDirection, pointArr[polygon.a], pointArr[polygon.b], pointArr[polygon.c], distance) && distance < hit.distance;
+			if (!isHit && polygon.c != polygon.d)
+				isHit = IntersectTriangle(localOrigin, localDirection, pointArr[polygon.a], pointArr[polygon.c], pointArr[polygon.d], distance) && distance < hit.distance;
+
+			if (isHit)
+			{
+				Vector localNormal = Cross(pointArr[polygon.b] - pointArr[polygon.a], pointArr[polygon.c] - pointArr[polygon.a]);
+				Vector localPosition = localOrigin + localDirection * distance;
+				hit.element = element;
+				hit.object = op;
+				hit.polygonIndex = polygonIndex;
+				hit.distance = distance;
+				hit.normal = (matrix * (localPosition + localNormal) - matrix * localPosition).GetNormalized();
+				found = true;
+			}
+		}
+	}
+	else if (op->IsInstanceOf(Ocube))
+	{
+		// Slab test, the entering side gives the normal
+		Vector halfSize = GetCubeHalfSize(op);
+		Float nearDistance = RAY_EPSILON;
+		Float farDistance = hit.distance;
+		Int32 nearAxis = NOTOK;
+		Bool isHit = true;
+		for (Int32 axis = 0; axis < 3 && isHit; ++axis)
+		{
+			Float axisOrigin = GetAxis(localOrigin, axis);
+			Float axisDirection = GetAxis(localDirection, axis);
+			Float axisHalfSize = GetAxis(halfSize, axis);
+			if (Abs(axisDirection) < RAY_EPSILON)
+			{
+				isHit = Abs(axisOrigin) <= axisHalfSize;
+				continue;
+			}
+
+			Float t0 = (-axisHalfSize - axisOrigin) / axisDirection;
+			Float t1 = (axisHalfSize - axisOrigin) / axisDirection;
+			if (t0 > t1)
+			{
+				Float swap = t0;
+				t0 = t1;
+				t1 = swap;
+			}
+			if (t0 > nearDistance)
+			{
+				nearDistance = t0;
+				nearAxis = axis;
+			}
+			farDistance = Min(farDistance, t1);
+			isHit = nearDistance <= farDistance;
+		}
+
+		// Rays starting inside the cube don't hit it
+		if (isHit && nearAxis != NOTOK)
+		{
+			Vector localNormal;
+			Float side = (GetAxis(localDirection, nearAxis) > 0.0) ? -1.0 : 1.0;
+			if (nearAxis == 0)
+				localNormal.x = side;
+			else if (nearAxis == 1)
+				localNormal.y = side;
+			else
+				localNormal.z = side;
+
+			Vector localPosition = localOrigin + localDirection * nearDistance;
+			hit.element = element;
+			hit.object = op;
+			hit.polygonIndex = NOTOK;
+			hit.distance = nearDistance;
+			hit.normal = (matrix * (localPosition + localNormal) - matrix * localPosition).GetNormalized();
+			found = true;
+		}
+	}
+	else if (op->IsInstanceOf(Oinstance) && depth < MAX_LINK_DEPTH)
+	{
+		BaseObject *link = GetInstanceLink(op);
+		if (link)
+			found |= RaycastObject(link, matrix, origin, direction, element, hit, depth + 1);
+	}
+
+	for (BaseObject *child = op->GetDown(); child; child = child->GetNext())
+		found |= RaycastObject(child, matrix * child->GetMl(), origin, direction, element, hit, depth);
+
+	return found;
+}
+
+
+Bool ElementBVH::Build(BaseObject *root, BaseObject *exclude)
+{
+	Flush();
+
+	if (!root)
+		return false;
+
+	// The root's own matrix is not part of the coordinates
+	for (BaseObject *child = root->GetDown(); child; child = child->GetNext())
+	{
+		if (child != exclude && !CollectElements(child, child->GetMl()))
+			return false;
+	}
+
+	if (_elements.GetCount() == 0)
+		return true;
+
+	if (!_nodes.Append(Node()))
+		return false;
+
+	return BuildNode(0, 0, (Int32)_elements.GetCount());
+}
+
+
+void ElementBVH::Flush()
+{
+	_elements.Flush();
+	_nodes.Flush();
+}
+
+
+Bool ElementBVH::Raycast(const Vector &origin, const Vector &direction, Float maxDistance, ElementHit &hit) const
+{
+	hit = ElementHit();
+	hit.distance = maxDistance;
+
+	if (_nodes.GetCount() == 0)
+		return false;
+
+	Vector invDirection(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+	Bool found = false;
+
+	Int32 stack[MAX_DEPTH];
+	Int32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node &node = _nodes[stack[--stackSize]];
+
+		// The nearest hit so far shortens the ray
+		if (!RayHitsBox(origin, invDirection, node.boxMin, node.boxMax, hit.distance))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+			continue;
+		}
+
+		for (Int32 elementIndex = node.first; elementIndex < node.first + node.count; ++elementIndex)
+		{
+			const Element &element = _elements[elementIndex];
+			if (RayHitsBox(origin, invDirection, element.boxMin, element.boxMax, hit.distance))
+				found |= RaycastObject(element.op, element.matrix, origin, direction, element.op, hit, 0);
+		}
+	}
+
+	if (found)
+		hit.position = origin + direction * hit.distance;
+
+	return found;
+}
+
+
+Bool ElementBVH::GetElementsInBox(const Vector &boxMin, const Vector &boxMax, maxon::BaseArray<BaseObject*> &elements) const
+{
+	if (_nodes.GetCount() == 0)
+		return true;
+
+	Int32 stack[MAX_DEPTH];
+	Int32 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node &node = _nodes[stack[--stackSize]];
+
+		if (node.boxMin.x > boxMax.x || node.boxMin.y > boxMax.y || node.boxMin.z > boxMax.z ||
+		    node.boxMax.x < boxMin.x || node.boxMax.y < boxMin.y || node.boxMax.z < boxMin.z)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+			continue;
+		}
+
+		for (Int32 elementIndex = node.first; elementIndex < node.first + node.count; ++elementIndex)
+		{
+			const Element &element = _elements[elementIndex];
+			if (element.boxMin.x > boxMax.x || element.boxMin.y > boxMax.y || element.boxMin.z > boxMax.z ||
+			    element.boxMax.x < boxMin.x || element.boxMax.y < boxMin.y || element.boxMax.z < boxMin.z)
+				continue;
+
+			if (!elements.Append(element.op))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+Bool ElementBVH::CollectElements(BaseObject *op, const Matrix &matrix)
+{
+	if (IsElement(op))
+	{
+		Element element;
+		element.op = op;
+		element.matrix = matrix;
+		element.boxMin = Vector(MAXVALUE_FLOAT);
+		element.boxMax = Vector(MINVALUE_FLOAT);
+		AddBounds(op, matrix, element.boxMin, element.boxMax, 0);
+
+		// Elements without geometry can't be hit
+		if (element.boxMin.x > element.boxMax.x)
+			return true;
+
+		element.center = (element.boxMin + element.boxMax) * 0.5;
+		return _elements.Append(element) != nullptr;
+	}
+
+	for (BaseObject *child = op->GetDown(); child; child = child->GetNext())
+	{
+		if (!CollectElements(child, matrix * child->GetMl()))
+			return false;
+	}
+
+	return true;
+}
+
+
+Bool ElementBVH::BuildNode(Int32 nodeIndex, Int32 first, Int32 count)
+{
+	Vector boxMin(MAXVALUE_FLOAT), boxMax(MINVALUE_FLOAT);
+	Vector centerMin(MAXVALUE_FLOAT), centerMax(MINVALUE_FLOAT);
+	for (Int32 elementIndex = first; elementIndex < first + count; ++elementIndex)
+	{
+		const Element &element = _elements[elementIndex];
+		AddPoint(element.boxMin, boxMin, boxMax);
+		AddPoint(element.boxMax, boxMin, boxMax);
+		AddPoint(element.center, centerMin, centerMax);
+	}
+
+	_nodes[nodeIndex].boxMin = boxMin;
+	_nodes[nodeIndex].boxMax = boxMax;
+
+	if (count <= MAX_LEAF_ELEMENTS)
+	{
+		_nodes[nodeIndex].first = first;
+		_nodes[nodeIndex].count = count;
+		return true;
+	}
+
+	// Split at the median along the longest axis of the centers, so the tree is balanced
+	Vector centerExtent = centerMax - centerMin;
+	Int32 axis = (centerExtent.x >= centerExtent.y && centerExtent.x >= centerExtent.z) ? 0 : ((centerExtent.y >= centerExtent.z) ? 1 : 2);
+	Int32 half = count / 2;
+	SelectNth(first, count, first + half, axis);
+
+	// Appending invalidates references to nodes
+	Int32 childIndex = (Int32)_nodes.GetCount();
+	_nodes[nodeIndex].first = childIndex;
+	_nodes[nodeIndex].count = 0;
+	if (!_nodes.Append(Node()) || !_nodes.Append(Node()))
+		return false;
+
+	return BuildNode(childIndex, first, half) && BuildNode(childIndex + 1, first + half, count - half);
+}
+
+
+void ElementBVH::SelectNth(Int32 first, Int32 count, Int32 n, Int32 axis)
+{
+	Int32 left = first;
+	Int32 right = first + count - 1;
+	while (left < right)
+	{
+		Float pivot = GetAxis(_elements[(left + right) / 2].center, axis);
+		Int32 i = left;
+		Int32 j = right;
+		while (i <= j)
+		{
+			while (GetAxis(_elements[i].center, axis) < pivot)
+				++i;
+			while (GetAxis(_elements[j].center, axis) > pivot)
+				--j;
+			if (i <= j)
+			{
+				Element swap = _elements[i];
+				_elements[i] = _elements[j];
+				_elements[j] = swap;
+				++i;
+				--j;
+			}
+		}
+
+		if (n <= j)
+			right = j;
+		else if (n >= i)
+			left = i;
+		else
+			break;
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef ELEMENTBVH_H__
+#define ELEMENTBVH_H__
+
+#include "c4d.h"
+
+
+/// Nearest hit of a ray query
+struct ElementHit
+{
+	BaseObject *element;   ///< The element that was hit: A plate, cobblestone, curbstone, dirt plane or tile instance
+	BaseObject *object;    ///< The object whose geometry was hit. For tile instances, it's inside the tile.
+	Int32 polygonIndex;    ///< Polygon of object that was hit; or NOTOK if object is a primitive
+	Float distance;        ///< Distance along the ray
+	Vector position;       ///< Hit position
+	Vector normal;         ///< Surface normal at the hit position
+
+	/// Default constructor
+	ElementHit() : element(nullptr), object(nullptr), polygonIndex(NOTOK), distance(0.0)
+	{}
+};
+
+
+/// Bounding volume hierarchy over the elements of a sidewalk, one bounding box per plate, cobblestone, curbstone, dirt plane or tile instance.
+/// Ray and box queries only test the geometry of elements whose boxes are touched, so they're logarithmic in the number of elements.
+/// Coordinates are relative to the root object of the hierarchy. Object pointers are valid as long as the hierarchy is unchanged.
+class ElementBVH
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(ElementBVH);
+
+public:
+	/// Build over all elements below root
+	/// @param[in] exclude A child of root that is left out; or nullptr
+	/// @return False if an error occurred; otherwise true
+	Bool Build(BaseObject *root, BaseObject *exclude = nullptr);
+
+	/// Remove all elements and nodes, but keep the memory
+	void Flush();
+
+	/// Find the nearest polygon hit by a ray
+	/// @param[in] origin Start of the ray
+	/// @param[in] direction Direction of the ray, normalized
+	/// @param[in] maxDistance Length of the ray
+	/// @param[out] hit Receives the nearest hit
+	/// @return True if anything was hit; otherwise false
+	Bool Raycast(const Vector &origin, const Vector &direction, Float maxDistance, ElementHit &hit) const;
+
+	/// Find all elements whose bounding boxes overlap a box
+	/// @param[out] elements Receives the elements. Existing entries are kept.
+	/// @return False if an error occurred; otherwise true
+	Bool GetElementsInBox(const Vector &boxMin, const Vector &boxMax, maxon::BaseArray<BaseObject*> &elements) const;
+
+	/// Get the number of elements
+	Int32 GetElementCount() const
+	{
+		return (Int32)_elements.GetCount();
+	}
+
+private:
+	/// An element with its bounding box
+	struct Element
+	{
+		BaseObject *op;
+		Matrix matrix;   ///< Matrix of op, relative to the root
+		Vector boxMin;
+		Vector boxMax;
+		Vector center;
+	};
+
+	/// A node of the tree. Inner nodes have two children, stored next to each other.
+	struct Node
+	{
+		Vector boxMin;
+		Vector boxMax;
+		Int32 first;   ///< First element of a leaf; or first child of an inner node
+		Int32 count;   ///< Number of elements of a leaf; or 0 for inner nodes
+	};
+
+	/// Add all elements below op
+	Bool CollectElements(BaseObject *op, const Matrix &parentMatrix);
+
+	/// Compute the box of a node and split it, until there are only a few elements left
+	Bool BuildNode(Int32 nodeIndex, Int32 first, Int32 count);
+
+	/// Reorder elements, so that the one with the n-th smallest center on an axis is at index n, smaller ones are before
+	void SelectNth(Int32 first, Int32 count, Int32 n, Int32 axis);
+
+private:
+	maxon::BaseArray<Element> _elements;
+	maxon::BaseArray<Node> _nodes;
+
+	static const Int32 MAX_LEAF_ELEMENTS = 4;
+	static const Int32 MAX_DEPTH = 64;
+
+public:
+	/// Default constructor
+	ElementBVH()
+	{}
+};
+
+
+#endif // ELEMENTBVH_H__
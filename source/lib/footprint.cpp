@@ -0,0 +1,302 @@
+#include "footprint.h"
+#include "splinepath.h"
+
+
+// Outline points closer than this are merged
+static const Float POINT_TOLERANCE = 0.0001;
+
+
+Bool Footprint::Init(const SplineObject *spline, const Matrix &matrix, Float step)
+{
+	Flush();
+
+	// Points at equal distances along the spline
+	SplinePath path;
+	if (!path.Init(spline, matrix, step))
+		return false;
+
+	const Matrix *sampleArr = path.GetSamples();
+	Int sampleCount = path.GetSampleCount();
+
+	_min = Vector(MAXVALUE_FLOAT);
+	_max = Vector(MINVALUE_FLOAT);
+	for (Int i = 0; i < sampleCount; ++i)
+	{
+		Vector point(sampleArr[i].off.x, 0.0, sampleArr[i].off.z);
+		if (_points.GetCount() > 0 && (point - _points[_points.GetCount() - 1]).GetLength() < POINT_TOLERANCE)
+			continue;
+
+		if (!_points.Append(point))
+		{
+			Flush();
+			return false;
+		}
+
+		_min = Vector(Min(_min.x, point.x), 0.0, Min(_min.z, point.z));
+		_max = Vector(Max(_max.x, point.x), 0.0, Max(_max.z, point.z));
+	}
+
+	// A closed spline ends where it started
+	if (_points.GetCount() > 1 && (_points[0] - _points[_points.GetCount() - 1]).GetLength() < POINT_TOLERANCE)
+		_points.Pop();
+
+	// Without area, there's nothing inside
+	Float doubleArea = 0.0;
+	for (Int32 edgeIndex = 0; edgeIndex < (Int32)_points.GetCount(); ++edgeIndex)
+	{
+		Vector a, b;
+		GetEdge(edgeIndex, a, b);
+		doubleArea += a.x * b.z - b.x * a.z;
+	}
+
+	if (!IsValid() || Abs(doubleArea) < POINT_TOLERANCE)
+	{
+		Flush();
+		return false;
+	}
+
+	return true;
+}
+
+
+Bool Footprint::Classify(Float originX, Float originZ, const Vector &cellSize, Int32 columnCount, Int32 rowCount, Float evenColumnShift, FOOTPRINTCELL *classes) const
+{
+	if (!classes || columnCount < 1 || rowCount < 1 || cellSize.x <= 0.0 || cellSize.z <= 0.0)
+		return false;
+
+	for (Int32 i = 0; i < columnCount * rowCount; ++i)
+		classes[i] = FOOTPRINTCELL::OUTSIDE;
+
+	if (!IsValid())
+		return true;
+
+	Int32 edgeCount = (Int32)_points.GetCount();
+
+	// Sort the edges into the columns they touch (counting sort, bucket c starts at bucketStart[c])
+	maxon::BaseArray<Int32> bucketStart;
+	if (!bucketStart.Resize(columnCount + 1))
+		return false;
+
+	for (Int32 columnIndex = 0; columnIndex <= columnCount; ++columnIndex)
+		bucketStart[columnIndex] = 0;
+
+	for (Int32 edgeIndex = 0; edgeIndex < edgeCount; ++edgeIndex)
+	{
+		Int32 firstColumn, lastColumn;
+		GetEdgeColumns(edgeIndex, originX, cellSize.x, columnCount, firstColumn, lastColumn);
+		for (Int32 columnIndex = firstColumn; columnIndex <= lastColumn; ++columnIndex)
+			++bucketStart[columnIndex + 1];
+	}
+
+	for (Int32 columnIndex = 0; columnIndex < columnCount; ++columnIndex)
+		bucketStart[columnIndex + 1] += bucketStart[columnIndex];
+
+	maxon::BaseArray<Int32> bucketEdges;
+	maxon::BaseArray<Int32> bucketFill;
+	if (!bucketEdges.Resize(bucketStart[columnCount]) || !bucketFill.Resize(columnCount))
+		return false;
+
+	for (Int32 columnIndex = 0; columnIndex < columnCount; ++columnIndex)
+		bucketFill[columnIndex] = bucketStart[columnIndex];
+
+	for (Int32 edgeIndex = 0; edgeIndex < edgeCount; ++edgeIndex)
+	{
+		Int32 firstColumn, lastColumn;
+		GetEdgeColumns(edgeIndex, originX, cellSize.x, columnCount, firstColumn, lastColumn);
+		for (Int32 columnIndex = firstColumn; columnIndex <= lastColumn; ++columnIndex)
+			bucketEdges[bucketFill[columnIndex]++] = edgeIndex;
+	}
+
+	// One scanline per column
+	maxon::BaseArray<Float> crossings;
+	for (Int32 columnIndex = 0; columnIndex < columnCount; ++columnIndex)
+	{
+		Float columnMinX = originX + cellSize.x * columnIndex;
+		Float columnMaxX = columnMinX + cellSize.x;
+		Float centerX = columnMinX + cellSize.x * 0.5;
+		Float columnOriginZ = originZ + ((columnIndex % 2 == 0) ? evenColumnShift : 0.0);
+		FOOTPRINTCELL *columnClasses = classes + columnIndex * rowCount;
+
+		// Where the center line crosses the outline. Every edge that crosses it is in this column's bucket.
+		crossings.Flush();
+		for (Int32 bucketIndex = bucketStart[columnIndex]; bucketIndex < bucketStart[columnIndex + 1]; ++bucketIndex)
+		{
+			Vector a, b;
+			GetEdge(bucketEdges[bucketIndex], a, b);
+			if ((a.x <= centerX) != (b.x <= centerX))
+			{
+				if (!crossings.Append(a.z + (b.z - a.z) * (centerX - a.x) / (b.x - a.x)))
+					return false;
+			}
+		}
+
+		// Few crossings per column, insertion sort is fine
+		for (Int i = 1; i < crossings.GetCount(); ++i)
+		{
+			Float crossing = crossings[i];
+			Int j = i;
+			for (; j > 0 && crossings[j - 1] > crossing; --j)
+				crossings[j] = crossings[j - 1];
+			crossings[j] = crossing;
+		}
+
+		// Cells whose centers lie between two crossings are inside
+		for (Int i = 0; i + 1 < crossings.GetCount(); i += 2)
+		{
+			Int32 firstRow = Max((Int32)Ceil((crossings[i] - columnOriginZ) / cellSize.z - 0.5), (Int32)0);
+			Int32 lastRow = Min((Int32)Floor((crossings[i + 1] - columnOriginZ) / cellSize.z - 0.5), rowCount - 1);
+			for (Int32 rowIndex = firstRow; rowIndex <= lastRow; ++rowIndex)
+				columnClasses[rowIndex] = FOOTPRINTCELL::INSIDE;
+		}
+
+		// Cells touched by an edge are on the boundary
+		for (Int32 bucketIndex = bucketStart[columnIndex]; bucketIndex < bucketStart[columnIndex + 1]; ++bucketIndex)
+		{
+			Vector a, b;
+			GetEdge(bucketEdges[bucketIndex], a, b);
+
+			// Part of the edge inside the column
+			Float tMin = 0.0, tMax = 1.0;
+			if (a.x != b.x)
+			{
+				Float t0 = (columnMinX - a.x) / (b.x - a.x);
+				Float t1 = (columnMaxX - a.x) / (b.x - a.x);
+				tMin = Max(Min(t0, t1), 0.0);
+				tMax = Min(Max(t0, t1), 1.0);
+				if (tMin > tMax)
+					continue;
+			}
+
+			Float zA = a.z + (b.z - a.z) * tMin;
+			Float zB = a.z + (b.z - a.z) * tMax;
+			Int32 firstRow = Max((Int32)Floor((Min(zA, zB) - columnOriginZ) / cellSize.z), (Int32)0);
+			Int32 lastRow = Min((Int32)Floor((Max(zA, zB) - columnOriginZ) / cellSize.z), rowCount - 1);
+			for (Int32 rowIndex = firstRow; rowIndex <= lastRow; ++rowIndex)
+				columnClasses[rowIndex] = FOOTPRINTCELL::BOUNDARY;
+		}
+	}
+
+	return true;
+}
+
+
+void Footprint::GetEdgeColumns(Int32 edgeIndex, Float originX, Float columnWidth, Int32 columnCount, Int32 &firstColumn, Int32 &lastColumn) const
+{
+	Vector a, b;
+	GetEdge(edgeIndex, a, b);
+
+	// Edges beyond the grid are clamped to its outer columns, they only matter if they reach into it
+	firstColumn = ClampValue((Int32)Floor((Min(a.x, b.x) - originX) / columnWidth), (Int32)0, columnCount - 1);
+	lastColumn = ClampValue((Int32)Floor((Max(a.x, b.x) - originX) / columnWidth), (Int32)0, columnCount - 1);
+}
+
+
+Bool Footprint::IsInside(const Vector &point) const
+{
+	if (!IsValid() || point.x < _min.x || point.x > _max.x || point.z < _min.z || point.z > _max.z)
+		return false;
+
+	Bool inside = false;
+	for (Int32 edgeIndex = 0; edgeIndex < (Int32)_points.GetCount(); ++edgeIndex)
+	{
+		Vector a, b;
+		GetEdge(edgeIndex, a, b);
+		if ((a.x <= point.x) != (b.x <= point.x) && point.z < a.z + (b.z - a.z) * (point.x - a.x) / (b.x - a.x))
+			inside = !inside;
+	}
+
+	return inside;
+}
+
+
+Bool Footprint::ContainsRect(const Vector &rectMin, const Vector &rectMax) const
+{
+	if (!IsInside((rectMin + rectMax) * 0.5))
+		return false;
+
+	// Inside if no edge touches the rectangle
+	for (Int32 edgeIndex = 0; edgeIndex < (Int32)_points.GetCount(); ++edgeIndex)
+	{
+		Vector a, b;
+		GetEdge(edgeIndex, a, b);
+
+		// Clip the edge against the rectangle's slabs
+		Float tMin = 0.0, tMax = 1.0;
+		Bool separated = false;
+		for (Int32 axis = 0; axis < 2 && !separated; ++axis)
+		{
+			Float start = (axis == 0) ? a.x : a.z;
+			Float delta = (axis == 0) ? b.x - a.x : b.z - a.z;
+			Float slabMin = (axis == 0) ? rectMin.x : rectMin.z;
+			Float slabMax = (axis == 0) ? rectMax.x : rectMax.z;
+
+			if (delta == 0.0)
+			{
+				separated = start < slabMin || start > slabMax;
+				continue;
+			}
+
+			Float t0 = (slabMin - start) / delta;
+			Float t1 = (slabMax - start) / delta;
+			tMin = Max(tMin, Min(t0, t1));
+			tMax = Min(tMax, Max(t0, t1));
+			separated = tMin > tMax;
+		}
+
+		if (!separated)
+			return false;
+	}
+
+	return true;
+}
+
+
+Vector Footprint::GetNearestPoint(const Vector &point) const
+{
+	Vector nearest = point;
+	Float nearestDistance = MAXVALUE_FLOAT;
+	Vector flatPoint(point.x, 0.0, point.z);
+
+	for (Int32 edgeIndex = 0; edgeIndex < (Int32)_points.GetCount(); ++edgeIndex)
+	{
+		Vector a, b;
+		GetEdge(edgeIndex, a, b);
+
+		Vector edge = b - a;
+		Float edgeLengthSqr = edge.GetSquaredLength();
+		Float t = (edgeLengthSqr > 0.0) ? ClampValue(Dot(flatPoint - a, edge) / edgeLengthSqr, 0.0, 1.0) : 0.0;
+		Vector edgePoint = a + edge * t;
+
+		Float distance = (flatPoint - edgePoint).GetSquaredLength();
+		if (distance < nearestDistance)
+		{
+			nearestDistance = distance;
+			nearest = Vector(edgePoint.x, point.y, edgePoint.z);
+		}
+	}
+
+	return nearest;
+}
+
+
+Bool Footprint::IsEqual(const Footprint &other) const
+{
+	if (_points.GetCount() != other._points.GetCount())
+		return false;
+
+	for (Int i = 0; i < _points.GetCount(); ++i)
+	{
+		if (_points[i] != other._points[i])
+			return false;
+	}
+
+	return true;
+}
+
+
+void Footprint::Flush()
+{
+	_points.Flush();
+	_min = Vector();
+	_max = Vector();
+}
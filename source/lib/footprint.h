@@ -0,0 +1,127 @@
+#ifndef FOOTPRINT_H__
+#define FOOTPRINT_H__
+
+#include "c4d.h"
+
+
+/// Class of a grid cell relative to a footprint
+enum class FOOTPRINTCELL
+{
+	OUTSIDE =	0,     ///< Completely outside, nothing is built
+	INSIDE =	1,      ///< Completely inside
+	BOUNDARY =	2     ///< Crossed by the outline
+} ENUM_END_LIST(FOOTPRINTCELL);
+
+
+/// Closed outline on the XZ plane that limits the paved area.
+/// Grid cells are classified column by column with a scanline pass: Only the cells crossed by an edge and the runs between the crossings of the column's center line are visited.
+class Footprint
+{
+public:
+	/// Sample the first segment of a spline as outline. Open splines are closed implicitly.
+	/// @param[in] spline The spline, e.g. from GetRealSpline()
+	/// @param[in] matrix Transforms the spline's points into the space the footprint is used in. Only X and Z of that space are used.
+	/// @param[in] step Distance between two outline points
+	/// @return False if the outline has no area or an error occurred; otherwise true
+	Bool Init(const SplineObject *spline, const Matrix &matrix, Float step);
+
+	/// Check if there is an outline
+	Bool IsValid() const
+	{
+		return _points.GetCount() >= 3;
+	}
+
+	/// Get the corner of the bounding box with the smallest coordinates
+	const Vector &GetMin() const
+	{
+		return _min;
+	}
+
+	/// Get the corner of the bounding box with the largest coordinates
+	const Vector &GetMax() const
+	{
+		return _max;
+	}
+
+	/// Classify the cells of a grid of columns along X and rows along Z
+	/// @param[in] originX Left border of the first column
+	/// @param[in] originZ Front border of the first row
+	/// @param[in] cellSize Size of a cell, only X and Z are used
+	/// @param[in] evenColumnShift Offset along Z of the rows in every even column
+	/// @param[out] classes Receives one class per cell, index is (columnIndex * rowCount + rowIndex)
+	/// @return False if an error occurred; otherwise true
+	Bool Classify(Float originX, Float originZ, const Vector &cellSize, Int32 columnCount, Int32 rowCount, Float evenColumnShift, FOOTPRINTCELL *classes) const;
+
+	/// Check if a point is inside the outline (even-odd rule)
+	Bool IsInside(const Vector &point) const;
+
+	/// Check if a rectangle is completely inside the outline
+	/// @param[in] rectMin Corner of the rectangle with the smallest coordinates, only X and Z are used
+	/// @param[in] rectMax Corner of the rectangle with the largest coordinates, only X and Z are used
+	Bool ContainsRect(const Vector &rectMin, const Vector &rectMax) const;
+
+	/// Get the point on the outline that's nearest to a point. Y is taken from the point.
+	Vector GetNearestPoint(const Vector &point) const;
+
+	/// Check if two footprints have the same outline
+	Bool IsEqual(const Footprint &other) const;
+
+	/// Get the number of outline points
+	Int GetPointCount() const
+	{
+		return _points.GetCount();
+	}
+
+	/// Get the outline points, for hashing
+	const Vector *GetPoints() const
+	{
+		return _points.GetFirst();
+	}
+
+	/// Remove the outline
+	void Flush();
+
+private:
+	/// Get the two points of an edge
+	void GetEdge(Int32 edgeIndex, Vector &a, Vector &b) const
+	{
+		a = _points[edgeIndex];
+		b = _points[(edgeIndex + 1) % _points.GetCount()];
+	}
+
+	/// Get the range of grid columns an edge touches
+	void GetEdgeColumns(Int32 edgeIndex, Float originX, Float columnWidth, Int32 columnCount, Int32 &firstColumn, Int32 &lastColumn) const;
+
+private:
+	maxon::BaseArray<Vector> _points;  ///< Outline points with Y set to zero, the last one connects to the first one
+	Vector _min;
+	Vector _max;
+
+public:
+	/// Default constructor
+	Footprint()
+	{}
+
+	/// Copy constructor. If there's not enough memory for the outline, the copy is invalid.
+	Footprint(const Footprint &src)
+	{
+		*this = src;
+	}
+
+	/// Copy assignment. If there's not enough memory for the outline, the copy is invalid.
+	Footprint &operator =(const Footprint &src)
+	{
+		if (this == &src)
+			return *this;
+
+		_min = src._min;
+		_max = src._max;
+		if (!_points.CopyFrom(src._points))
+			Flush();
+
+		return *this;
+	}
+};
+
+
+#endif // FOOTPRINT_H__
@@ -0,0 +1,255 @@
+#include "heightfield.h"
+#include "lib_collider.h"
+
+
+// The grid never gets more samples than this along each axis, larger areas get a larger step
+static const Int32 MAX_SAMPLES_PER_AXIS = 1024;
+
+// Rays start this far above the terrain's highest point and end this far below its lowest one
+static const Float RAY_MARGIN = 1.0;
+
+
+Bool HeightField::Init(PolygonObject *terrain, const Matrix &matrix, const Vector &areaMin, const Vector &areaMax, Float step)
+{
+	Flush();
+
+	if (!terrain || terrain->GetPolygonCount() == 0 || step <= 0.0)
+		return false;
+
+	// At least two samples along each axis, so there's always a cell to interpolate in
+	Float sizeX = Max(areaMax.x - areaMin.x, 0.0);
+	Float sizeZ = Max(areaMax.z - areaMin.z, 0.0);
+	step = Max(step, Max(sizeX, sizeZ) / (Float)(MAX_SAMPLES_PER_AXIS - 1));
+	_countX = ClampValue(SAFEINT32(Ceil(sizeX / step)) + 1, (Int32)2, MAX_SAMPLES_PER_AXIS);
+	_countZ = ClampValue(SAFEINT32(Ceil(sizeZ / step)) + 1, (Int32)2, MAX_SAMPLES_PER_AXIS);
+	_origin = Vector(areaMin.x, 0.0, areaMin.z);
+	_step = step;
+
+	// Height range of the terrain, in the space of the height field
+	const Vector *pointArr = terrain->GetPointR();
+	Int32 pointCount = terrain->GetPointCount();
+	if (!pointArr || pointCount == 0)
+	{
+		Flush();
+		return false;
+	}
+
+	Float minY = MAXVALUE_FLOAT;
+	Float maxY = MINVALUE_FLOAT;
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		Float y = (matrix * pointArr[i]).y;
+		minY = Min(minY, y);
+		maxY = Max(maxY, y);
+	}
+
+	AutoAlloc<GeRayCollider> collider;
+	maxon::BaseArray<Bool> hits;
+	if (!collider || !collider->Init(terrain, true) || !_heights.Resize(_countX * _countZ) || !_normals.Resize(_countX * _countZ) || !hits.Resize(_countX * _countZ))
+	{
+		Flush();
+		return false;
+	}
+
+	// Rays are cast in the terrain's own space
+	Matrix inverseMatrix = ~matrix;
+	Float rayTop = maxY + RAY_MARGIN;
+	Float rayBottom = minY - RAY_MARGIN;
+
+	Bool anyHit = false;
+	for (Int32 x = 0; x < _countX; ++x)
+	{
+		for (Int32 z = 0; z < _countZ; ++z)
+		{
+			Int32 sampleIndex = x * _countZ + z;
+			Vector samplePos = _origin + Vector(_step * x, 0.0, _step * z);
+			Vector rayStart = inverseMatrix * Vector(samplePos.x, rayTop, samplePos.z);
+			Vector rayEnd = inverseMatrix * Vector(samplePos.x, rayBottom, samplePos.z);
+
+			GeRayColResult result;
+			hits[sampleIndex] = collider->Intersect(rayStart, (rayEnd - rayStart).GetNormalized(), (rayEnd - rayStart).GetLength()) && collider->GetNearestIntersection(&result);
+			_heights[sampleIndex] = hits[sampleIndex] ? (matrix * result.hitpos).y : 0.0;
+			anyHit |= hits[sampleIndex];
+		}
+	}
+
+	// The terrain may not be below the area at all
+	if (!anyHit)
+	{
+		Flush();
+		return false;
+	}
+
+	FillMisses(hits);
+	ComputeNormals();
+	return true;
+}
+
+
+void HeightField::FillMisses(const maxon::BaseArray<Bool> &hits)
+{
+	// Nearest hit along each column, searched forwards and backwards
+	maxon::BaseArray<Bool> columnHits;
+	if (!columnHits.Resize(_countX))
+		return;
+
+	for (Int32 x = 0; x < _countX; ++x)
+	{
+		Float *columnHeights = &_heights[x * _countZ];
+		const Bool *columnHitArr = &hits[x * _countZ];
+
+		Int32 lastHit = -1;
+		for (Int32 z = 0; z < _countZ; ++z)
+		{
+			if (!columnHitArr[z])
+				continue;
+
+			// Misses before the first hit, or between two hits
+			Int32 firstMiss = lastHit + 1;
+			for (Int32 miss = firstMiss; miss < z; ++miss)
+				columnHeights[miss] = (lastHit < 0 || z - miss < miss - lastHit) ? columnHeights[z] : columnHeights[lastHit];
+
+			lastHit = z;
+		}
+
+		// Misses after the last hit
+		for (Int32 miss = lastHit + 1; lastHit >= 0 && miss < _countZ; ++miss)
+			columnHeights[miss] = columnHeights[lastHit];
+
+		columnHits[x] = lastHit >= 0;
+	}
+
+	// Columns without any hit take the nearest column with hits
+	for (Int32 x = 0; x < _countX; ++x)
+	{
+		if (columnHits[x])
+			continue;
+
+		Int32 source = -1;
+		for (Int32 distance = 1; source < 0 && distance < _countX; ++distance)
+		{
+			if (x - distance >= 0 && columnHits[x - distance])
+				source = x - distance;
+			else if (x + distance < _countX && columnHits[x + distance])
+				source = x + distance;
+		}
+
+		if (source >= 0)
+			CopyMem(&_heights[source * _countZ], &_heights[x * _countZ], sizeof(Float) * _countZ);
+	}
+}
+
+
+void HeightField::ComputeNormals()
+{
+	// Central differences, one-sided at the border
+	for (Int32 x = 0; x < _countX; ++x)
+	{
+		Int32 left = Max(x - 1, (Int32)0);
+		Int32 right = Min(x + 1, _countX - 1);
+		for (Int32 z = 0; z < _countZ; ++z)
+		{
+			Int32 front = Max(z - 1, (Int32)0);
+			Int32 back = Min(z + 1, _countZ - 1);
+
+			Float slopeX = (_heights[right * _countZ + z] - _heights[left * _countZ + z]) / (_step * (right - left));
+			Float slopeZ = (_heights[x * _countZ + back] - _heights[x * _countZ + front]) / (_step * (back - front));
+			_normals[x * _countZ + z] = Vector(-slopeX, 1.0, -slopeZ).GetNormalized();
+		}
+	}
+}
+
+
+void HeightField::GetCell(const Vector &point, Int32 &x, Int32 &z, Float &blendX, Float &blendZ) const
+{
+	Float positionX = ClampValue((point.x - _origin.x) / _step, 0.0, (Float)(_countX - 1));
+	Float positionZ = ClampValue((point.z - _origin.z) / _step, 0.0, (Float)(_countZ - 1));
+	x = Min((Int32)positionX, _countX - 2);
+	z = Min((Int32)positionZ, _countZ - 2);
+	blendX = positionX - (Float)x;
+	blendZ = positionZ - (Float)z;
+}
+
+
+Float HeightField::GetHeight(const Vector &point) const
+{
+	if (!IsValid())
+		return 0.0;
+
+	Int32 x, z;
+	Float blendX, blendZ;
+	GetCell(point, x, z, blendX, blendZ);
+
+	const Float *column = &_heights[x * _countZ + z];
+	const Float *nextColumn = column + _countZ;
+	Float front = column[0] + (nextColumn[0] - column[0]) * blendX;
+	Float back = column[1] + (nextColumn[1] - column[1]) * blendX;
+	return front + (back - front) * blendZ;
+}
+
+
+Vector HeightField::GetNormal(const Vector &point) const
+{
+	if (!IsValid())
+		return Vector(0.0, 1.0, 0.0);
+
+	Int32 x, z;
+	Float blendX, blendZ;
+	GetCell(point, x, z, blendX, blendZ);
+
+	const Vector *column = &_normals[x * _countZ + z];
+	const Vector *nextColumn = column + _countZ;
+	Vector front = column[0] + (nextColumn[0] - column[0]) * blendX;
+	Vector back = column[1] + (nextColumn[1] - column[1]) * blendX;
+	return (front + (back - front) * blendZ).GetNormalized();
+}
+
+
+Matrix HeightField::Conform(const Matrix &matrix) const
+{
+	if (!IsValid())
+		return matrix;
+
+	// Shortest rotation from up to the normal, around the matrix's own position
+	Vector up(0.0, 1.0, 0.0);
+	Vector normal = GetNormal(matrix.off);
+	Vector axis = Cross(up, normal);
+
+	Matrix result = matrix;
+	if (axis.GetLength() > 0.0001)
+	{
+		Matrix tilt = RotAxisToMatrix(axis.GetNormalized(), ACos(ClampValue(Dot(up, normal), -1.0, 1.0)));
+		result.v1 = tilt * matrix.v1;
+		result.v2 = tilt * matrix.v2;
+		result.v3 = tilt * matrix.v3;
+	}
+
+	result.off.y += GetHeight(matrix.off);
+	return result;
+}
+
+
+Bool HeightField::IsEqual(const HeightField &other) const
+{
+	if (_countX != other._countX || _countZ != other._countZ || _origin != other._origin || _step != other._step)
+		return false;
+
+	for (Int i = 0; i < _heights.GetCount(); ++i)
+	{
+		if (_heights[i] != other._heights[i])
+			return false;
+	}
+
+	return true;
+}
+
+
+void HeightField::Flush()
+{
+	_heights.Flush();
+	_normals.Flush();
+	_countX = 0;
+	_countZ = 0;
+	_origin = Vector();
+	_step = 0.0;
+}
@@ -0,0 +1,109 @@
+#ifndef HEIGHTFIELD_H__
+#define HEIGHTFIELD_H__
+
+#include "c4d.h"
+
+
+/// Heights and normals of a terrain, sampled once on a regular grid on the XZ plane.
+/// Each sample is found by casting a ray straight down onto the terrain's polygons. Looking up the height or normal at any point
+/// only interpolates the four surrounding samples, it's O(1). Points beyond the sampled area get the values of its border.
+class HeightField
+{
+public:
+	/// Sample a polygon object inside an area
+	/// @param[in] terrain The terrain's polygons
+	/// @param[in] matrix Transforms the terrain's points into the space the height field is used in. Y of that space is up.
+	/// @param[in] areaMin Corner of the area with the smallest coordinates, only X and Z are used
+	/// @param[in] areaMax Corner of the area with the largest coordinates, only X and Z are used
+	/// @param[in] step Distance between two samples. It's increased if the grid would get too large.
+	/// @return False if no ray hit the terrain or an error occurred; otherwise true
+	Bool Init(PolygonObject *terrain, const Matrix &matrix, const Vector &areaMin, const Vector &areaMax, Float step);
+
+	/// Check if the terrain has been sampled
+	Bool IsValid() const
+	{
+		return _heights.GetCount() >= 4;
+	}
+
+	/// Get the interpolated height at a point, only X and Z are used
+	Float GetHeight(const Vector &point) const;
+
+	/// Get the interpolated, normalized normal at a point, only X and Z are used
+	Vector GetNormal(const Vector &point) const;
+
+	/// Put a matrix onto the terrain: Its position is lifted by the height, and it's tilted from Y to the normal. It's not bent.
+	Matrix Conform(const Matrix &matrix) const;
+
+	/// Put a point onto the terrain: It's lifted by the height
+	Vector Conform(const Vector &point) const
+	{
+		return Vector(point.x, point.y + GetHeight(point), point.z);
+	}
+
+	/// Check if two height fields have the same samples
+	Bool IsEqual(const HeightField &other) const;
+
+	/// Get the number of samples
+	Int GetSampleCount() const
+	{
+		return _heights.GetCount();
+	}
+
+	/// Get the heights, for hashing
+	const Float *GetHeights() const
+	{
+		return _heights.GetFirst();
+	}
+
+	/// Remove all samples
+	void Flush();
+
+private:
+	/// Get the two samples along X and along Z around a point, and the blend between them
+	void GetCell(const Vector &point, Int32 &x, Int32 &z, Float &blendX, Float &blendZ) const;
+
+	/// Give samples whose ray missed the terrain the height of the nearest hit in the same column, or of the nearest column with hits
+	/// @param[in] hits One entry per sample, true if the ray hit the terrain
+	void FillMisses(const maxon::BaseArray<Bool> &hits);
+
+	/// Compute the normals from the heights of the neighbouring samples
+	void ComputeNormals();
+
+private:
+	maxon::BaseArray<Float> _heights;   ///< One height per sample, index is (x * countZ + z)
+	maxon::BaseArray<Vector> _normals;  ///< One normal per sample, same index
+	Int32 _countX;
+	Int32 _countZ;
+	Vector _origin;                     ///< Position of the first sample, Y is zero
+	Float _step;                        ///< Distance between two samples
+
+public:
+	/// Default constructor
+	HeightField() : _countX(0), _countZ(0), _step(0.0)
+	{}
+
+	/// Copy constructor. If there's not enough memory for the samples, the copy is invalid.
+	HeightField(const HeightField &src) : _countX(0), _countZ(0), _step(0.0)
+	{
+		*this = src;
+	}
+
+	/// Copy assignment. If there's not enough memory for the samples, the copy is invalid.
+	HeightField &operator =(const HeightField &src)
+	{
+		if (this == &src)
+			return *this;
+
+		_countX = src._countX;
+		_countZ = src._countZ;
+		_origin = src._origin;
+		_step = src._step;
+		if (!_heights.CopyFrom(src._heights) || !_normals.CopyFrom(src._normals))
+			Flush();
+
+		return *this;
+	}
+};
+
+
+#endif // HEIGHTFIELD_H__
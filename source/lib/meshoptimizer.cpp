@@ -0,0 +1,413 @@
+#include "meshoptimizer.h"
+
+
+// Score weights, as suggested by Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static const Float CACHE_DECAY_POWER = 1.5;
+static const Float LAST_TRIANGLE_SCORE = 0.75;
+static const Float VALENCE_BOOST_SCALE = 2.0;
+static const Float VALENCE_BOOST_POWER = 0.5;
+
+
+/// Get the distinct corners of a polygon
+/// @return 3 for triangles, 4 for quadrangles
+static Int32 GetCorners(const CPolygon &poly, Int32 *corners)
+{
+	corners[0] = poly.a;
+	corners[1] = poly.b;
+	corners[2] = poly.c;
+	corners[3] = poly.d;
+	return (poly.c == poly.d) ? 3 : 4;
+}
+
+
+/// Get the bucket of a spatial hash cell
+static Int32 GetCellBucket(Int32 cellX, Int32 cellY, Int32 cellZ, Int32 bucketCount)
+{
+	UInt32 hash = ((UInt32)cellX * 73856093u) ^ ((UInt32)cellY * 19349663u) ^ ((UInt32)cellZ * 83492791u);
+	return (Int32)(hash % (UInt32)bucketCount);
+}
+
+
+/// Get the score of a point, higher scores are emitted earlier
+/// @param[in] cachePosition Position in the simulated cache; or NOTOK if not cached
+/// @param[in] remainingPolygons Number of polygons using this point that are not emitted yet
+static Float GetPointScore(Int32 cachePosition, Int32 remainingPolygons)
+{
+	if (remainingPolygons == 0)
+		return -1.0;
+
+	Float score = 0.0;
+	if (cachePosition >= 0)
+	{
+		// Points of the last triangle get a fixed score, so that it's not simply continued
+		if (cachePosition < 3)
+			score = LAST_TRIANGLE_SCORE;
+		else
+			score = Pow(1.0 - (Float)(cachePosition - 3) / (Float)(VERTEX_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+	}
+
+	// Points with few remaining polygons should be finished soon
+	score += VALENCE_BOOST_SCALE * Pow((Float)remainingPolygons, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+
+void VertexCacheStatistics::Add(const PolygonObject *op)
+{
+	if (!op)
+		return;
+
+	const CPolygon *polygonArr = op->GetPolygonR();
+	Int32 polygonCount = op->GetPolygonCount();
+	if (!polygonArr)
+		return;
+
+	Int32 cache[VERTEX_CACHE_SIZE];
+	Int32 cacheCount = 0;
+
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const CPolygon &poly = polygonArr[polygonIndex];
+
+		// Triangles as they're drawn: (a, b, c) and (a, c, d)
+		Int32 vertices[6] = { poly.a, poly.b, poly.c, poly.a, poly.c, poly.d };
+		Int32 vertexCount = (poly.c == poly.d) ? 3 : 6;
+		triangleCount += vertexCount / 3;
+
+		for (Int32 vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex)
+		{
+			Int32 point = vertices[vertexIndex];
+
+			Int32 cachePosition = 0;
+			while (cachePosition < cacheCount && cache[cachePosition] != point)
+				++cachePosition;
+
+			if (cachePosition == cacheCount)
+			{
+				++cacheMisses;
+				if (cacheCount < VERTEX_CACHE_SIZE)
+					++cacheCount;
+				cachePosition = cacheCount - 1;
+			}
+
+			// Move to the front
+			for (; cachePosition > 0; --cachePosition)
+				cache[cachePosition] = cache[cachePosition - 1];
+			cache[0] = point;
+		}
+	}
+}
+
+
+Int32 WeldPoints(PolygonObject *op, Float tolerance, Arena &arena)
+{
+	if (!op || tolerance <= 0.0)
+		return NOTOK;
+
+	Int32 pointCount = op->GetPointCount();
+	Int32 polygonCount = op->GetPolygonCount();
+	if (pointCount == 0)
+		return 0;
+
+	Vector *pointArr = op->GetPointW();
+	CPolygon *polygonArr = op->GetPolygonW();
+	if (!pointArr || (!polygonArr && polygonCount > 0))
+		return NOTOK;
+
+	// Spatial hash with cells as large as the tolerance. Each bucket chains the points that are kept.
+	Int32 bucketCount = pointCount * 2;
+	Int32 *bucketHeads = arena.Alloc<Int32>(bucketCount);
+	Int32 *nextInBucket = arena.Alloc<Int32>(pointCount);
+	Int32 *remap = arena.Alloc<Int32>(pointCount);
+	if (!bucketHeads || !nextInBucket || !remap)
+		return NOTOK;
+
+	for (Int32 i = 0; i < bucketCount; ++i)
+		bucketHeads[i] = NOTOK;
+
+	Float invCellSize = 1.0 / tolerance;
+	Float toleranceSquared = tolerance * tolerance;
+	Int32 keptCount = 0;
+
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+	{
+		const Vector &point = pointArr[pointIndex];
+		Int32 cellX = (Int32)Floor(point.x * invCellSize);
+		Int32 cellY = (Int32)Floor(point.y * invCellSize);
+		Int32 cellZ = (Int32)Floor(point.z * invCellSize);
+
+		// Look for a kept point in this cell and its neighbours
+		Int32 match = NOTOK;
+		for (Int32 offsetZ = -1; offsetZ <= 1 && match == NOTOK; ++offsetZ)
+		{
+			for (Int32 offsetY = -1; offsetY <= 1 && match == NOTOK; ++offsetY)
+			{
+				for (Int32 offsetX = -1; offsetX <= 1 && match == NOTOK; ++offsetX)
+				{
+					Int32 bucket = GetCellBucket(cellX + offsetX, cellY + offsetY, cellZ + offsetZ, bucketCount);
+					for (Int32 keptIndex = bucketHeads[bucket]; keptIndex != NOTOK; keptIndex = nextInBucket[keptIndex])
+					{
+						if ((pointArr[keptIndex] - point).GetSquaredLength() <= toleranceSquared)
+						{
+							match = keptIndex;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if (match != NOTOK)
+		{
+			remap[pointIndex] = remap[match];
+			continue;
+		}
+
+		remap[pointIndex] = keptCount++;
+		Int32 bucket = GetCellBucket(cellX, cellY, cellZ, bucketCount);
+		nextInBucket[pointIndex] = bucketHeads[bucket];
+		bucketHeads[bucket] = pointIndex;
+	}
+
+	if (keptCount == pointCount)
+		return 0;
+
+	// Kept points get increasing indices, so they can be moved to the front in place
+	Int32 writeIndex = 0;
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+	{
+		if (remap[pointIndex] == writeIndex)
+			pointArr[writeIndex++] = pointArr[pointIndex];
+	}
+
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		CPolygon &poly = polygonArr[polygonIndex];
+		poly.a = remap[poly.a];
+		poly.b = remap[poly.b];
+		poly.c = remap[poly.c];
+		poly.d = remap[poly.d];
+	}
+
+	if (!op->ResizeObject(keptCount, polygonCount))
+		return NOTOK;
+
+	op->Message(MSG_UPDATE);
+	return pointCount - keptCount;
+}
+
+
+Bool OptimizeVertexOrder(PolygonObject *op, Arena &arena)
+{
+	if (!op)
+		return false;
+
+	Int32 pointCount = op->GetPointCount();
+	Int32 polygonCount = op->GetPolygonCount();
+	if (pointCount == 0 || polygonCount == 0)
+		return true;
+
+	Vector *pointArr = op->GetPointW();
+	CPolygon *polygonArr = op->GetPolygonW();
+	if (!pointArr || !polygonArr)
+		return false;
+
+	Int32 *pointPolygonStart = arena.Alloc<Int32>(pointCount + 1);
+	Int32 *pointPolygons = arena.Alloc<Int32>(polygonCount * 4);
+	Int32 *remainingPolygons = arena.Alloc<Int32>(pointCount);
+	Int32 *cachePositions = arena.Alloc<Int32>(pointCount);
+	Float *pointScores = arena.Alloc<Float>(pointCount);
+	Float *polygonScores = arena.Alloc<Float>(polygonCount);
+	Bool *polygonEmitted = arena.Alloc<Bool>(polygonCount);
+	Int32 *polygonOrder = arena.Alloc<Int32>(polygonCount);
+	Int32 *pointRemap = arena.Alloc<Int32>(pointCount);
+	if (!pointPolygonStart || !pointPolygons || !remainingPolygons || !cachePositions || !pointScores || !polygonScores || !polygonEmitted || !polygonOrder || !pointRemap)
+		return false;
+
+	Int32 corners[4];
+
+	// Polygons attached to each point, stored consecutively
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+		remainingPolygons[pointIndex] = 0;
+
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		Int32 cornerCount = GetCorners(polygonArr[polygonIndex], corners);
+		for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+			++remainingPolygons[corners[cornerIndex]];
+	}
+
+	pointPolygonStart[0] = 0;
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+	{
+		pointPolygonStart[pointIndex + 1] = pointPolygonStart[pointIndex] + remainingPolygons[pointIndex];
+		remainingPolygons[pointIndex] = 0;
+	}
+
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		Int32 cornerCount = GetCorners(polygonArr[polygonIndex], corners);
+		for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+		{
+			Int32 point = corners[cornerIndex];
+			pointPolygons[pointPolygonStart[point] + remainingPolygons[point]++] = polygonIndex;
+		}
+	}
+
+	// Initial scores
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+	{
+		cachePositions[pointIndex] = NOTOK;
+		pointScores[pointIndex] = GetPointScore(NOTOK, remainingPolygons[pointIndex]);
+	}
+
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		Int32 cornerCount = GetCorners(polygonArr[polygonIndex], corners);
+		polygonScores[polygonIndex] = 0.0;
+		for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+			polygonScores[polygonIndex] += pointScores[corners[cornerIndex]];
+		polygonEmitted[polygonIndex] = false;
+	}
+
+	// Simulated cache, with room for the corners of one more polygon
+	Int32 cache[VERTEX_CACHE_SIZE + 4];
+	Int32 newCache[VERTEX_CACHE_SIZE + 4];
+	Int32 cacheCount = 0;
+
+	Int32 bestPolygon = NOTOK;
+	for (Int32 emittedCount = 0; emittedCount < polygonCount; ++emittedCount)
+	{
+		// No candidate in the cache, take the best of all remaining polygons
+		if (bestPolygon == NOTOK)
+		{
+			Float bestScore = -1.0;
+			for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+			{
+				if (!polygonEmitted[polygonIndex] && polygonScores[polygonIndex] > bestScore)
+				{
+					bestScore = polygonScores[polygonIndex];
+					bestPolygon = polygonIndex;
+				}
+			}
+		}
+
+		polygonOrder[emittedCount] = bestPolygon;
+		polygonEmitted[bestPolygon] = true;
+
+		// Corners of the emitted polygon go to the front of the cache
+		Int32 cornerCount = GetCorners(polygonArr[bestPolygon], corners);
+		Int32 newCacheCount = 0;
+		for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+		{
+			--remainingPolygons[corners[cornerIndex]];
+			newCache[newCacheCount++] = corners[cornerIndex];
+		}
+
+		for (Int32 cacheIndex = 0; cacheIndex < cacheCount; ++cacheIndex)
+		{
+			Int32 point = cache[cacheIndex];
+			Bool isCorner = false;
+			for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+				isCorner |= (corners[cornerIndex] == point);
+			if (!isCorner)
+				newCache[newCacheCount++] = point;
+		}
+
+		// Update the scores of all points that were in the cache, including the ones that dropped out
+		for (Int32 cacheIndex = 0; cacheIndex < newCacheCount; ++cacheIndex)
+		{
+			Int32 point = newCache[cacheIndex];
+			cachePositions[point] = (cacheIndex < VERTEX_CACHE_SIZE) ? cacheIndex : NOTOK;
+			pointScores[point] = GetPointScore(cachePositions[point], remainingPolygons[point]);
+		}
+
+		// The next polygon is the best one that uses a cached point
+		bestPolygon = NOTOK;
+		Float bestScore = -1.0;
+		for (Int32 cacheIndex = 0; cacheIndex < newCacheCount; ++cacheIndex)
+		{
+			Int32 point = newCache[cacheIndex];
+			for (Int32 i = pointPolygonStart[point]; i < pointPolygonStart[point + 1]; ++i)
+			{
+				Int32 polygonIndex = pointPolygons[i];
+				if (polygonEmitted[polygonIndex])
+					continue;
+
+				Int32 polygonCornerCount = GetCorners(polygonArr[polygonIndex], corners);
+				Float score = 0.0;
+				for (Int32 cornerIndex = 0; cornerIndex < polygonCornerCount; ++cornerIndex)
+					score += pointScores[corners[cornerIndex]];
+				polygonScores[polygonIndex] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestPolygon = polygonIndex;
+				}
+			}
+		}
+
+		cacheCount = Min(newCacheCount, VERTEX_CACHE_SIZE);
+		for (Int32 cacheIndex = 0; cacheIndex < cacheCount; ++cacheIndex)
+			cache[cacheIndex] = newCache[cacheIndex];
+	}
+
+	// Points in order of first use, unused points at the end
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+		pointRemap[pointIndex] = NOTOK;
+
+	Int32 nextPoint = 0;
+	for (Int32 orderIndex = 0; orderIndex < polygonCount; ++orderIndex)
+	{
+		Int32 cornerCount = GetCorners(polygonArr[polygonOrder[orderIndex]], corners);
+		for (Int32 cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex)
+		{
+			if (pointRemap[corners[cornerIndex]] == NOTOK)
+				pointRemap[corners[cornerIndex]] = nextPoint++;
+		}
+	}
+
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+	{
+		if (pointRemap[pointIndex] == NOTOK)
+			pointRemap[pointIndex] = nextPoint++;
+	}
+
+	// Write points, polygons and UVWs in their new order
+	Vector *oldPoints = arena.Alloc<Vector>(pointCount);
+	CPolygon *oldPolygons = arena.Alloc<CPolygon>(polygonCount);
+	if (!oldPoints || !oldPolygons)
+		return false;
+
+	CopyMem(pointArr, oldPoints, sizeof(Vector) * pointCount);
+	CopyMem(polygonArr, oldPolygons, sizeof(CPolygon) * polygonCount);
+
+	for (Int32 pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+		pointArr[pointRemap[pointIndex]] = oldPoints[pointIndex];
+
+	for (Int32 orderIndex = 0; orderIndex < polygonCount; ++orderIndex)
+	{
+		const CPolygon &oldPoly = oldPolygons[polygonOrder[orderIndex]];
+		polygonArr[orderIndex] = CPolygon(pointRemap[oldPoly.a], pointRemap[oldPoly.b], pointRemap[oldPoly.c], pointRemap[oldPoly.d]);
+	}
+
+	UVWTag *uvwTag = static_cast<UVWTag*>(op->GetTag(Tuvw));
+	if (uvwTag)
+	{
+		UVWStruct *oldUVWs = arena.Alloc<UVWStruct>(polygonCount);
+		if (!oldUVWs)
+			return false;
+
+		ConstUVWHandle uvwRead = uvwTag->GetDataAddressR();
+		for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+			UVWTag::Get(uvwRead, polygonIndex, oldUVWs[polygonIndex]);
+
+		UVWHandle uvwWrite = uvwTag->GetDataAddressW();
+		for (Int32 orderIndex = 0; orderIndex < polygonCount; ++orderIndex)
+			UVWTag::Set(uvwWrite, orderIndex, oldUVWs[polygonOrder[orderIndex]]);
+	}
+
+	op->Message(MSG_UPDATE);
+	return true;
+}
@@ -0,0 +1,56 @@
+#ifndef MESHOPTIMIZER_H__
+#define MESHOPTIMIZER_H__
+
+#include "c4d.h"
+#include "arena.h"
+
+
+/// Number of vertices in the simulated post-transform vertex cache
+static const Int32 VERTEX_CACHE_SIZE = 32;
+
+
+/// Post-transform vertex cache statistics of one or more polygon objects, simulated with an LRU cache
+struct VertexCacheStatistics
+{
+	Int cacheMisses;
+	Int triangleCount;
+
+	/// Add the polygons of an object. Quadrangles count as two triangles.
+	void Add(const PolygonObject *op);
+
+	/// Get the average cache miss ratio: Transformed vertices per triangle
+	Float GetACMR() const
+	{
+		return triangleCount > 0 ? (Float)cacheMisses / (Float)triangleCount : 0.0;
+	}
+
+	/// Set all counters to zero
+	void Reset()
+	{
+		cacheMisses = 0;
+		triangleCount = 0;
+	}
+
+	/// Default constructor
+	VertexCacheStatistics() : cacheMisses(0), triangleCount(0)
+	{}
+};
+
+
+/// Merge points that are closer to each other than a tolerance, and remap the polygons.
+/// UVWs are stored per polygon and stay valid. Point based tags are not remapped.
+/// @param[in] op The polygon object
+/// @param[in] tolerance Maximum distance of merged points
+/// @param[in] arena Receives temporary data
+/// @return Number of removed points; or NOTOK if an error occurred
+Int32 WeldPoints(PolygonObject *op, Float tolerance, Arena &arena);
+
+/// Reorder polygons for post-transform vertex cache locality (Forsyth), then points in order of first use.
+/// UVWs are reordered along with the polygons. Other point or polygon based tags are not.
+/// @param[in] op The polygon object
+/// @param[in] arena Receives temporary data
+/// @return False if an error occurred; otherwise true
+Bool OptimizeVertexOrder(PolygonObject *op, Arena &arena);
+
+
+#endif // MESHOPTIMIZER_H__
@@ -0,0 +1,248 @@
+#include "objectpool.h"
+
+
+void ObjectPool::Recycle(BaseObject *op)
+{
+	if (!op)
+		return;
+
+	// Children first, pooled objects never have any
+	while (op->GetDown())
+		Recycle(op->GetDown());
+
+	op->Remove();
+
+	maxon::BaseArray<BaseObject*> *bucket = GetObjectBucket(op->GetType());
+	if (!bucket)
+	{
+		BaseObject::Free(op);
+		return;
+	}
+
+	RecycleTags(op);
+	op->SetMl(Matrix());
+	op->SetName(String());
+	op->SetEditorMode(MODE_UNDEF);
+	op->SetRenderMode(MODE_UNDEF);
+
+	if (!bucket->Append(op))
+		BaseObject::Free(op);
+}
+
+
+BaseObject *ObjectPool::GetObject(Int32 type)
+{
+	maxon::BaseArray<BaseObject*> *bucket = GetObjectBucket(type);
+
+	BaseObject *op = nullptr;
+	_lock.Lock();
+	Bool popped = bucket && bucket->Pop(&op);
+	_lock.Unlock();
+
+	if (popped)
+	{
+		// Generators have to rebuild with their new parameters
+		op->SetDirty(DIRTYFLAGS_DATA);
+		return op;
+	}
+
+	CountAllocation();
+	return BaseObject::Alloc(type);
+}
+
+
+PolygonObject *ObjectPool::GetPolygonObject(Int32 pointCount, Int32 polygonCount, Bool uvw)
+{
+	PolygonObject *poly = PopPolygonObject(pointCount, polygonCount);
+	if (!poly)
+	{
+		CountAllocation();
+		poly = PolygonObject::Alloc(pointCount, polygonCount);
+		if (!poly)
+			return nullptr;
+	}
+
+	if (!uvw)
+	{
+		poly->KillTag(Tuvw);
+		return poly;
+	}
+
+	// An existing UVW tag has already been resized, the caller writes all of it
+	if (!poly->GetTag(Tuvw))
+	{
+		CountAllocation();
+		if (!poly->MakeVariableTag(Tuvw, polygonCount))
+		{
+			PolygonObject::Free(poly);
+			return nullptr;
+		}
+	}
+
+	return poly;
+}
+
+
+PolygonObject *ObjectPool::GetPolygonCopy(PolygonObject *source)
+{
+	if (!source)
+		return nullptr;
+
+	Int32 pointCount = source->GetPointCount();
+	Int32 polygonCount = source->GetPolygonCount();
+
+	PolygonObject *poly = PopPolygonObject(pointCount, polygonCount);
+	if (!poly)
+	{
+		CountAllocation();
+		return static_cast<PolygonObject*>(source->GetClone(COPYFLAGS_0, nullptr));
+	}
+
+	// Points and polygons
+	CopyMem(source->GetPointR(), poly->GetPointW(), sizeof(Vector) * pointCount);
+	CopyMem(source->GetPolygonR(), poly->GetPolygonW(), sizeof(CPolygon) * polygonCount);
+
+	// UVWs, the existing tag has already been resized
+	UVWTag *sourceUVW = static_cast<UVWTag*>(source->GetTag(Tuvw));
+	if (sourceUVW)
+	{
+		UVWTag *uvw = static_cast<UVWTag*>(poly->GetTag(Tuvw));
+		if (!uvw)
+		{
+			CountAllocation();
+			uvw = static_cast<UVWTag*>(poly->MakeVariableTag(Tuvw, polygonCount));
+			if (!uvw)
+			{
+				PolygonObject::Free(poly);
+				return nullptr;
+			}
+		}
+
+		CopyMem(sourceUVW->GetLowlevelDataAddressR(), uvw->GetLowlevelDataAddressW(), sourceUVW->GetDataSize() * polygonCount);
+	}
+	else
+	{
+		poly->KillTag(Tuvw);
+	}
+
+	return poly;
+}
+
+
+BaseTag *ObjectPool::GetTag(Int32 type)
+{
+	maxon::BaseArray<BaseTag*> *bucket = GetTagBucket(type);
+
+	BaseTag *tag = nullptr;
+	_lock.Lock();
+	Bool popped = bucket && bucket->Pop(&tag);
+	_lock.Unlock();
+
+	if (popped)
+		return tag;
+
+	CountAllocation();
+	return BaseTag::Alloc(type);
+}
+
+
+void ObjectPool::Flush()
+{
+	maxon::BaseArray<BaseObject*> *objectBuckets[] = { &_nullObjects, &_cubeObjects, &_polygonObjects, &_instanceObjects };
+	for (Int32 bucketIndex = 0; bucketIndex < 4; ++bucketIndex)
+	{
+		maxon::BaseArray<BaseObject*> &bucket = *objectBuckets[bucketIndex];
+		for (Int i = 0; i < bucket.GetCount(); ++i)
+			BaseObject::Free(bucket[i]);
+		bucket.Reset();
+	}
+
+	maxon::BaseArray<BaseTag*> *tagBuckets[] = { &_phongTags, &_textureTags };
+	for (Int32 bucketIndex = 0; bucketIndex < 2; ++bucketIndex)
+	{
+		maxon::BaseArray<BaseTag*> &bucket = *tagBuckets[bucketIndex];
+		for (Int i = 0; i < bucket.GetCount(); ++i)
+			BaseTag::Free(bucket[i]);
+		bucket.Reset();
+	}
+}
+
+
+maxon::BaseArray<BaseObject*> *ObjectPool::GetObjectBucket(Int32 type)
+{
+	switch (type)
+	{
+		case Onull:
+			return &_nullObjects;
+		case Ocube:
+			return &_cubeObjects;
+		case Opolygon:
+			return &_polygonObjects;
+		case Oinstance:
+			return &_instanceObjects;
+	}
+
+	return nullptr;
+}
+
+
+maxon::BaseArray<BaseTag*> *ObjectPool::GetTagBucket(Int32 type)
+{
+	switch (type)
+	{
+		case Tphong:
+			return &_phongTags;
+		case Ttexture:
+			return &_textureTags;
+	}
+
+	return nullptr;
+}
+
+
+PolygonObject *ObjectPool::PopPolygonObject(Int32 pointCount, Int32 polygonCount)
+{
+	BaseObject *op = nullptr;
+	_lock.Lock();
+	Bool popped = _polygonObjects.Pop(&op);
+	_lock.Unlock();
+
+	if (!popped)
+		return nullptr;
+
+	PolygonObject *poly = ToPoly(op);
+	if (!poly->ResizeObject(pointCount, polygonCount))
+	{
+		BaseObject::Free(op);
+		return nullptr;
+	}
+
+	poly->SetDirty(DIRTYFLAGS_DATA);
+	return poly;
+}
+
+
+void ObjectPool::RecycleTags(BaseObject *op)
+{
+	BaseTag *tag = op->GetFirstTag();
+	while (tag)
+	{
+		BaseTag *nextTag = tag->GetNext();
+		Int32 tagType = tag->GetType();
+
+		maxon::BaseArray<BaseTag*> *bucket = GetTagBucket(tagType);
+		if (bucket)
+		{
+			tag->Remove();
+			if (!bucket->Append(tag))
+				BaseTag::Free(tag);
+		}
+		else if (tagType != Tpoint && tagType != Tpolygon && tagType != Tuvw)
+		{
+			tag->Remove();
+			BaseTag::Free(tag);
+		}
+
+		tag = nextTag;
+	}
+}
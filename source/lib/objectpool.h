@@ -0,0 +1,99 @@
+#ifndef OBJECTPOOL_H__
+#define OBJECTPOOL_H__
+
+#include "c4d.h"
+
+
+/// Keeps the objects and tags of a previous result, so the next build can reuse them instead of allocating new ones.
+/// Objects are pooled by type: null objects, cube primitives, polygon objects and instances. Phong and texture tags are pooled separately.
+/// Objects and tags may be taken from several threads at once. Recycle() and Flush() must not run concurrently with anything else.
+class ObjectPool
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(ObjectPool);
+
+public:
+	/// Take an object and all of its children out of their hierarchy and keep them for reuse.
+	/// Objects of types that are not pooled are freed.
+	/// @param[in] op The object. It's removed from its hierarchy, the pool owns it afterwards.
+	void Recycle(BaseObject *op);
+
+	/// Get an object of a pooled type, or allocate a new one
+	/// @param[in] type Onull, Ocube or Oinstance
+	/// @return Pointer to the object, with reset matrix, visibility and no name. Caller owns the pointed object.
+	BaseObject *GetObject(Int32 type);
+
+	/// Get an empty polygon object with a certain number of points and polygons
+	/// @param[in] uvw True to get a UVW tag with one entry per polygon, its contents are undefined; false for none
+	/// @return Pointer to the polygon object; or nullptr if an error occurred. Caller owns the pointed object.
+	PolygonObject *GetPolygonObject(Int32 pointCount, Int32 polygonCount, Bool uvw);
+
+	/// Get a polygon object with the same points, polygons and UVWs as source. Other tags are not copied.
+	/// @return Pointer to the polygon object; or nullptr if an error occurred. Caller owns the pointed object.
+	PolygonObject *GetPolygonCopy(PolygonObject *source);
+
+	/// Get a tag of a pooled type, or allocate a new one
+	/// @param[in] type Tphong or Ttexture
+	/// @return Pointer to the tag. Caller owns the pointed tag.
+	BaseTag *GetTag(Int32 type);
+
+	/// Free everything that is still in the pool
+	void Flush();
+
+	/// Get the number of objects and tags that had to be allocated since the last reset
+	Int GetAllocationCount() const
+	{
+		return _allocationCount;
+	}
+
+	/// Set the allocation counter to zero
+	void ResetAllocationCount()
+	{
+		_allocationCount = 0;
+	}
+
+private:
+	/// Get the bucket for an object type; or nullptr if the type is not pooled
+	maxon::BaseArray<BaseObject*> *GetObjectBucket(Int32 type);
+
+	/// Get the bucket for a tag type; or nullptr if the type is not pooled
+	maxon::BaseArray<BaseTag*> *GetTagBucket(Int32 type);
+
+	/// Take a polygon object from the pool and resize it. Its variable tags are resized, too.
+	/// @return Pointer to the polygon object; or nullptr if the pool is empty. Caller owns the pointed object.
+	PolygonObject *PopPolygonObject(Int32 pointCount, Int32 polygonCount);
+
+	/// Move an object's phong and texture tags to the pool. Other tags, except points, polygons and UVWs, are freed.
+	void RecycleTags(BaseObject *op);
+
+	/// Count an allocation that was necessary because the pool was empty
+	void CountAllocation()
+	{
+		_lock.Lock();
+		++_allocationCount;
+		_lock.Unlock();
+	}
+
+private:
+	maxon::BaseArray<BaseObject*> _nullObjects;
+	maxon::BaseArray<BaseObject*> _cubeObjects;
+	maxon::BaseArray<BaseObject*> _polygonObjects;
+	maxon::BaseArray<BaseObject*> _instanceObjects;
+	maxon::BaseArray<BaseTag*> _phongTags;
+	maxon::BaseArray<BaseTag*> _textureTags;
+	Int _allocationCount;
+	GeSpinlock _lock;  ///< Protects the buckets and the counter while taking objects and tags
+
+public:
+	/// Default constructor
+	ObjectPool() : _allocationCount(0)
+	{}
+
+	/// Destructor, frees everything that is still in the pool
+	~ObjectPool()
+	{
+		Flush();
+	}
+};
+
+
+#endif // OBJECTPOOL_H__
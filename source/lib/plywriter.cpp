@@ -0,0 +1,190 @@
+#include "plywriter.h"
+
+
+// Size of each write buffer in bytes
+static const Int WRITE_BUFFER_SIZE = 1 << 20;
+
+// Counts in the header are padded to this many characters, so they can be written when closing
+static const Int32 HEADER_COUNT_WIDTH = 20;
+
+
+/// Write a C string to a file
+static Bool WriteCString(BaseFile *file, const Char *text)
+{
+	return file->WriteBytes(text, strlen(text));
+}
+
+
+/// Write a count, padded with spaces to HEADER_COUNT_WIDTH
+static Bool WriteHeaderCount(BaseFile *file, Int count)
+{
+	Char text[HEADER_COUNT_WIDTH + 1];
+	String countString = String::IntToString((Int64)count);
+	countString.GetCString(text, HEADER_COUNT_WIDTH + 1, STRINGENCODING_7BIT);
+	for (Int32 i = (Int32)strlen(text); i < HEADER_COUNT_WIDTH; ++i)
+		text[i] = ' ';
+	return file->WriteBytes(text, HEADER_COUNT_WIDTH);
+}
+
+
+Bool PlyWriter::Open(const Filename &file)
+{
+	Abort();
+
+	if (!_file || !_faceFile)
+		return false;
+
+	_vertexBuffer = NewMem(Char, WRITE_BUFFER_SIZE);
+	_faceBuffer = NewMem(Char, WRITE_BUFFER_SIZE);
+	if (!_vertexBuffer || !_faceBuffer)
+		return false;
+
+	_faceFilename = Filename(file.GetString() + ".faces");
+	if (!_file->Open(file, FILEOPEN_WRITE, FILEDIALOG_NONE) || !_faceFile->Open(_faceFilename, FILEOPEN_WRITE, FILEDIALOG_NONE))
+	{
+		Abort();
+		return false;
+	}
+	_open = true;
+
+	_vertexBufferFill = 0;
+	_faceBufferFill = 0;
+	_vertexCount = 0;
+	_faceCount = 0;
+
+	// Header, the counts are filled in when closing
+	if (!WriteCString(_file, "ply\nformat binary_little_endian 1.0\ncomment Sidewalk\nelement vertex "))
+		return false;
+	_vertexCountOffset = _file->GetPosition();
+	if (!WriteHeaderCount(_file, 0))
+		return false;
+
+	if (!WriteCString(_file, "\nproperty float x\nproperty float y\nproperty float z\nelement face "))
+		return false;
+	_faceCountOffset = _file->GetPosition();
+	if (!WriteHeaderCount(_file, 0))
+		return false;
+
+	return WriteCString(_file, "\nproperty list uchar int vertex_indices\nend_header\n");
+}
+
+
+Bool PlyWriter::WritePolygons(const Vector *pointArr, Int32 pointCount, const CPolygon *polygonArr, Int32 polygonCount, const Matrix &matrix)
+{
+	if (!_open || !pointArr || !polygonArr)
+		return false;
+
+	// Indices are 32 bit signed in the file
+	if (_vertexCount + pointCount > LIMIT<Int32>::MAX)
+		return false;
+
+	Int32 firstIndex = (Int32)_vertexCount;
+
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		Vector point = matrix * pointArr[i];
+		Float32 coordinates[3] = { (Float32)point.x, (Float32)point.y, (Float32)point.z };
+		if (!Append(_vertexBuffer, _vertexBufferFill, _file, coordinates, sizeof(coordinates)))
+			return false;
+	}
+
+	for (Int32 i = 0; i < polygonCount; ++i)
+	{
+		const CPolygon &polygon = polygonArr[i];
+
+		// Index count, followed by the indices
+		Char face[1 + 4 * sizeof(Int32)];
+		UChar cornerCount = (polygon.c == polygon.d) ? 3 : 4;
+		Int32 indices[4] = { firstIndex + polygon.a, firstIndex + polygon.b, firstIndex + polygon.c, firstIndex + polygon.d };
+		face[0] = (Char)cornerCount;
+		CopyMem(indices, face + 1, sizeof(Int32) * cornerCount);
+
+		if (!Append(_faceBuffer, _faceBufferFill, _faceFile, face, 1 + sizeof(Int32) * cornerCount))
+			return false;
+	}
+
+	_vertexCount += pointCount;
+	_faceCount += polygonCount;
+	return true;
+}
+
+
+Bool PlyWriter::Close()
+{
+	if (!_open)
+		return false;
+
+	// Write what's left in the buffers
+	if (!_file->WriteBytes(_vertexBuffer, _vertexBufferFill) || !_faceFile->WriteBytes(_faceBuffer, _faceBufferFill))
+	{
+		Abort();
+		return false;
+	}
+	_vertexBufferFill = 0;
+	_faceBufferFill = 0;
+
+	// Append the faces to the vertices, block by block
+	_faceFile->Close();
+	if (!_faceFile->Open(_faceFilename, FILEOPEN_READ, FILEDIALOG_NONE))
+	{
+		Abort();
+		return false;
+	}
+
+	Int64 remaining = _faceFile->GetLength();
+	while (remaining > 0)
+	{
+		Int blockSize = (Int)Min(remaining, (Int64)WRITE_BUFFER_SIZE);
+		if (_faceFile->ReadBytes(_faceBuffer, blockSize) != blockSize || !_file->WriteBytes(_faceBuffer, blockSize))
+		{
+			Abort();
+			return false;
+		}
+		remaining -= blockSize;
+	}
+
+	// Complete the header
+	Bool success = _file->Seek(_vertexCountOffset, FILESEEK_START) && WriteHeaderCount(_file, _vertexCount) &&
+	               _file->Seek(_faceCountOffset, FILESEEK_START) && WriteHeaderCount(_file, _faceCount);
+	if (!success)
+	{
+		Abort();
+		return false;
+	}
+
+	success = _file->Close();
+	Abort();
+	return success;
+}
+
+
+Bool PlyWriter::Append(Char *buffer, Int &bufferFill, BaseFile *file, const void *data, Int size)
+{
+	if (bufferFill + size > WRITE_BUFFER_SIZE)
+	{
+		if (!file->WriteBytes(buffer, bufferFill))
+			return false;
+		bufferFill = 0;
+	}
+
+	CopyMem(data, buffer + bufferFill, size);
+	bufferFill += size;
+	return true;
+}
+
+
+void PlyWriter::Abort()
+{
+	if (_file)
+		_file->Close();
+
+	if (_faceFile)
+		_faceFile->Close();
+
+	if (_open)
+		GeFKill(_faceFilename);
+	_open = false;
+
+	DeleteMem(_vertexBuffer);
+	DeleteMem(_faceBuffer);
+}
@@ -0,0 +1,84 @@
+#ifndef PLYWRITER_H__
+#define PLYWRITER_H__
+
+#include "c4d.h"
+
+
+/// Writes polygons to a binary PLY file as they come, without keeping them in memory.
+/// PLY wants all vertices before all faces, so faces go to a temporary file first and are appended when closing.
+/// Memory is bounded by two fixed write buffers, no matter how much geometry is written.
+class PlyWriter
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(PlyWriter);
+
+public:
+	/// Create the file and write the header
+	/// @return False if an error occurred; otherwise true
+	Bool Open(const Filename &file);
+
+	/// Append polygons
+	/// @param[in] pointArr The points, relative to matrix
+	/// @param[in] polygonArr The polygons, triangles have c == d
+	/// @param[in] matrix Transforms the points to global space
+	/// @return False if an error occurred; otherwise true
+	Bool WritePolygons(const Vector *pointArr, Int32 pointCount, const CPolygon *polygonArr, Int32 polygonCount, const Matrix &matrix);
+
+	/// Append all polygons of a polygon object
+	/// @param[in] matrix Global matrix of the object
+	/// @return False if an error occurred; otherwise true
+	Bool WriteObject(const PolygonObject *op, const Matrix &matrix)
+	{
+		return op && WritePolygons(op->GetPointR(), op->GetPointCount(), op->GetPolygonR(), op->GetPolygonCount(), matrix);
+	}
+
+	/// Append the faces to the vertices, complete the header and close the file
+	/// @return False if an error occurred; otherwise true
+	Bool Close();
+
+	/// Get the number of vertices written so far
+	Int GetVertexCount() const
+	{
+		return _vertexCount;
+	}
+
+	/// Get the number of faces written so far
+	Int GetFaceCount() const
+	{
+		return _faceCount;
+	}
+
+private:
+	/// Add bytes to a write buffer. A full buffer is written to its file first.
+	Bool Append(Char *buffer, Int &bufferFill, BaseFile *file, const void *data, Int size);
+
+	/// Close both files without completing them, and delete the temporary face file
+	void Abort();
+
+private:
+	AutoAlloc<BaseFile> _file;      ///< The PLY file, receives header and vertices
+	AutoAlloc<BaseFile> _faceFile;  ///< Temporary file for the faces
+	Filename _faceFilename;
+	Char *_vertexBuffer;
+	Char *_faceBuffer;
+	Int _vertexBufferFill;
+	Int _faceBufferFill;
+	Int _vertexCount;
+	Int _faceCount;
+	Int64 _vertexCountOffset;       ///< Position of the vertex count in the header
+	Int64 _faceCountOffset;         ///< Position of the face count in the header
+	Bool _open;
+
+public:
+	/// Default constructor
+	PlyWriter() : _vertexBuffer(nullptr), _faceBuffer(nullptr), _vertexBufferFill(0), _faceBufferFill(0), _vertexCount(0), _faceCount(0), _vertexCountOffset(0), _faceCountOffset(0), _open(false)
+	{}
+
+	/// Destructor, an incomplete file is closed and its temporary face file deleted
+	~PlyWriter()
+	{
+		Abort();
+	}
+};
+
+
+#endif // PLYWRITER_H__
@@ -0,0 +1,97 @@
+#include "pointbuffer.h"
+
+
+// Largest quantized value
+static const Float QUANTIZATION_MAX = 65535.0;
+
+
+Bool PointBuffer::Set(const Vector *pointArr, Int32 pointCount, Bool quantize)
+{
+	Flush();
+
+	if (!pointArr || pointCount < 0)
+		return false;
+
+	_count = pointCount;
+	_quantized = quantize;
+
+	if (!quantize)
+	{
+		if (!_x.Resize(pointCount) || !_y.Resize(pointCount) || !_z.Resize(pointCount))
+			return false;
+
+		for (Int32 i = 0; i < pointCount; ++i)
+		{
+			_x[i] = (Float32)pointArr[i].x;
+			_y[i] = (Float32)pointArr[i].y;
+			_z[i] = (Float32)pointArr[i].z;
+		}
+
+		return true;
+	}
+
+	if (!_quantizedX.Resize(pointCount) || !_quantizedY.Resize(pointCount) || !_quantizedZ.Resize(pointCount))
+		return false;
+
+	// Bounding box
+	Vector boxMin(MAXVALUE_FLOAT), boxMax(MINVALUE_FLOAT);
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		boxMin = Vector(Min(boxMin.x, pointArr[i].x), Min(boxMin.y, pointArr[i].y), Min(boxMin.z, pointArr[i].z));
+		boxMax = Vector(Max(boxMax.x, pointArr[i].x), Max(boxMax.y, pointArr[i].y), Max(boxMax.z, pointArr[i].z));
+	}
+
+	if (pointCount == 0)
+		boxMin = boxMax = Vector();
+
+	// Flat boxes don't need any steps
+	Vector boxSize = boxMax - boxMin;
+	_boxMin = (Vector32)boxMin;
+	_boxScale = (Vector32)(boxSize / QUANTIZATION_MAX);
+
+	Vector invStep(boxSize.x > 0.0 ? QUANTIZATION_MAX / boxSize.x : 0.0,
+	               boxSize.y > 0.0 ? QUANTIZATION_MAX / boxSize.y : 0.0,
+	               boxSize.z > 0.0 ? QUANTIZATION_MAX / boxSize.z : 0.0);
+
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		Vector relative = (pointArr[i] - boxMin) * invStep;
+		_quantizedX[i] = (UInt16)ClampValue(Round(relative.x), 0.0, QUANTIZATION_MAX);
+		_quantizedY[i] = (UInt16)ClampValue(Round(relative.y), 0.0, QUANTIZATION_MAX);
+		_quantizedZ[i] = (UInt16)ClampValue(Round(relative.z), 0.0, QUANTIZATION_MAX);
+	}
+
+	return true;
+}
+
+
+void PointBuffer::Get(Vector *pointArr) const
+{
+	if (!pointArr)
+		return;
+
+	for (Int32 i = 0; i < _count; ++i)
+		pointArr[i] = GetPoint(i);
+}
+
+
+Int PointBuffer::GetMemorySize() const
+{
+	if (_quantized)
+		return _count * 3 * sizeof(UInt16);
+
+	return _count * 3 * sizeof(Float32);
+}
+
+
+void PointBuffer::Flush()
+{
+	_x.Flush();
+	_y.Flush();
+	_z.Flush();
+	_quantizedX.Flush();
+	_quantizedY.Flush();
+	_quantizedZ.Flush();
+	_count = 0;
+	_quantized = false;
+}
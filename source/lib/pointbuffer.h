@@ -0,0 +1,70 @@
+#ifndef POINTBUFFER_H__
+#define POINTBUFFER_H__
+
+#include "c4d.h"
+
+
+/// Host-independent storage for points or normals.
+/// Coordinates are kept as float32 in separate arrays per axis (SoA). Optionally, they're quantized to 16 bits relative to their bounding box.
+/// Conversion to and from Vector only happens when points are set or read.
+class PointBuffer
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(PointBuffer);
+
+public:
+	/// Store points
+	/// @param[in] pointArr The points
+	/// @param[in] pointCount Number of points
+	/// @param[in] quantize Store 16 bits per coordinate instead of 32
+	/// @return False if an error occurred; otherwise true
+	Bool Set(const Vector *pointArr, Int32 pointCount, Bool quantize);
+
+	/// Write all points to an array of vectors
+	/// @param[out] pointArr Receives the points, must have room for GetCount() elements
+	void Get(Vector *pointArr) const;
+
+	/// Get a single point
+	Vector GetPoint(Int32 index) const
+	{
+		if (_quantized)
+			return Vector(_boxMin.x + _boxScale.x * _quantizedX[index], _boxMin.y + _boxScale.y * _quantizedY[index], _boxMin.z + _boxScale.z * _quantizedZ[index]);
+
+		return Vector(_x[index], _y[index], _z[index]);
+	}
+
+	/// Get the number of points
+	Int32 GetCount() const
+	{
+		return _count;
+	}
+
+	/// Get the number of bytes used by the coordinates
+	Int GetMemorySize() const;
+
+	/// Remove all points, but keep the memory
+	void Flush();
+
+private:
+	// Float32 coordinates
+	maxon::BaseArray<Float32> _x;
+	maxon::BaseArray<Float32> _y;
+	maxon::BaseArray<Float32> _z;
+
+	// Quantized coordinates, relative to the bounding box
+	maxon::BaseArray<UInt16> _quantizedX;
+	maxon::BaseArray<UInt16> _quantizedY;
+	maxon::BaseArray<UInt16> _quantizedZ;
+	Vector32 _boxMin;
+	Vector32 _boxScale;  ///< Size of one quantization step
+
+	Int32 _count;
+	Bool _quantized;
+
+public:
+	/// Default constructor
+	PointBuffer() : _count(0), _quantized(false)
+	{}
+};
+
+
+#endif // POINTBUFFER_H__
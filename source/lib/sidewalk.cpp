@@ -3,536 +3,3440 @@
 #include "c4d_symbols.h"
 
 
-BaseObject *Sidewalk::Build(BaseContainer *bc, BaseDocument *doc)
+// Maximum distance of prototype points that are welded
+static const Float WELD_TOLERANCE = 0.0001;
+
+// Collision boxes are at least this thick, flat elements like the dirt plane get a slab
+static const Float COLLISION_MIN_THICKNESS = 1.0;
+
+// Instances are followed into the linked object only this deep
+static const Int32 COLLISION_MAX_LINK_DEPTH = 16;
+
+// Element IDs hold two indices of 16 bits each, see NameElement(). Counts of elements are limited so their indices fit.
+static const Int32 MAX_ELEMENT_INDEX_COUNT = 0x10000;
+
+// Container entry that holds the ID of an element. It's the plugin ID of the sidewalk object, so it doesn't collide with the parameters of the element's own type.
+static const Int32 ELEMENT_ID_ENTRY = 1024588;
+
+// Modeling commands are not thread safe. Builds and streams on any thread polygonize through MakeEditable(), they take turns.
+static GeSpinlock g_makeEditableLock;
+
+// Number of samples per element length in the arc length table of a spline path
+static const Float PATH_SAMPLES_PER_ELEMENT = 8.0;
+
+// Number of outline points per element size of a footprint
+static const Float FOOTPRINT_SAMPLES_PER_ELEMENT = 8.0;
+
+// Number of terrain height samples per element size
+static const Float TERRAIN_SAMPLES_PER_ELEMENT = 4.0;
+
+// Offset basis and prime of the 64 bit FNV-1a hash
+static const UInt64 HASH_OFFSET_BASIS = 14695981039346656037ULL;
+static const UInt64 HASH_PRIME = 1099511628211ULL;
+
+
+/// Add bytes to a FNV-1a hash
+static void HashBytes(UInt64 &hash, const void *data, Int size)
 {
-	// Cancel if invalid pointers
-	if (!bc || !doc)
+	const UChar *bytes = static_cast<const UChar*>(data);
+	for (Int i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+	}
+}
+
+
+/// Add a value to a FNV-1a hash
+template <typename T> static void HashValue(UInt64 &hash, const T &value)
+{
+	HashBytes(hash, &value, sizeof(T));
+}
+
+
+/// Add a vector to a FNV-1a hash
+static void HashVector(UInt64 &hash, const Vector &value)
+{
+	HashValue(hash, value.x);
+	HashValue(hash, value.y);
+	HashValue(hash, value.z);
+}
+
+
+/// Pack the two indices of an element into its ID. Each index must be below MAX_ELEMENT_INDEX_COUNT.
+static Int32 PackElementID(Int32 firstIndex, Int32 secondIndex)
+{
+	return (Int32)(((UInt32)firstIndex << 16) | ((UInt32)secondIndex & 0xFFFF));
+}
+
+
+/// Get the two indices of an element from its ID, see PackElementID()
+static void UnpackElementID(Int32 elementID, Int32 &firstIndex, Int32 &secondIndex)
+{
+	firstIndex = (Int32)((UInt32)elementID >> 16);
+	secondIndex = (Int32)((UInt32)elementID & 0xFFFF);
+}
+
+
+/// Store the ID of an element in its container. The unique IP of the object is left alone, the IDs of different groups and kinds of elements repeat.
+static void SetElementID(BaseObject *op, Int32 firstIndex, Int32 secondIndex)
+{
+	BaseContainer *bc = op->GetDataInstance();
+	if (bc)
+		bc->SetInt32(ELEMENT_ID_ENTRY, PackElementID(firstIndex, secondIndex));
+}
+
+
+/// Get the two indices of an element from the ID in its container, see SetElementID()
+static void GetElementID(BaseObject *op, Int32 &firstIndex, Int32 &secondIndex)
+{
+	BaseContainer *bc = op->GetDataInstance();
+	UnpackElementID(bc ? bc->GetInt32(ELEMENT_ID_ENTRY) : 0, firstIndex, secondIndex);
+}
+
+
+/// Add a string to a FNV-1a hash
+static void HashString(UInt64 &hash, const String &value)
+{
+	HashValue(hash, value.GetLength());
+	for (Int32 i = 0; i < value.GetLength(); ++i)
+		HashValue(hash, value[i]);
+}
+
+
+/// Append the indices of all chunks inside a square of the chunk grid, in Morton order (Z-order)
+/// @param[in] size Edge length of the square, a power of 2
+static Bool AppendMortonOrder(Int32 x, Int32 z, Int32 size, Int32 countX, Int32 countZ, maxon::BaseArray<Int32> &order)
+{
+	// Squares outside the grid are skipped as a whole
+	if (x >= countX || z >= countZ)
+		return true;
+	
+	if (size == 1)
+		return order.Append(x * countZ + z) != nullptr;
+	
+	Int32 half = size / 2;
+	return AppendMortonOrder(x, z, half, countX, countZ, order) &&
+	       AppendMortonOrder(x + half, z, half, countX, countZ, order) &&
+	       AppendMortonOrder(x, z + half, half, countX, countZ, order) &&
+	       AppendMortonOrder(x + half, z + half, half, countX, countZ, order);
+}
+
+
+/// Find the first polygon object of a terrain: The object itself, its deformed points, or the first one in its cache or children
+/// @param[in] matrix Matrix of op in the space the terrain is used in
+/// @param[out] polygonMatrix Receives the matrix of the polygon object in that space
+/// @return Pointer to the polygon object; or nullptr if there is none. The terrain owns the pointed object.
+static PolygonObject *FindTerrainPolygons(BaseObject *op, const Matrix &matrix, Matrix &polygonMatrix)
+{
+	if (!op)
 		return nullptr;
 	
-	// Get parameters
-	_doc = doc;
-	GetParametersFromContainer(*bc, *doc);
-	GetObjectNames();
+	// Deformed points are in the same space as the object
+	if (op->GetDeformCache())
+		return FindTerrainPolygons(op->GetDeformCache(), matrix, polygonMatrix);
+	
+	BaseObject *cache = op->GetCache();
+	if (cache)
+		return FindTerrainPolygons(cache, matrix * cache->GetMl(), polygonMatrix);
+	
+	if (op->IsInstanceOf(Opolygon) && ToPoly(op)->GetPolygonCount() > 0)
+	{
+		polygonMatrix = matrix;
+		return ToPoly(op);
+	}
+	
+	for (BaseObject *child = op->GetDown(); child; child = child->GetNext())
+	{
+		PolygonObject *polygons = FindTerrainPolygons(child, matrix * child->GetMl(), polygonMatrix);
+		if (polygons)
+			return polygons;
+	}
 	
-	// Calculate the total size of the sidewalk
-	Vector totalSize = Vector(_params.elementSize.x * _params.countX, _params.elementSize.y, _params.elementSize.z * _params.countZ);
+	return nullptr;
+}
+
 
-	// Random generators
-	Random rndElementChoice; // Element selection
-	rndElementChoice.Init(_params.elementRndSeed);
+BaseObject *Sidewalk::Build(const Parameters &params, State &state, BaseDocument *doc, BaseObject *previousResult)
+{
+	// Cancel if invalid pointers
+	if (!doc)
+		return nullptr;
+	
+	// If only the grid size or the layout changed, cells that keep their element type keep their elements.
+	// That needs the previous result to be intact, and to be built from the parameters in the state.
+	Bool keepElements = previousResult && state.updatable && params.CanKeepElements(state.params);
 	
-	Random holeRnd; // Missing element / hole random
-	holeRnd.Init(_params.elementRndSeed * 2);
+	// The result of a failed build can't be updated
+	state.updatable = false;
+	state.params = params;
+	
+	// Stages add their times
+	state.statistics.Reset();
+	Float startTime = GeGetMilliSeconds();
+	
+	// Build from the state's copy, so the caller's parameters may change during the build
+	Sidewalk builder(state.params, state, doc);
+	BaseObject *result = builder.BuildHierarchy(previousResult, keepElements);
+	
+	if (result)
+	{
+		builder.WriteFiles(result);
+		state.statistics.totalTime = GeGetMilliSeconds() - startTime;
+		state.statistics.source = BUILDSOURCE::BUILT;
+		state.statistics.Count(result);
+	}
+	else
+	{
+		state.statistics.Reset();
+	}
+	
+	// Points and matrices of this result may be rewritten later. With only collision proxies, there are no elements to rewrite.
+	state.updatable = result != nullptr && !state.params.collisionOnly;
+	state.complete = result != nullptr;
+	
+	// Queries are answered from the elements of the new result
+	if (!result || !state.bvh.Build(result, GetCollisionGroup(state.params, result)))
+		state.bvh.Flush();
+	
+	return result;
+}
 
-	Random plateRnd; // Plate variation
-	plateRnd.Init(_params.plateRndSeed);
+
+Bool Sidewalk::Update(const Parameters &params, State &state, BaseDocument *doc, BaseObject *cache)
+{
+	// Cancel if invalid pointers, or if the cache is not the result of a complete build
+	if (!cache || !doc || !state.updatable)
+		return false;
+	
+	// The cache stays intact, Build() may still keep parts of it
+	if (!params.HasSameTopology(state.params))
+		return false;
 	
-	Random cobbleRotRnd; // Cobblestone random
-	cobbleRotRnd.Init(_params.cobbleRotSeed);
+	// From here on, the cache might get changed. Unless this completes, only a new build will do.
+	state.updatable = false;
+	state.complete = false;
 	
-	Random cobbleCrumpleRnd; // Cobblestone Crumple variation
-	cobbleCrumpleRnd.Init(_params.cobbleCrumpleSeed);
+	state.params = params;
 	
-	Random dirtPlaneCrumpleRnd;  // Dirt Plane Crumple variation
-	dirtPlaneCrumpleRnd.Init(_params.dirtPlaneCrumpleSeed);
+	Float startTime = GeGetMilliSeconds();
 	
+	Sidewalk builder(state.params, state, doc);
+	state.updatable = builder.UpdateHierarchy(cache);
+	state.complete = state.updatable;
 	
-	// Main group
-	AutoAlloc<BaseObject> mainGroup(Onull);
-	if (!mainGroup)
-		return nullptr;
+	// Updates are not split by component
+	if (state.updatable)
+	{
+		builder.WriteFiles(cache);
+		state.statistics.Reset();
+		state.statistics.totalTime = GeGetMilliSeconds() - startTime;
+		state.statistics.source = BUILDSOURCE::UPDATED;
+		state.statistics.Count(cache);
+	}
 	
-	// Element groups
-	AutoAlloc<BaseObject> plateGroup(Onull);
-	if (!plateGroup)
-		return nullptr;
+	// Elements have moved
+	if (!state.updatable || !state.bvh.Build(cache, GetCollisionGroup(state.params, cache)))
+		state.bvh.Flush();
 	
-	AutoAlloc<BaseObject> cobblestoneGroup(Onull);
-	if (!cobblestoneGroup)
-		return nullptr;
+	return state.updatable;
+}
 
 
-	// Iterate sidewalk rows
-	for (Int32 columnIndex = 0; columnIndex < _params.countX; ++columnIndex)
+void Sidewalk::Adopt(const Parameters &params, State &state, BaseDocument *doc, BaseObject *result)
+{
+	state.params = params;
+	
+	// Prototypes and layout in the state belong to another result
+	state.updatable = false;
+	state.complete = result != nullptr;
+	
+	if (!result || !state.bvh.Build(result, GetCollisionGroup(state.params, result)))
+		state.bvh.Flush();
+	
+	state.statistics.Reset();
+	if (result)
 	{
-		// Iterate sidewalk columns
-		for (Int32 rowIndex = 0; rowIndex < _params.countZ; ++rowIndex)
+		state.statistics.source = BUILDSOURCE::CACHED;
+		state.statistics.Count(result);
+		
+		// Prefetched results haven't written anything
+		if (doc)
 		{
-			// Do we create any element in this position, or just leave a hole?
-			if (holeRnd.Get01() > _params.elementHoleBias)
-			{
-				// Do we create a plate or cobblestones?
-				if (rndElementChoice.Get01() < _params.elementSelectBias)
-				{
-					// Create a new plate
-					AutoFree<BaseObject> newPlate;
-					newPlate.Set(CreateSinglePlate());
-					if (!newPlate)
-						return nullptr;
-					
-					// Position new plate (note that every 2nd row is shifted)
-					Vector elementPos = Vector(_params.elementSize.x * columnIndex - _params.elementSize.x * ((Float)_params.countX - 1.0) * 0.5,
-					                           0.0,
-					                           _params.elementSize.z * rowIndex + _params.shift * ((columnIndex % 2 == 0) ? 1.0 : 0.0));
-					
-					// Compute random position variation
-					elementPos += _params.plateRndPos * Vector(plateRnd.Get11(), plateRnd.Get11(), plateRnd.Get11());
-					
-					// Compute random rotation variation
-					Vector elementRot = _params.plateRndRot * Vector(plateRnd.Get11(), plateRnd.Get11(), plateRnd.Get11());
-
-					// Set position and rotation to plate
-					newPlate->SetRelPos(elementPos);
-					newPlate->SetRelRot(elementRot);
-					
-					// Set name
-					newPlate->SetName(String::IntToString(rowIndex) + "-" + String::IntToString(columnIndex) + " (" + _params.plateName + ")");
-					
-					// Release plate into group
-					newPlate->InsertUnderLast(plateGroup);
-					newPlate.Release();
-				}
-				else
-				{
-					// Create new cobble stone group (same size as a plate)
-					AutoFree<BaseObject> newCobblestones;
-					newCobblestones.Set(CreateCobblestones(cobbleCrumpleRnd));
-					if (!newCobblestones)
-						return nullptr;
-					
-					// Position new coblestone group (note that every 2nd row is shifted)
-					Vector elementPos = Vector(_params.elementSize.x * columnIndex - _params.elementSize.x * ((Float)_params.countX - 1.0) * 0.5,
-					                           _params.cobbleElevation,
-					                           _params.elementSize.z * rowIndex + _params.shift * (columnIndex % 2 == 0));
-					
-					newCobblestones->SetRelPos(elementPos);
-					
-					// Set name
-					newCobblestones->SetName(String::IntToString(rowIndex) + "-" + String::IntToString(columnIndex) + " (" + _params.cobblestoneGroupName + ")");
-					
-					// Release new coblestones into main cobblestone group
-					newCobblestones->InsertUnderLast(cobblestoneGroup);
-					newCobblestones.Release();
-				}
-			}
+			Sidewalk builder(state.params, state, doc);
+			builder.WriteFiles(result);
 		}
 	}
+}
+
+
+Bool Sidewalk::Export(const Parameters &params, State &state, BaseDocument *doc, const Filename &file, Int *polygonCount)
+{
+	if (!doc)
+		return false;
 	
-	
-	// If required, assign texture tag to plate group
-	if (_params.plateMat && !_params.plateMatPerPlate)
+	// A PLY file has no textures, baked detail becomes geometry
+	Parameters exportParams = params;
+	if (exportParams.bakeEnabled)
 	{
-		if (!AddTextureTag(plateGroup, _params.plateMat, _params.plateMatScale))
-			return nullptr;
+		exportParams.bakeEnabled = false;
+		exportParams.cobbleSubdiv = (Int32)exportParams.bakeCobbleDetail;
+		exportParams.cobbleCrumple = exportParams.bakeCobbleStrength;
+		exportParams.curbSubd = (Int32)exportParams.bakeCurbDetail;
+		exportParams.curbCrumpleVal = exportParams.bakeCurbStrength;
 	}
-
-	// If required, assign texture tag to cobblestone group
-	if (_params.cobbleMat && !_params.cobbleMatPerStone)
+	
+	PlyWriter writer;
+	if (!writer.Open(file))
+		return false;
+	
+	// Each element is written before the next one is generated
+	ElementStream stream(state, doc);
+	if (!stream.Init(exportParams))
+		return false;
+	
+	Element element;
+	while (stream.GetNext(element))
 	{
-		if (!AddTextureTag(cobblestoneGroup, _params.cobbleMat, _params.cobbleMatScale))
-			return nullptr;
+		if (!writer.WritePolygons(element.pointArr, element.pointCount, element.polygonArr, element.polygonCount, element.matrix))
+			return false;
 	}
 	
+	if (stream.HasFailed())
+		return false;
 	
-	// Set groups' names
-	mainGroup->SetName(_params.sidewalkGroupName);
-	plateGroup->SetName(_params.plateGroupName);
-	cobblestoneGroup->SetName(_params.cobblestoneGroupName);
+	if (polygonCount)
+		*polygonCount = writer.GetFaceCount();
 	
+	return writer.Close();
+}
+
+
+Bool Sidewalk::ElementStream::Init(const Parameters &params)
+{
+	State &state = _builder._state;
+	_phase = PHASE::DONE;
+	_failed = false;
+	
+	// The state is used for the stream, whatever it held before is gone
+	state.updatable = false;
+	state.complete = false;
+	state.bvh.Flush();
+	state.params = params;
+	
+	// Elements have no instances, the whole area is generated
+	state.params.tileEnabled = false;
+	state.params.collisionProxies = false;
+	state.params.collisionOnly = false;
+	state.params.bakeEnabled = false;
+	_builder.SelectEmitters();
+	
+	state.pool.ResetAllocationCount();
+	state.originalCacheStats.Reset();
+	state.optimizedCacheStats.Reset();
+	
+	// Nothing is left from a previous Init()
+	state.arena.Reset();
+	_platePrototype.Free();
+	_cobblePrototype.Free();
+	_curbPrototype.Free();
+	
+	if (!_placement)
+		return Fail();
+	
+	// Same layout as the build stage. It's the only data that grows with the size of the sidewalk.
+	if (!_builder.BuildLayout())
+		return Fail();
+	
+	if (state.params.dirtPlaneEnabled && !InitDirtPlane())
+		return Fail();
+	
+	if (state.params.curbEnabled && !InitCurbstones())
+		return Fail();
+	
+	// Cells are visited with the same cursors as in the build stages
+	_plateCursor.Init(ELEMENTTYPE::PLATE, state.params.plateRndSeed, state.params.positionalSeeds);
+	_cobbleCursor.Init(ELEMENTTYPE::COBBLESTONES, state.params.cobbleCrumpleSeed, state.params.positionalSeeds);
+	
+	_inCobbleCell = false;
+	_phase = PHASE::PLATES;
+	return true;
+}
+
+
+Bool Sidewalk::ElementStream::GetNext(Element &element)
+{
+	element = Element();
 	
-	// Insert groups into mainGroup and release
-	plateGroup->InsertUnderLast(mainGroup);
-	plateGroup.Release();
-	cobblestoneGroup->InsertUnderLast(mainGroup);
-	cobblestoneGroup.Release();
+	// Each phase moves on to the next one when it runs out of elements
+	while (!_failed && _phase != PHASE::DONE)
+	{
+		switch (_phase)
+		{
+			case PHASE::PLATES:
+				if (GetNextPlate(element))
+					return true;
+				_phase = PHASE::COBBLESTONES;
+				break;
+				
+			case PHASE::COBBLESTONES:
+				if (GetNextCobblestone(element))
+					return true;
+				_phase = PHASE::DIRTPLANE;
+				break;
+				
+			case PHASE::DIRTPLANE:
+				if (GetNextDirtPatch(element))
+					return true;
+				_phase = PHASE::CURBSTONES;
+				break;
+				
+			case PHASE::CURBSTONES:
+				if (GetNextCurbstone(element))
+					return true;
+				_phase = PHASE::DONE;
+				break;
+				
+			case PHASE::DONE:
+				break;
+		}
+	}
 	
+	// The pool only held the objects the prototypes were made from
+	_builder._state.pool.Flush();
+	return false;
+}
+
+
+Bool Sidewalk::ElementStream::GetNextPlate(Element &element)
+{
+	if (!_plateCursor.Next(_builder))
+		return false;
 	
-	// Dirt Plane
-	if (_params.dirtPlaneEnabled)
+	// All plates are the same, only one is polygonized
+	if (!_platePrototype)
 	{
-		// Create Dirt Plane
-		AutoFree<BaseObject> newPlane;
-		newPlane.Set(CreateDirtPlane(dirtPlaneCrumpleRnd));
-		if (!newPlane)
-			return nullptr;
-		
-		// Set Name
-		newPlane->SetName(_params.dirtPlaneName);
-		
-		// Set Position
-		Vector planePos = Vector(0.0, _params.dirtPlaneElevation, totalSize.z * 0.5 - _params.elementSize.z * 0.5);
-		newPlane->SetRelPos(planePos);
+		BaseObject *plate = (_builder.*_builder._emitters.plate)();
+		if (!plate)
+			return Fail();
 		
-		// Release plane into mainGroup
-		newPlane->InsertUnderLast(mainGroup);
-		newPlane.Release();
+		_platePrototype.Set(static_cast<PolygonObject*>(MakeEditable(plate, _builder._doc)));
+		_builder._state.pool.Recycle(plate);
+		if (!_platePrototype || !_platePrototype->IsInstanceOf(Opolygon))
+			return Fail();
 	}
 	
-	// Curbstones
-	if (_params.curbEnabled)
+	_placement->SetMl(Matrix());
+	_builder.PlacePlate(_placement, _plateCursor.GetColumn(), _plateCursor.GetRow(), _plateCursor.GetRandom());
+	
+	element.kind = ELEMENTKIND::PLATE;
+	element.columnIndex = _plateCursor.GetColumn();
+	element.rowIndex = _plateCursor.GetRow();
+	element.seed = _plateCursor.GetSeed();
+	element.matrix = _placement->GetMl();
+	element.geometry = _platePrototype;
+	element.pointArr = _platePrototype->GetPointR();
+	element.pointCount = _platePrototype->GetPointCount();
+	element.polygonArr = _platePrototype->GetPolygonR();
+	element.polygonCount = _platePrototype->GetPolygonCount();
+	return true;
+}
+
+
+Bool Sidewalk::ElementStream::GetNextCobblestone(Element &element)
+{
+	State &state = _builder._state;
+	
+	for (;;)
 	{
-		AutoFree<BaseObject> curbstoneGroup;
-		curbstoneGroup.Set(CreateCurbstoneRow(totalSize.z));
-		if (!curbstoneGroup)
-			return nullptr;
+		// Remaining stones of the current cell
+		Int32 stoneColumn, stoneRow;
+		if (_inCobbleCell && _builder.GetNextCobblestoneInside(_cobbleCursor.GetColumn(), _cobbleCursor.GetRow(), _stoneIndex, stoneColumn, stoneRow))
+		{
+			_placement->SetMl(Matrix());
+			_builder.PlaceCobblestone(_placement, stoneColumn, stoneRow, _cobbleCursor.GetRandom());
+			
+			element.kind = ELEMENTKIND::COBBLESTONE;
+			element.columnIndex = _cobbleCursor.GetColumn();
+			element.rowIndex = _cobbleCursor.GetRow();
+			element.stoneColumn = stoneColumn;
+			element.stoneRow = stoneRow;
+			element.seed = _cobbleCursor.GetSeed();
+			element.matrix = _cobbleMatrix * _placement->GetMl();
+			element.geometry = _cobblePrototype;
+			element.pointArr = state.crumpledCobblePoints.GetFirst();
+			element.pointCount = _cobblePrototype->GetPointCount();
+			element.polygonArr = _cobblePrototype->GetPolygonR();
+			element.polygonCount = _cobblePrototype->GetPolygonCount();
+			return true;
+		}
 		
-		// Set Group position
-		Vector groupPos = Vector(totalSize.x * 0.5 + _params.curbSize.x * 0.5, _params.curbSize.y * -0.5 + _params.elementSize.y * 0.5 + _params.curbElevation, _params.elementSize.z * -0.5);
-		curbstoneGroup->SetRelPos(groupPos);
+		_inCobbleCell = _cobbleCursor.Next(_builder);
+		if (!_inCobbleCell)
+			return false;
 		
-		// If required, assign texture tag to curbstone group
-		if (_params.curbMat && !_params.curbMatPerStone)
+		if (!_cobblePrototype)
 		{
-			if (!AddTextureTag(curbstoneGroup, _params.curbMat, _params.curbMatScale))
-				return nullptr;
+			_cobblePrototype.Set(_builder.CreateCobblestonePrototype(_builder.PolygonizeCobblestone()));
+			if (!_cobblePrototype)
+				return Fail();
 		}
-
-		// Release curbstone group into mainGroup
-		curbstoneGroup->InsertUnderLast(mainGroup);
-		curbstoneGroup.Release();
+		
+		// Crumpled points, shared by all stones of this cell. The generator continues from stone to stone.
+		_builder.CrumpleCobblestone(state.crumpledCobblePoints.GetFirst(), _cobbleCursor.GetRandom());
+		
+		_placement->SetMl(Matrix());
+		_builder.PlaceCobblestones(_placement, _cobbleCursor.GetColumn(), _cobbleCursor.GetRow());
+		_cobbleMatrix = _placement->GetMl();
+		_stoneIndex = 0;
 	}
-	
-	// Release & return main group
-	return mainGroup.Release();
 }
 
 
-BaseObject *Sidewalk::CreateSinglePlate()
+Bool Sidewalk::ElementStream::InitDirtPlane()
 {
-	// Create new plate
-	AutoAlloc<BaseObject> newPlate(Ocube);
-	if (!newPlate)
-		return nullptr;
+	// Same position as the dirt plane object. Along a path or on a terrain, the points are mapped instead.
+	_planeMatrix = Matrix();
+	if (_builder.IsStraight())
+		_planeMatrix.off = _builder.GetDirtPlanePosition();
+	
+	// One patch at a time, the buffers fit the largest one. Points on patch borders are generated once per patch, they come from the same lattice, so there are no cracks.
+	Int32 patchCountX = _builder.GetDirtPatchCountX();
+	Int32 patchCountZ = _builder.GetDirtPatchCountZ();
+	Int32 spanX = (_builder.GetDirtCellCountX() + patchCountX - 1) / patchCountX;
+	Int32 spanZ = (_builder.GetDirtCellCountZ() + patchCountZ - 1) / patchCountZ;
+	Int32 latticePointCount = (spanX + 1) * (spanZ + 1);
+	
+	// A full patch has a polygon per cell, a coarse one a triangle per lattice point on its border
+	_patchPointArr = _builder._state.arena.Alloc<Vector>(latticePointCount + 1);
+	_patchPolygonArr = _builder._state.arena.Alloc<CPolygon>(Max(spanX * spanZ, (spanX + spanZ) * 2));
+	_patchPointIndices = _builder._state.arena.Alloc<Int32>(latticePointCount);
+	if (!_patchPointArr || !_patchPolygonArr || !_patchPointIndices)
+		return false;
 	
-	// Calculate actual size of plate (elementSize - gapSize)
-	Vector gappedSize = _params.elementSize - Vector(_params.plateGap, 0.0, _params.plateGap);
+	_patchIndex = 0;
+	return true;
+}
 
-	// Get plate's container
-	BaseContainer *plateData = newPlate->GetDataInstance();
-	if (!plateData)
-		return nullptr;
+
+Bool Sidewalk::ElementStream::GetNextDirtPatch(Element &element)
+{
+	const Parameters &params = _builder._params;
+	if (!params.dirtPlaneEnabled)
+		return false;
 	
-	// Set plate parameters
-	plateData->SetVector(PRIM_CUBE_LEN, gappedSize);
-	plateData->SetBool(PRIM_CUBE_DOFILLET, (_params.plateFilletRad > 0.0));
-	plateData->SetFloat(PRIM_CUBE_FRAD, _params.plateFilletRad);
-	plateData->SetInt32(PRIM_CUBE_SUBF, _params.plateFilletSubd);
+	Int32 cellCountX = _builder.GetDirtCellCountX();
+	Int32 cellCountZ = _builder.GetDirtCellCountZ();
+	Int32 latticeCountZ = cellCountZ + 1;
+	Int32 patchCountX = _builder.GetDirtPatchCountX();
+	Int32 patchCountZ = _builder.GetDirtPatchCountZ();
+	Vector planePos = _builder.GetDirtPlanePosition();
 	
-	// Apply Phong tag
-	if (_params.plateUsePhong)
-	{
-		if (!AddPhongTag(newPlate))
-			return nullptr;
-	}
+	// Behind all lattice indices
+	Int32 centerIndex = (cellCountX + 1) * latticeCountZ;
 	
-	// Apply material
-	if (_params.plateMat && _params.plateMatPerPlate)
+	while (_patchIndex < patchCountX * patchCountZ)
 	{
-		if (!AddTextureTag(newPlate, _params.plateMat, _params.plateMatScale))
-			return nullptr;
+		Int32 patchX = _patchIndex / patchCountZ;
+		Int32 patchZ = _patchIndex % patchCountZ;
+		++_patchIndex;
+		
+		// Same polygons as the patch has in the plane. Patches outside of the footprint have none.
+		Bool usesCenter = false;
+		Int32 polygonCount = _builder.GetDirtPatchPolygons(patchX, patchZ, centerIndex, _patchPolygonArr, usesCenter);
+		if (polygonCount == 0)
+			continue;
+		
+		Int32 x0, x1, z0, z1;
+		GetDirtPatchSpan(patchX, cellCountX, patchCountX, x0, x1);
+		GetDirtPatchSpan(patchZ, cellCountZ, patchCountZ, z0, z1);
+		
+		Int32 spanZ = z1 - z0 + 1;
+		for (Int32 i = 0; i < (x1 - x0 + 1) * spanZ; ++i)
+			_patchPointIndices[i] = NOTOK;
+		
+		// Only the points the polygons use, in the order they're used
+		Int32 pointCount = 0;
+		Int32 centerPoint = NOTOK;
+		for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+		{
+			CPolygon &polygon = _patchPolygonArr[polygonIndex];
+			Int32 *corners[4] = { &polygon.a, &polygon.b, &polygon.c, &polygon.d };
+			for (Int32 cornerIndex = 0; cornerIndex < 4; ++cornerIndex)
+			{
+				Int32 &index = *corners[cornerIndex];
+				Int32 x = index / latticeCountZ;
+				Int32 z = index % latticeCountZ;
+				Int32 &pointIndex = (index == centerIndex) ? centerPoint : _patchPointIndices[(x - x0) * spanZ + z - z0];
+				if (pointIndex == NOTOK)
+				{
+					Vector point = (index == centerIndex) ? _builder.GetDirtPatchCenter(patchX, patchZ) : _builder.GetDirtLatticePoint(x, z);
+					pointIndex = pointCount++;
+					_patchPointArr[pointIndex] = _builder.IsStraight() ? point : _builder.MapToGround(planePos + point);
+				}
+				index = pointIndex;
+			}
+		}
+		
+		element.kind = ELEMENTKIND::DIRTBLOCK;
+		element.columnIndex = patchX;
+		element.rowIndex = patchZ;
+		element.seed = (UInt32)params.dirtPlaneCrumpleSeed;
+		element.matrix = _planeMatrix;
+		element.pointArr = _patchPointArr;
+		element.pointCount = pointCount;
+		element.polygonArr = _patchPolygonArr;
+		element.polygonCount = polygonCount;
+		return true;
 	}
 	
-	// Release & return
-	return newPlate.Release();
+	return false;
 }
 
 
-BaseObject *Sidewalk::CreateCobblestones(Random &rnd)
+Bool Sidewalk::ElementStream::InitCurbstones()
 {
-	// Size of a single cobblestone
-	if (_params.cobbleCount == 0)
-		return nullptr;
+	const Parameters &params = _builder._params;
+	// No curbstones, the curb phase stays empty
+	if (params.curbCount < 1)
+		return true;
 	
-	Float invCobbleCount = 1.0 / _params.cobbleCount;
-	Vector stoneSize = Vector(_params.elementSize.x * invCobbleCount, _params.elementSize.y, _params.elementSize.z * invCobbleCount);
-	
-	// Create a new Cube: That's our cobblestone prototype
-	AutoAlloc<BaseObject> newPrototypeCobblestone(Ocube);
-	if (!newPrototypeCobblestone)
-		return nullptr;
-	
-	// Get new cube's container
-	BaseContainer	*cobblestoneData = newPrototypeCobblestone->GetDataInstance();
-	if (!cobblestoneData)
-		return nullptr;
+	// Same row as CreateCurbstoneRow() builds, one stone at a time
+	Vector nominalStoneSize = _builder.GetNominalCurbstoneSize();
 	
-	// Calculate actual size
-	Vector gappedStoneSize = stoneSize - Vector(_params.cobbleGap, 0.0, _params.cobbleGap);
+	_curbPrototype.Set(_builder.CreateCurbstonePrototype(_builder.PolygonizeCurbstone(nominalStoneSize), nominalStoneSize.z));
+	if (!_curbPrototype)
+		return false;
 	
-	// Set basic cobblestone parameters
-	cobblestoneData->SetVector(PRIM_CUBE_LEN, gappedStoneSize);
-	cobblestoneData->SetInt32(PRIM_CUBE_SUBX, _params.cobbleSubdiv);
-	cobblestoneData->SetInt32(PRIM_CUBE_SUBY, _params.cobbleSubdiv);
-	cobblestoneData->SetInt32(PRIM_CUBE_SUBZ, _params.cobbleSubdiv);
-	cobblestoneData->SetBool(PRIM_CUBE_DOFILLET, _params.cobbleFilletRad > 0.0);
-	cobblestoneData->SetFloat(PRIM_CUBE_FRAD, _params.cobbleFilletRad);
-	cobblestoneData->SetInt32(PRIM_CUBE_SUBF, _params.cobbleFilletSubd);
+	_curbPointArr = _builder._state.arena.Alloc<Vector>(_curbPrototype->GetPointCount());
+	if (!_curbPointArr)
+		return false;
 	
-	// Get cobblestone polygon object: That's our 'polygonized' cobblestone prototype
-	AutoFree<PolygonObject>	cobblePoly;
-	cobblePoly.Set(static_cast<PolygonObject*>(MakeEditable(newPrototypeCobblestone, _doc)));
-	if (!cobblePoly)
-		return nullptr;
+	_curbCursor.Init(_builder);
+	return true;
+}
+
+
+Bool Sidewalk::ElementStream::GetNextCurbstone(Element &element)
+{
+	const Parameters &params = _builder._params;
+	if (!params.curbEnabled || !_curbPrototype)
+		return false;
 	
-	// Crumple cobblestone geometry
-	if (_params.cobbleCrumple > 0.0)
-		CrumpleGeometry(cobblePoly, _params.cobbleCrumple, rnd);
+	if (!_curbCursor.Next(_builder))
+		return false;
 	
-	// Attach Phong Tag
-	if (_params.cobbleUsePhong)
+	_builder.ShapeCurbstone(_curbPointArr, _curbCursor.GetNominalLength(), _curbCursor.GetLength(), _curbCursor.GetCrumpleRandom());
+	
+	element.kind = ELEMENTKIND::CURBSTONE;
+	element.columnIndex = _curbCursor.GetIndex();
+	element.seed = (UInt32)params.curbSizeSeed;
+	element.matrix = _builder.MapToGround(MatrixMove(_builder.GetCurbstoneGroupPosition() + _curbCursor.GetPosition()));
+	element.geometry = _curbPrototype;
+	element.pointArr = _curbPointArr;
+	element.pointCount = _curbPrototype->GetPointCount();
+	element.polygonArr = _curbPrototype->GetPolygonR();
+	element.polygonCount = _curbPrototype->GetPolygonCount();
+	return true;
+}
+
+
+BaseObject *Sidewalk::BuildHierarchy(BaseObject *previousResult, Bool keepElements)
+{
+	// Transient data of this build is released at once when leaving
+	ArenaScope arenaScope(_state.arena);
+	
+	_state.pool.ResetAllocationCount();
+	_state.originalCacheStats.Reset();
+	_state.optimizedCacheStats.Reset();
+	
+	// The previous result stays intact until this build has succeeded, so it can still be shown if the build fails.
+	// Only the elements that may be kept are taken out of it, they're put back on failure.
+	AutoFree<BaseObject> mainGroup;
+	mainGroup.Set(_state.pool.GetObject(Onull));
+	if (!mainGroup || (keepElements && !TakeKeptElements(previousResult)) || !BuildComponents(mainGroup))
 	{
-		if (!AddPhongTag(cobblePoly))
-			return nullptr;
+		PutBackKeptElements(previousResult);
+		return nullptr;
 	}
 	
-	// Apply material
-	if (_params.cobbleMat && _params.cobbleMatPerStone)
+	// Whatever hasn't been reused is not needed anymore. The objects of the previous result are reused by the next build.
+	_state.pool.Flush();
+	if (previousResult)
 	{
-		if (!AddTextureTag(cobblePoly, _params.cobbleMat, _params.cobbleMatScale))
-			return nullptr;
+		while (previousResult->GetDown())
+			_state.pool.Recycle(previousResult->GetDown());
 	}
+	_state.pool.Recycle(_stageResults.previousPlateGroup.Release());
+	_state.pool.Recycle(_stageResults.previousCobblestoneGroup.Release());
 	
-	// Create Null Object to group Cobblestones in
-	AutoAlloc<BaseObject> cobbleGroup(Onull);
-	if (!cobbleGroup)
-		return nullptr;
+	// Release & return main group
+	return mainGroup.Release();
+}
+
+
+Bool Sidewalk::BuildComponents(BaseObject *mainGroup)
+{
+	// In tile mode, elements and dirt plane are only built once, as a tile
+	AutoFree<BaseObject> tileGroup;
+	if (_params.tileEnabled)
+	{
+		tileGroup.Set(_state.pool.GetObject(Onull));
+		if (!tileGroup)
+			return false;
+	}
+	
+	BaseObject *componentGroup = _params.tileEnabled ? (BaseObject*)tileGroup : (BaseObject*)mainGroup;
+	
+	// MakeEditable() only runs on one thread at a time, the stone prototypes are polygonized before the stages start
+	if (!PolygonizePrototypes())
+		return false;
+	
+	
+	// Stages that don't depend on each other run concurrently. Curbstones only need the parameters,
+	// plates, the cobblestone prototype and the dirt plane only need the layout.
+	TaskGraph<Sidewalk> stages(this);
+	Int32 layoutStage = stages.AddTask(&Sidewalk::BuildLayout);
+	Int32 plateStage = stages.AddTask(&Sidewalk::BuildPlates);
+	Int32 prototypeStage = stages.AddTask(&Sidewalk::BuildCobblestonePrototype);
+	Int32 cobblestoneStage = stages.AddTask(&Sidewalk::BuildCobblestones);
+	Int32 dirtPlaneStage = stages.AddTask(&Sidewalk::BuildDirtPlane);
+	stages.AddTask(&Sidewalk::BuildCurbstones);
+	
+	if (!stages.AddDependency(plateStage, layoutStage) ||
+	    !stages.AddDependency(prototypeStage, layoutStage) ||
+	    !stages.AddDependency(cobblestoneStage, prototypeStage) ||
+	    !stages.AddDependency(dirtPlaneStage, layoutStage))
+		return false;
+	
+	// Callers that run many builds at once, like the batch mode, limit each of them to fewer threads
+	if (!stages.Run(_state.threadCount > 0 ? _state.threadCount : GeGetCurrentThreadCount()))
+		return false;
+	
+	
+	// Only assembling the hierarchy happens in order
+	mainGroup->SetName(_params.sidewalkGroupName);
+	
+	_stageResults.plateGroup->InsertUnderLast(componentGroup);
+	_stageResults.plateGroup.Release();
+	_stageResults.cobblestoneGroup->InsertUnderLast(componentGroup);
+	_stageResults.cobblestoneGroup.Release();
+	
+	if (_stageResults.dirtPlane)
+	{
+		_stageResults.dirtPlane->InsertUnderLast(componentGroup);
+		_stageResults.dirtPlane.Release();
+	}
+	
+	// Cover the rest of the area with instances of the tile
+	if (_params.tileEnabled)
+	{
+		tileGroup->SetName(_params.tileName);
+		tileGroup->InsertUnderLast(mainGroup);
+		
+		if (!CreateTileInstances(tileGroup.Release(), mainGroup))
+			return false;
+	}
+	
+	if (_stageResults.curbstoneGroup)
+	{
+		_stageResults.curbstoneGroup->InsertUnderLast(mainGroup);
+		_stageResults.curbstoneGroup.Release();
+	}
+	
+	// Stone detail goes into the texture, which is written by Build()
+	if (_params.bakeEnabled && !MapDisplacementUVWs(mainGroup))
+		return false;
+	
+	// Collision proxies, always the last component
+	if (_params.collisionProxies)
+	{
+		AutoFree<BaseObject> proxyGroup;
+		proxyGroup.Set(CreateCollisionProxies(mainGroup));
+		if (!proxyGroup)
+			return false;
+		
+		proxyGroup->InsertUnderLast(mainGroup);
+		proxyGroup.Release();
+		
+		// A generator that is only used as collider outputs nothing else, so dynamics tags on it only see the proxies
+		if (_params.collisionOnly)
+		{
+			while (mainGroup->GetDown() != mainGroup->GetDownLast())
+				_state.pool.Recycle(mainGroup->GetDown());
+		}
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::BuildLayout()
+{
+	_state.layout.Flush();
+	if (!_state.layout.Resize(GetGridCountX() * GetGridCountZ()))
+		return false;
+	
+	if (!ClassifyFootprint())
+		return false;
+	
+	LayoutRandom layoutRnd;
+	InitLayoutRandom(layoutRnd);
+	
+	for (Int32 columnIndex = 0; columnIndex < GetGridCountX(); ++columnIndex)
+	{
+		for (Int32 rowIndex = 0; rowIndex < GetGridCountZ(); ++rowIndex)
+			_state.layout[columnIndex * GetGridCountZ() + rowIndex] = GetCellType(columnIndex, rowIndex, layoutRnd);
+	}
+	
+	return true;
+}
+
+
+void Sidewalk::CellRandom::Init(Int32 seed, Bool positional)
+{
+	_seed = seed;
+	_cellSeed = (UInt32)seed;
+	_positional = positional;
+	_rnd.Init(seed);
+}
+
+
+Random &Sidewalk::CellRandom::Get(Int32 columnIndex, Int32 rowIndex)
+{
+	if (_positional)
+	{
+		_cellSeed = GetPositionalSeed(_seed, columnIndex, rowIndex);
+		_rnd.Init(_cellSeed);
+	}
+	
+	return _rnd;
+}
+
+
+void Sidewalk::CellCursor::Init(ELEMENTTYPE type, Int32 seed, Bool positional)
+{
+	_rnd.Init(seed, positional);
+	_type = type;
+	_cellIndex = 0;
+	_columnIndex = 0;
+	_rowIndex = 0;
+}
+
+
+Bool Sidewalk::CellCursor::Next(const Sidewalk &builder)
+{
+	Int32 countZ = builder.GetGridCountZ();
+	while (_cellIndex < builder._state.layout.GetCount())
+	{
+		Int32 cellIndex = _cellIndex++;
+		if (builder._state.layout[cellIndex] != _type)
+			continue;
+		
+		// Each cell of the type gets the generator once, whether it draws from it or not
+		_columnIndex = cellIndex / countZ;
+		_rowIndex = cellIndex % countZ;
+		_rnd.Get(_columnIndex, _rowIndex);
+		return true;
+	}
+	
+	return false;
+}
+
+
+void Sidewalk::CurbstoneCursor::Init(const Sidewalk &builder)
+{
+	// Both generators start from the same seed
+	_sizeRnd.Init(builder._params.curbSizeSeed);
+	_crumpleRnd.Init(builder._params.curbSizeSeed);
+	
+	_stoneCount = 0;
+	_stoneIndex = 0;
+	_nominalLength = builder.GetNominalCurbstoneSize().z;
+	_totalSpace = builder.GetTotalSize().z;
+	_remainingSpace = _totalSpace;
+	_stoneLength = 0.0;
+	_stonePos = Vector();
+}
+
+
+Bool Sidewalk::CurbstoneCursor::Next(const Sidewalk &builder)
+{
+	const Parameters &params = builder._params;
+	
+	// A stone can't be shorter than its fillets
+	if (_stoneCount >= params.curbCount || _remainingSpace <= params.curbFilletRad * 2.0)
+		return false;
+	
+	_stoneLength = _nominalLength + _nominalLength * _sizeRnd.Get11() * params.curbSizeVar;
+	_stonePos = Vector(0.0, 0.0, _totalSpace - _remainingSpace + _stoneLength * 0.5);
+	_remainingSpace -= _stoneLength;
+	_stoneIndex = _stoneCount++;
+	return true;
+}
+
+
+void Sidewalk::InitLayoutRandom(LayoutRandom &layoutRnd) const
+{
+	// Sequential seeds draw holes from a stream of their own, with a different seed
+	layoutRnd.holeRnd.Init(_params.positionalSeeds ? _params.elementRndSeed : _params.elementRndSeed * 2, _params.positionalSeeds);
+	layoutRnd.choiceRnd.Init(_params.elementRndSeed, _params.positionalSeeds);
+}
+
+
+ELEMENTTYPE Sidewalk::GetCellType(Int32 columnIndex, Int32 rowIndex, LayoutRandom &layoutRnd) const
+{
+	// Do we create any element in this position, or just leave a hole? Do we create a plate or cobblestones?
+	ELEMENTTYPE cellType = ELEMENTTYPE::HOLE;
+	if (_params.positionalSeeds)
+	{
+		// Both values are always drawn, so changing one bias doesn't change the other decision
+		Random &cellRnd = layoutRnd.holeRnd.Get(columnIndex, rowIndex);
+		Float holeValue = cellRnd.Get01();
+		Float choiceValue = cellRnd.Get01();
+		
+		if (holeValue > _params.elementHoleBias)
+			cellType = (choiceValue < _params.elementSelectBias) ? ELEMENTTYPE::PLATE : ELEMENTTYPE::COBBLESTONES;
+	}
+	else
+	{
+		// The choice is only drawn for cells that aren't holes
+		if (layoutRnd.holeRnd.Get(columnIndex, rowIndex).Get01() > _params.elementHoleBias)
+			cellType = (layoutRnd.choiceRnd.Get(columnIndex, rowIndex).Get01() < _params.elementSelectBias) ? ELEMENTTYPE::PLATE : ELEMENTTYPE::COBBLESTONES;
+	}
+	
+	return ClipToFootprint(cellType, columnIndex, rowIndex);
+}
+
+
+Bool Sidewalk::TakeKeptElements(BaseObject *previousResult)
+{
+	// Same structure that BuildHierarchy() creates
+	BaseObject *componentGroup = _params.tileEnabled ? previousResult->GetDown() : previousResult;
+	BaseObject *plateGroup = componentGroup ? componentGroup->GetDown() : nullptr;
+	BaseObject *cobblestoneGroup = plateGroup ? plateGroup->GetNext() : nullptr;
+	if (!cobblestoneGroup)
+		return true;
+	
+	// The stages take the elements out of these groups. If the build succeeds, whatever is left is recycled with them.
+	plateGroup->Remove();
+	_stageResults.previousPlateGroup.Set(plateGroup);
+	cobblestoneGroup->Remove();
+	_stageResults.previousCobblestoneGroup.Set(cobblestoneGroup);
+	
+	return IndexKeptElements(plateGroup, _stageResults.keptPlates) && IndexKeptElements(cobblestoneGroup, _stageResults.keptCobblestones);
+}
+
+
+Bool Sidewalk::IndexKeptElements(BaseObject *group, maxon::BaseArray<KeptElement> &kept) const
+{
+	if (!kept.Resize(GetGridCountX() * GetGridCountZ()))
+		return false;
+	
+	for (Int32 cellIndex = 0; cellIndex < kept.GetCount(); ++cellIndex)
+		kept[cellIndex] = KeptElement();
+	
+	// The ID of each element holds its cell, see NameElement(). Cells that aren't part of the grid any more are left out.
+	for (BaseObject *element = GetFirstElement(_params, group); element; element = GetNextElement(_params, element))
+	{
+		Int32 columnIndex, rowIndex;
+		GetElementID(element, columnIndex, rowIndex);
+		if (columnIndex < GetGridCountX() && rowIndex < GetGridCountZ())
+			kept[columnIndex * GetGridCountZ() + rowIndex].element = element;
+	}
+	
+	return true;
+}
+
+
+BaseObject *Sidewalk::TakeKeptElement(maxon::BaseArray<KeptElement> &kept, Int32 columnIndex, Int32 rowIndex)
+{
+	if (kept.GetCount() == 0)
+		return nullptr;
+	
+	KeptElement &keptElement = kept[columnIndex * GetGridCountZ() + rowIndex];
+	BaseObject *result = keptElement.element;
+	if (!result || keptElement.taken)
+		return nullptr;
+	
+	// Remember where it was, in case it has to be put back
+	keptElement.parent = result->GetUp();
+	keptElement.pred = result->GetPred();
+	keptElement.ml = result->GetMl();
+	keptElement.taken = true;
+	result->Remove();
+	
+	return result;
+}
+
+
+void Sidewalk::PutBackKeptElements(BaseObject *previousResult)
+{
+	// Elements are taken in cell order. Undone in reverse, each element's predecessor is back in place when it's needed.
+	maxon::BaseArray<KeptElement> *keptArrays[] = { &_stageResults.keptPlates, &_stageResults.keptCobblestones };
+	for (Int32 arrayIndex = 0; arrayIndex < 2; ++arrayIndex)
+	{
+		maxon::BaseArray<KeptElement> &kept = *keptArrays[arrayIndex];
+		for (Int cellIndex = kept.GetCount() - 1; cellIndex >= 0; --cellIndex)
+		{
+			KeptElement &keptElement = kept[cellIndex];
+			if (!keptElement.taken)
+				continue;
+			
+			keptElement.element->Remove();
+			if (keptElement.pred)
+				keptElement.element->InsertAfter(keptElement.pred);
+			else
+				keptElement.element->InsertUnder(keptElement.parent);
+			keptElement.element->SetMl(keptElement.ml);
+			keptElement.taken = false;
+		}
+	}
+	
+	// The element groups were the first two components
+	BaseObject *componentGroup = (previousResult && _params.tileEnabled) ? previousResult->GetDown() : previousResult;
+	if (!componentGroup)
+		return;
+	
+	if (_stageResults.previousCobblestoneGroup)
+		_stageResults.previousCobblestoneGroup.Release()->InsertUnder(componentGroup);
+	if (_stageResults.previousPlateGroup)
+		_stageResults.previousPlateGroup.Release()->InsertUnder(componentGroup);
+}
+
+
+Bool Sidewalk::BuildPlates()
+{
+	StageTimer timer(_state.statistics.plateTime);
+	
+	_stageResults.plateGroup.Set(_state.pool.GetObject(Onull));
+	if (!_stageResults.plateGroup)
+		return false;
+	
+	maxon::BaseArray<BaseObject*> chunks;
+	if (!InitChunkArray(chunks))
+		return false;
+	
+	CellCursor cursor; // Plate variation
+	cursor.Init(ELEMENTTYPE::PLATE, _params.plateRndSeed, _params.positionalSeeds);
+	
+	while (cursor.Next(*this))
+	{
+		Int32 columnIndex = cursor.GetColumn();
+		Int32 rowIndex = cursor.GetRow();
+		
+		// The chunk comes first. Once a kept plate is taken, nothing may fail until it's in the new hierarchy, see PutBackKeptElements().
+		BaseObject *chunk = GetChunk(_stageResults.plateGroup, chunks, columnIndex, rowIndex);
+		if (!chunk)
+			return false;
+		
+		// Keep the plate of the previous result, or create a new one
+		AutoFree<BaseObject> newPlate;
+		newPlate.Set(TakeKeptElement(_stageResults.keptPlates, columnIndex, rowIndex));
+		if (!newPlate)
+			newPlate.Set((this->*_emitters.plate)());
+		if (!newPlate)
+			return false;
+		
+		// Position new plate (plate variation)
+		PlacePlate(newPlate, columnIndex, rowIndex, cursor.GetRandom());
+		
+		// Set name
+		NameElement(newPlate, ELEMENTKIND::PLATE, columnIndex, rowIndex);
+		
+		// Release plate into its chunk
+		InsertIntoChunk(newPlate.Release(), chunk);
+	}
+	
+	if (!SortChunks(_stageResults.plateGroup, chunks))
+		return false;
+	
+	// If required, assign texture tag to plate group
+	if (_params.plateMat && !_params.plateMatPerPlate)
+	{
+		if (!AddTextureTag(_stageResults.plateGroup, _params.plateMat, _params.plateMatScale))
+			return false;
+	}
+	
+	_stageResults.plateGroup->SetName(_params.plateGroupName);
+	return true;
+}
+
+
+Bool Sidewalk::PolygonizePrototypes()
+{
+	// The cobblestone cube is only used if there are any cobblestones, which isn't known before the layout is built
+	if (_params.cobbleCount > 0)
+	{
+		_stageResults.cobbleCube.Set(PolygonizeCobblestone());
+		if (!_stageResults.cobbleCube)
+			return false;
+	}
+	
+	if (_params.curbEnabled)
+	{
+		_stageResults.curbCube.Set(PolygonizeCurbstone(GetNominalCurbstoneSize()));
+		if (!_stageResults.curbCube)
+			return false;
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::BuildCobblestonePrototype()
+{
+	StageTimer timer(_state.statistics.cobblestoneTime);
+	
+	// Polygonize the cobblestone prototype only if there are any cobblestones
+	for (Int32 cellIndex = 0; cellIndex < _state.layout.GetCount(); ++cellIndex)
+	{
+		if (_state.layout[cellIndex] == ELEMENTTYPE::COBBLESTONES)
+		{
+			_stageResults.cobblePrototype.Set(CreateCobblestonePrototype(_stageResults.cobbleCube.Release()));
+			return _stageResults.cobblePrototype != nullptr;
+		}
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::BuildCobblestones()
+{
+	StageTimer timer(_state.statistics.cobblestoneTime);
+	
+	_stageResults.cobblestoneGroup.Set(_state.pool.GetObject(Onull));
+	if (!_stageResults.cobblestoneGroup)
+		return false;
+	
+	maxon::BaseArray<BaseObject*> chunks;
+	if (!InitChunkArray(chunks))
+		return false;
+	
+	CellCursor cursor; // Cobblestone Crumple variation
+	cursor.Init(ELEMENTTYPE::COBBLESTONES, _params.cobbleCrumpleSeed, _params.positionalSeeds);
+	
+	while (cursor.Next(*this))
+	{
+		Int32 columnIndex = cursor.GetColumn();
+		Int32 rowIndex = cursor.GetRow();
+		
+		// The chunk comes first, see BuildPlates()
+		BaseObject *chunk = GetChunk(_stageResults.cobblestoneGroup, chunks, columnIndex, rowIndex);
+		if (!chunk)
+			return false;
+		
+		// Keep the cobblestones of the previous result, or create a new cobble stone group (same size as a plate)
+		AutoFree<BaseObject> newCobblestones;
+		newCobblestones.Set(TakeKeptElement(_stageResults.keptCobblestones, columnIndex, rowIndex));
+		if (!newCobblestones)
+			newCobblestones.Set(CreateCobblestones(_stageResults.cobblePrototype, columnIndex, rowIndex, cursor.GetRandom()));
+		if (!newCobblestones)
+			return false;
+		
+		// Position new coblestone group
+		PlaceCobblestones(newCobblestones, columnIndex, rowIndex);
+		
+		// Set name
+		NameElement(newCobblestones, ELEMENTKIND::COBBLESTONES, columnIndex, rowIndex);
+		
+		// Release new coblestones into their chunk
+		InsertIntoChunk(newCobblestones.Release(), chunk);
+	}
+	
+	if (!SortChunks(_stageResults.cobblestoneGroup, chunks))
+		return false;
+	
+	// If required, assign texture tag to cobblestone group
+	if (_params.cobbleMat && !_params.cobbleMatPerStone)
+	{
+		if (!AddTextureTag(_stageResults.cobblestoneGroup, _params.cobbleMat, _params.cobbleMatScale))
+			return false;
+	}
+	
+	_stageResults.cobblestoneGroup->SetName(_params.cobblestoneGroupName);
+	return true;
+}
+
+
+Bool Sidewalk::BuildDirtPlane()
+{
+	if (!_params.dirtPlaneEnabled)
+		return true;
+	
+	StageTimer timer(_state.statistics.dirtPlaneTime);
+	
+	// Create Dirt Plane
+	_stageResults.dirtPlane.Set(CreateDirtPlane());
+	if (!_stageResults.dirtPlane)
+		return false;
+	
+	// Set Name
+	_stageResults.dirtPlane->SetName(_params.dirtPlaneName);
+	
+	// Set Position. Along a path or on a terrain, the points have been mapped instead.
+	if (IsStraight())
+		_stageResults.dirtPlane->SetRelPos(GetDirtPlanePosition());
+	
+	return true;
+}
+
+
+Bool Sidewalk::BuildCurbstones()
+{
+	if (!_params.curbEnabled)
+		return true;
+	
+	StageTimer timer(_state.statistics.curbstoneTime);
+	
+	_stageResults.curbstoneGroup.Set(CreateCurbstoneRow(_stageResults.curbCube.Release()));
+	if (!_stageResults.curbstoneGroup)
+		return false;
+	
+	// Set Group position. Along a path or on a terrain, each stone has been placed on its own.
+	if (IsStraight())
+		_stageResults.curbstoneGroup->SetRelPos(GetCurbstoneGroupPosition());
+	
+	// If required, assign texture tag to curbstone group
+	if (_params.curbMat && !_params.curbMatPerStone)
+	{
+		if (!AddTextureTag(_stageResults.curbstoneGroup, _params.curbMat, _params.curbMatScale))
+			return false;
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::UpdateHierarchy(BaseObject *cache)
+{
+	// Transient data of this update is released at once when leaving
+	ArenaScope arenaScope(_state.arena);
+	
+	// Element groups (in tile mode, they are in the tile)
+	BaseObject *componentGroup = _params.tileEnabled ? cache->GetDown() : cache;
+	if (!componentGroup)
+		return false;
+	
+	BaseObject *plateGroup = componentGroup->GetDown();
+	if (!plateGroup)
+		return false;
+	
+	BaseObject *cobblestoneGroup = plateGroup->GetNext();
+	if (!cobblestoneGroup)
+		return false;
+	
+	// Walk the elements in the same order they were built. Inside each chunk, they're in the same order as in the grid.
+	maxon::BaseArray<BaseObject*> plates;
+	maxon::BaseArray<BaseObject*> cobblestoneGroups;
+	if (!GetChunkCursors(plateGroup, plates) || !GetChunkCursors(cobblestoneGroup, cobblestoneGroups))
+		return false;
+	
+	// Same cursors as the build stages, so the random generators are in the same state
+	CellCursor plateCursor;
+	plateCursor.Init(ELEMENTTYPE::PLATE, _params.plateRndSeed, _params.positionalSeeds);
+	while (plateCursor.Next(*this))
+	{
+		BaseObject *&plate = plates[GetChunkIndex(plateCursor.GetColumn(), plateCursor.GetRow())];
+		if (!plate)
+			return false;
+		
+		PlacePlate(plate, plateCursor.GetColumn(), plateCursor.GetRow(), plateCursor.GetRandom());
+		if (_params.chunkEnabled)
+			plate->SetMl(~plate->GetUp()->GetMl() * plate->GetMl());
+		plate = plate->GetNext();
+	}
+	
+	CellCursor cobbleCursor;
+	cobbleCursor.Init(ELEMENTTYPE::COBBLESTONES, _params.cobbleCrumpleSeed, _params.positionalSeeds);
+	while (cobbleCursor.Next(*this))
+	{
+		BaseObject *&cobblestones = cobblestoneGroups[GetChunkIndex(cobbleCursor.GetColumn(), cobbleCursor.GetRow())];
+		if (!cobblestones || !UpdateCobblestones(cobblestones, cobbleCursor.GetColumn(), cobbleCursor.GetRow(), cobbleCursor.GetRandom()))
+			return false;
+		cobblestones = cobblestones->GetNext();
+	}
+	
+	// Dirt Plane
+	if (_params.dirtPlaneEnabled)
+	{
+		BaseObject *dirtPlane = cobblestoneGroup->GetNext();
+		if (!dirtPlane || !dirtPlane->IsInstanceOf(Opolygon))
+			return false;
+		
+		if (!UpdateDirtPlane(ToPoly(dirtPlane)))
+			return false;
+	}
+	
+	// Curbstones
+	if (_params.curbEnabled)
+	{
+		BaseObject *curbstoneGroup = GetCurbstoneGroup(_params, cache);
+		if (!curbstoneGroup || !UpdateCurbstoneRow(curbstoneGroup))
+			return false;
+	}
+	
+	// Collision proxies follow the elements, they're simply built again
+	if (_params.collisionProxies)
+	{
+		BaseObject *oldProxyGroup = GetCollisionGroup(_params, cache);
+		if (!oldProxyGroup)
+			return false;
+		_state.pool.Recycle(oldProxyGroup);
+		
+		BaseObject *proxyGroup = CreateCollisionProxies(cache);
+		if (!proxyGroup)
+			return false;
+		proxyGroup->InsertUnderLast(cache);
+	}
+	
+	return true;
+}
+
+
+Int32 Sidewalk::GetGridCountX() const
+{
+	return _params.tileEnabled ? _params.tileSize : _params.countX;
+}
+
+
+Int32 Sidewalk::GetGridCountZ() const
+{
+	return _params.tileEnabled ? _params.tileSize : _params.countZ;
+}
+
+
+Int32 Sidewalk::GetTileCountX() const
+{
+	return _params.tileEnabled ? (_params.countX + _params.tileSize - 1) / _params.tileSize : 1;
+}
+
+
+Int32 Sidewalk::GetTileCountZ() const
+{
+	return _params.tileEnabled ? (_params.countZ + _params.tileSize - 1) / _params.tileSize : 1;
+}
+
+
+Vector Sidewalk::GetTotalSize() const
+{
+	// In tile mode, the area is rounded up to whole tiles
+	return Vector(_params.elementSize.x * GetGridCountX() * GetTileCountX(), _params.elementSize.y, _params.elementSize.z * GetGridCountZ() * GetTileCountZ());
+}
+
+
+Int32 Sidewalk::GetChunkCountX() const
+{
+	return _params.chunkEnabled ? (GetGridCountX() + _params.chunkSizeX - 1) / _params.chunkSizeX : 1;
+}
+
+
+Int32 Sidewalk::GetChunkCountZ() const
+{
+	return _params.chunkEnabled ? (GetGridCountZ() + _params.chunkSizeZ - 1) / _params.chunkSizeZ : 1;
+}
+
+
+Int32 Sidewalk::GetChunkIndex(Int32 columnIndex, Int32 rowIndex) const
+{
+	if (!_params.chunkEnabled)
+		return 0;
+	
+	return (columnIndex / _params.chunkSizeX) * GetChunkCountZ() + rowIndex / _params.chunkSizeZ;
+}
+
+
+Matrix Sidewalk::GetChunkMatrix(Int32 chunkX, Int32 chunkZ) const
+{
+	// The last chunk of a row or column may have fewer cells
+	Int32 firstColumn = chunkX * _params.chunkSizeX;
+	Int32 firstRow = chunkZ * _params.chunkSizeZ;
+	Int32 lastColumn = Min(firstColumn + _params.chunkSizeX, GetGridCountX()) - 1;
+	Int32 lastRow = Min(firstRow + _params.chunkSizeZ, GetGridCountZ()) - 1;
+	
+	Vector center = (GetElementPosition(firstColumn, firstRow) + GetElementPosition(lastColumn, lastRow)) * 0.5;
+	return MapToGround(MatrixMove(center));
+}
+
+
+Bool Sidewalk::InitChunkArray(maxon::BaseArray<BaseObject*> &chunks) const
+{
+	if (!chunks.Resize(GetChunkCountX() * GetChunkCountZ()))
+		return false;
+	
+	for (Int32 chunkIndex = 0; chunkIndex < chunks.GetCount(); ++chunkIndex)
+		chunks[chunkIndex] = nullptr;
+	
+	return true;
+}
+
+
+BaseObject *Sidewalk::GetChunk(BaseObject *group, maxon::BaseArray<BaseObject*> &chunks, Int32 columnIndex, Int32 rowIndex)
+{
+	if (!_params.chunkEnabled)
+		return group;
+	
+	BaseObject *&chunk = chunks[GetChunkIndex(columnIndex, rowIndex)];
+	if (chunk)
+		return chunk;
+	
+	chunk = _state.pool.GetObject(Onull);
+	if (!chunk)
+		return nullptr;
+	
+	Int32 chunkX = columnIndex / _params.chunkSizeX;
+	Int32 chunkZ = rowIndex / _params.chunkSizeZ;
+	chunk->SetMl(GetChunkMatrix(chunkX, chunkZ));
+	NameElement(chunk, ELEMENTKIND::CHUNK, chunkX, chunkZ);
+	
+	// The group owns the chunk right away, so it's freed with the group if the build fails
+	chunk->InsertUnderLast(group);
+	return chunk;
+}
+
+
+void Sidewalk::InsertIntoChunk(BaseObject *element, BaseObject *chunk) const
+{
+	if (_params.chunkEnabled)
+		element->SetMl(~chunk->GetMl() * element->GetMl());
+	
+	element->InsertUnderLast(chunk);
+}
+
+
+Bool Sidewalk::SortChunks(BaseObject *group, const maxon::BaseArray<BaseObject*> &chunks) const
+{
+	if (!_params.chunkEnabled)
+		return true;
+	
+	Int32 size = 1;
+	while (size < GetChunkCountX() || size < GetChunkCountZ())
+		size *= 2;
+	
+	maxon::BaseArray<Int32> order;
+	if (!AppendMortonOrder(0, 0, size, GetChunkCountX(), GetChunkCountZ(), order))
+		return false;
+	
+	// Moving each chunk to the end in curve order leaves all of them sorted
+	for (Int32 i = 0; i < order.GetCount(); ++i)
+	{
+		BaseObject *chunk = chunks[order[i]];
+		if (!chunk)
+			continue;
+		
+		chunk->Remove();
+		chunk->InsertUnderLast(group);
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::GetChunkCursors(BaseObject *group, maxon::BaseArray<BaseObject*> &cursors) const
+{
+	if (!InitChunkArray(cursors))
+		return false;
+	
+	if (!_params.chunkEnabled)
+	{
+		cursors[0] = group->GetDown();
+		return true;
+	}
+	
+	for (BaseObject *chunk = group->GetDown(); chunk; chunk = chunk->GetNext())
+	{
+		// The ID holds the chunk's position in the chunk grid, see GetChunk()
+		Int32 chunkX, chunkZ;
+		GetElementID(chunk, chunkX, chunkZ);
+		if (chunkX >= GetChunkCountX() || chunkZ >= GetChunkCountZ())
+			return false;
+		
+		cursors[chunkX * GetChunkCountZ() + chunkZ] = chunk->GetDown();
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::IsTileVariationActive() const
+{
+	// Shifted rows reach into the neighbouring tiles, they would not fit any more after flipping or rotating
+	return _params.tileEnabled && _params.tileVariation != SIDEWALK_TILE_VARIATION_NONE && Abs(_params.shift) < 0.001;
+}
+
+
+Bool Sidewalk::CreateTileInstances(BaseObject *tile, BaseObject *parent)
+{
+	if (!tile || !parent)
+		return false;
+	
+	Int32 tileCountX = GetTileCountX();
+	Int32 tileCountZ = GetTileCountZ();
+	Vector tileSize = Vector(_params.elementSize.x * _params.tileSize, 0.0, _params.elementSize.z * _params.tileSize);
+	
+	// Flipping and rotating happens around the center of the tile's content
+	Vector tileCenter = Vector(0.0, 0.0, _params.elementSize.z * (_params.tileSize - 1) * 0.5);
+	
+	Random variationRnd;
+	variationRnd.Init(_params.tileSeed);
+	
+	for (Int32 tileX = 0; tileX < tileCountX; ++tileX)
+	{
+		for (Int32 tileZ = 0; tileZ < tileCountZ; ++tileZ)
+		{
+			Vector tileOffset = Vector(tileSize.x * (tileX - (tileCountX - 1) * 0.5), 0.0, tileSize.z * tileZ);
+			
+			// The first slot is taken by the tile itself
+			if (tileX == 0 && tileZ == 0)
+			{
+				tile->SetRelPos(tileOffset);
+				continue;
+			}
+			
+			// Random flip or rotation
+			Matrix tileMatrix;
+			if (IsTileVariationActive())
+			{
+				Int32 variation = (Int32)(variationRnd.Get01() * 4.0);
+				if (_params.tileVariation == SIDEWALK_TILE_VARIATION_ROTATE)
+				{
+					// Either 0° or 180°
+					variation = (variation % 2) * 3;
+				}
+				
+				if (variation & 1)
+					tileMatrix.v1 = Vector(-1.0, 0.0, 0.0);
+				if (variation & 2)
+					tileMatrix.v3 = Vector(0.0, 0.0, -1.0);
+			}
+			tileMatrix.off = tileOffset + tileCenter - tileMatrix * tileCenter;
+			
+			// Create instance
+			AutoFree<BaseObject> newInstance;
+			newInstance.Set(_state.pool.GetObject(Oinstance));
+			if (!newInstance)
+				return false;
+			
+			BaseContainer *instanceData = newInstance->GetDataInstance();
+			if (!instanceData)
+				return false;
+			
+			instanceData->SetLink(INSTANCEOBJECT_LINK, tile);
+			instanceData->SetBool(INSTANCEOBJECT_RENDERINSTANCE, true);
+			
+			newInstance->SetMl(tileMatrix);
+			NameElement(newInstance, ELEMENTKIND::TILEINSTANCE, tileX, tileZ);
+			
+			// Release instance into parent
+			newInstance->InsertUnderLast(parent);
+			newInstance.Release();
+		}
+	}
+	
+	return true;
+}
+
+
+Vector Sidewalk::GetElementPosition(Int32 columnIndex, Int32 rowIndex) const
+{
+	// Note that every 2nd row is shifted
+	return Vector(_params.elementSize.x * columnIndex - _params.elementSize.x * ((Float)GetGridCountX() - 1.0) * 0.5,
+	              0.0,
+	              _params.elementSize.z * rowIndex + _params.shift * ((columnIndex % 2 == 0) ? 1.0 : 0.0)) + _params.gridOffset;
+}
+
+
+Bool Sidewalk::ClassifyFootprint()
+{
+	_state.cellClasses.Flush();
+	_state.dirtBlockClasses.Flush();
+	if (!_params.footprint.IsValid())
+		return true;
+	
+	Int32 cellCount = GetGridCountX() * GetGridCountZ();
+	if (!_state.cellClasses.Resize(cellCount) || !_state.dirtBlockClasses.Resize(cellCount))
+		return false;
+	
+	// Corner of the first cell of an unshifted column
+	Float originX = _params.gridOffset.x - _params.elementSize.x * (Float)GetGridCountX() * 0.5;
+	Float originZ = _params.gridOffset.z - _params.elementSize.z * 0.5;
+	
+	// Elements are shifted in every 2nd column, the blocks of the dirt plane are not
+	return _params.footprint.Classify(originX, originZ, _params.elementSize, GetGridCountX(), GetGridCountZ(), _params.shift, _state.cellClasses.GetFirst()) &&
+	       _params.footprint.Classify(originX, originZ, _params.elementSize, GetGridCountX(), GetGridCountZ(), 0.0, _state.dirtBlockClasses.GetFirst());
+}
+
+
+FOOTPRINTCELL Sidewalk::GetCellClass(Int32 columnIndex, Int32 rowIndex) const
+{
+	if (_state.cellClasses.GetCount() == 0)
+		return FOOTPRINTCELL::INSIDE;
+	
+	return _state.cellClasses[columnIndex * GetGridCountZ() + rowIndex];
+}
+
+
+FOOTPRINTCELL Sidewalk::GetDirtBlockClass(Int32 columnIndex, Int32 rowIndex) const
+{
+	if (_state.dirtBlockClasses.GetCount() == 0)
+		return FOOTPRINTCELL::INSIDE;
+	
+	return _state.dirtBlockClasses[columnIndex * GetGridCountZ() + rowIndex];
+}
+
+
+ELEMENTTYPE Sidewalk::ClipToFootprint(ELEMENTTYPE cellType, Int32 columnIndex, Int32 rowIndex) const
+{
+	switch (GetCellClass(columnIndex, rowIndex))
+	{
+		case FOOTPRINTCELL::OUTSIDE:
+			return ELEMENTTYPE::HOLE;
+		
+		case FOOTPRINTCELL::BOUNDARY:
+		{
+			// Plates can't be cut, cobblestones are small enough to follow the outline
+			if (cellType == ELEMENTTYPE::HOLE)
+				return ELEMENTTYPE::HOLE;
+			
+			Int32 stoneIndex = 0;
+			Int32 stoneColumn, stoneRow;
+			return GetNextCobblestoneInside(columnIndex, rowIndex, stoneIndex, stoneColumn, stoneRow) ? ELEMENTTYPE::COBBLESTONES : ELEMENTTYPE::HOLE;
+		}
+		
+		default:
+			return cellType;
+	}
+}
+
+
+Matrix Sidewalk::MapToGround(const Matrix &matrix) const
+{
+	Matrix groundMatrix = matrix;
+	
+	// The path starts at the near edge of the first row
+	if (_params.path.IsValid())
+	{
+		groundMatrix.off.z += _params.elementSize.z * 0.5;
+		groundMatrix = _params.path.Follow(groundMatrix);
+	}
+	
+	// The terrain is looked up where the element ends up
+	if (_params.terrain.IsValid())
+		groundMatrix = _params.terrain.Conform(groundMatrix);
+	
+	return groundMatrix;
+}
+
+
+Vector Sidewalk::MapToGround(const Vector &point) const
+{
+	Vector groundPoint = point;
+	
+	if (_params.path.IsValid())
+		groundPoint = _params.path.Follow(groundPoint + Vector(0.0, 0.0, _params.elementSize.z * 0.5));
+	
+	if (_params.terrain.IsValid())
+		groundPoint = _params.terrain.Conform(groundPoint);
+	
+	return groundPoint;
+}
+
+
+void Sidewalk::PlacePlate(BaseObject *plate, Int32 columnIndex, Int32 rowIndex, Random &rnd) const
+{
+	Vector elementPos = GetElementPosition(columnIndex, rowIndex);
+	
+	// Compute random position variation
+	elementPos += _params.plateRndPos * Vector(rnd.Get11(), rnd.Get11(), rnd.Get11());
+	
+	// Compute random rotation variation
+	Vector elementRot = _params.plateRndRot * Vector(rnd.Get11(), rnd.Get11(), rnd.Get11());
+	
+	// Along a path or on a terrain, the plate is turned with it
+	if (!IsStraight())
+	{
+		Matrix plateMatrix = HPBToMatrix(elementRot, ROTATIONORDER_DEFAULT);
+		plateMatrix.off = elementPos;
+		plate->SetMl(MapToGround(plateMatrix));
+		return;
+	}
+	
+	// Set position and rotation to plate
+	plate->SetRelPos(elementPos);
+	plate->SetRelRot(elementRot);
+}
+
+
+template <Bool USEPHONG, Bool MATPERPLATE>
+BaseObject *Sidewalk::CreateSinglePlate()
+{
+	// Create new plate
+	AutoFree<BaseObject> newPlate;
+	newPlate.Set(_state.pool.GetObject(Ocube));
+	if (!newPlate)
+		return nullptr;
+	
+	// Calculate actual size of plate (elementSize - gapSize)
+	Vector gappedSize = _params.elementSize - Vector(_params.plateGap, 0.0, _params.plateGap);
+
+	// Get plate's container
+	BaseContainer *plateData = newPlate->GetDataInstance();
+	if (!plateData)
+		return nullptr;
+	
+	// Set plate parameters
+	plateData->SetVector(PRIM_CUBE_LEN, gappedSize);
+	plateData->SetBool(PRIM_CUBE_DOFILLET, (_params.plateFilletRad > 0.0));
+	plateData->SetFloat(PRIM_CUBE_FRAD, _params.plateFilletRad);
+	plateData->SetInt32(PRIM_CUBE_SUBF, _params.plateFilletSubd);
+	
+	// Apply Phong tag
+	if (USEPHONG)
+	{
+		if (!AddPhongTag(newPlate))
+			return nullptr;
+	}
+	
+	// Apply material
+	if (MATPERPLATE)
+	{
+		if (!AddTextureTag(newPlate, _params.plateMat, _params.plateMatScale))
+			return nullptr;
+	}
+	
+	// Release & return
+	return newPlate.Release();
+}
+
+
+Vector Sidewalk::GetCobblestoneSize() const
+{
+	Float invCobbleCount = 1.0 / _params.cobbleCount;
+	return Vector(_params.elementSize.x * invCobbleCount, _params.elementSize.y, _params.elementSize.z * invCobbleCount);
+}
+
+
+PolygonObject *Sidewalk::PolygonizeCobblestone() const
+{
+	// Size of a single cobblestone
+	if (_params.cobbleCount == 0)
+		return nullptr;
+	
+	Vector stoneSize = GetCobblestoneSize();
+	
+	// Create a new Cube: That's our cobblestone prototype
+	AutoAlloc<BaseObject> newPrototypeCobblestone(Ocube);
+	if (!newPrototypeCobblestone)
+		return nullptr;
+	
+	// Get new cube's container
+	BaseContainer	*cobblestoneData = newPrototypeCobblestone->GetDataInstance();
+	if (!cobblestoneData)
+		return nullptr;
+	
+	// Calculate actual size
+	Vector gappedStoneSize = stoneSize - Vector(_params.cobbleGap, 0.0, _params.cobbleGap);
+	
+	// Set basic cobblestone parameters
+	cobblestoneData->SetVector(PRIM_CUBE_LEN, gappedStoneSize);
+	cobblestoneData->SetInt32(PRIM_CUBE_SUBX, _params.cobbleSubdiv);
+	cobblestoneData->SetInt32(PRIM_CUBE_SUBY, _params.cobbleSubdiv);
+	cobblestoneData->SetInt32(PRIM_CUBE_SUBZ, _params.cobbleSubdiv);
+	cobblestoneData->SetBool(PRIM_CUBE_DOFILLET, _params.cobbleFilletRad > 0.0);
+	cobblestoneData->SetFloat(PRIM_CUBE_FRAD, _params.cobbleFilletRad);
+	cobblestoneData->SetInt32(PRIM_CUBE_SUBF, _params.cobbleFilletSubd);
+	
+	// Get cobblestone polygon object: That's our 'polygonized' cobblestone prototype
+	return static_cast<PolygonObject*>(MakeEditable(newPrototypeCobblestone, _doc));
+}
+
+
+PolygonObject *Sidewalk::CreateCobblestonePrototype(PolygonObject *cube)
+{
+	AutoFree<PolygonObject>	cobblePoly;
+	cobblePoly.Set(cube);
+	if (!cobblePoly)
+		return nullptr;
+	
+	// Each stone gets its own tags, only geometry and UVWs are taken from the prototype
+	cobblePoly->KillTag(Tphong);
+	
+	if (!OptimizePrototype(cobblePoly))
+		return nullptr;
+	
+	// Remember uncrumpled points and normals
+	Int32 pointCount = cobblePoly->GetPointCount();
+	if (!_state.cobblePoints.Set(cobblePoly->GetPointR(), pointCount, _params.quantizeCache))
+		return nullptr;
+	
+	if (!GetVertexNormals(cobblePoly, _state.cobbleNormals, _params.quantizeCache, _state.arena))
+		return nullptr;
+	
+	// Crumpled points of a group are written here first
+	if (!_state.crumpledCobblePoints.Resize(pointCount))
+		return nullptr;
+	
+	return cobblePoly.Release();
+}
+
+
+BaseObject *Sidewalk::CreateCobblestones(PolygonObject *prototype, Int32 cellColumn, Int32 cellRow, Random &rnd)
+{
+	if (!prototype)
+		return nullptr;
+	
+	Int32 pointCount = prototype->GetPointCount();
+	if (pointCount != _state.cobblePoints.GetCount() || pointCount != _state.crumpledCobblePoints.GetCount())
+		return nullptr;
+	
+	// Crumpled points, shared by all stones of this group
+	CrumpleCobblestone(_state.crumpledCobblePoints.GetFirst(), rnd);
+	
+	// Create Null Object to group Cobblestones in
+	AutoFree<BaseObject> cobbleGroup;
+	cobbleGroup.Set(_state.pool.GetObject(Onull));
+	if (!cobbleGroup)
+		return nullptr;
+	
+	// Create all cobblestones
+	if (!(this->*_emitters.cobblestones)(cobbleGroup, prototype, cellColumn, cellRow, rnd))
+		return nullptr;
+	
+	// Release & return result
+	return cobbleGroup.Release();
+}
+
+
+template <Bool USEPHONG, Bool MATPERSTONE>
+Bool Sidewalk::EmitCobblestones(BaseObject *group, PolygonObject *prototype, Int32 cellColumn, Int32 cellRow, Random &rnd)
+{
+	Int32 pointCount = prototype->GetPointCount();
+	
+	// Iterate & create all cobblestones. Stones that reach out of the footprint are left out.
+	Int32 stoneIndex = 0;
+	Int32 columsIndex, rowIndex;
+	while (GetNextCobblestoneInside(cellColumn, cellRow, stoneIndex, columsIndex, rowIndex))
+	{
+		// Create a single cobblestone
+		AutoFree<PolygonObject> newCobblestone;
+		newCobblestone.Set(_state.pool.GetPolygonCopy(prototype));
+		if (!newCobblestone)
+			return false;
+		
+		CopyMem(_state.crumpledCobblePoints.GetFirst(), newCobblestone->GetPointW(), sizeof(Vector) * pointCount);
+		newCobblestone->Message(MSG_UPDATE);
+		
+		// Attach Phong Tag
+		if (USEPHONG)
+		{
+			if (!AddPhongTag(newCobblestone))
+				return false;
+		}
+		
+		// Apply material
+		if (MATPERSTONE)
+		{
+			if (!AddTextureTag(newCobblestone, _params.cobbleMat, _params.cobbleMatScale))
+				return false;
+		}
+		
+		// Set name to new cobblestone
+		NameElement(newCobblestone, ELEMENTKIND::COBBLESTONE, columsIndex, rowIndex);
+		
+		// Set position and rotation to stone
+		PlaceCobblestone(newCobblestone, columsIndex, rowIndex, rnd);
+		
+		// Release to group
+		newCobblestone->InsertUnderLast(group);
+		newCobblestone.Release();
+	}
+	
+	return true;
+}
+
+
+Bool Sidewalk::UpdateCobblestones(BaseObject *group, Int32 cellColumn, Int32 cellRow, Random &rnd) const
+{
+	Int32 pointCount = _state.cobblePoints.GetCount();
+	
+	// The first stone is crumpled, all others get a copy of its points
+	BaseObject *stone = group->GetDown();
+	if (!stone || !stone->IsInstanceOf(Opolygon) || ToPoly(stone)->GetPointCount() != pointCount)
+		return false;
+	
+	PolygonObject *firstStone = ToPoly(stone);
+	CrumpleCobblestone(firstStone->GetPointW(), rnd);
+	
+	Int32 stoneIndex = 0;
+	Int32 columsIndex, rowIndex;
+	while (GetNextCobblestoneInside(cellColumn, cellRow, stoneIndex, columsIndex, rowIndex))
+	{
+		if (!stone || !stone->IsInstanceOf(Opolygon) || ToPoly(stone)->GetPointCount() != pointCount)
+			return false;
+		
+		PolygonObject *stonePoly = ToPoly(stone);
+		if (stonePoly != firstStone)
+			CopyMem(firstStone->GetPointR(), stonePoly->GetPointW(), sizeof(Vector) * pointCount);
+		
+		stonePoly->Message(MSG_UPDATE);
+		PlaceCobblestone(stonePoly, columsIndex, rowIndex, rnd);
+		
+		stone = stone->GetNext();
+	}
+	
+	return true;
+}
+
+
+void Sidewalk::CrumpleCobblestone(Vector *pointArr, Random &rnd) const
+{
+	_state.cobblePoints.Get(pointArr);
+	
+	// Crumple cobblestone geometry
+	if (_params.cobbleCrumple > 0.0)
+		CrumplePoints(pointArr, _state.cobbleNormals, _params.cobbleCrumple, rnd);
+}
+
+
+Vector Sidewalk::GetCobblestonePosition(Int32 columsIndex, Int32 rowIndex) const
+{
+	Vector stoneSize = GetCobblestoneSize();
+	return Vector(stoneSize.x * columsIndex - stoneSize.x * ((Float)_params.cobbleCount - 1.0) * 0.5,
+	              0.0,
+	              stoneSize.z * rowIndex - stoneSize.z * ((Float)_params.cobbleCount - 1.0) * 0.5);
+}
+
+
+Bool Sidewalk::IsCobblestoneInside(Int32 cellColumn, Int32 cellRow, Int32 columsIndex, Int32 rowIndex) const
+{
+	// Only cells on the outline have to be checked stone by stone
+	if (GetCellClass(cellColumn, cellRow) != FOOTPRINTCELL::BOUNDARY)
+		return true;
+	
+	Vector stoneCenter = GetElementPosition(cellColumn, cellRow) + GetCobblestonePosition(columsIndex, rowIndex);
+	Vector halfSize = GetCobblestoneSize() * 0.5;
+	return _params.footprint.ContainsRect(stoneCenter - halfSize, stoneCenter + halfSize);
+}
+
+
+Bool Sidewalk::GetNextCobblestoneInside(Int32 cellColumn, Int32 cellRow, Int32 &stoneIndex, Int32 &columsIndex, Int32 &rowIndex) const
+{
+	while (stoneIndex < _params.cobbleCount * _params.cobbleCount)
+	{
+		columsIndex = stoneIndex / _params.cobbleCount;
+		rowIndex = stoneIndex % _params.cobbleCount;
+		++stoneIndex;
+		
+		if (IsCobblestoneInside(cellColumn, cellRow, columsIndex, rowIndex))
+			return true;
+	}
+	
+	return false;
+}
+
+
+void Sidewalk::PlaceCobblestones(BaseObject *group, Int32 columnIndex, Int32 rowIndex) const
+{
+	Vector groupPos = GetElementPosition(columnIndex, rowIndex) + Vector(0.0, _params.cobbleElevation, 0.0);
+	
+	// Along a path or on a terrain, the whole group is turned with it, the stones keep their places inside
+	if (!IsStraight())
+		group->SetMl(MapToGround(MatrixMove(groupPos)));
+	else
+		group->SetRelPos(groupPos);
+}
+
+
+void Sidewalk::PlaceCobblestone(BaseObject *stone, Int32 columsIndex, Int32 rowIndex, Random &rnd) const
+{
+	// Calculate position for new stone
+	Vector cobblePos = GetCobblestonePosition(columsIndex, rowIndex);
+	
+	// Calculate position variation
+	cobblePos += Vector(_params.cobbleRndPos.x * rnd.GetG11(),
+	                    _params.cobbleRndPos.y * rnd.GetG11(),
+	                    _params.cobbleRndPos.z * rnd.GetG11());
+	
+	// Calculate basic rotation (randomly rotating the stone by 0°, 90°, 180° or 270°)
+	Vector cobbleRot = Vector(GetHardRndAngle(rnd, RANDOMANGLE::GETALL), 0.0, GetHardRndAngle(rnd, RANDOMANGLE::GET180));
+	
+	// Calculate rotation variation
+	cobbleRot += Vector(_params.cobbleRndRot.x * rnd.GetG11(),
+	                    _params.cobbleRndRot.y * rnd.GetG11(),
+	                    _params.cobbleRndRot.z * rnd.GetG11());
+	
+	// Set position and rotation to stone
+	stone->SetRelPos(cobblePos);
+	stone->SetRelRot(cobbleRot);
+}
+
+
+Bool Sidewalk::IsDirtBlockVisible(Int32 columnIndex, Int32 rowIndex) const
+{
+	// Shift of this column in units of element length (note that every 2nd row is shifted)
+	Float shift = (columnIndex % 2 == 0) ? (_params.shift / _params.elementSize.z) : 0.0;
+	
+	// The block overlaps one element if the shift is a multiple of the element length, otherwise two
+	Float elementPos = (Float)rowIndex - shift;
+	Int32 firstRow = (Int32)Floor(elementPos + 0.001);
+	Int32 lastRow = (Int32)Ceil(elementPos - 0.001);
+	
+	for (Int32 elementRow = firstRow; elementRow <= lastRow; ++elementRow)
+	{
+		Int32 layoutRow = elementRow;
+		if (elementRow < 0 || elementRow >= GetGridCountZ())
+		{
+			// Outside the grid there are no plates, unless tiles continue it
+			if (!_params.tileEnabled)
+				return true;
+			
+			layoutRow = (elementRow + GetGridCountZ()) % GetGridCountZ();
+		}
+		
+		// Missing elements and gaps between cobblestones reveal the dirt
+		if (_state.layout[columnIndex * GetGridCountZ() + layoutRow] != ELEMENTTYPE::PLATE)
+			return true;
+	}
+	
+	return false;
+}
+
+
+Int32 Sidewalk::GetDirtCellCountX() const
+{
+	Int32 subd = Max(_params.dirtPlaneSubd, (Int32)1);
+	if (IsStraight() && !_params.footprint.IsValid())
+		return subd;
+	
+	return Max(subd, GetGridCountX());
+}
+
+
+Int32 Sidewalk::GetDirtCellCountZ() const
+{
+	Int32 subd = Max(_params.dirtPlaneSubd, (Int32)1);
+	if (IsStraight() && !_params.footprint.IsValid())
+		return subd;
+	
+	return Max(subd, GetGridCountZ());
+}
+
+
+Int32 Sidewalk::GetDirtPatchCountX() const
+{
+	return Min(GetDirtCellCountX(), GetGridCountX());
+}
+
+
+Int32 Sidewalk::GetDirtPatchCountZ() const
+{
+	return Min(GetDirtCellCountZ(), GetGridCountZ());
+}
+
+
+void Sidewalk::GetDirtPatchSpan(Int32 patchIndex, Int32 cellCount, Int32 patchCount, Int32 &first, Int32 &last)
+{
+	// The cells are spread evenly, patches differ by one cell at most
+	first = (Int32)((Int64)patchIndex * cellCount / patchCount);
+	last = (Int32)((Int64)(patchIndex + 1) * cellCount / patchCount);
+}
+
+
+void Sidewalk::GetDirtBlockSpan(Int32 first, Int32 last, Int32 cellCount, Int32 blockCount, Bool closed, Int32 &firstBlock, Int32 &lastBlock)
+{
+	// Block b spans the lattice coordinates from b * cellCount / blockCount to (b + 1) * cellCount / blockCount.
+	// Scaled by blockCount, the borders are integers, so a span that ends exactly on a border is not rounded into the next block.
+	Int64 firstPos = (Int64)first * blockCount;
+	Int64 lastPos = (Int64)last * blockCount;
+	if (closed)
+	{
+		firstBlock = (Int32)((firstPos + cellCount - 1) / cellCount - 1);
+		lastBlock = (Int32)(lastPos / cellCount);
+	}
+	else
+	{
+		firstBlock = (Int32)(firstPos / cellCount);
+		lastBlock = (Int32)((lastPos + cellCount - 1) / cellCount - 1);
+	}
+	
+	firstBlock = Max(firstBlock, (Int32)0);
+	lastBlock = Min(lastBlock, blockCount - 1);
+}
+
+
+DIRTPATCH Sidewalk::GetDirtPatchMode(Int32 patchX, Int32 patchZ) const
+{
+	Int32 x0, x1, z0, z1;
+	GetDirtPatchSpan(patchX, GetDirtCellCountX(), GetDirtPatchCountX(), x0, x1);
+	GetDirtPatchSpan(patchZ, GetDirtCellCountZ(), GetDirtPatchCountZ(), z0, z1);
+	
+	Int32 firstColumn, lastColumn, firstRow, lastRow;
+	GetDirtBlockSpan(x0, x1, GetDirtCellCountX(), GetGridCountX(), false, firstColumn, lastColumn);
+	GetDirtBlockSpan(z0, z1, GetDirtCellCountZ(), GetGridCountZ(), false, firstRow, lastRow);
+	
+	Bool anyInside = false;
+	Bool anyOutside = false;
+	Bool visible = false;
+	for (Int32 columnIndex = firstColumn; columnIndex <= lastColumn; ++columnIndex)
+	{
+		for (Int32 rowIndex = firstRow; rowIndex <= lastRow; ++rowIndex)
+		{
+			FOOTPRINTCELL blockClass = GetDirtBlockClass(columnIndex, rowIndex);
+			if (blockClass == FOOTPRINTCELL::OUTSIDE)
+			{
+				anyOutside = true;
+				continue;
+			}
+			
+			anyInside = true;
+			if (blockClass == FOOTPRINTCELL::BOUNDARY || IsDirtBlockVisible(columnIndex, rowIndex))
+				visible = true;
+		}
+	}
+	
+	if (!anyInside)
+		return DIRTPATCH::OUTSIDE;
+	
+	// Where a patch reaches out of the footprint, its cells are left out one by one
+	if (visible || anyOutside)
+		return DIRTPATCH::FULL;
+	
+	return DIRTPATCH::COARSE;
+}
+
+
+Bool Sidewalk::IsDirtCellOutside(Int32 x, Int32 z) const
+{
+	if (_state.dirtBlockClasses.GetCount() == 0)
+		return false;
+	
+	Int32 firstColumn, lastColumn, firstRow, lastRow;
+	GetDirtBlockSpan(x, x + 1, GetDirtCellCountX(), GetGridCountX(), false, firstColumn, lastColumn);
+	GetDirtBlockSpan(z, z + 1, GetDirtCellCountZ(), GetGridCountZ(), false, firstRow, lastRow);
+	
+	for (Int32 columnIndex = firstColumn; columnIndex <= lastColumn; ++columnIndex)
+	{
+		for (Int32 rowIndex = firstRow; rowIndex <= lastRow; ++rowIndex)
+		{
+			if (GetDirtBlockClass(columnIndex, rowIndex) != FOOTPRINTCELL::OUTSIDE)
+				return false;
+		}
+	}
+	
+	return true;
+}
+
+
+Vector Sidewalk::GetDirtPatchCenter(Int32 patchX, Int32 patchZ) const
+{
+	Int32 x0, x1, z0, z1;
+	GetDirtPatchSpan(patchX, GetDirtCellCountX(), GetDirtPatchCountX(), x0, x1);
+	GetDirtPatchSpan(patchZ, GetDirtCellCountZ(), GetDirtPatchCountZ(), z0, z1);
+	
+	return Vector(_params.elementSize.x * (Float)GetGridCountX() * ((Float)(x0 + x1) * 0.5 / (Float)GetDirtCellCountX() - 0.5),
+	              0.0,
+	              _params.elementSize.z * (Float)GetGridCountZ() * ((Float)(z0 + z1) * 0.5 / (Float)GetDirtCellCountZ() - 0.5));
+}
+
+
+Int32 Sidewalk::GetDirtPatchPolygons(Int32 patchX, Int32 patchZ, Int32 centerIndex, CPolygon *polygonArr, Bool &usesCenter) const
+{
+	usesCenter = false;
+	
+	DIRTPATCH mode = GetDirtPatchMode(patchX, patchZ);
+	if (mode == DIRTPATCH::OUTSIDE)
+		return 0;
+	
+	Int32 patchCountX = GetDirtPatchCountX();
+	Int32 patchCountZ = GetDirtPatchCountZ();
+	Int32 latticeCountZ = GetDirtCellCountZ() + 1;
+	
+	Int32 x0, x1, z0, z1;
+	GetDirtPatchSpan(patchX, GetDirtCellCountX(), patchCountX, x0, x1);
+	GetDirtPatchSpan(patchZ, GetDirtCellCountZ(), patchCountZ, z0, z1);
+	
+	Int32 polygonCount = 0;
+	if (mode == DIRTPATCH::FULL)
+	{
+		// Regular grid, without the cells outside of the footprint
+		for (Int32 x = x0; x < x1; ++x)
+		{
+			for (Int32 z = z0; z < z1; ++z)
+			{
+				if (IsDirtCellOutside(x, z))
+					continue;
+				
+				if (polygonArr)
+				{
+					polygonArr[polygonCount] = CPolygon(x * latticeCountZ + z,
+					                                     x * latticeCountZ + z + 1,
+					                                     (x + 1) * latticeCountZ + z + 1,
+					                                     (x + 1) * latticeCountZ + z);
+				}
+				++polygonCount;
+			}
+		}
+		return polygonCount;
+	}
+	
+	// The border, walking +Z, +X, -Z, -X keeps the normals pointing up. Each side has a neighbour patch.
+	Int32 cornerX[5] = { x0, x0, x1, x1, x0 };
+	Int32 cornerZ[5] = { z0, z1, z1, z0, z0 };
+	Int32 neighbourX[4] = { patchX - 1, patchX, patchX + 1, patchX };
+	Int32 neighbourZ[4] = { patchZ, patchZ + 1, patchZ, patchZ - 1 };
+	
+	// A side is subdivided where a full patch is next to it, otherwise it would leave T-junctions.
+	// Beyond the plane's border, the next tile may have a full patch there.
+	Int32 sideSteps[4];
+	for (Int32 side = 0; side < 4; ++side)
+	{
+		Bool detailed = _params.tileEnabled;
+		if (neighbourX[side] >= 0 && neighbourX[side] < patchCountX && neighbourZ[side] >= 0 && neighbourZ[side] < patchCountZ)
+			detailed = GetDirtPatchMode(neighbourX[side], neighbourZ[side]) == DIRTPATCH::FULL;
+		
+		sideSteps[side] = detailed ? Abs(cornerX[side + 1] - cornerX[side]) + Abs(cornerZ[side + 1] - cornerZ[side]) : 1;
+		if (sideSteps[side] > 1)
+			usesCenter = true;
+	}
+	
+	// Nothing to stitch, a single quad covers the patch
+	if (!usesCenter)
+	{
+		if (polygonArr)
+			polygonArr[0] = CPolygon(x0 * latticeCountZ + z0, x0 * latticeCountZ + z1, x1 * latticeCountZ + z1, x1 * latticeCountZ + z0);
+		return 1;
+	}
+	
+	// Triangle fan around the border
+	for (Int32 side = 0; side < 4; ++side)
+	{
+		Int32 steps = sideSteps[side];
+		Int32 deltaX = cornerX[side + 1] - cornerX[side];
+		Int32 deltaZ = cornerZ[side + 1] - cornerZ[side];
+		for (Int32 step = 0; step < steps; ++step)
+		{
+			if (polygonArr)
+			{
+				Int32 xa = cornerX[side] + deltaX * step / steps;
+				Int32 za = cornerZ[side] + deltaZ * step / steps;
+				Int32 xb = cornerX[side] + deltaX * (step + 1) / steps;
+				Int32 zb = cornerZ[side] + deltaZ * (step + 1) / steps;
+				polygonArr[polygonCount] = CPolygon(centerIndex, xa * latticeCountZ + za, xb * latticeCountZ + zb);
+			}
+			++polygonCount;
+		}
+	}
+	
+	return polygonCount;
+}
+
+
+Vector Sidewalk::GetDirtLatticePoint(Int32 x, Int32 z) const
+{
+	Int32 cellCountX = GetDirtCellCountX();
+	Int32 cellCountZ = GetDirtCellCountZ();
+	
+	Vector point(_params.elementSize.x * (Float)GetGridCountX() * ((Float)x / (Float)cellCountX - 0.5),
+	             0.0,
+	             _params.elementSize.z * (Float)GetGridCountZ() * ((Float)z / (Float)cellCountZ - 0.5));
+	
+	if (_params.tileEnabled)
+	{
+		// Tiles have to fit seamlessly. If they are flipped or rotated, the border can't be crumpled.
+		if (IsTileVariationActive() && (x == 0 || x == cellCountX || z == 0 || z == cellCountZ))
+			return point;
+		
+		// Otherwise, the crumple wraps around
+		x %= cellCountX;
+		z %= cellCountZ;
+	}
+	else
+	{
+		// Plan a little extra width, in case the sidewalk also has curbstones
+		// If we don't do this, there might be a visible gap between the plane and the crumpled curbstone.
+		// The exact value is not important, it should just somehow close the gap
+		Float extraWidth = _params.curbCrumpleVal * 5.0;
+		if (x == 0)
+			point.x -= extraWidth * 0.5;
+		else if (x == cellCountX)
+			point.x += extraWidth * 0.5;
+	}
+	
+	// Crumple (the plane's normal always points up)
+	point.y = _params.dirtPlaneCrumple * GetPositionalRnd11(_params.dirtPlaneCrumpleSeed, x, z);
+	
+	// Cut the plane to the footprint's outline
+	if (IsDirtLatticePointOnBoundary(x, z))
+	{
+		Vector planePos = GetDirtPlanePosition();
+		if (!_params.footprint.IsInside(planePos + point))
+			point = _params.footprint.GetNearestPoint(planePos + point) - planePos;
+	}
+	
+	return point;
+}
+
+
+Bool Sidewalk::IsDirtLatticePointOnBoundary(Int32 x, Int32 z) const
+{
+	if (_state.dirtBlockClasses.GetCount() == 0)
+		return false;
+	
+	// A lattice point belongs to up to four blocks
+	Int32 firstColumn, lastColumn, firstRow, lastRow;
+	GetDirtBlockSpan(x, x, GetDirtCellCountX(), GetGridCountX(), true, firstColumn, lastColumn);
+	GetDirtBlockSpan(z, z, GetDirtCellCountZ(), GetGridCountZ(), true, firstRow, lastRow);
+	
+	for (Int32 columnIndex = firstColumn; columnIndex <= lastColumn; ++columnIndex)
+	{
+		for (Int32 rowIndex = firstRow; rowIndex <= lastRow; ++rowIndex)
+		{
+			if (GetDirtBlockClass(columnIndex, rowIndex) == FOOTPRINTCELL::BOUNDARY)
+				return true;
+		}
+	}
+	
+	return false;
+}
+
+
+Vector Sidewalk::GetDirtPlanePosition() const
+{
+	return Vector(_params.gridOffset.x, _params.dirtPlaneElevation, _params.elementSize.z * GetGridCountZ() * 0.5 - _params.elementSize.z * 0.5 + _params.gridOffset.z);
+}
+
+
+BaseObject *Sidewalk::CreateDirtPlane()
+{
+	if (GetGridCountX() < 1 || GetGridCountZ() < 1)
+		return nullptr;
+	
+	// Resolution of the lattice, the subdivision is for the whole plane
+	Int32 cellCountX = GetDirtCellCountX();
+	Int32 cellCountZ = GetDirtCellCountZ();
+	Int32 latticeCountX = cellCountX + 1;
+	Int32 latticeCountZ = cellCountZ + 1;
+	Int32 latticeIndexCount = latticeCountX * latticeCountZ;
+	Int32 patchCountX = GetDirtPatchCountX();
+	Int32 patchCountZ = GetDirtPatchCountZ();
+	
+	// Count the polygons and fans of all patches
+	Int32 polygonCount = 0;
+	Int32 fanCount = 0;
+	for (Int32 patchX = 0; patchX < patchCountX; ++patchX)
+	{
+		for (Int32 patchZ = 0; patchZ < patchCountZ; ++patchZ)
+		{
+			Bool usesCenter = false;
+			polygonCount += GetDirtPatchPolygons(patchX, patchZ, NOTOK, nullptr, usesCenter);
+			if (usesCenter)
+				++fanCount;
+		}
+	}
+	
+	// Polygons of lattice indices. Each fan's center gets an index behind the lattice.
+	CPolygon *latticePolygonArr = _state.arena.Alloc<CPolygon>(Max(polygonCount, (Int32)1));
+	Int32 *fanPatches = _state.arena.Alloc<Int32>(Max(fanCount, (Int32)1));
+	Int32 *latticeIndex = _state.arena.Alloc<Int32>(latticeIndexCount);
+	if (!latticePolygonArr || !fanPatches || !latticeIndex)
+		return nullptr;
+	
+	Int32 polygonIndex = 0;
+	Int32 fanIndex = 0;
+	for (Int32 patchX = 0; patchX < patchCountX; ++patchX)
+	{
+		for (Int32 patchZ = 0; patchZ < patchCountZ; ++patchZ)
+		{
+			Bool usesCenter = false;
+			polygonIndex += GetDirtPatchPolygons(patchX, patchZ, latticeIndexCount + fanIndex, latticePolygonArr + polygonIndex, usesCenter);
+			if (usesCenter)
+				fanPatches[fanIndex++] = patchX * patchCountZ + patchZ;
+		}
+	}
+	
+	// Mark all lattice points that are used by any polygon
+	for (Int32 i = 0; i < latticeIndexCount; ++i)
+		latticeIndex[i] = NOTOK;
+	
+	for (polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const CPolygon &polygon = latticePolygonArr[polygonIndex];
+		Int32 corners[4] = { polygon.a, polygon.b, polygon.c, polygon.d };
+		for (Int32 cornerIndex = 0; cornerIndex < 4; ++cornerIndex)
+		{
+			if (corners[cornerIndex] < latticeIndexCount)
+				latticeIndex[corners[cornerIndex]] = 0;
+		}
+	}
+	
+	// Assign point indices. Update() gets each point's lattice index from the state, the points may have been moved off the lattice.
+	Int32 pointCount = 0;
+	_state.dirtLatticeIndices.Flush();
+	for (Int32 i = 0; i < latticeIndexCount; ++i)
+	{
+		if (latticeIndex[i] == NOTOK)
+			continue;
+		
+		if (!_state.dirtLatticeIndices.Append(i))
+			return nullptr;
+		latticeIndex[i] = pointCount++;
+	}
+	
+	Int32 latticePointCount = pointCount;
+	pointCount += fanCount;
+	
+	// Create polygon object
+	AutoFree<PolygonObject> polyPlane;
+	polyPlane.Set(_state.pool.GetPolygonObject(pointCount, polygonCount, true));
+	if (!polyPlane)
+		return nullptr;
+	
+	Vector *pointArr = polyPlane->GetPointW();
+	CPolygon *polygonArr = polyPlane->GetPolygonW();
+	UVWTag *uvwTag = static_cast<UVWTag*>(polyPlane->GetTag(Tuvw));
+	if (!pointArr || !polygonArr || !uvwTag)
+		return nullptr;
+	
+	// Lattice points
+	for (Int32 x = 0; x < latticeCountX; ++x)
+	{
+		for (Int32 z = 0; z < latticeCountZ; ++z)
+		{
+			Int32 pointIndex = latticeIndex[x * latticeCountZ + z];
+			if (pointIndex != NOTOK)
+				pointArr[pointIndex] = GetDirtLatticePoint(x, z);
+		}
+	}
+	
+	// Center points, behind the lattice points
+	for (fanIndex = 0; fanIndex < fanCount; ++fanIndex)
+		pointArr[latticePointCount + fanIndex] = GetDirtPatchCenter(fanPatches[fanIndex] / patchCountZ, fanPatches[fanIndex] % patchCountZ);
+	
+	// Polygons with point indices, and planar UVWs across the whole plane, like the plane primitive has them
+	Float planeWidth = _params.elementSize.x * GetGridCountX();
+	Float planeHeight = _params.elementSize.z * GetGridCountZ();
+	UVWHandle uvwData = uvwTag->GetDataAddressW();
+	for (polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const CPolygon &polygon = latticePolygonArr[polygonIndex];
+		Int32 corners[4] = { polygon.a, polygon.b, polygon.c, polygon.d };
+		Vector uvws[4];
+		for (Int32 cornerIndex = 0; cornerIndex < 4; ++cornerIndex)
+		{
+			Int32 index = corners[cornerIndex];
+			if (index < latticeIndexCount)
+			{
+				uvws[cornerIndex] = Vector((Float)(index / latticeCountZ) / (Float)cellCountX, 1.0 - (Float)(index % latticeCountZ) / (Float)cellCountZ, 0.0);
+				corners[cornerIndex] = latticeIndex[index];
+			}
+			else
+			{
+				corners[cornerIndex] = latticePointCount + index - latticeIndexCount;
+				const Vector &center = pointArr[corners[cornerIndex]];
+				uvws[cornerIndex] = Vector(center.x / planeWidth + 0.5, 0.5 - center.z / planeHeight, 0.0);
+			}
+		}
+		
+		polygonArr[polygonIndex] = CPolygon(corners[0], corners[1], corners[2], corners[3]);
+		UVWTag::Set(uvwData, polygonIndex, UVWStruct(uvws[0], uvws[1], uvws[2], uvws[3]));
+	}
+	
+	// Along a path or on a terrain, the plane is bent. Unlike the stones, it has no shape to keep.
+	if (!IsStraight())
+	{
+		Vector planePos = GetDirtPlanePosition();
+		for (Int32 i = 0; i < pointCount; ++i)
+			pointArr[i] = MapToGround(planePos + pointArr[i]);
+	}
+	
+	polyPlane->Message(MSG_UPDATE);
+	
+	// Apply Phong Tag
+	if (!AddPhongTag(polyPlane))
+		return nullptr;
+	
+	// Apply material
+	if (_params.dirtPlaneMat)
+	{
+		AddTextureTag(polyPlane, _params.dirtPlaneMat, _params.dirtPlaneMatScale);
+	}
+	
+	// Release & return Result
+	return polyPlane.Release();
+}
+
+
+Bool Sidewalk::UpdateDirtPlane(PolygonObject *plane) const
+{
+	Int32 latticeCountZ = GetDirtCellCountZ() + 1;
+	Int32 latticePointCount = (Int32)_state.dirtLatticeIndices.GetCount();
+	
+	if (plane->GetPointCount() < latticePointCount)
+		return false;
+	
+	Vector *pointArr = plane->GetPointW();
+	if (!pointArr)
+		return false;
+	
+	// Each lattice point's coordinates come from the build. The fan centers behind the lattice points never change.
+	Vector planePos = GetDirtPlanePosition();
+	for (Int32 i = 0; i < latticePointCount; ++i)
+	{
+		Int32 latticeIndex = _state.dirtLatticeIndices[i];
+		Vector point = GetDirtLatticePoint(latticeIndex / latticeCountZ, latticeIndex % latticeCountZ);
+		pointArr[i] = IsStraight() ? point : MapToGround(planePos + point);
+	}
+	
+	plane->Message(MSG_UPDATE);
+	return true;
+}
+
+
+// Create the canonical Curbstone
+PolygonObject *Sidewalk::PolygonizeCurbstone(const Vector &stoneSize) const
+{
+	// Create Cube primitive
+	AutoAlloc<BaseObject> newPrototypeStone(Ocube);
+	if (!newPrototypeStone)
+		return nullptr;
+	
+	// Get stone's container
+	BaseContainer *stoneData = newPrototypeStone->GetDataInstance();
+	if (!stoneData)
+		return nullptr;
+	
+	// Set Stone's basic attributes
+	stoneData->SetVector(PRIM_CUBE_LEN, stoneSize);
+	stoneData->SetInt32(PRIM_CUBE_SUBX, _params.curbSubd);
+	stoneData->SetInt32(PRIM_CUBE_SUBY, _params.curbSubd);
+	stoneData->SetInt32(PRIM_CUBE_SUBZ, _params.curbSubd);
+	stoneData->SetBool(PRIM_CUBE_DOFILLET, _params.curbFilletRad > 0.0);
+	stoneData->SetFloat(PRIM_CUBE_FRAD, _params.curbFilletRad);
+	stoneData->SetInt32(PRIM_CUBE_SUBF, _params.curbFilletSubd);
+	
+	// Convert Stone to Polygon Object
+	return static_cast<PolygonObject*>(MakeEditable(newPrototypeStone, _doc));
+}
+
+
+PolygonObject *Sidewalk::CreateCurbstonePrototype(PolygonObject *cube, Float prototypeLength)
+{
+	AutoFree<PolygonObject> stonePoly;
+	stonePoly.Set(cube);
+	if (!stonePoly)
+		return nullptr;
+	
+	// Each stone gets its own tags, only geometry and UVWs are taken from the prototype
+	stonePoly->KillTag(Tphong);
+	
+	if (!OptimizePrototype(stonePoly))
+		return nullptr;
+	
+	// Remember uncrumpled points and normals
+	if (!_state.curbPoints.Set(stonePoly->GetPointR(), stonePoly->GetPointCount(), _params.quantizeCache))
+		return nullptr;
+	
+	if (!GetVertexNormals(stonePoly, _state.curbNormals, _params.quantizeCache, _state.arena))
+		return nullptr;
+	
+	// The stored points may be quantized, so the parts are found on the exact points
+	if (!ClassifyCurbstonePoints(stonePoly->GetPointR(), stonePoly->GetPointCount(), prototypeLength))
+		return nullptr;
+	
+	return stonePoly.Release();
+}
+
+
+Vector Sidewalk::GetNominalCurbstoneSize() const
+{
+	// Available space / stone count
+	Vector stoneSize = _params.curbSize;
+	stoneSize.z = GetTotalSize().z / (Float)Max(_params.curbCount, (Int32)1);
+	return stoneSize;
+}
+
+
+Float Sidewalk::GetCurbstoneStraightLength(Float prototypeLength) const
+{
+	// Fillet radius, as the cube primitive would limit it
+	Float filletRad = 0.0;
+	if (_params.curbFilletRad > 0.0)
+		filletRad = Min(_params.curbFilletRad, Min(_params.curbSize.x, Min(_params.curbSize.y, prototypeLength)) * 0.5);
+	
+	return prototypeLength * 0.5 - filletRad;
+}
+
+
+Bool Sidewalk::ClassifyCurbstonePoints(const Vector *pointArr, Int32 pointCount, Float prototypeLength)
+{
+	_state.curbPointParts.Flush();
+	if (!_state.curbPointParts.Resize(pointCount))
+		return false;
+	
+	Float prototypeStraight = GetCurbstoneStraightLength(prototypeLength);
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		Float z = pointArr[i].z;
+		_state.curbPointParts[i] = (Abs(z) <= prototypeStraight + 0.001) ? 0 : ((z > 0.0) ? 1 : -1);
+	}
+	
+	return true;
+}
+
+
+// Stretch a Curbstone
+void Sidewalk::StretchCurbstone(Vector *pointArr, Int32 pointCount, Float prototypeLength, Float stoneLength) const
+{
+	if (pointCount != _state.curbPointParts.GetCount())
+		return;
+	
+	// Half length of the straight part of the prototype and of the new stone
+	Float prototypeStraight = GetCurbstoneStraightLength(prototypeLength);
+	Float stoneStraight = Max(prototypeStraight + (stoneLength - prototypeLength) * 0.5, 0.0);
+	
+	// Stretch the straight part, move the fillets
+	Float straightScale = (prototypeStraight > 0.001) ? (stoneStraight / prototypeStraight) : 0.0;
+	Float filletOffset = stoneStraight - prototypeStraight;
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		Char part = _state.curbPointParts[i];
+		if (part == 0)
+			pointArr[i].z *= straightScale;
+		else
+			pointArr[i].z += part * filletOffset;
+	}
+}
+
+
+// Create a Curbstone
+template <Bool CRUMPLE, Bool MATPERSTONE>
+BaseObject *Sidewalk::CreateSingleCurbstone(PolygonObject *prototype, Float prototypeLength, Float stoneLength, Random &crumpleRnd)
+{
+	if (!prototype)
+		return nullptr;
+	
+	// Copy prototype, including its polygons and UVWs
+	AutoFree<PolygonObject> stonePoly;
+	stonePoly.Set(_state.pool.GetPolygonCopy(prototype));
+	if (!stonePoly)
+		return nullptr;
+	
+	// Apply Phong Tag
+	if (!AddPhongTag(stonePoly))
+		return nullptr;
+	
+	Vector *pointArr = stonePoly->GetPointW();
+	Int32 pointCount = stonePoly->GetPointCount();
+	if (!pointArr || pointCount != _state.curbPoints.GetCount())
+		return nullptr;
+	
+	// Start from the cached points, so Update() gets the same result
+	_state.curbPoints.Get(pointArr);
+	StretchCurbstone(pointArr, pointCount, prototypeLength, stoneLength);
+	
+	// Crumple Stone geometry. Stretching along Z leaves all normals unchanged.
+	if (CRUMPLE)
+		CrumplePoints(pointArr, _state.curbNormals, _params.curbCrumpleVal, crumpleRnd);
+	
+	stonePoly->Message(MSG_UPDATE);
+	
+	// If required, assign texture tag to stone
+	if (MATPERSTONE)
+	{
+		if (!AddTextureTag(stonePoly, _params.curbMat, _params.curbMatScale))
+			return nullptr;
+	}
+	
+	// Return result
+	return stonePoly.Release();
+}
+
+
+void Sidewalk::ShapeCurbstone(Vector *pointArr, Float prototypeLength, Float stoneLength, Random &crumpleRnd) const
+{
+	Int32 pointCount = _state.curbPoints.GetCount();
+	
+	_state.curbPoints.Get(pointArr);
+	StretchCurbstone(pointArr, pointCount, prototypeLength, stoneLength);
+	
+	// Stretching along Z leaves all normals unchanged
+	if (_params.curbCrumpleVal > 0.0)
+		CrumplePoints(pointArr, _state.curbNormals, _params.curbCrumpleVal, crumpleRnd);
+}
+
+
+// Update a row of Curbstones
+Bool Sidewalk::UpdateCurbstoneRow(BaseObject *group) const
+{
+	// Same state as when building
+	Random curbstoneCrumpleRnd;
+	curbstoneCrumpleRnd.Init(_params.curbSizeSeed);
+	
+	Int32 pointCount = _state.curbPoints.GetCount();
+	Float prototypeLength = GetTotalSize().z / (Float)_params.curbCount;
+	
+	BaseObject *stone = group->GetDown();
+	for (Int32 stoneIndex = 0; stoneIndex < _state.curbLengths.GetCount(); ++stoneIndex)
+	{
+		if (!stone || !stone->IsInstanceOf(Opolygon) || ToPoly(stone)->GetPointCount() != pointCount)
+			return false;
+		
+		PolygonObject *stonePoly = ToPoly(stone);
+		ShapeCurbstone(stonePoly->GetPointW(), prototypeLength, _state.curbLengths[stoneIndex], curbstoneCrumpleRnd);
+		stonePoly->Message(MSG_UPDATE);
+		stone = stone->GetNext();
+	}
+	
+	return true;
+}
+
+
+// Create row of Curbstones
+BaseObject *Sidewalk::CreateCurbstoneRow(PolygonObject *cube)
+{
+	// All curbstones are derived from one prototype
+	AutoFree<PolygonObject> prototypeStone;
+	prototypeStone.Set(CreateCurbstonePrototype(cube, GetNominalCurbstoneSize().z));
+	if (!prototypeStone || _params.curbCount < 1)
+		return nullptr;
+	
+	AutoFree<BaseObject> stoneGroup;
+	stoneGroup.Set(_state.pool.GetObject(Onull));
+	if (!stoneGroup)
+		return nullptr;
+	
+	// Set group name
+	stoneGroup->SetName(_params.curbstoneGroupName);
+	
+	// Lengths and positions of the stones, with their random generators
+	CurbstoneCursor cursor;
+	cursor.Init(*this);
+	
+	// Remember the length of each stone
+	_state.curbLengths.Flush();
+	
+	// Create all curbstones except the last one
+	while (cursor.Next(*this))
+	{
+		// Create new stone
+		AutoFree<BaseObject> newStone;
+		newStone.Set((this->*_emitters.curbstone)(prototypeStone, cursor.GetNominalLength(), cursor.GetLength(), cursor.GetCrumpleRandom()));
+		if (!newStone)
+			return nullptr;
+		
+		if (!_state.curbLengths.Append(cursor.GetLength()))
+			return nullptr;
+		
+		// Set stone position. Along a path or on a terrain, each stone is turned with it, but not bent.
+		if (!IsStraight())
+			newStone->SetMl(MapToGround(MatrixMove(GetCurbstoneGroupPosition() + cursor.GetPosition())));
+		else
+			newStone->SetRelPos(cursor.GetPosition());
+		
+		// Set stone name
+		NameElement(newStone, ELEMENTKIND::CURBSTONE, cursor.GetIndex(), 0);
+		
+		// Insert into stone group
+		newStone->InsertUnderLast(stoneGroup);
+		newStone.Release();
+	}
+	
+	// Create the last stone, if there's still enough space
+	/*
+	if (remainingLength > _params.curbFilletRad * 2.0)
+	{
+		// Calculate Stone size
+		stoneSize.z = remainingLength;
+		
+		// Create new stone
+		AutoFree<BaseObject> newStone;
+		newStone.Set(CreateCurbstone(curbstoneCrumpleRnd));
+		if (!newStone)
+			return nullptr;
+		
+		// Set stone position
+		stonePos = Vector(0.0, 0.0, totalSize.z - stoneSize.z * 0.5);
+		newStone->SetRelPos(stonePos);
+		
+		// If required, assign texture tag to cobblestone group
+		if (_params.curbMat && _params.curbMatPerStone)
+			AddTextureTag(newStone, _params.curbMat, _params.curbMatScale);
+		
+		// Set stone name
+		newStone->SetName(_params.curbstoneName + " (" + String::IntToString(stoneIndex) + ")");
+		
+		// Insert into stone group
+		newStone->InsertUnderLast(stoneGroup);
+		newStone.Release();
+	}
+	 */
+	
+	// Release & return result
+	return stoneGroup.Release();
+}
+
+
+Vector Sidewalk::GetCurbstoneGroupPosition() const
+{
+	return Vector(GetTotalSize().x * 0.5 + _params.curbSize.x * 0.5, _params.curbSize.y * -0.5 + _params.elementSize.y * 0.5 + _params.curbElevation, _params.elementSize.z * -0.5);
+}
+
+
+void Sidewalk::NameElement(BaseObject *op, ELEMENTKIND kind, Int32 firstIndex, Int32 secondIndex) const
+{
+	// The ID is enough to resolve the name later
+	SetElementID(op, firstIndex, secondIndex);
+	
+	if (_params.namingPolicy == SIDEWALK_NAMING_FULL)
+		op->SetName(FormatElementName(_params, kind, firstIndex, secondIndex));
+}
+
+
+String Sidewalk::FormatElementName(const Parameters &params, ELEMENTKIND kind, Int32 firstIndex, Int32 secondIndex)
+{
+	switch (kind)
+	{
+		case ELEMENTKIND::PLATE:
+			return String::IntToString(secondIndex) + "-" + String::IntToString(firstIndex) + " (" + params.plateName + ")";
+			
+		case ELEMENTKIND::COBBLESTONES:
+			return String::IntToString(secondIndex) + "-" + String::IntToString(firstIndex) + " (" + params.cobblestoneGroupName + ")";
+			
+		case ELEMENTKIND::COBBLESTONE:
+			return params.cobblestoneName + " " + String::IntToString(firstIndex) + "-" + String::IntToString(secondIndex);
+			
+		case ELEMENTKIND::CURBSTONE:
+			return params.curbstoneName + " (" + String::IntToString(firstIndex) + ")";
+			
+		case ELEMENTKIND::TILEINSTANCE:
+			return params.tileInstanceName + " " + String::IntToString(firstIndex) + "-" + String::IntToString(secondIndex);
+			
+		case ELEMENTKIND::CHUNK:
+			return params.chunkName + " " + String::IntToString(firstIndex) + "-" + String::IntToString(secondIndex);
+			
+		case ELEMENTKIND::DIRTBLOCK:
+			return params.dirtPlaneName + " " + String::IntToString(firstIndex) + "-" + String::IntToString(secondIndex);
+	}
+	
+	return String();
+}
+
+
+void Sidewalk::ResolveElementNames(BaseObject *parent, ELEMENTKIND kind, const Parameters &params)
+{
+	for (BaseObject *op = parent ? parent->GetDown() : nullptr; op; op = op->GetNext())
+	{
+		Int32 firstIndex, secondIndex;
+		GetElementID(op, firstIndex, secondIndex);
+		op->SetName(FormatElementName(params, kind, firstIndex, secondIndex));
+		
+		// Cobblestone groups contain the stones
+		if (kind == ELEMENTKIND::COBBLESTONES)
+			ResolveElementNames(op, ELEMENTKIND::COBBLESTONE, params);
+	}
+}
+
+
+void Sidewalk::ResolveChunkNames(BaseObject *group, ELEMENTKIND kind, const Parameters &params)
+{
+	if (!params.chunkEnabled)
+	{
+		ResolveElementNames(group, kind, params);
+		return;
+	}
+	
+	for (BaseObject *chunk = group ? group->GetDown() : nullptr; chunk; chunk = chunk->GetNext())
+	{
+		Int32 chunkX, chunkZ;
+		GetElementID(chunk, chunkX, chunkZ);
+		chunk->SetName(FormatElementName(params, ELEMENTKIND::CHUNK, chunkX, chunkZ));
+		ResolveElementNames(chunk, kind, params);
+	}
+}
+
+
+BaseObject *Sidewalk::GetFirstElement(const Parameters &params, BaseObject *group)
+{
+	if (!group || !params.chunkEnabled)
+		return group ? group->GetDown() : nullptr;
+	
+	for (BaseObject *chunk = group->GetDown(); chunk; chunk = chunk->GetNext())
+	{
+		if (chunk->GetDown())
+			return chunk->GetDown();
+	}
+	
+	return nullptr;
+}
+
+
+BaseObject *Sidewalk::GetNextElement(const Parameters &params, BaseObject *element)
+{
+	if (!element || element->GetNext() || !params.chunkEnabled)
+		return element ? element->GetNext() : nullptr;
+	
+	// Continue with the first element of the next chunk that has any
+	for (BaseObject *chunk = element->GetUp() ? element->GetUp()->GetNext() : nullptr; chunk; chunk = chunk->GetNext())
+	{
+		if (chunk->GetDown())
+			return chunk->GetDown();
+	}
+	
+	return nullptr;
+}
+
+
+void Sidewalk::ResolveNames(const Parameters &params, BaseObject *hierarchy)
+{
+	// Collision proxies have no element names
+	if (!hierarchy || params.collisionOnly)
+		return;
+	
+	// Same structure that Build() creates
+	BaseObject *componentGroup = params.tileEnabled ? hierarchy->GetDown() : hierarchy;
+	BaseObject *plateGroup = componentGroup ? componentGroup->GetDown() : nullptr;
+	BaseObject *cobblestoneGroup = plateGroup ? plateGroup->GetNext() : nullptr;
+	if (!cobblestoneGroup)
+		return;
+	
+	ResolveChunkNames(plateGroup, ELEMENTKIND::PLATE, params);
+	ResolveChunkNames(cobblestoneGroup, ELEMENTKIND::COBBLESTONES, params);
+	
+	// Tile instances follow the tile
+	if (params.tileEnabled)
+	{
+		for (BaseObject *op = componentGroup->GetNext(); op && op->IsInstanceOf(Oinstance); op = op->GetNext())
+		{
+			Int32 tileX, tileZ;
+			GetElementID(op, tileX, tileZ);
+			op->SetName(FormatElementName(params, ELEMENTKIND::TILEINSTANCE, tileX, tileZ));
+		}
+	}
+	
+	if (params.curbEnabled)
+		ResolveElementNames(GetCurbstoneGroup(params, hierarchy), ELEMENTKIND::CURBSTONE, params);
+}
+
+
+BaseObject *Sidewalk::GetCurbstoneGroup(const Parameters &params, BaseObject *hierarchy)
+{
+	if (!hierarchy || !params.curbEnabled)
+		return nullptr;
+	
+	// Last component, only followed by the collision proxies
+	BaseObject *group = hierarchy->GetDownLast();
+	if (group && params.collisionProxies)
+		group = group->GetPred();
+	
+	return group;
+}
+
+
+BaseObject *Sidewalk::GetCollisionGroup(const Parameters &params, BaseObject *hierarchy)
+{
+	if (!hierarchy || !params.collisionProxies)
+		return nullptr;
+	
+	return hierarchy->GetDownLast();
+}
+
+
+void Sidewalk::SelectEmitters()
+{
+	// Index of a specialization in the tables: Bit 0 is the first flag, bit 1 the second one
+	static const PlateEmitter plateEmitters[] =
+	{
+		&Sidewalk::CreateSinglePlate<false, false>, &Sidewalk::CreateSinglePlate<true, false>,
+		&Sidewalk::CreateSinglePlate<false, true>, &Sidewalk::CreateSinglePlate<true, true>
+	};
+	static const CobblestonesEmitter cobblestonesEmitters[] =
+	{
+		&Sidewalk::EmitCobblestones<false, false>, &Sidewalk::EmitCobblestones<true, false>,
+		&Sidewalk::EmitCobblestones<false, true>, &Sidewalk::EmitCobblestones<true, true>
+	};
+	static const CurbstoneEmitter curbstoneEmitters[] =
+	{
+		&Sidewalk::CreateSingleCurbstone<false, false>, &Sidewalk::CreateSingleCurbstone<true, false>,
+		&Sidewalk::CreateSingleCurbstone<false, true>, &Sidewalk::CreateSingleCurbstone<true, true>
+	};
+	
+	_emitters.plate = plateEmitters[GetEmitterIndex(_params.plateUsePhong, _params.plateMat && _params.plateMatPerPlate)];
+	_emitters.cobblestones = cobblestonesEmitters[GetEmitterIndex(_params.cobbleUsePhong, _params.cobbleMat && _params.cobbleMatPerStone)];
+	_emitters.curbstone = curbstoneEmitters[GetEmitterIndex(_params.curbCrumpleVal > 0.0, _params.curbMat && _params.curbMatPerStone)];
+}
+
+
+Bool Sidewalk::Parameters::HasSameTopology(const Parameters &other) const
+{
+	// Everything except crumple strength, random variation and their seeds
+	return countX == other.countX && countZ == other.countZ && elementSelectBias == other.elementSelectBias && elementHoleBias == other.elementHoleBias &&
+	       HasSameElementTopology(other);
+}
+
+
+Bool Sidewalk::Parameters::CanKeepElements(const Parameters &other) const
+{
+	// Kept elements are placed again. The crumple and the variation inside cobblestone groups are not touched, they must not change.
+	// In bake mode, the UVWs of all stones are mapped into the atlas again, kept ones would be mapped twice.
+	return HasSameElementTopology(other) && positionalSeeds && !bakeEnabled && !other.bakeEnabled &&
+	       cobbleCrumple == other.cobbleCrumple && cobbleCrumpleSeed == other.cobbleCrumpleSeed &&
+	       cobbleRndRot == other.cobbleRndRot && cobbleRndPos == other.cobbleRndPos && cobbleRndSeed == other.cobbleRndSeed;
+}
+
+
+Bool Sidewalk::Parameters::HasSameElementTopology(const Parameters &other) const
+{
+	// Everything except grid size, layout biases, crumple strength, random variation and their seeds
+	return elementSize == other.elementSize && shift == other.shift && elementRndSeed == other.elementRndSeed && positionalSeeds == other.positionalSeeds &&
+	       path.IsEqual(other.path) && footprint.IsEqual(other.footprint) && gridOffset == other.gridOffset && terrain.IsEqual(other.terrain) &&
+	
+	       plateGap == other.plateGap && plateFilletRad == other.plateFilletRad && plateFilletSubd == other.plateFilletSubd && plateUsePhong == other.plateUsePhong &&
+	       plateMat == other.plateMat && plateMatPerPlate == other.plateMatPerPlate && plateMatScale == other.plateMatScale &&
+	
+	       cobbleCount == other.cobbleCount && cobbleElevation == other.cobbleElevation && cobbleSubdiv == other.cobbleSubdiv &&
+	       cobbleGap == other.cobbleGap && cobbleFilletRad == other.cobbleFilletRad && cobbleFilletSubd == other.cobbleFilletSubd && cobbleUsePhong == other.cobbleUsePhong &&
+	       cobbleMat == other.cobbleMat && cobbleMatPerStone == other.cobbleMatPerStone && cobbleMatScale == other.cobbleMatScale &&
+	
+	       dirtPlaneEnabled == other.dirtPlaneEnabled && dirtPlaneSubd == other.dirtPlaneSubd && dirtPlaneElevation == other.dirtPlaneElevation &&
+	       dirtPlaneMat == other.dirtPlaneMat && dirtPlaneMatScale == other.dirtPlaneMatScale &&
+	
+	       curbEnabled == other.curbEnabled && curbSize == other.curbSize && curbCount == other.curbCount && curbSubd == other.curbSubd &&
+	       curbFilletRad == other.curbFilletRad && curbFilletSubd == other.curbFilletSubd && curbSizeVar == other.curbSizeVar && curbSizeSeed == other.curbSizeSeed &&
+	       curbElevation == other.curbElevation && curbMat == other.curbMat && curbMatScale == other.curbMatScale && curbMatPerStone == other.curbMatPerStone &&
+	
+	       tileEnabled == other.tileEnabled && tileSize == other.tileSize && tileVariation == other.tileVariation && tileSeed == other.tileSeed &&
+	
+	       bakeEnabled == other.bakeEnabled &&
+	
+	       namingPolicy == other.namingPolicy && quantizeCache == other.quantizeCache && optimizeMeshes == other.optimizeMeshes && collisionProxies == other.collisionProxies && collisionOnly == other.collisionOnly &&
+	       chunkEnabled == other.chunkEnabled && chunkSizeX == other.chunkSizeX && chunkSizeZ == other.chunkSizeZ;
+}
+
+
+UInt64 Sidewalk::Parameters::GetHash() const
+{
+	UInt64 hash = HASH_OFFSET_BASIS;
+	
+	HashVector(hash, elementSize); HashValue(hash, countX); HashValue(hash, countZ); HashValue(hash, shift);
+	HashValue(hash, elementRndSeed); HashValue(hash, elementSelectBias); HashValue(hash, elementHoleBias); HashValue(hash, positionalSeeds);
+	HashValue(hash, path.GetSampleCount()); HashBytes(hash, path.GetSamples(), path.GetSampleCount() * sizeof(Matrix));
+	HashValue(hash, footprint.GetPointCount()); HashBytes(hash, footprint.GetPoints(), footprint.GetPointCount() * sizeof(Vector)); HashVector(hash, gridOffset);
+	HashValue(hash, terrain.GetSampleCount()); HashBytes(hash, terrain.GetHeights(), terrain.GetSampleCount() * sizeof(Float));
+	
+	HashValue(hash, plateGap); HashValue(hash, plateFilletRad); HashValue(hash, plateFilletSubd); HashValue(hash, plateUsePhong);
+	HashVector(hash, plateRndRot); HashVector(hash, plateRndPos); HashValue(hash, plateRndSeed);
+	HashValue(hash, plateMat); HashValue(hash, plateMatPerPlate); HashValue(hash, plateMatScale);
+	
+	HashValue(hash, cobbleCount); HashValue(hash, cobbleElevation);
+	HashValue(hash, cobbleSubdiv); HashValue(hash, cobbleCrumple); HashValue(hash, cobbleCrumpleSeed); HashValue(hash, cobbleRotSeed);
+	HashValue(hash, cobbleGap); HashValue(hash, cobbleFilletRad); HashValue(hash, cobbleFilletSubd); HashValue(hash, cobbleUsePhong);
+	HashVector(hash, cobbleRndRot); HashVector(hash, cobbleRndPos); HashValue(hash, cobbleRndSeed);
+	HashValue(hash, cobbleMat); HashValue(hash, cobbleMatPerStone); HashValue(hash, cobbleMatScale);
+	
+	HashValue(hash, dirtPlaneEnabled); HashValue(hash, dirtPlaneSubd); HashValue(hash, dirtPlaneCrumple); HashValue(hash, dirtPlaneCrumpleSeed); HashValue(hash, dirtPlaneElevation);
+	HashValue(hash, dirtPlaneMat); HashValue(hash, dirtPlaneMatScale);
+	
+	HashValue(hash, curbEnabled); HashVector(hash, curbSize); HashValue(hash, curbCount); HashValue(hash, curbSubd); HashValue(hash, curbCrumpleVal);
+	HashValue(hash, curbFilletRad); HashValue(hash, curbFilletSubd); HashValue(hash, curbSizeVar); HashValue(hash, curbSizeSeed); HashValue(hash, curbElevation);
+	HashValue(hash, curbMat); HashValue(hash, curbMatScale); HashValue(hash, curbMatPerStone);
+	
+	HashValue(hash, tileEnabled); HashValue(hash, tileSize); HashValue(hash, tileVariation); HashValue(hash, tileSeed);
+	
+	HashValue(hash, bakeEnabled); HashValue(hash, bakeResolution); HashString(hash, bakeFile.GetString());
+	HashValue(hash, bakeCobbleDetail); HashValue(hash, bakeCobbleStrength); HashValue(hash, bakeCurbDetail); HashValue(hash, bakeCurbStrength);
+	
+	HashValue(hash, namingPolicy); HashValue(hash, quantizeCache); HashValue(hash, optimizeMeshes); HashValue(hash, collisionProxies); HashValue(hash, collisionOnly);
+	HashValue(hash, chunkEnabled); HashValue(hash, chunkSizeX); HashValue(hash, chunkSizeZ);
+	
+	HashString(hash, sidewalkGroupName); HashString(hash, plateGroupName); HashString(hash, cobblestoneGroupName);
+	HashString(hash, curbstoneGroupName); HashString(hash, collisionGroupName);
+	HashString(hash, plateName); HashString(hash, cobblestoneName); HashString(hash, dirtPlaneName);
+	HashString(hash, curbstoneName); HashString(hash, tileName); HashString(hash, tileInstanceName); HashString(hash, chunkName);
+	
+	return hash;
+}
+
+
+void Sidewalk::WriteFiles(BaseObject *result)
+{
+	if (result && _state.writeFiles && _params.bakeEnabled && !_params.collisionOnly)
+		BakeDisplacement(result);
+}
+
+
+Int32 Sidewalk::GetBakeGroups(BaseObject *hierarchy, BaseObject *&cobblestoneGroup, BaseObject *&curbstoneGroup) const
+{
+	// Same structure that BuildHierarchy() creates
+	BaseObject *componentGroup = _params.tileEnabled ? (hierarchy ? hierarchy->GetDown() : nullptr) : hierarchy;
+	BaseObject *plateGroup = componentGroup ? componentGroup->GetDown() : nullptr;
+	cobblestoneGroup = plateGroup ? plateGroup->GetNext() : nullptr;
+	curbstoneGroup = GetCurbstoneGroup(_params, hierarchy);
+	if (!cobblestoneGroup)
+		return -1;
+	
+	Int32 tileCount = 0;
+	for (BaseObject *op = GetFirstElement(_params, cobblestoneGroup); op; op = GetNextElement(_params, op))
+		++tileCount;
+	for (BaseObject *op = curbstoneGroup ? curbstoneGroup->GetDown() : nullptr; op; op = op->GetNext())
+		++tileCount;
+	
+	return tileCount;
+}
+
+
+Bool Sidewalk::MapDisplacementUVWs(BaseObject *hierarchy)
+{
+	BaseObject *cobblestoneGroup = nullptr;
+	BaseObject *curbstoneGroup = nullptr;
+	Int32 tileCount = GetBakeGroups(hierarchy, cobblestoneGroup, curbstoneGroup);
+	if (tileCount < 0)
+		return false;
+	
+	// Same order of tiles as in BakeDisplacement()
+	Int32 tileIndex = 0;
+	for (BaseObject *group = GetFirstElement(_params, cobblestoneGroup); group; group = GetNextElement(_params, group), ++tileIndex)
+	{
+		for (BaseObject *stone = group->GetDown(); stone; stone = stone->GetNext())
+			MapStoneUVWs(stone, tileIndex, tileCount);
+	}
+	
+	for (BaseObject *stone = curbstoneGroup ? curbstoneGroup->GetDown() : nullptr; stone; stone = stone->GetNext(), ++tileIndex)
+		MapStoneUVWs(stone, tileIndex, tileCount);
+	
+	return true;
+}
+
+
+Bool Sidewalk::BakeDisplacement(BaseObject *hierarchy)
+{
+	BaseObject *cobblestoneGroup = nullptr;
+	BaseObject *curbstoneGroup = nullptr;
+	Int32 tileCount = GetBakeGroups(hierarchy, cobblestoneGroup, curbstoneGroup);
+	if (tileCount < 0)
+		return false;
+	
+	Filename file = GetBakeFile();
+	if (tileCount == 0 || !file.Content())
+		return true;
+	
+	maxon::BaseArray<BakeTile> tiles;
+	maxon::BaseArray<Float> heights;
+	
+	// Each group of cobblestones is crumpled from the generator of its cell, see BuildCobblestones()
+	Vector cobbleSize = GetCobblestoneSize();
+	CellRandom cobbleRnd;
+	cobbleRnd.Init(_params.cobbleCrumpleSeed, _params.positionalSeeds);
+	for (BaseObject *group = GetFirstElement(_params, cobblestoneGroup); group; group = GetNextElement(_params, group))
+	{
+		Int32 columnIndex, rowIndex;
+		GetElementID(group, columnIndex, rowIndex);
+		
+		if (!AppendBakeTile(_params.bakeCobbleDetail, _params.bakeCobbleStrength, Max(cobbleSize.x, cobbleSize.z), cobbleRnd.Get(columnIndex, rowIndex), tiles, heights))
+			return false;
+	}
+	
+	// All curbstones are crumpled from one sequence, see UpdateCurbstoneRow()
+	Random curbRnd;
+	curbRnd.Init(_params.curbSizeSeed);
+	for (BaseObject *stone = curbstoneGroup ? curbstoneGroup->GetDown() : nullptr; stone; stone = stone->GetNext())
+	{
+		if (!AppendBakeTile(_params.bakeCurbDetail, _params.bakeCurbStrength, Max(_params.curbSize.x, _params.curbSize.y), curbRnd, tiles, heights))
+			return false;
+	}
+	
+	// Writing the textures takes long, and renderers reload them. Only do it if they change, or have been removed.
+	UInt64 hash = HASH_OFFSET_BASIS;
+	HashValue(hash, _params.bakeResolution);
+	HashString(hash, file.GetString());
+	HashValue(hash, tiles.GetCount());
+	for (Int i = 0; i < tiles.GetCount(); ++i)
+	{
+		HashValue(hash, tiles[i].gridSize);
+		HashValue(hash, tiles[i].strength);
+		HashValue(hash, tiles[i].size);
+	}
+	HashBytes(hash, heights.GetFirst(), heights.GetCount() * sizeof(Float));
+	
+	if (hash == _state.bakeHash && GeFExist(file) && GeFExist(DisplacementAtlas::GetNormalFile(file)))
+		return true;
+	
+	if (!DisplacementAtlas::Bake(tiles, heights, _params.bakeResolution, file))
+		return false;
+	
+	_state.bakeHash = hash;
+	return true;
+}
+
+
+Bool Sidewalk::AppendBakeTile(Float detail, Float strength, Float size, Random &rnd, maxon::BaseArray<BakeTile> &tiles, maxon::BaseArray<Float> &heights) const
+{
+	BakeTile tile;
+	tile.firstHeight = heights.GetCount();
+	tile.gridSize = Max((Int32)detail, (Int32)1) + 1;
+	tile.strength = strength;
+	tile.size = Max(size, WELD_TOLERANCE);
+	
+	// A flat grid facing up, crumpled by the same function as the stone's points
+	Int32 pointCount = tile.gridSize * tile.gridSize;
+	maxon::BaseArray<Vector> points;
+	maxon::BaseArray<Vector> normals;
+	if (!points.Resize(pointCount) || !normals.Resize(pointCount) || !heights.Resize(tile.firstHeight + pointCount))
+		return false;
+	
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		points[i] = Vector();
+		normals[i] = Vector(0.0, 1.0, 0.0);
+	}
+	
+	if (strength > 0.0)
+		CrumplePoints(points.GetFirst(), normals.GetFirst(), pointCount, strength, rnd);
 	
-	// Set group name
-	cobbleGroup->SetName(_params.cobblestoneGroupName);
+	for (Int32 i = 0; i < pointCount; ++i)
+		heights[tile.firstHeight + i] = points[i].y;
+	
+	return tiles.Append(tile) != nullptr;
+}
+
+
+void Sidewalk::MapStoneUVWs(BaseObject *stone, Int32 tileIndex, Int32 tileCount)
+{
+	if (!stone || !stone->IsInstanceOf(Opolygon))
+		return;
+	
+	UVWTag *uvwTag = static_cast<UVWTag*>(stone->GetTag(Tuvw));
+	if (!uvwTag)
+		return;
 	
-	// Iterate & create all cobblestones
-	for (Int32 columsIndex = 0; columsIndex < _params.cobbleCount; ++columsIndex)
+	UVWHandle uvwData = uvwTag->GetDataAddressW();
+	Int32 polygonCount = ToPoly(stone)->GetPolygonCount();
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
 	{
-		for (Int32 rowIndex = 0; rowIndex < _params.cobbleCount; ++rowIndex)
-		{
-			// Create a single cobblestone
-			AutoFree<PolygonObject> newCobblestone;
-			newCobblestone.Set(static_cast<PolygonObject*>(cobblePoly->GetClone(COPYFLAGS_0, nullptr)));
-			if (!newCobblestone)
-				return nullptr;
-			
-			// Set name to new cobblestone
-			newCobblestone->SetName(_params.cobblestoneName + " " + String::IntToString(columsIndex) + "-" + String::IntToString(rowIndex));
-			
-			// Calculate position for new stone
-			Vector cobblePos = Vector(stoneSize.x * columsIndex - stoneSize.x * ((Float)_params.cobbleCount - 1.0) * 0.5,
-			                          0.0,
-			                          stoneSize.z * rowIndex - stoneSize.z * ((Float)_params.cobbleCount - 1.0) * 0.5);
-			
-			// Calculate position variation
-			cobblePos += Vector(_params.cobbleRndPos.x * rnd.GetG11(),
-			                    _params.cobbleRndPos.y * rnd.GetG11(),
-			                    _params.cobbleRndPos.z * rnd.GetG11());
-			
-			// Calculate basic rotation (randomly rotating the stone by 0°, 90°, 180° or 270°)
-			Vector cobbleRot = Vector(GetHardRndAngle(rnd, RANDOMANGLE::GETALL), 0.0, GetHardRndAngle(rnd, RANDOMANGLE::GET180));
-			
-			// Calculate rotation variation
-			cobbleRot += Vector(_params.cobbleRndRot.x * rnd.GetG11(),
-			                    _params.cobbleRndRot.y * rnd.GetG11(),
-			                    _params.cobbleRndRot.z * rnd.GetG11());
-			
-			// Set position and rotation to stone
-			newCobblestone->SetRelPos(cobblePos);
-			newCobblestone->SetRelRot(cobbleRot);
-			
-			// Release to group
-			newCobblestone->InsertUnderLast(cobbleGroup);
-			newCobblestone.Release();
-		}
+		UVWStruct uvw;
+		UVWTag::Get(uvwData, polygonIndex, uvw);
+		uvw.a = DisplacementAtlas::GetAtlasUVW(uvw.a, tileIndex, tileCount);
+		uvw.b = DisplacementAtlas::GetAtlasUVW(uvw.b, tileIndex, tileCount);
+		uvw.c = DisplacementAtlas::GetAtlasUVW(uvw.c, tileIndex, tileCount);
+		uvw.d = DisplacementAtlas::GetAtlasUVW(uvw.d, tileIndex, tileCount);
+		UVWTag::Set(uvwData, polygonIndex, uvw);
 	}
+}
+
+
+Filename Sidewalk::GetBakeFile() const
+{
+	if (_params.bakeFile.Content())
+		return _params.bakeFile;
 	
-	// Release & return result
-	return cobbleGroup.Release();
+	// Next to the document, if it has been saved
+	Filename documentPath = _doc->GetDocumentPath();
+	if (!documentPath.Content())
+		return Filename();
+	
+	return documentPath + Filename("sidewalk_displacement.tif");
 }
 
 
-BaseObject *Sidewalk::CreateDirtPlane(Random &rnd)
+BaseObject *Sidewalk::CreateCollisionProxies(BaseObject *hierarchy)
 {
-	// Create Plane primitive
-	AutoAlloc<BaseObject> newPlane(Oplane);
-	if (!newPlane)
+	if (!hierarchy)
 		return nullptr;
 	
-	// Get Plane container
-	BaseContainer *planeData = newPlane->GetDataInstance();
-	if (!planeData)
+	AutoFree<BaseObject> proxyGroup;
+	proxyGroup.Set(_state.pool.GetObject(Onull));
+	if (!proxyGroup)
 		return nullptr;
 	
-	// Plan a little extra width, in case the sidewalk also has curbstones
-	// If we don't do this, there might be a visible gap between the plane and the crumpled curbstone.
-	// The exact value is not important, it should just somehow close the gap
-	Float extraWidth = _params.curbCrumpleVal * 5.0;
-	
-	// Set Plane attributes
-	planeData->SetFloat(PRIM_PLANE_WIDTH, _params.elementSize.x * _params.countX + extraWidth);
-	planeData->SetFloat(PRIM_PLANE_HEIGHT, _params.elementSize.z * _params.countZ);
-	planeData->SetInt32(PRIM_PLANE_SUBW, _params.dirtPlaneSubd);
-	planeData->SetInt32(PRIM_PLANE_SUBH, _params.dirtPlaneSubd);
-	
-	// Prepare Polygon Plane
-	AutoFree<PolygonObject> polyPlane;
-	polyPlane.Set(static_cast<PolygonObject*>(MakeEditable(newPlane, _doc)));
-	if (!polyPlane)
-		return nullptr;
+	proxyGroup->SetName(_params.collisionGroupName);
 	
-	// Crumple
-	if (_params.dirtPlaneCrumple > 0.0)
-		CrumpleGeometry(polyPlane, _params.dirtPlaneCrumple, rnd);
+	// Only for dynamics, the visible geometry is the real one. As the only output, the proxies are what the user works with in the editor.
+	proxyGroup->SetEditorMode(_params.collisionOnly ? MODE_UNDEF : MODE_OFF);
+	proxyGroup->SetRenderMode(MODE_OFF);
 	
-	// Apply Phong Tag
-	if (!AddPhongTag(polyPlane))
-		return nullptr;
+	// Without tiles, the dirt plane follows the plates and cobblestones. It gets a box per block if it's not a plain rectangle.
+	BaseObject *dirtPlane = nullptr;
+	if (_params.dirtPlaneEnabled && !_params.tileEnabled && (!IsStraight() || _params.footprint.IsValid()))
+	{
+		BaseObject *cobblestoneGroup = hierarchy->GetDown() ? hierarchy->GetDown()->GetNext() : nullptr;
+		dirtPlane = cobblestoneGroup ? cobblestoneGroup->GetNext() : nullptr;
+		if (dirtPlane && !dirtPlane->IsInstanceOf(Opolygon))
+			dirtPlane = nullptr;
+	}
 	
-	// Apply material
-	if (_params.dirtPlaneMat)
+	// The group sits at the origin of the hierarchy
+	for (BaseObject *op = hierarchy->GetDown(); op; op = op->GetNext())
 	{
-		AddTextureTag(polyPlane, _params.dirtPlaneMat, _params.dirtPlaneMatScale);
+		Bool success = (op == dirtPlane) ? AddDirtPlaneProxies(op->GetMl(), proxyGroup) : AddCollisionProxies(op, op->GetMl(), proxyGroup, 0);
+		if (!success)
+			return nullptr;
 	}
 	
-	// Release & return Result
-	return polyPlane.Release();
+	return proxyGroup.Release();
 }
 
 
-// Create a Curbstone
-BaseObject *Sidewalk::CreateSingleCurbstone(Vector &stoneSize, Random &sizeRnd, Random &crumpleRnd)
+Bool Sidewalk::AddCollisionProxies(BaseObject *op, const Matrix &matrix, BaseObject *proxyGroup, Int32 depth)
 {
-	// Create Cube primitive
-	AutoAlloc<BaseObject> newPrototypeStone(Ocube);
-	if (!newPrototypeStone)
-		return nullptr;
-	
-	// Calculate random length variation
-	stoneSize.z += stoneSize.z * sizeRnd.Get11() * _params.curbSizeVar;
-	
-	// Get stone's container
-	BaseContainer *stoneData = newPrototypeStone->GetDataInstance();
-	if (!stoneData)
-		return nullptr;
+	// Box of the element in its own space
+	Vector boxMin(MAXVALUE_FLOAT), boxMax(MINVALUE_FLOAT);
+	if (op->IsInstanceOf(Opolygon))
+	{
+		const PolygonObject *poly = ToPoly(op);
+		const Vector *pointArr = poly->GetPointR();
+		for (Int32 i = 0; pointArr && i < poly->GetPointCount(); ++i)
+		{
+			boxMin = Vector(Min(boxMin.x, pointArr[i].x), Min(boxMin.y, pointArr[i].y), Min(boxMin.z, pointArr[i].z));
+			boxMax = Vector(Max(boxMax.x, pointArr[i].x), Max(boxMax.y, pointArr[i].y), Max(boxMax.z, pointArr[i].z));
+		}
+	}
+	else if (op->IsInstanceOf(Ocube))
+	{
+		BaseContainer *opData = op->GetDataInstance();
+		if (!opData)
+			return false;
+		boxMax = opData->GetVector(PRIM_CUBE_LEN) * 0.5;
+		boxMin = -boxMax;
+	}
+	else if (op->IsInstanceOf(Oinstance) && depth < COLLISION_MAX_LINK_DEPTH)
+	{
+		// The linked tile is placed with the instance's matrix instead of its own
+		BaseContainer *opData = op->GetDataInstance();
+		BaseLink *link = opData ? opData->GetBaseLink(INSTANCEOBJECT_LINK) : nullptr;
+		BaseObject *linkedObject = link ? static_cast<BaseObject*>(link->ForceGetLink()) : nullptr;
+		if (linkedObject && !AddCollisionProxies(linkedObject, matrix, proxyGroup, depth + 1))
+			return false;
+	}
 	
-	// Set Stone's basic attributes
-	stoneData->SetVector(PRIM_CUBE_LEN, stoneSize);
-	stoneData->SetInt32(PRIM_CUBE_SUBX, _params.curbSubd);
-	stoneData->SetInt32(PRIM_CUBE_SUBY, _params.curbSubd);
-	stoneData->SetInt32(PRIM_CUBE_SUBZ, _params.curbSubd);
-	stoneData->SetBool(PRIM_CUBE_DOFILLET, _params.curbFilletRad > 0.0);
-	stoneData->SetFloat(PRIM_CUBE_FRAD, _params.curbFilletRad);
-	stoneData->SetInt32(PRIM_CUBE_SUBF, _params.curbFilletSubd);
+	if (boxMin.x <= boxMax.x && !AddCollisionBox(matrix, boxMin, boxMax, proxyGroup))
+		return false;
 	
-	// Convert Stone to Polygon Object
-	AutoFree<PolygonObject> stonePoly;
-	stonePoly.Set(static_cast<PolygonObject*>(MakeEditable(newPrototypeStone, _doc)));
-	if (!stonePoly)
-		return nullptr;
+	for (BaseObject *child = op->GetDown(); child; child = child->GetNext())
+	{
+		if (!AddCollisionProxies(child, matrix * child->GetMl(), proxyGroup, depth))
+			return false;
+	}
 	
-	// Crumple Stone geometry
-	if (_params.curbCrumpleVal > 0.0)
-		CrumpleGeometry(stonePoly, _params.curbCrumpleVal, crumpleRnd);
-		
+	return true;
+}
+
+
+Bool Sidewalk::AddDirtPlaneProxies(const Matrix &matrix, BaseObject *proxyGroup)
+{
+	Int32 cellCountX = GetDirtCellCountX();
+	Int32 cellCountZ = GetDirtCellCountZ();
+	Vector planePos = GetDirtPlanePosition();
+	Vector halfBlockSize = _params.elementSize * 0.5;
 	
-	// Apply Phong Tag
-	if (!AddPhongTag(stonePoly))
-		return nullptr;
+	for (Int32 columnIndex = 0; columnIndex < GetGridCountX(); ++columnIndex)
+	{
+		for (Int32 rowIndex = 0; rowIndex < GetGridCountZ(); ++rowIndex)
+		{
+			// Blocks outside of the footprint were left out of the plane
+			if (GetDirtBlockClass(columnIndex, rowIndex) == FOOTPRINTCELL::OUTSIDE)
+				continue;
+			
+			// Each block's box is in the space of the ground at its center. Without path and terrain, that's the plane's own space.
+			Vector blockCenter(_params.elementSize.x * ((Float)columnIndex + 0.5 - (Float)GetGridCountX() * 0.5),
+			                   0.0,
+			                   _params.elementSize.z * ((Float)rowIndex + 0.5 - (Float)GetGridCountZ() * 0.5));
+			Matrix blockMatrix = IsStraight() ? MatrixMove(blockCenter) : MapToGround(MatrixMove(planePos + blockCenter));
+			Matrix inverseMatrix = ~blockMatrix;
+			
+			// All lattice points of the cells the block overlaps. Covered patches don't have all of them, the box must not depend on that.
+			Int32 firstX = (Int32)((Int64)columnIndex * cellCountX / GetGridCountX());
+			Int32 lastX = (Int32)(((Int64)(columnIndex + 1) * cellCountX + GetGridCountX() - 1) / GetGridCountX());
+			Int32 firstZ = (Int32)((Int64)rowIndex * cellCountZ / GetGridCountZ());
+			Int32 lastZ = (Int32)(((Int64)(rowIndex + 1) * cellCountZ + GetGridCountZ() - 1) / GetGridCountZ());
+			
+			Vector boxMin(MAXVALUE_FLOAT), boxMax(MINVALUE_FLOAT);
+			for (Int32 x = firstX; x <= lastX; ++x)
+			{
+				for (Int32 z = firstZ; z <= lastZ; ++z)
+				{
+					Vector point = GetDirtLatticePoint(x, z);
+					point = inverseMatrix * (IsStraight() ? point : MapToGround(planePos + point));
+					boxMin = Vector(Min(boxMin.x, point.x), Min(boxMin.y, point.y), Min(boxMin.z, point.z));
+					boxMax = Vector(Max(boxMax.x, point.x), Max(boxMax.y, point.y), Max(boxMax.z, point.z));
+				}
+			}
+			
+			// The cells may reach beyond the block
+			boxMin = Vector(Max(boxMin.x, -halfBlockSize.x), boxMin.y, Max(boxMin.z, -halfBlockSize.z));
+			boxMax = Vector(Min(boxMax.x, halfBlockSize.x), boxMax.y, Min(boxMax.z, halfBlockSize.z));
+			if (boxMin.x <= boxMax.x && boxMin.z <= boxMax.z && !AddCollisionBox(matrix * blockMatrix, boxMin, boxMax, proxyGroup))
+				return false;
+		}
+	}
 	
-	// Return result
-	return stonePoly.Release();
+	return true;
 }
 
 
-// Create row of Curbstones
-BaseObject *Sidewalk::CreateCurbstoneRow(Float totalSpace)
+Bool Sidewalk::AddCollisionBox(const Matrix &matrix, const Vector &boxMin, const Vector &boxMax, BaseObject *proxyGroup)
 {
-	if (_params.curbCount < 1)
-		return nullptr;
+	Vector boxSize = boxMax - boxMin;
+	Vector boxCenter = (boxMin + boxMax) * 0.5;
 	
-	AutoAlloc<BaseObject> stoneGroup(Onull);
-	if (!stoneGroup)
-		return nullptr;
+	// Flat boxes grow downwards, their top stays where the surface is
+	if (boxSize.y < COLLISION_MIN_THICKNESS)
+	{
+		boxCenter.y = boxMax.y - COLLISION_MIN_THICKNESS * 0.5;
+		boxSize.y = COLLISION_MIN_THICKNESS;
+	}
+	boxSize.x = Max(boxSize.x, COLLISION_MIN_THICKNESS);
+	boxSize.z = Max(boxSize.z, COLLISION_MIN_THICKNESS);
 	
-	// Set group name
-	stoneGroup->SetName(_params.curbstoneGroupName);
+	AutoFree<BaseObject> proxy;
+	proxy.Set(_state.pool.GetObject(Ocube));
+	if (!proxy)
+		return false;
 	
-	// Random generator
-	Random curbstoneCrumpleRnd;
-	curbstoneCrumpleRnd.Init(_params.curbSizeSeed);
+	BaseContainer *proxyData = proxy->GetDataInstance();
+	if (!proxyData)
+		return false;
 	
-	Random curbstoneSizeRnd;
-	curbstoneSizeRnd.Init(_params.curbSizeSeed);
+	// Pooled cubes may still have the settings of a plate
+	proxyData->SetVector(PRIM_CUBE_LEN, boxSize);
+	proxyData->SetInt32(PRIM_CUBE_SUBX, 1);
+	proxyData->SetInt32(PRIM_CUBE_SUBY, 1);
+	proxyData->SetInt32(PRIM_CUBE_SUBZ, 1);
+	proxyData->SetBool(PRIM_CUBE_DOFILLET, false);
 	
-	// Initialize remaining space
-	Float remainingSpace = totalSpace;
+	Matrix proxyMatrix = matrix;
+	proxyMatrix.off = matrix * boxCenter;
+	proxy->SetMl(proxyMatrix);
 	
-	// Calculate minimum space required for one curbstone (can't be less than twice the space needed for the curbstone fillet)
-	Float minimumRequiredSpace = _params.curbFilletRad * 2.0;
+	proxy->InsertUnderLast(proxyGroup);
+	proxy.Release();
+	return true;
+}
+
+
+Bool Sidewalk::OptimizePrototype(PolygonObject *prototype)
+{
+	if (!prototype)
+		return false;
 	
-	// Create all curbstones except the last one
-	for (Int32 stoneIndex = 0; (stoneIndex < _params.curbCount) && (remainingSpace > minimumRequiredSpace); ++stoneIndex)
-	{
-		// Calculate stone size (available space / stone count)
-		Vector stoneSize = _params.curbSize;
-		stoneSize.z = (Float)(totalSpace / _params.curbCount);
-		
-		// Create new stone
-		AutoFree<BaseObject> newStone;
-		newStone.Set(CreateSingleCurbstone(stoneSize, curbstoneSizeRnd, curbstoneCrumpleRnd));
-		if (!newStone)
-			return nullptr;
-		
-		// Set stone position
-		Vector stonePos = Vector(0.0, 0.0, totalSpace - remainingSpace + stoneSize.z * 0.5);
-		newStone->SetRelPos(stonePos);
-		
-		// Update remaining space
-		remainingSpace -= stoneSize.z;
-		
-		// If required, assign texture tag to cobblestone group
-		if (_params.curbMat && _params.curbMatPerStone)
-		{
-			if (!AddTextureTag(newStone, _params.curbMat, _params.curbMatScale))
-				return nullptr;
-		}
-		
-		// Set stone name
-		newStone->SetName(_params.curbstoneName + " (" + String::IntToString(stoneIndex) + ")");
-		
-		// Insert into stone group
-		newStone->InsertUnderLast(stoneGroup);
-		newStone.Release();
-	}
+	// Prototypes of different stages may be optimized concurrently
+	_statisticsLock.Lock();
+	_state.originalCacheStats.Add(prototype);
+	_statisticsLock.Unlock();
 	
-	// Create the last stone, if there's still enough space
-	/*
-	if (remainingLength > _params.curbFilletRad * 2.0)
+	if (_params.optimizeMeshes)
 	{
-		// Calculate Stone size
-		stoneSize.z = remainingLength;
-		
-		// Create new stone
-		AutoFree<BaseObject> newStone;
-		newStone.Set(CreateCurbstone(curbstoneCrumpleRnd));
-		if (!newStone)
-			return nullptr;
-		
-		// Set stone position
-		stonePos = Vector(0.0, 0.0, totalSize.z - stoneSize.z * 0.5);
-		newStone->SetRelPos(stonePos);
-		
-		// If required, assign texture tag to cobblestone group
-		if (_params.curbMat && _params.curbMatPerStone)
-			AddTextureTag(newStone, _params.curbMat, _params.curbMatScale);
-		
-		// Set stone name
-		newStone->SetName(_params.curbstoneName + " (" + String::IntToString(stoneIndex) + ")");
+		// Points on fillet seams are duplicated by the cube primitive
+		if (WeldPoints(prototype, WELD_TOLERANCE, _state.arena) == NOTOK)
+			return false;
 		
-		// Insert into stone group
-		newStone->InsertUnderLast(stoneGroup);
-		newStone.Release();
+		if (!OptimizeVertexOrder(prototype, _state.arena))
+			return false;
 	}
-	 */
 	
-	// Release & return result
-	return stoneGroup.Release();
+	_statisticsLock.Lock();
+	_state.optimizedCacheStats.Add(prototype);
+	_statisticsLock.Unlock();
+	return true;
 }
 
 
@@ -540,7 +3444,7 @@ Bool Sidewalk::AddTextureTag(BaseObject *op, BaseMaterial *mat, Float matScale)
 {
 	if (op && mat)
 	{
-		TextureTag *matTag = TextureTag::Alloc();
+		TextureTag *matTag = static_cast<TextureTag*>(_state.pool.GetTag(Ttexture));
 		if (!matTag)
 			return false;
 
@@ -569,10 +3473,13 @@ Bool Sidewalk::AddPhongTag(BaseObject *op, Bool angleLimit, Float angle)
 	if (!op)
 		return false;
 
-	BaseTag *phongTag = op->MakeTag(Tphong);
+	BaseTag *phongTag = _state.pool.GetTag(Tphong);
 	if (!phongTag)
 		return false;
 
+	// Attach phong tag to object
+	op->InsertTag(phongTag);
+
 	BaseContainer *phongTagData = phongTag->GetDataInstance();
 	if (!phongTagData)
 		return false;
@@ -584,92 +3491,213 @@ Bool Sidewalk::AddPhongTag(BaseObject *op, Bool angleLimit, Float angle)
 }
 
 
-void Sidewalk::GetParametersFromContainer(const BaseContainer &bc, const BaseDocument &doc)
+void Sidewalk::GetParametersFromContainer(const BaseContainer &bc, const BaseDocument &doc, Parameters &params, const Matrix &mg)
 {
 	// General Parameters
-	_params.elementSize = bc.GetVector(SIDEWALK_ELEMENT_SIZE);
-	_params.countX = bc.GetInt32(SIDEWALK_COUNT_X);
-	_params.countZ = bc.GetInt32(SIDEWALK_COUNT_Z);
-	_params.shift = bc.GetFloat(SIDEWALK_SHIFT);
-	_params.elementRndSeed = bc.GetInt32(SIDEWALK_ELEMENT_SEED);
-	_params.elementSelectBias = 1.0 - ((bc.GetFloat(SIDEWALK_ELEMENT_SELBIAS) + 1.0) * 0.5);
-	_params.elementHoleBias = bc.GetFloat(SIDEWALK_ELEMENT_HOLEBIAS);
+	params.elementSize = bc.GetVector(SIDEWALK_ELEMENT_SIZE);
+	params.countX = bc.GetInt32(SIDEWALK_COUNT_X);
+	params.countZ = bc.GetInt32(SIDEWALK_COUNT_Z);
+	params.shift = bc.GetFloat(SIDEWALK_SHIFT);
+	params.elementRndSeed = bc.GetInt32(SIDEWALK_ELEMENT_SEED);
+	params.elementSelectBias = 1.0 - ((bc.GetFloat(SIDEWALK_ELEMENT_SELBIAS) + 1.0) * 0.5);
+	params.elementHoleBias = bc.GetFloat(SIDEWALK_ELEMENT_HOLEBIAS);
+	
+	// Scenes saved before have no layout version, they keep their sequential random streams
+	params.positionalSeeds = bc.GetInt32(SIDEWALK_LAYOUT_VERSION) >= SIDEWALK_LAYOUT_VERSION_POSITIONAL;
 	
 	// Plates Parameters
-	_params.plateGap = bc.GetFloat(SIDEWALK_PLATES_SPACE);
-	_params.plateFilletRad = bc.GetFloat(SIDEWALK_PLATES_FILLET_RAD);
-	_params.plateFilletSubd = bc.GetInt32(SIDEWALK_PLATES_FILLET_SUBD);
-	_params.plateUsePhong = bc.GetBool(SIDEWALK_PLATES_PHONG);
+	params.plateGap = bc.GetFloat(SIDEWALK_PLATES_SPACE);
+	params.plateFilletRad = bc.GetFloat(SIDEWALK_PLATES_FILLET_RAD);
+	params.plateFilletSubd = bc.GetInt32(SIDEWALK_PLATES_FILLET_SUBD);
+	params.plateUsePhong = bc.GetBool(SIDEWALK_PLATES_PHONG);
 	
-	_params.plateRndRot = bc.GetVector(SIDEWALK_PLATES_RND_ROT);
-	_params.plateRndPos = bc.GetVector(SIDEWALK_PLATES_RND_POS);
-	_params.plateRndSeed = bc.GetInt32(SIDEWALK_PLATES_RND_SEED);
+	params.plateRndRot = bc.GetVector(SIDEWALK_PLATES_RND_ROT);
+	params.plateRndPos = bc.GetVector(SIDEWALK_PLATES_RND_POS);
+	params.plateRndSeed = bc.GetInt32(SIDEWALK_PLATES_RND_SEED);
 	
-	_params.plateMat = bc.GetMaterialLink(SIDEWALK_PLATES_MAT_LINK, &doc);
-	_params.plateMatPerPlate = bc.GetBool(SIDEWALK_PLATES_MAT_EACH);
-	_params.plateMatScale = bc.GetFloat(SIDEWALK_PLATES_MAT_SCALE);
+	params.plateMat = bc.GetMaterialLink(SIDEWALK_PLATES_MAT_LINK, &doc);
+	params.plateMatPerPlate = bc.GetBool(SIDEWALK_PLATES_MAT_EACH);
+	params.plateMatScale = bc.GetFloat(SIDEWALK_PLATES_MAT_SCALE);
 	
 	// Cobblestones Parameters
-	_params.cobbleCount = bc.GetInt32(SIDEWALK_COBBLE_COUNT);
-	_params.cobbleElevation = bc.GetFloat(SIDEWALK_COBBLE_ELEVATION);
+	params.cobbleCount = bc.GetInt32(SIDEWALK_COBBLE_COUNT);
+	params.cobbleElevation = bc.GetFloat(SIDEWALK_COBBLE_ELEVATION);
 	
-	_params.cobbleSubdiv = bc.GetInt32(SIDEWALK_COBBLE_SUBD);
-	_params.cobbleCrumple = bc.GetFloat(SIDEWALK_COBBLE_CRUMPLE);
-	_params.cobbleCrumpleSeed = 9876;
-	_params.cobbleRotSeed = 4567;
+	params.cobbleSubdiv = bc.GetInt32(SIDEWALK_COBBLE_SUBD);
+	params.cobbleCrumple = bc.GetFloat(SIDEWALK_COBBLE_CRUMPLE);
+	params.cobbleCrumpleSeed = 9876;
+	params.cobbleRotSeed = 4567;
 	
-	_params.cobbleGap = bc.GetFloat(SIDEWALK_COBBLE_SPACE);
-	_params.cobbleFilletRad = bc.GetFloat(SIDEWALK_COBBLE_FILLET_RAD);
-	_params.cobbleFilletSubd = bc.GetInt32(SIDEWALK_COBBLE_FILLET_SUBD);
-	_params.cobbleUsePhong = bc.GetBool(SIDEWALK_COBBLE_PHONG);
+	params.cobbleGap = bc.GetFloat(SIDEWALK_COBBLE_SPACE);
+	params.cobbleFilletRad = bc.GetFloat(SIDEWALK_COBBLE_FILLET_RAD);
+	params.cobbleFilletSubd = bc.GetInt32(SIDEWALK_COBBLE_FILLET_SUBD);
+	params.cobbleUsePhong = bc.GetBool(SIDEWALK_COBBLE_PHONG);
 	
-	_params.cobbleRndRot = bc.GetVector(SIDEWALK_COBBLE_RND_ROT);
-	_params.cobbleRndPos = bc.GetVector(SIDEWALK_COBBLE_RND_POS);
-	_params.cobbleRndSeed = bc.GetInt32(SIDEWALK_COBBLE_RND_SEED);
+	params.cobbleRndRot = bc.GetVector(SIDEWALK_COBBLE_RND_ROT);
+	params.cobbleRndPos = bc.GetVector(SIDEWALK_COBBLE_RND_POS);
+	params.cobbleRndSeed = bc.GetInt32(SIDEWALK_COBBLE_RND_SEED);
 	
-	_params.cobbleMat = bc.GetMaterialLink(SIDEWALK_COBBLE_MAT_LINK, &doc);
-	_params.cobbleMatPerStone = bc.GetBool(SIDEWALK_COBBLE_MAT_EACH);
-	_params.cobbleMatScale = bc.GetFloat(SIDEWALK_COBBLE_MAT_SCALE);
+	params.cobbleMat = bc.GetMaterialLink(SIDEWALK_COBBLE_MAT_LINK, &doc);
+	params.cobbleMatPerStone = bc.GetBool(SIDEWALK_COBBLE_MAT_EACH);
+	params.cobbleMatScale = bc.GetFloat(SIDEWALK_COBBLE_MAT_SCALE);
 	
 	// Dirt Plane Parameters
-	_params.dirtPlaneEnabled = bc.GetBool(SIDEWALK_USE_DIRT);
-	_params.dirtPlaneCrumple = bc.GetFloat(SIDEWALK_DIRT_CRUMPLE);
-	_params.dirtPlaneSubd = bc.GetInt32(SIDEWALK_DIRT_SUBD);
-	_params.dirtPlaneCrumpleSeed = bc.GetInt32(SIDEWALK_DIRT_SEED);
-	_params.dirtPlaneElevation = bc.GetFloat(SIDEWALK_DIRT_ELEVATION);
+	params.dirtPlaneEnabled = bc.GetBool(SIDEWALK_USE_DIRT);
+	params.dirtPlaneCrumple = bc.GetFloat(SIDEWALK_DIRT_CRUMPLE);
+	params.dirtPlaneSubd = bc.GetInt32(SIDEWALK_DIRT_SUBD);
+	params.dirtPlaneCrumpleSeed = bc.GetInt32(SIDEWALK_DIRT_SEED);
+	params.dirtPlaneElevation = bc.GetFloat(SIDEWALK_DIRT_ELEVATION);
 	
-	_params.dirtPlaneMat = bc.GetMaterialLink(SIDEWALK_DIRT_MAT_LINK, &doc);
-	_params.dirtPlaneMatScale = bc.GetFloat(SIDEWALK_DIRT_MAT_SCALE);
+	params.dirtPlaneMat = bc.GetMaterialLink(SIDEWALK_DIRT_MAT_LINK, &doc);
+	params.dirtPlaneMatScale = bc.GetFloat(SIDEWALK_DIRT_MAT_SCALE);
 	
 	// Curbstone Parameters
-	_params.curbEnabled = bc.GetBool(SIDEWALK_USE_CURB);
-	_params.curbSize.x = bc.GetFloat(SIDEWALK_CURB_SIZE_X);
-	_params.curbSize.y = bc.GetFloat(SIDEWALK_CURB_SIZE_Y);
-	_params.curbCount = bc.GetInt32(SIDEWALK_CURB_COUNT);
-	_params.curbCrumpleVal = bc.GetFloat(SIDEWALK_CURB_CRUMPLE_VAL);
-	_params.curbFilletRad = bc.GetFloat(SIDEWALK_CURB_FILLET_RAD);
-	_params.curbFilletSubd = bc.GetInt32(SIDEWALK_CURB_FILLET_SUBD);
-	_params.curbSizeVar = bc.GetFloat(SIDEWALK_CURB_VARIATION);
-	_params.curbSizeSeed = bc.GetInt32(SIDEWALK_CURB_VARIATION_SEED);
-	_params.curbSubd = bc.GetInt32(SIDEWALK_CURB_SUBD);
-	_params.curbElevation = bc.GetFloat(SIDEWALK_CURB_ELEVATION);
+	params.curbEnabled = bc.GetBool(SIDEWALK_USE_CURB);
+	params.curbSize.x = bc.GetFloat(SIDEWALK_CURB_SIZE_X);
+	params.curbSize.y = bc.GetFloat(SIDEWALK_CURB_SIZE_Y);
+	params.curbCount = bc.GetInt32(SIDEWALK_CURB_COUNT);
+	params.curbCrumpleVal = bc.GetFloat(SIDEWALK_CURB_CRUMPLE_VAL);
+	params.curbFilletRad = bc.GetFloat(SIDEWALK_CURB_FILLET_RAD);
+	params.curbFilletSubd = bc.GetInt32(SIDEWALK_CURB_FILLET_SUBD);
+	params.curbSizeVar = bc.GetFloat(SIDEWALK_CURB_VARIATION);
+	params.curbSizeSeed = bc.GetInt32(SIDEWALK_CURB_VARIATION_SEED);
+	params.curbSubd = bc.GetInt32(SIDEWALK_CURB_SUBD);
+	params.curbElevation = bc.GetFloat(SIDEWALK_CURB_ELEVATION);
+	
+	params.curbMat = bc.GetMaterialLink(SIDEWALK_CURB_MAT_LINK, &doc);
+	params.curbMatScale = bc.GetFloat(SIDEWALK_CURB_MAT_SCALE);
+	params.curbMatPerStone = bc.GetBool(SIDEWALK_PLATES_MAT_EACH);
+	
+	// Tile Parameters (tile size has to be even, to keep the row shifting intact)
+	params.tileEnabled = bc.GetBool(SIDEWALK_TILE_ENABLE);
+	params.tileSize = ClampValue(bc.GetInt32(SIDEWALK_TILE_SIZE), (Int32)2, MAX_ELEMENT_INDEX_COUNT);
+	params.tileSize += params.tileSize % 2;
+	params.tileVariation = bc.GetInt32(SIDEWALK_TILE_VARIATION);
+	params.tileSeed = bc.GetInt32(SIDEWALK_TILE_SEED);
+	
+	// Spline path, sampled in the generator's space
+	params.path.Flush();
+	BaseObject *splineLink = bc.GetObjectLink(SIDEWALK_SPLINE, &doc);
+	SplineObject *spline = splineLink ? splineLink->GetRealSpline() : nullptr;
+	if (spline && params.elementSize.z > 0.0 && params.path.Init(spline, ~mg * splineLink->GetMg(), params.elementSize.z / PATH_SAMPLES_PER_ELEMENT))
+	{
+		// As many rows as fit on the spline. Tiles are straight, they can't follow it.
+		params.countZ = Max((Int32)(params.path.GetLength() / params.elementSize.z), (Int32)1);
+		params.tileEnabled = false;
+	}
+	
+	// Footprint, sampled in the generator's space
+	params.footprint.Flush();
+	params.gridOffset = Vector();
+	BaseObject *footprintLink = bc.GetObjectLink(SIDEWALK_FOOTPRINT, &doc);
+	SplineObject *footprintSpline = footprintLink ? footprintLink->GetRealSpline() : nullptr;
+	Float footprintStep = Min(params.elementSize.x, params.elementSize.z) / FOOTPRINT_SAMPLES_PER_ELEMENT;
+	if (footprintSpline && footprintStep > 0.0 && params.footprint.Init(footprintSpline, ~mg * footprintLink->GetMg(), footprintStep))
+	{
+		// The grid is fitted around the footprint. Shifted columns need room for the shift.
+		Vector footprintMin = params.footprint.GetMin();
+		Vector footprintMax = params.footprint.GetMax();
+		params.countX = Max(SAFEINT32(Ceil((footprintMax.x - footprintMin.x) / params.elementSize.x)), (Int32)1);
+		params.countZ = Max(SAFEINT32(Ceil((footprintMax.z - footprintMin.z + Abs(params.shift)) / params.elementSize.z)), (Int32)1);
+		params.gridOffset = Vector(footprintMin.x + params.elementSize.x * params.countX * 0.5, 0.0, footprintMin.z + params.elementSize.z * 0.5 - Min(params.shift, 0.0));
+		
+		// Curbstones, tiles and a path only fit a straight rectangle
+		params.curbEnabled = false;
+		params.tileEnabled = false;
+		params.path.Flush();
+	}
+	
+	// Indices of all elements have to fit into their IDs. Tile instances, chunks and dirt blocks are never more than the cells.
+	params.countX = ClampValue(params.countX, (Int32)1, MAX_ELEMENT_INDEX_COUNT);
+	params.countZ = ClampValue(params.countZ, (Int32)1, MAX_ELEMENT_INDEX_COUNT);
+	params.cobbleCount = Min(params.cobbleCount, MAX_ELEMENT_INDEX_COUNT);
+	params.curbCount = Min(params.curbCount, MAX_ELEMENT_INDEX_COUNT);
+	
+	// Terrain, sampled in the generator's space where the sidewalk and its curbstones are
+	params.terrain.Flush();
+	Matrix terrainMatrix;
+	BaseObject *terrainLink = bc.GetObjectLink(SIDEWALK_TERRAIN, &doc);
+	PolygonObject *terrainPolygons = terrainLink ? FindTerrainPolygons(terrainLink, ~mg * terrainLink->GetMg(), terrainMatrix) : nullptr;
+	Float terrainStep = Min(params.elementSize.x, params.elementSize.z) / TERRAIN_SAMPLES_PER_ELEMENT;
+	if (terrainPolygons && terrainStep > 0.0)
+	{
+		Float halfWidth = params.elementSize.x * params.countX * 0.5 + (params.curbEnabled ? params.curbSize.x : 0.0) + terrainStep;
+		Vector areaMin, areaMax;
+		if (params.path.IsValid())
+		{
+			// Around the path, as wide as the sidewalk on both sides
+			areaMin = Vector(MAXVALUE_FLOAT);
+			areaMax = Vector(MINVALUE_FLOAT);
+			const Matrix *sampleArr = params.path.GetSamples();
+			for (Int i = 0; i < params.path.GetSampleCount(); ++i)
+			{
+				const Vector &samplePos = sampleArr[i].off;
+				areaMin = Vector(Min(areaMin.x, samplePos.x), 0.0, Min(areaMin.z, samplePos.z));
+				areaMax = Vector(Max(areaMax.x, samplePos.x), 0.0, Max(areaMax.z, samplePos.z));
+			}
+			areaMin -= Vector(halfWidth, 0.0, halfWidth);
+			areaMax += Vector(halfWidth, 0.0, halfWidth);
+		}
+		else
+		{
+			// Rows start half an element before the first position, shifted columns reach further
+			Float margin = params.elementSize.z * 0.5 + Abs(params.shift) + terrainStep;
+			areaMin = params.gridOffset + Vector(-halfWidth, 0.0, -margin);
+			areaMax = params.gridOffset + Vector(halfWidth, 0.0, params.elementSize.z * (params.countZ - 1) + margin);
+		}
+		
+		// Tiles are flat, they can't follow the terrain
+		if (params.terrain.Init(terrainPolygons, terrainMatrix, areaMin, areaMax, terrainStep))
+			params.tileEnabled = false;
+	}
+	
+	// Displacement Bake Parameters
+	params.bakeEnabled = bc.GetBool(SIDEWALK_BAKE_ENABLE);
+	params.bakeResolution = Max(bc.GetInt32(SIDEWALK_BAKE_RESOLUTION), (Int32)1);
+	params.bakeFile = bc.GetFilename(SIDEWALK_BAKE_FILE);
+	if (params.bakeEnabled)
+	{
+		// Stones are built with low subdivision and without crumple, the detail goes into the texture
+		params.bakeCobbleDetail = (Float)params.cobbleSubdiv;
+		params.bakeCobbleStrength = params.cobbleCrumple;
+		params.bakeCurbDetail = (Float)params.curbSubd;
+		params.bakeCurbStrength = params.curbCrumpleVal;
+		params.cobbleSubdiv = 1;
+		params.cobbleCrumple = 0.0;
+		params.curbSubd = 1;
+		params.curbCrumpleVal = 0.0;
+	}
 	
-	_params.curbMat = bc.GetMaterialLink(SIDEWALK_CURB_MAT_LINK, &doc);
-	_params.curbMatScale = bc.GetFloat(SIDEWALK_CURB_MAT_SCALE);
-	_params.curbMatPerStone = bc.GetBool(SIDEWALK_PLATES_MAT_EACH);
+	// Performance Parameters
+	params.namingPolicy = bc.GetInt32(SIDEWALK_NAMING);
+	params.quantizeCache = bc.GetBool(SIDEWALK_QUANTIZE);
+	params.optimizeMeshes = bc.GetBool(SIDEWALK_OPTIMIZE);
+	// Scenes from before the collision modes stored a Bool, true is the same as SIDEWALK_COLLISION_HIDDEN
+	Int32 collisionMode = bc.GetInt32(SIDEWALK_COLLISION);
+	params.collisionProxies = collisionMode != SIDEWALK_COLLISION_OFF;
+	params.collisionOnly = collisionMode == SIDEWALK_COLLISION_ONLY;
+	params.chunkEnabled = bc.GetBool(SIDEWALK_CHUNK_ENABLE);
+	params.chunkSizeX = Max(bc.GetInt32(SIDEWALK_CHUNK_SIZE_X), (Int32)1);
+	params.chunkSizeZ = Max(bc.GetInt32(SIDEWALK_CHUNK_SIZE_Z), (Int32)1);
+	
+	GetObjectNames(params);
 }
 
 
-void Sidewalk::GetObjectNames()
+void Sidewalk::GetObjectNames(Parameters &params)
 {
-	_params.sidewalkGroupName = GeLoadString(IDS_OSIDEWALK);
-	_params.plateGroupName = GeLoadString(IDS_OBJ_PLATE_GROUP);
-	_params.cobblestoneGroupName = GeLoadString(IDS_OBJ_COBBLESTONE_GROUP);
-	_params.curbstoneGroupName = GeLoadString(IDS_OBJ_CURBSTONE_GROUP);
-	_params.plateName = GeLoadString(IDS_OBJ_PLATE);
-	_params.cobblestoneName = GeLoadString(IDS_OBJ_COBBLESTONE);
-	_params.dirtPlaneName = GeLoadString(IDS_OBJ_PLATE);
-	_params.curbstoneName = GeLoadString(IDS_OBJ_CURBSTONE);
+	params.sidewalkGroupName = GeLoadString(IDS_OSIDEWALK);
+	params.plateGroupName = GeLoadString(IDS_OBJ_PLATE_GROUP);
+	params.cobblestoneGroupName = GeLoadString(IDS_OBJ_COBBLESTONE_GROUP);
+	params.curbstoneGroupName = GeLoadString(IDS_OBJ_CURBSTONE_GROUP);
+	params.collisionGroupName = GeLoadString(IDS_OBJ_COLLISION_GROUP);
+	params.plateName = GeLoadString(IDS_OBJ_PLATE);
+	params.cobblestoneName = GeLoadString(IDS_OBJ_COBBLESTONE);
+	params.dirtPlaneName = GeLoadString(IDS_OBJ_PLATE);
+	params.curbstoneName = GeLoadString(IDS_OBJ_CURBSTONE);
+	params.tileName = GeLoadString(IDS_OBJ_TILE);
+	params.tileInstanceName = GeLoadString(IDS_OBJ_TILE_INSTANCE);
+	params.chunkName = GeLoadString(IDS_OBJ_CHUNK);
 }
 
 
@@ -680,24 +3708,32 @@ BaseObject *MakeEditable(BaseObject *op, BaseDocument *doc)
 	
 	BaseObject *result = nullptr;
 	
-	AutoAlloc<BaseDocument> tmpDoc;
-	BaseObject *tmpOp = static_cast<BaseObject*>(op->GetClone(COPYFLAGS_0, nullptr));
-	tmpDoc->InsertObject(tmpOp, nullptr, nullptr);
-	
-	ModelingCommandData cd;
-	cd.doc = tmpDoc;
-	cd.op = tmpOp;
-	
-	if (SendModelingCommand(MCOMMAND_MAKEEDITABLE, cd))
+	// Covers the temporary document as well as the command, whichever build, prefetch or batch thread calls
+	g_makeEditableLock.Lock();
 	{
-		BaseObject *commandResult = static_cast<BaseObject*>(cd.result->GetIndex(0));
-		if (!commandResult)
-			return nullptr;
-		
-		result = static_cast<BaseObject*>(commandResult->GetClone(COPYFLAGS_NO_ANIMATION|COPYFLAGS_NO_BITS, nullptr));
-		
-		BaseObject::Free(commandResult);
+		AutoAlloc<BaseDocument> tmpDoc;
+		BaseObject *tmpOp = static_cast<BaseObject*>(op->GetClone(COPYFLAGS_0, nullptr));
+		if (tmpDoc && tmpOp)
+		{
+			tmpDoc->InsertObject(tmpOp, nullptr, nullptr);
+			
+			ModelingCommandData cd;
+			cd.doc = tmpDoc;
+			cd.op = tmpOp;
+			
+			BaseObject *commandResult = SendModelingCommand(MCOMMAND_MAKEEDITABLE, cd) ? static_cast<BaseObject*>(cd.result->GetIndex(0)) : nullptr;
+			if (commandResult)
+			{
+				result = static_cast<BaseObject*>(commandResult->GetClone(COPYFLAGS_NO_ANIMATION|COPYFLAGS_NO_BITS, nullptr));
+				BaseObject::Free(commandResult);
+			}
+		}
+		else
+		{
+			BaseObject::Free(tmpOp);
+		}
 	}
+	g_makeEditableLock.Unlock();
 	
 	return result;
 }
@@ -736,22 +3772,89 @@ Vector GetVertexNormal(PolygonObject *op, Neighbor *neighbor, Int32 pointIndex)
 }
 
 
-void CrumpleGeometry(PolygonObject *op, Float strength, Random &rnd)
+void CrumpleGeometry(PolygonObject *op, Float strength, Random &rnd, Arena &arena)
+{
+	if (!op)
+		return;
+	
+	Int32 pointCount = op->GetPointCount();
+	
+	// Normals are only needed while crumpling
+	Vector *normalArr = arena.Alloc<Vector>(pointCount);
+	if (!normalArr)
+		return;
+	
+	ComputeVertexNormals(op, normalArr);
+	CrumplePoints(op->GetPointW(), normalArr, pointCount, strength, rnd);
+}
+
+
+Bool GetVertexNormals(const PolygonObject *op, PointBuffer &normals, Bool quantize, Arena &arena)
 {
 	if (!op)
+		return false;
+	
+	Int32 pointCount = op->GetPointCount();
+	Vector *normalArr = arena.Alloc<Vector>(pointCount);
+	if (!normalArr)
+		return false;
+	
+	ComputeVertexNormals(op, normalArr);
+	return normals.Set(normalArr, pointCount, quantize);
+}
+
+
+void ComputeVertexNormals(const PolygonObject *op, Vector *normalArr)
+{
+	if (!op || !normalArr)
 		return;
 	
 	Int32 pointCount = op->GetPointCount();
 	Int32 polygonCount = op->GetPolygonCount();
+	const Vector *pointArr = op->GetPointR();
+	const CPolygon *polygonArr = op->GetPolygonR();
 	
-	Vector *pointArr = op->GetPointW();
+	for (Int32 i = 0; i < pointCount; ++i)
+		normalArr[i] = Vector();
+	
+	// Sum up face normals of all polygons attached to each point
+	for (Int32 polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	{
+		const CPolygon &poly = polygonArr[polygonIndex];
+		Vector faceNormal = Cross(pointArr[poly.b] - pointArr[poly.a], pointArr[poly.c] - pointArr[poly.a]);
+		
+		normalArr[poly.a] += faceNormal;
+		normalArr[poly.b] += faceNormal;
+		normalArr[poly.c] += faceNormal;
+		if (poly.c != poly.d)
+			normalArr[poly.d] += faceNormal;
+	}
+	
+	for (Int32 i = 0; i < pointCount; ++i)
+		normalArr[i] = normalArr[i].GetNormalized();
+}
+
+
+void CrumplePoints(Vector *pointArr, const Vector *normalArr, Int32 pointCount, Float strength, Random &rnd)
+{
+	if (!pointArr || !normalArr)
+		return;
 	
-	Neighbor nb;
-	if (!nb.Init(pointCount, op->GetPolygonW(), polygonCount, nullptr)) return;
+	for (Int32 i = 0; i < pointCount; ++i)
+	{
+		pointArr[i] += normalArr[i] * strength * rnd.Get11();
+	}
+}
+
+
+void CrumplePoints(Vector *pointArr, const PointBuffer &normals, Float strength, Random &rnd)
+{
+	if (!pointArr)
+		return;
 	
-	for (Int32 i = 0; i < pointCount; i++)
+	for (Int32 i = 0; i < normals.GetCount(); ++i)
 	{
-		pointArr[i] += GetVertexNormal(op, &nb, i) * strength * rnd.Get11();
+		pointArr[i] += normals.GetPoint(i) * strength * rnd.Get11();
 	}
 }
 
@@ -772,3 +3875,28 @@ Float GetHardRndAngle(Random &rnd, RANDOMANGLE mode)
 	}
 	return x;
 }
+
+
+Float GetPositionalRnd11(Int32 seed, Int32 x, Int32 z)
+{
+	return (Float)GetPositionalSeed(seed, x, z) / (Float)0xFFFFFFFFu * 2.0 - 1.0;
+}
+
+
+UInt32 GetPositionalSeed(Int32 seed, Int32 x, Int32 z)
+{
+	// Combine inputs
+	UInt32 hash = (UInt32)seed * 0x9E3779B1u;
+	hash ^= (UInt32)x * 0x85EBCA77u;
+	hash = (hash << 13) | (hash >> 19);
+	hash ^= (UInt32)z * 0xC2B2AE3Du;
+	
+	// Final avalanche
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	
+	return hash;
+}
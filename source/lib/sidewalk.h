@@ -3,6 +3,18 @@
 
 #include "c4d.h"
 #include "lib_noise.h"
+#include "objectpool.h"
+#include "arena.h"
+#include "pointbuffer.h"
+#include "meshoptimizer.h"
+#include "elementbvh.h"
+#include "displacementbake.h"
+#include "plywriter.h"
+#include "taskgraph.h"
+#include "buildstatistics.h"
+#include "splinepath.h"
+#include "footprint.h"
+#include "heightfield.h"
 
 
 /// Options for GetHardRndAngle()
@@ -13,7 +25,40 @@ enum class RANDOMANGLE
 } ENUM_END_LIST(RANDOMANGLE);
 
 
+/// Type of element that occupies a cell of the sidewalk grid
+enum class ELEMENTTYPE
+{
+	HOLE =	0,            ///< Missing element, the dirt plane is visible
+	PLATE =	1,            ///< A single plate
+	COBBLESTONES =	2     ///< A group of cobblestones
+} ENUM_END_LIST(ELEMENTTYPE);
+
+
+/// Kind of element, for naming
+enum class ELEMENTKIND
+{
+	PLATE =	0,            ///< A plate
+	COBBLESTONES =	1,    ///< A group of cobblestones
+	COBBLESTONE =	2,    ///< A single cobblestone
+	CURBSTONE =	3,        ///< A curbstone
+	TILEINSTANCE =	4,    ///< An instance of the tile
+	CHUNK =	5,            ///< A chunk of plates or cobblestone groups
+	DIRTBLOCK =	6         ///< A patch of the dirt plane, only as a streamed element
+} ENUM_END_LIST(ELEMENTKIND);
+
+
+/// How a patch of the dirt plane is built
+enum class DIRTPATCH
+{
+	OUTSIDE =	0,    ///< Left out, it's outside of the footprint
+	FULL =	1,       ///< Every lattice cell, the dirt is visible
+	COARSE =	2     ///< A single quad, or a fan where it meets full patches. The dirt is covered by plates.
+} ENUM_END_LIST(DIRTPATCH);
+
+
 /// This class builds a complete sidewalk from separate objects.
+/// It's reentrant: Everything a build reads comes from an immutable parameter snapshot, everything it writes goes into the caller's State.
+/// Builds with different State objects can run concurrently. Each build runs its independent stages on several threads itself.
 class Sidewalk
 {
 	MAXON_DISALLOW_COPY_AND_ASSIGN(Sidewalk);
@@ -31,6 +76,11 @@ public:
 		Int32 elementRndSeed;
 		Float elementSelectBias;
 		Float elementHoleBias;
+		SplinePath path;           ///< Path the sidewalk follows; or an invalid path for a straight sidewalk
+		Footprint footprint;       ///< Outline of the paved area; or an invalid footprint for the whole grid
+		Vector gridOffset;         ///< Offset of the element grid, e.g. to fit it around the footprint
+		HeightField terrain;       ///< Ground the sidewalk is placed on; or an invalid height field for flat ground
+		Bool positionalSeeds;      ///< Each cell draws from its own random generator, seeded from its position. False for scenes saved before, which keep one sequential stream through the grid.
 
 		// Plates Parameters
 		Float plateGap;
@@ -94,20 +144,49 @@ public:
 		Float curbMatScale;
 		Bool curbMatPerStone;
 
+		// Tile Parameters
+		Bool tileEnabled;
+		Int32 tileSize;
+		Int32 tileVariation;
+		Int32 tileSeed;
+
+		// Displacement Bake Parameters. Detail and strength are the original subdivision and crumple of the stones.
+		Bool bakeEnabled;
+		Int32 bakeResolution;
+		Filename bakeFile;
+		Float bakeCobbleDetail;
+		Float bakeCobbleStrength;
+		Float bakeCurbDetail;
+		Float bakeCurbStrength;
+
+		// Performance Parameters
+		Int32 namingPolicy;
+		Bool quantizeCache;
+		Bool optimizeMeshes;
+		Bool collisionProxies;     ///< The result holds collision proxies. Next to the visible geometry they don't replace it as collider, dynamics tags on the generator see both.
+		Bool collisionOnly;        ///< The result only holds the collision proxies, for a second generator that is used as collider
+		Bool chunkEnabled;         ///< Put plates and cobblestone groups into chunks of neighbouring cells
+		Int32 chunkSizeX;          ///< Number of cells of a chunk along X
+		Int32 chunkSizeZ;          ///< Number of cells of a chunk along Z
+
 		// Component group names
 		String sidewalkGroupName;
 		String plateGroupName;
 		String cobblestoneGroupName;
 		String curbstoneGroupName;
+		String collisionGroupName;
 
 		// Component names
 		String plateName;
 		String cobblestoneName;
 		String dirtPlaneName;
 		String curbstoneName;
+		String tileName;
+		String tileInstanceName;
+		String chunkName;
 
 		/// Default constructor
-		Parameters() : countX(0), countZ(0), shift(0.0), elementRndSeed(0), elementSelectBias(0.0), elementHoleBias(0.0),
+		Parameters() : countX(0), countZ(0), shift(0.0), elementRndSeed(0), elementSelectBias(0.0), elementHoleBias(0.0), positionalSeeds(true),
 		               plateGap(0.0), plateFilletRad(0.0), plateFilletSubd(0), plateUsePhong(false),
 		               plateRndRot(0.0), plateRndPos(0.0), plateRndSeed(0),
 		               plateMat(nullptr), plateMatPerPlate(false), plateMatScale(0.0),
@@ -119,78 +198,939 @@ public:
 		               dirtPlaneEnabled(false), dirtPlaneSubd(0), dirtPlaneCrumple(0.0), dirtPlaneCrumpleSeed(0), dirtPlaneElevation(0.0),
 		               dirtPlaneMat(nullptr), dirtPlaneMatScale(0.0),
 		               curbEnabled(false), curbCount(0), curbSubd(0), curbCrumpleVal(0.0), curbFilletRad(0.0), curbFilletSubd(0), curbSizeVar(0.0), curbSizeSeed(0), curbElevation(0.0),
-		               curbMat(nullptr), curbMatScale(0.0), curbMatPerStone(false)
+		               curbMat(nullptr), curbMatScale(0.0), curbMatPerStone(false),
+		               tileEnabled(false), tileSize(0), tileVariation(0), tileSeed(0),
+		               bakeEnabled(false), bakeResolution(0), bakeCobbleDetail(0.0), bakeCobbleStrength(0.0), bakeCurbDetail(0.0), bakeCurbStrength(0.0),
+		               namingPolicy(0), quantizeCache(false), optimizeMeshes(false), collisionProxies(false), collisionOnly(false), chunkEnabled(false), chunkSizeX(0), chunkSizeZ(0)
 		{}
+		
+		/// Check if a sidewalk built from other parameters has the same objects, points and polygons.
+		/// Crumple, random variation and their seeds may differ.
+		Bool HasSameTopology(const Parameters &other) const;
+		
+		/// Check if the elements of a sidewalk built from other parameters can be kept in all cells whose element type doesn't change.
+		/// Grid size, layout biases and the variation of plates may differ. Never in bake mode, as the atlas tiles move with the element count.
+		/// Never with sequential seeds, as each cell's variation depends on the cells before it.
+		Bool CanKeepElements(const Parameters &other) const;
+		
+		/// Check if a sidewalk built from other parameters has the same objects, points and polygons in each cell with the same element type.
+		/// Grid size, layout biases, crumple, random variation and their seeds may differ.
+		Bool HasSameElementTopology(const Parameters &other) const;
+		
+		/// Get a hash of all parameters. Equal hashes mean equal results.
+		UInt64 GetHash() const;
 	};
 
+	/// This struct holds everything that is kept from one build to the next: The data needed by Update(), and reusable memory.
+	/// Each generator owns one. It must not be used by more than one build at a time.
+	struct State
+	{
+		MAXON_DISALLOW_COPY_AND_ASSIGN(State);
+		
+	public:
+		Parameters params;                     ///< Parameters of the last build or update
+		maxon::BaseArray<ELEMENTTYPE> layout;  ///< Element type of each cell, index is (columnIndex * countZ + rowIndex)
+		
+		// Class of each cell and each dirt plane block relative to the footprint, same index as the layout. Empty without footprint.
+		maxon::BaseArray<FOOTPRINTCELL> cellClasses;
+		maxon::BaseArray<FOOTPRINTCELL> dirtBlockClasses;
+		
+		// Uncrumpled prototype geometry, kept for Update()
+		PointBuffer cobblePoints;
+		PointBuffer cobbleNormals;
+		maxon::BaseArray<Vector> crumpledCobblePoints;
+		PointBuffer curbPoints;
+		PointBuffer curbNormals;
+		maxon::BaseArray<Float> curbLengths;
+		maxon::BaseArray<Char> curbPointParts;       ///< Part of the curbstone prototype each point is in: 0 for the straight part, -1 and 1 for the fillets at either end
+		maxon::BaseArray<Int32> dirtLatticeIndices;  ///< Lattice index (x * latticeCountZ + z) of each lattice point of the dirt plane, in point order
+		Bool updatable;                        ///< True if the last result is complete and may be updated
+		Bool complete;                         ///< True if the last result is complete, though it may not have been built with this state
+		Int32 threadCount;                     ///< Number of threads a build may use at most; 0 uses all threads
+		Bool writeFiles;                       ///< True if results may write files, like the displacement atlas. Only set for builds in the active document, not for prefetching, batch builds, renders or conversions.
+		UInt64 bakeHash;                       ///< Hash of the inputs of the last displacement atlas that was written; 0 if none
+		
+		ObjectPool pool;                       ///< Objects and tags of the result before the last one, reused by the next build
+		Arena arena;                           ///< Transient data of the current build
+		
+		// Vertex cache statistics of the prototypes, before and after optimizing them
+		VertexCacheStatistics originalCacheStats;
+		VertexCacheStatistics optimizedCacheStats;
+		
+		ElementBVH bvh;                        ///< Bounding boxes of the elements of the last result, for queries
+		BuildStatistics statistics;            ///< Contents and timing of the last result
+		
+		/// Default constructor
+		State() : updatable(false), complete(false), threadCount(0), writeFiles(false), bakeHash(0)
+		{}
+	};
+	
+	/// A single element of a sidewalk, as generated by ElementStream.
+	/// Points and polygons belong to the stream. They're only valid until the next element is generated.
+	struct Element
+	{
+		ELEMENTKIND kind;                ///< PLATE, COBBLESTONE, DIRTBLOCK or CURBSTONE
+		Int32 columnIndex;               ///< Column of the element's cell or dirt plane patch; or index of the curbstone
+		Int32 rowIndex;                  ///< Row of the element's cell or dirt plane patch; 0 for curbstones
+		Int32 stoneColumn;               ///< Column of a cobblestone inside its cell; 0 for other elements
+		Int32 stoneRow;                  ///< Row of a cobblestone inside its cell; 0 for other elements
+		UInt32 seed;                     ///< Seed of the random generator the element's variation was drawn from
+		Matrix matrix;                   ///< Matrix of the element, relative to the sidewalk
+		const PolygonObject *geometry;   ///< Prototype that all elements of this kind share, with their polygons and UVWs; nullptr for dirt plane patches
+		const Vector *pointArr;          ///< Points of the element, relative to matrix. Crumpled or stretched stones differ from their prototype.
+		Int32 pointCount;
+		const CPolygon *polygonArr;
+		Int32 polygonCount;
+		
+		/// Default constructor
+		Element() : kind(ELEMENTKIND::PLATE), columnIndex(0), rowIndex(0), stoneColumn(0), stoneRow(0), seed(0), geometry(nullptr), pointArr(nullptr), pointCount(0), polygonArr(nullptr), polygonCount(0)
+		{}
+	};
+	
+	class ElementStream;
+
 public:
+	/// Take a snapshot of all sidewalk parameters from a BaseContainer
+	/// @param[out] params Receives the parameters, including the object names
+	/// @param[in] mg Global matrix of the generator. A linked spline is sampled relative to it.
+	static void GetParametersFromContainer(const BaseContainer &bc, const BaseDocument &doc, Parameters &params, const Matrix &mg = Matrix());
+	
 	/// Build a complete sidewalk
+	/// @param[in] params Parameter snapshot
+	/// @param[in,out] state State of this generator
+	/// @param[in] previousResult The previous object hierarchy, may be nullptr. If the build succeeds, its children are taken and reused by the next build.
+	/// If the build fails, it's left intact and can still be shown.
 	/// @return Pointer to the parent object of the sidewalk object hierarchy; or nullptr if an error occurred. Caller owns the pointed object.
-	BaseObject *Build(BaseContainer *bc, BaseDocument *doc);
+	static BaseObject *Build(const Parameters &params, State &state, BaseDocument *doc, BaseObject *previousResult = nullptr);
+	
+	/// Rewrite points and matrices of the last built sidewalk in place.
+	/// Only possible if none of the changed parameters affects the topology.
+	/// @param[in] params Parameter snapshot
+	/// @param[in,out] state State of this generator
+	/// @param[in] cache The object hierarchy returned by the last call to Build() with this state
+	/// @return True if the cache has been updated; false if it has to be built again
+	static Bool Update(const Parameters &params, State &state, BaseDocument *doc, BaseObject *cache);
+	
+	/// Take over a complete result that was built with another state, e.g. a copy from a build cache.
+	/// It can't be updated, the next change builds again.
+	/// @param[in] params The parameters the result was built with
+	/// @param[in,out] state State of this generator
+	/// @param[in] doc The document the result is shown in
+	/// @param[in] result The result
+	static void Adopt(const Parameters &params, State &state, BaseDocument *doc, BaseObject *result);
+	
+	/// Name all elements of a sidewalk from their IDs, for results built without full names
+	/// @param[in] params The parameters the hierarchy was built with
+	/// @param[in] hierarchy The object hierarchy returned by Build()
+	static void ResolveNames(const Parameters &params, BaseObject *hierarchy);
+	
+	/// Stream a complete sidewalk to a binary PLY file, element by element, without building the object hierarchy.
+	/// Tiles are expanded, baked detail is built as geometry, and no collision proxies are written. See ElementStream.
+	/// @param[in] params Parameter snapshot
+	/// @param[in,out] state State of this generator. Its last result can't be updated afterwards.
+	/// @param[in] file The PLY file
+	/// @param[out] polygonCount Receives the number of polygons written, may be nullptr
+	/// @return False if an error occurred; otherwise true
+	static Bool Export(const Parameters &params, State &state, BaseDocument *doc, const Filename &file, Int *polygonCount = nullptr);
 
 private:
-	/// Get all sidewalk parameters from a BaseContainer and copy them to _params
-	void GetParametersFromContainer(const BaseContainer &bc, const BaseDocument &doc);
+	/// Construct a builder for a single build or update
+	Sidewalk(const Parameters &params, State &state, BaseDocument *doc) : _params(params), _state(state), _doc(doc)
+	{
+		SelectEmitters();
+	}
+	
+	/// Element emitters, specialized on the flags that don't change during a build
+	typedef BaseObject *(Sidewalk::*PlateEmitter)();
+	typedef Bool (Sidewalk::*CobblestonesEmitter)(BaseObject *group, PolygonObject *prototype, Int32 cellColumn, Int32 cellRow, Random &rnd);
+	typedef BaseObject *(Sidewalk::*CurbstoneEmitter)(PolygonObject *prototype, Float prototypeLength, Float stoneLength, Random &crumpleRnd);
+	
+	/// The emitters selected for the current parameters
+	struct Emitters
+	{
+		PlateEmitter plate;
+		CobblestonesEmitter cobblestones;
+		CurbstoneEmitter curbstone;
+	};
+	
+	/// Pick the specialized emitters for the current parameters from the dispatch tables
+	void SelectEmitters();
+	
+	/// Get the index of an emitter specialization in a dispatch table
+	static Int32 GetEmitterIndex(Bool firstFlag, Bool secondFlag)
+	{
+		return (firstFlag ? 1 : 0) | (secondFlag ? 2 : 0);
+	}
+	
+	/// Build a complete sidewalk, see Build()
+	/// @param[in] keepElements True if the elements of previousResult may be kept in cells whose element type doesn't change, see Parameters::CanKeepElements()
+	BaseObject *BuildHierarchy(BaseObject *previousResult, Bool keepElements);
+	
+	/// Run the build stages and assemble their results
+	/// @param[in] mainGroup Receives the components of the sidewalk
+	/// @return False if an error occurred; otherwise true
+	Bool BuildComponents(BaseObject *mainGroup);
+	
+	/// Random generator that cells draw from one by one, in grid order.
+	/// With positional seeds, each cell gets its own generator, seeded from the seed and the cell's position.
+	/// Otherwise one sequential stream runs through all cells that draw from it, see Parameters::positionalSeeds.
+	class CellRandom
+	{
+	public:
+		/// Start over
+		void Init(Int32 seed, Bool positional);
+		
+		/// Get the generator for a cell
+		Random &Get(Int32 columnIndex, Int32 rowIndex);
+		
+		/// Get the generator of the last cell again, to continue drawing from it
+		Random &GetCurrent()
+		{
+			return _rnd;
+		}
+		
+		/// Get the seed the generator of the last cell was initialized with
+		UInt32 GetSeed() const
+		{
+			return _cellSeed;
+		}
+		
+	private:
+		Random _rnd;
+		Int32 _seed;
+		UInt32 _cellSeed;
+		Bool _positional;
+		
+	public:
+		/// Default constructor
+		CellRandom() : _seed(0), _cellSeed(0), _positional(true)
+		{}
+	};
+	
+	/// Random generators of the layout. Sequential seeds draw holes and the choice between plates and cobblestones from two streams.
+	struct LayoutRandom
+	{
+		CellRandom holeRnd;
+		CellRandom choiceRnd;
+	};
+	
+	/// Steps through the cells of one element type in grid order, with the random generator of each cell.
+	/// The build stages, UpdateHierarchy() and ElementStream all visit cells with it, so they draw the same numbers.
+	class CellCursor
+	{
+	public:
+		/// Start before the first cell
+		/// @param[in] type The element type of the cells to visit
+		/// @param[in] seed Seed of the cells' random generator, see CellRandom
+		void Init(ELEMENTTYPE type, Int32 seed, Bool positional);
+		
+		/// Move to the next cell of the type. Needs the layout.
+		/// @return False if there are no more cells; otherwise true
+		Bool Next(const Sidewalk &builder);
+		
+		Int32 GetColumn() const
+		{
+			return _columnIndex;
+		}
+		
+		Int32 GetRow() const
+		{
+			return _rowIndex;
+		}
+		
+		/// Get the random generator of the current cell
+		Random &GetRandom()
+		{
+			return _rnd.GetCurrent();
+		}
+		
+		/// Get the seed the generator of the current cell was initialized with
+		UInt32 GetSeed() const
+		{
+			return _rnd.GetSeed();
+		}
+		
+	private:
+		CellRandom _rnd;
+		ELEMENTTYPE _type;
+		Int32 _cellIndex;    ///< Next cell to check, index is (columnIndex * countZ + rowIndex)
+		Int32 _columnIndex;
+		Int32 _rowIndex;
+		
+	public:
+		/// Default constructor
+		CellCursor() : _type(ELEMENTTYPE::HOLE), _cellIndex(0), _columnIndex(0), _rowIndex(0)
+		{}
+	};
+	
+	/// Steps through the curbstones of the row, drawing the length of each stone.
+	/// CreateCurbstoneRow() and ElementStream both lay out the row with it, so their stones are the same.
+	class CurbstoneCursor
+	{
+	public:
+		/// Start before the first stone
+		void Init(const Sidewalk &builder);
+		
+		/// Move to the next stone. The row ends after the curb count, or when the remaining space is too short for a stone.
+		/// @return False if there are no more stones; otherwise true
+		Bool Next(const Sidewalk &builder);
+		
+		Int32 GetIndex() const
+		{
+			return _stoneIndex;
+		}
+		
+		/// Get the nominal length of a curbstone, that all stones are stretched from
+		Float GetNominalLength() const
+		{
+			return _nominalLength;
+		}
+		
+		/// Get the length of the current stone, including variation
+		Float GetLength() const
+		{
+			return _stoneLength;
+		}
+		
+		/// Get the position of the current stone in the row, relative to GetCurbstoneGroupPosition()
+		Vector GetPosition() const
+		{
+			return _stonePos;
+		}
+		
+		/// Get the generator the current stone is crumpled from. It continues from stone to stone.
+		Random &GetCrumpleRandom()
+		{
+			return _crumpleRnd;
+		}
+		
+	private:
+		Random _sizeRnd;
+		Random _crumpleRnd;
+		Int32 _stoneCount;      ///< Number of stones stepped through so far
+		Int32 _stoneIndex;
+		Float _nominalLength;
+		Float _totalSpace;
+		Float _remainingSpace;
+		Float _stoneLength;
+		Vector _stonePos;
+		
+	public:
+		/// Default constructor
+		CurbstoneCursor() : _stoneCount(0), _stoneIndex(0), _nominalLength(0.0), _totalSpace(0.0), _remainingSpace(0.0), _stoneLength(0.0)
+		{}
+	};
+	
+	/// An element of the previous result that may be kept, and where it was taken from
+	struct KeptElement
+	{
+		BaseObject *element;  ///< The element; or nullptr if the cell had none
+		BaseObject *parent;   ///< Parent of the element before it was taken
+		BaseObject *pred;     ///< Predecessor of the element before it was taken; or nullptr if it was the first child
+		Matrix ml;            ///< Local matrix of the element before it was placed again
+		Bool taken;           ///< True if the element has been taken out of the previous result
+		
+		/// Default constructor
+		KeptElement() : element(nullptr), parent(nullptr), pred(nullptr), taken(false)
+		{}
+	};
+	
+	/// Results of the build stages, assembled into the hierarchy when all stages are done
+	struct StageResults
+	{
+		AutoFree<BaseObject> plateGroup;
+		AutoFree<PolygonObject> cobbleCube;      ///< Polygonized cube of the cobblestone prototype, see PolygonizePrototypes()
+		AutoFree<PolygonObject> curbCube;        ///< Polygonized cube of the curbstone prototype; or nullptr without curbstones
+		AutoFree<PolygonObject> cobblePrototype;
+		AutoFree<BaseObject> cobblestoneGroup;
+		AutoFree<BaseObject> dirtPlane;
+		AutoFree<BaseObject> curbstoneGroup;
+		
+		// Element groups of the previous result, and their elements by cell. Elements are taken out when they're kept.
+		AutoFree<BaseObject> previousPlateGroup;
+		AutoFree<BaseObject> previousCobblestoneGroup;
+		maxon::BaseArray<KeptElement> keptPlates;
+		maxon::BaseArray<KeptElement> keptCobblestones;
+	};
+	
+	/// Take the element groups out of the previous result and index their elements by cell, so the build stages can keep them
+	/// @return False if an error occurred; otherwise true
+	Bool TakeKeptElements(BaseObject *previousResult);
+	
+	/// Index the elements of an element group by cell, from their IDs
+	/// @param[out] kept Receives one entry per cell of the current grid, its element may be nullptr
+	/// @return False if an error occurred; otherwise true
+	Bool IndexKeptElements(BaseObject *group, maxon::BaseArray<KeptElement> &kept) const;
+	
+	/// Take the element of a cell out of the previous result. Where it was is remembered for PutBackKeptElements().
+	/// @return Pointer to the element; or nullptr if there is none. Caller owns the pointed object.
+	BaseObject *TakeKeptElement(maxon::BaseArray<KeptElement> &kept, Int32 columnIndex, Int32 rowIndex);
+	
+	/// Put all elements and element groups that have been taken back into the previous result, after the build has failed.
+	/// Taken elements must be in the new hierarchy or in the stage results, so they haven't been freed.
+	void PutBackKeptElements(BaseObject *previousResult);
+	
+	/// Polygonize the cubes of the stone prototypes. It runs before the build stages: MakeEditable() runs on one thread at a time, stages would only wait for each other.
+	/// @return False if an error occurred; otherwise true
+	Bool PolygonizePrototypes();
+	
+	// Build stages, run as tasks by BuildHierarchy(). Each one returns false if an error occurred.
+	
+	/// Decide the element type of each cell
+	Bool BuildLayout();
+	
+	/// Start the random generators of the layout, see GetCellType()
+	void InitLayoutRandom(LayoutRandom &layoutRnd) const;
+	
+	/// Decide the element type of a cell. With positional seeds, it only depends on the cell's own random values, not on the other cells or the grid size.
+	/// @param[in,out] layoutRnd Generators from InitLayoutRandom(). Cells must be visited in grid order.
+	ELEMENTTYPE GetCellType(Int32 columnIndex, Int32 rowIndex, LayoutRandom &layoutRnd) const;
+	
+	/// Create all plates in a group. Needs the layout.
+	Bool BuildPlates();
+	
+	/// Create the cobblestone prototype from its polygonized cube, if there are any cobblestones. Needs the layout.
+	Bool BuildCobblestonePrototype();
+	
+	/// Create all cobblestone groups in a group. Needs the cobblestone prototype.
+	Bool BuildCobblestones();
+	
+	/// Create the dirt plane, if enabled. Needs the layout.
+	Bool BuildDirtPlane();
+	
+	/// Create the row of curbstones, if enabled
+	Bool BuildCurbstones();
+	
+	/// Rewrite points and matrices of the last built sidewalk, see Update()
+	Bool UpdateHierarchy(BaseObject *cache);
+	
+	// Get all object and group names from the string resource and copy them to params
+	static void GetObjectNames(Parameters &params);
+	
+	/// Store the element's indices as its ID, 16 bits each, in a private entry of its container. Format the name only if the naming policy asks for full names.
+	/// GetParametersFromContainer() limits all counts, so indices are below 65536. IDs are only unique among their siblings.
+	void NameElement(BaseObject *op, ELEMENTKIND kind, Int32 firstIndex, Int32 secondIndex) const;
+	
+	/// Get the name of an element from its indices
+	static String FormatElementName(const Parameters &params, ELEMENTKIND kind, Int32 firstIndex, Int32 secondIndex);
+	
+	/// Name all children of parent from their IDs
+	static void ResolveElementNames(BaseObject *parent, ELEMENTKIND kind, const Parameters &params);
+	
+	/// Name the chunks of an element group and the elements inside them from their IDs. Without chunks, the elements are directly in the group.
+	static void ResolveChunkNames(BaseObject *group, ELEMENTKIND kind, const Parameters &params);
+	
+	/// Get the first element of an element group, inside its first chunk if there are chunks
+	/// @return Pointer to the element; or nullptr if the group is empty. The hierarchy owns the pointed object.
+	static BaseObject *GetFirstElement(const Parameters &params, BaseObject *group);
+	
+	/// Get the element that follows another one in its group, continuing in the next chunk if there are chunks
+	/// @return Pointer to the element; or nullptr if it was the last one. The hierarchy owns the pointed object.
+	static BaseObject *GetNextElement(const Parameters &params, BaseObject *element);
+	
+	/// Get the curbstone group of a hierarchy built with params
+	/// @return Pointer to the group; or nullptr if there is none. The hierarchy owns the pointed object.
+	static BaseObject *GetCurbstoneGroup(const Parameters &params, BaseObject *hierarchy);
+	
+	/// Get the collision proxy group of a hierarchy built with params
+	/// @return Pointer to the group; or nullptr if there is none. The hierarchy owns the pointed object.
+	static BaseObject *GetCollisionGroup(const Parameters &params, BaseObject *hierarchy);
+	
+	/// Get the number of cells that are actually generated along X (the whole sidewalk, or one tile)
+	Int32 GetGridCountX() const;
+	
+	/// Get the number of cells that are actually generated along Z (the whole sidewalk, or one tile)
+	Int32 GetGridCountZ() const;
+	
+	/// Get the number of tiles along X, 1 if not in tile mode
+	Int32 GetTileCountX() const;
+	
+	/// Get the number of tiles along Z, 1 if not in tile mode
+	Int32 GetTileCountZ() const;
+	
+	/// Get the total size of the paved area
+	Vector GetTotalSize() const;
+	
+	/// Get the number of chunks along X, 1 without chunks
+	Int32 GetChunkCountX() const;
+	
+	/// Get the number of chunks along Z, 1 without chunks
+	Int32 GetChunkCountZ() const;
+	
+	/// Get the index of the chunk a cell belongs to, 0 without chunks
+	Int32 GetChunkIndex(Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Get the matrix of a chunk. It sits at the center of its cells, so its elements stay close to its origin.
+	Matrix GetChunkMatrix(Int32 chunkX, Int32 chunkZ) const;
 	
-	// Get all object and group names from the string resource and copy them to _params
-	void GetObjectNames();
+	/// Get the chunk of a cell below an element group. It's created when it's needed for the first time.
+	/// @param[in,out] chunks The chunks of group, indexed by GetChunkIndex(). Must have one entry per chunk, nullptr for missing ones.
+	/// @return Pointer to the chunk, or group itself without chunks; or nullptr if an error occurred. The group owns the pointed object.
+	BaseObject *GetChunk(BaseObject *group, maxon::BaseArray<BaseObject*> &chunks, Int32 columnIndex, Int32 rowIndex);
+	
+	/// Size an array to one entry per chunk, all nullptr
+	/// @return False if an error occurred; otherwise true
+	Bool InitChunkArray(maxon::BaseArray<BaseObject*> &chunks) const;
+	
+	/// Move an element that has been placed in the space of its element group into a chunk
+	void InsertIntoChunk(BaseObject *element, BaseObject *chunk) const;
+	
+	/// Reorder the chunks of an element group along a Morton curve (Z-order), so chunks that are close in space are close in the hierarchy
+	/// @param[in] chunks The chunks of group, indexed by GetChunkIndex(), nullptr for missing ones
+	/// @return False if an error occurred; otherwise true
+	Bool SortChunks(BaseObject *group, const maxon::BaseArray<BaseObject*> &chunks) const;
+	
+	/// Get the first element of each chunk of an element group
+	/// @param[out] cursors Receives one element per chunk, indexed by GetChunkIndex(), nullptr for missing ones. Without chunks, the first element of group.
+	/// @return False if the chunks don't match the current parameters; otherwise true
+	Bool GetChunkCursors(BaseObject *group, maxon::BaseArray<BaseObject*> &cursors) const;
+	
+	/// Check if tiles get flipped or rotated. That's only possible without row shifting.
+	Bool IsTileVariationActive() const;
+	
+	/// Cover the area with instances of a tile
+	/// @param[in] tile The tile. It's moved into the first slot of the area.
+	/// @param[in] parent Object that receives the new instances
+	/// @return False if an error occurred; otherwise true
+	Bool CreateTileInstances(BaseObject *tile, BaseObject *parent);
+	
+	/// Get the position of the element in a cell, without any variation
+	Vector GetElementPosition(Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Classify all cells and dirt plane blocks relative to the footprint. Without footprint, the classes are removed.
+	/// @return False if an error occurred; otherwise true
+	Bool ClassifyFootprint();
+	
+	/// Get the class of a cell relative to the footprint, INSIDE if there is none
+	FOOTPRINTCELL GetCellClass(Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Get the class of a dirt plane block relative to the footprint, INSIDE if there is none
+	FOOTPRINTCELL GetDirtBlockClass(Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Limit the element type of a cell to what fits into the footprint.
+	/// Nothing is built outside. On the outline, only cobblestones are built, and only if at least one of them is inside.
+	ELEMENTTYPE ClipToFootprint(ELEMENTTYPE cellType, Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Check if the elements are placed on a straight, flat grid. Along a path or on a terrain, each element is placed on its own.
+	Bool IsStraight() const
+	{
+		return !_params.path.IsValid() && !_params.terrain.IsValid();
+	}
+	
+	/// Map a matrix from straight sidewalk coordinates onto the path, then onto the terrain. It's turned and tilted, but not bent.
+	/// Without path and terrain, it's returned unchanged.
+	Matrix MapToGround(const Matrix &matrix) const;
+	
+	/// Map a point from straight sidewalk coordinates onto the path, then onto the terrain. Without path and terrain, it's returned unchanged.
+	Vector MapToGround(const Vector &point) const;
 	
 	/// Create a single plate
+	/// @tparam USEPHONG Attach a phong tag
+	/// @tparam MATPERPLATE Attach a texture tag
 	/// @return Pointer to a new plate. Caller owns the pointed object.
-	BaseObject *CreateSinglePlate();
+	template <Bool USEPHONG, Bool MATPERPLATE> BaseObject *CreateSinglePlate();
+	
+	/// Set position and rotation of a plate, including random variation
+	void PlacePlate(BaseObject *plate, Int32 columnIndex, Int32 rowIndex, Random &rnd) const;
+	
+	/// Get the size of a single cobblestone, without gap
+	Vector GetCobblestoneSize() const;
+	
+	/// Polygonize the cube primitive of a cobblestone
+	/// @return Pointer to a new polygon cube; or nullptr if an error occurred. Caller owns the pointed object.
+	PolygonObject *PolygonizeCobblestone() const;
+	
+	/// Create the uncrumpled cobblestone that all cobblestones are derived from. Stores its points and normals.
+	/// @param[in] cube The polygonized cube from PolygonizeCobblestone(). The function takes ownership of it.
+	/// @return Pointer to a new polygon cobblestone. Caller owns the pointed object.
+	PolygonObject *CreateCobblestonePrototype(PolygonObject *cube);
 	
 	/// Create a group of cobblestones (same size as a plate)
+	/// @param[in] prototype The cobblestone prototype
 	/// @return Pointer to a new group of cobblestones. Caller owns the pointed object.
-	BaseObject *CreateCobblestones(Random &rnd);
+	BaseObject *CreateCobblestones(PolygonObject *prototype, Int32 cellColumn, Int32 cellRow, Random &rnd);
+	
+	/// Create all cobblestones of a group, using the crumpled points
+	/// @tparam USEPHONG Attach a phong tag to each stone
+	/// @tparam MATPERSTONE Attach a texture tag to each stone
+	/// @return False if an error occurred; otherwise true
+	template <Bool USEPHONG, Bool MATPERSTONE> Bool EmitCobblestones(BaseObject *group, PolygonObject *prototype, Int32 cellColumn, Int32 cellRow, Random &rnd);
+	
+	/// Rewrite points and matrices of an existing group of cobblestones
+	/// @return False if the group doesn't match the current parameters; otherwise true
+	Bool UpdateCobblestones(BaseObject *group, Int32 cellColumn, Int32 cellRow, Random &rnd) const;
+	
+	/// Write the crumpled points of a cobblestone, derived from the prototype
+	void CrumpleCobblestone(Vector *pointArr, Random &rnd) const;
+	
+	/// Get the position of a cobblestone inside its group, without any variation
+	Vector GetCobblestonePosition(Int32 columsIndex, Int32 rowIndex) const;
+	
+	/// Check if a cobblestone of a cell is completely inside the footprint. Without footprint, all of them are.
+	Bool IsCobblestoneInside(Int32 cellColumn, Int32 cellRow, Int32 columsIndex, Int32 rowIndex) const;
+	
+	/// Set the position of a group of cobblestones
+	void PlaceCobblestones(BaseObject *group, Int32 columnIndex, Int32 rowIndex) const;
 	
-	/// Create the dirt plane
+	/// Set position and rotation of a cobblestone inside its group, including random variation
+	void PlaceCobblestone(BaseObject *stone, Int32 columsIndex, Int32 rowIndex, Random &rnd) const;
+	
+	/// Move to the next cobblestone of a cell that is inside the footprint, in the order all stones of a cell are built and placed
+	/// @param[in,out] stoneIndex Index of the next stone to check, (stoneColumn * cobbleCount + stoneRow). Start with 0.
+	/// @param[out] columsIndex Receives the column of the stone inside its cell
+	/// @param[out] rowIndex Receives the row of the stone inside its cell
+	/// @return False if there are no more stones in the cell; otherwise true
+	Bool GetNextCobblestoneInside(Int32 cellColumn, Int32 cellRow, Int32 &stoneIndex, Int32 &columsIndex, Int32 &rowIndex) const;
+	
+	/// Check if the dirt plane is visible anywhere inside a block of the dirt plane
+	/// @param[in] columnIndex Column of the block (same as the element column)
+	/// @param[in] rowIndex Row of the block (element row without shift)
+	/// @return False if the block is completely covered by plates; otherwise true
+	Bool IsDirtBlockVisible(Int32 columnIndex, Int32 rowIndex) const;
+	
+	/// Get the number of lattice cells of the dirt plane along X. The subdivision is for the whole plane.
+	/// Along a path, on a terrain or cut to a footprint, there's at least one cell per block, so the plane can follow.
+	Int32 GetDirtCellCountX() const;
+	
+	/// Get the number of lattice cells of the dirt plane along Z, see GetDirtCellCountX()
+	Int32 GetDirtCellCountZ() const;
+	
+	/// Get the number of patches of the dirt plane along X. A patch is one block, or one cell if there are fewer cells than blocks.
+	Int32 GetDirtPatchCountX() const;
+	
+	/// Get the number of patches of the dirt plane along Z
+	Int32 GetDirtPatchCountZ() const;
+	
+	/// Get the lattice coordinates a patch spans along one axis
+	/// @param[in] patchIndex Index of the patch
+	/// @param[in] cellCount Number of lattice cells along the axis
+	/// @param[in] patchCount Number of patches along the axis
+	/// @param[out] first Receives the lattice coordinate of the patch's first border
+	/// @param[out] last Receives the lattice coordinate of the patch's last border
+	static void GetDirtPatchSpan(Int32 patchIndex, Int32 cellCount, Int32 patchCount, Int32 &first, Int32 &last);
+	
+	/// Get the blocks a span of lattice coordinates overlaps along one axis
+	/// @param[in] closed True to also get blocks that only touch the ends of the span, like the blocks around a single lattice point
+	/// @param[out] firstBlock Receives the first block
+	/// @param[out] lastBlock Receives the last block
+	static void GetDirtBlockSpan(Int32 first, Int32 last, Int32 cellCount, Int32 blockCount, Bool closed, Int32 &firstBlock, Int32 &lastBlock);
+	
+	/// Decide how a patch of the dirt plane is built
+	DIRTPATCH GetDirtPatchMode(Int32 patchX, Int32 patchZ) const;
+	
+	/// Check if a lattice cell of the dirt plane is completely outside of the footprint
+	Bool IsDirtCellOutside(Int32 x, Int32 z) const;
+	
+	/// Get the center of a patch of the dirt plane, the hub of its fan. It's covered, so it's not crumpled.
+	Vector GetDirtPatchCenter(Int32 patchX, Int32 patchZ) const;
+	
+	/// Get the polygons of a patch of the dirt plane. The plane and ElementStream both get their polygons from here.
+	/// Sides of coarse patches are subdivided like their full neighbours, so there are no T-junctions.
+	/// @param[in] centerIndex Point index that stands for the center of the patch in a fan
+	/// @param[out] polygonArr Receives the polygons. Their points are lattice indices (x * latticeCountZ + z) or centerIndex. Pass nullptr to only count them.
+	/// @param[out] usesCenter Receives true if the polygons use the center of the patch
+	/// @return Number of polygons, 0 if the patch is left out
+	Int32 GetDirtPatchPolygons(Int32 patchX, Int32 patchZ, Int32 centerIndex, CPolygon *polygonArr, Bool &usesCenter) const;
+	
+	/// Get a crumpled point of the dirt plane lattice. On the footprint's outline, points outside of it are moved onto it.
+	Vector GetDirtLatticePoint(Int32 x, Int32 z) const;
+	
+	/// Check if a point of the dirt plane lattice belongs to a block on the footprint's outline
+	Bool IsDirtLatticePointOnBoundary(Int32 x, Int32 z) const;
+	
+	/// Get the position of the dirt plane's center in straight sidewalk coordinates
+	Vector GetDirtPlanePosition() const;
+	
+	/// Create the dirt plane directly as a heightfield, with planar UVWs.
+	/// Only patches where the dirt is visible get the full subdivision, patches covered by plates are built coarse.
 	/// @return Pointer to a new dirt plane. Caller owns the pointed object.
-	BaseObject *CreateDirtPlane(Random &rnd);
+	BaseObject *CreateDirtPlane();
+	
+	/// Rewrite the points of an existing dirt plane
+	/// @return False if the plane doesn't match the current parameters; otherwise true
+	Bool UpdateDirtPlane(PolygonObject *plane) const;
+	
+	/// Get the size of a curbstone before its length is varied
+	Vector GetNominalCurbstoneSize() const;
 	
-	/// Create a curbstone
-	/// @param[in,out] stoneSize The size for this curbstone. Assigned the final actual size value (changed by variation).
+	/// Polygonize the cube primitive of a curbstone
+	/// @param[in] stoneSize The nominal size of a curbstone
+	/// @return Pointer to a new polygon cube; or nullptr if an error occurred. Caller owns the pointed object.
+	PolygonObject *PolygonizeCurbstone(const Vector &stoneSize) const;
+	
+	/// Create the canonical curbstone that all curbstones of a row are derived from. Stores its points and normals.
+	/// @param[in] cube The polygonized cube from PolygonizeCurbstone(). The function takes ownership of it.
+	/// @param[in] prototypeLength The nominal length of a curbstone
+	/// @return Pointer to a new, uncrumpled polygon curbstone. Caller owns the pointed object.
+	PolygonObject *CreateCurbstonePrototype(PolygonObject *cube, Float prototypeLength);
+	
+	/// Get half the length of the straight part of a curbstone, between its fillets
+	Float GetCurbstoneStraightLength(Float prototypeLength) const;
+	
+	/// Store which part of the curbstone prototype each point belongs to, see State::curbPointParts
+	/// @param[in] pointArr The exact, unquantized points of the prototype
+	/// @return False if an error occurred; otherwise true
+	Bool ClassifyCurbstonePoints(const Vector *pointArr, Int32 pointCount, Float prototypeLength);
+	
+	/// Stretch the points of a curbstone along Z. Vertices in the fillets are only moved, so the fillet radius stays exact.
+	/// Points are sorted into straight part and fillets by their part stored for the prototype, not by their position.
+	void StretchCurbstone(Vector *pointArr, Int32 pointCount, Float prototypeLength, Float stoneLength) const;
+	
+	/// Create a curbstone by stretching the prototype
+	/// @tparam CRUMPLE Crumple the stone
+	/// @tparam MATPERSTONE Attach a texture tag
+	/// @param[in] prototype The canonical curbstone
+	/// @param[in] prototypeLength The nominal length of a curbstone
+	/// @param[in] stoneLength The length of this curbstone, including variation, see CurbstoneCursor
 	/// @return Pointer to a new curbstone. Caller owns the pointed object.
-	BaseObject *CreateSingleCurbstone(Vector &stoneSize, Random &sizeRnd, Random &crumpleRnd);
+	template <Bool CRUMPLE, Bool MATPERSTONE> BaseObject *CreateSingleCurbstone(PolygonObject *prototype, Float prototypeLength, Float stoneLength, Random &crumpleRnd);
+	
+	/// Write the points of a curbstone, stretched and crumpled from the stored prototype points
+	/// @param[in] prototypeLength The nominal length of a curbstone
+	/// @param[in] stoneLength The actual length of this curbstone
+	void ShapeCurbstone(Vector *pointArr, Float prototypeLength, Float stoneLength, Random &crumpleRnd) const;
 	
-	/// Create a row of curbstones
+	/// Create a row of curbstones along the whole sidewalk
+	/// @param[in] cube The polygonized cube from PolygonizeCurbstone(). The function takes ownership of it.
 	/// @return Pointer to a new row of curbstones. Caller owns the pointed object.
-	BaseObject *CreateCurbstoneRow(Float totalSpace);
+	BaseObject *CreateCurbstoneRow(PolygonObject *cube);
+	
+	/// Get the position of the curbstone row in straight sidewalk coordinates
+	Vector GetCurbstoneGroupPosition() const;
+	
+	/// Rewrite the points of an existing row of curbstones
+	/// @return False if the row doesn't match the current parameters; otherwise true
+	Bool UpdateCurbstoneRow(BaseObject *group) const;
+	
+	/// Write the files that belong to a result, if the state allows it. A missing file doesn't invalidate the result.
+	void WriteFiles(BaseObject *result);
+	
+	/// Get the groups whose stones get tiles in the displacement atlas: one tile per group of cobblestones, as they share their crumple, and one per curbstone
+	/// @param[out] cobblestoneGroup The cobblestone group of the hierarchy
+	/// @param[out] curbstoneGroup The curbstone group of the hierarchy; or nullptr if there's none
+	/// @return The number of tiles; or -1 if the hierarchy doesn't match the parameters
+	Int32 GetBakeGroups(BaseObject *hierarchy, BaseObject *&cobblestoneGroup, BaseObject *&curbstoneGroup) const;
+	
+	/// Map the UVWs of all stones into their tiles of the displacement atlas
+	/// @return False if an error occurred; otherwise true
+	Bool MapDisplacementUVWs(BaseObject *hierarchy);
+	
+	/// Bake the crumple of all stones into the displacement atlas, with the seeds and the detail the stones would be crumpled with.
+	/// Nothing is written if the inputs are the same as the last time, and the file still exists.
+	/// @return False if an error occurred, or the file is being written by another sidewalk; otherwise true
+	Bool BakeDisplacement(BaseObject *hierarchy);
+	
+	/// Append the crumple offsets of one tile to the heights of the displacement atlas
+	/// @param[in] detail Subdivisions the stone would be crumpled with
+	/// @param[in] strength Crumple strength the stone would be crumpled with
+	/// @param[in] size Edge length of the stone's face
+	/// @param[in,out] rnd Random generator that the stone would be crumpled with
+	/// @return False if an error occurred; otherwise true
+	Bool AppendBakeTile(Float detail, Float strength, Float size, Random &rnd, maxon::BaseArray<BakeTile> &tiles, maxon::BaseArray<Float> &heights) const;
+	
+	/// Map all UVWs of a stone into a tile of the displacement atlas
+	static void MapStoneUVWs(BaseObject *stone, Int32 tileIndex, Int32 tileCount);
+	
+	/// Get the file the displacement atlas is saved to
+	/// @return The file; or an empty Filename if there's nowhere to save to
+	Filename GetBakeFile() const;
+	
+	/// Create one box per element of a hierarchy, oriented like the element, for dynamics.
+	/// Hidden proxies don't make dynamics any cheaper: they're a second collider next to the visible geometry, and dynamics tags on the generator see both.
+	/// They're kept with the result, e.g. for exporting it. To collide with the proxies alone, a second generator with SIDEWALK_COLLISION_ONLY outputs nothing else, see BuildHierarchy().
+	/// @return Pointer to a new group of cube primitives that is hidden in the renderer, and in the editor unless it's the only output; or nullptr if an error occurred. Caller owns the pointed object.
+	BaseObject *CreateCollisionProxies(BaseObject *hierarchy);
+	
+	/// Add boxes for op and its children to a proxy group
+	/// @param[in] matrix Matrix of op, relative to the proxy group
+	/// @return False if an error occurred; otherwise true
+	Bool AddCollisionProxies(BaseObject *op, const Matrix &matrix, BaseObject *proxyGroup, Int32 depth);
+	
+	/// Add one box per block of the dirt plane, oriented like the ground at the block's center. The boxes come from the lattice, not from the plane's points.
+	/// Along a path, on a terrain or cut to a footprint, one box around the whole plane would not fit it.
+	/// @param[in] matrix Matrix of the plane, relative to the proxy group
+	/// @return False if an error occurred; otherwise true
+	Bool AddDirtPlaneProxies(const Matrix &matrix, BaseObject *proxyGroup);
+	
+	/// Add a box to a proxy group. Flat boxes are thickened downwards.
+	/// @param[in] matrix Space the box corners are in, relative to the proxy group
+	/// @return False if an error occurred; otherwise true
+	Bool AddCollisionBox(const Matrix &matrix, const Vector &boxMin, const Vector &boxMax, BaseObject *proxyGroup);
+	
+	/// Weld and reorder the points and polygons of a prototype, if enabled, and add it to the vertex cache statistics
+	/// @return False if an error occurred; otherwise true
+	Bool OptimizePrototype(PolygonObject *prototype);
 	
 	/// Add a texture tag to op
 	/// @param[in] op Pointer to the object that should receive the new texture tag
 	/// @param[in] mat Pointer to the material that should be linked in the texture tag
 	/// @param[in] matScale Scale value for the projection in the texture tag
 	/// @return False if an error occurred and the tag could not be added; otherwise true
-	static Bool AddTextureTag(BaseObject *op, BaseMaterial *mat, Float matScale);
+	Bool AddTextureTag(BaseObject *op, BaseMaterial *mat, Float matScale);
 	
 	/// Add a phong tag to op
 	/// @return False if an error occurred and the tag could not be added; otherwise true
-	static Bool AddPhongTag(BaseObject *op, Bool angleLimit = true, Float angle = Rad(89.9));
+	Bool AddPhongTag(BaseObject *op, Bool angleLimit = true, Float angle = Rad(89.9));
 
 private:
-	Sidewalk::Parameters _params;
+	const Sidewalk::Parameters &_params;
+	Sidewalk::State &_state;
 	BaseDocument *_doc;
+	Emitters _emitters;
+	StageResults _stageResults;
+	GeSpinlock _statisticsLock;  ///< Protects the vertex cache statistics while stages run
+};
+
+
+/// Generates the elements of a sidewalk one at a time, when they're pulled, without building the object hierarchy.
+/// The cells are visited column by column, cobblestones one by one, then the dirt plane patch by patch and the curbstones.
+/// Only the current element is held, so memory doesn't grow with the size of the sidewalk, except for the layout.
+/// Elements have the same geometry and matrices as in the hierarchy that Build() returns for the same parameters, without tiles.
+class Sidewalk::ElementStream
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(ElementStream);
+
+public:
+	/// Take a parameter snapshot and prepare the first element
+	/// @param[in] params Parameter snapshot. Tiles are expanded, baking and collision proxies are ignored.
+	/// @return False if an error occurred; otherwise true
+	Bool Init(const Parameters &params);
+	
+	/// Generate the next element
+	/// @param[out] element Receives the element
+	/// @return False if there are no more elements or an error occurred, see HasFailed(); otherwise true
+	Bool GetNext(Element &element);
+	
+	/// Check if generating an element has failed. The stream ends early then.
+	Bool HasFailed() const
+	{
+		return _failed;
+	}
+
+private:
+	/// Part of the sidewalk the stream is in
+	enum class PHASE
+	{
+		PLATES,
+		COBBLESTONES,
+		DIRTPLANE,
+		CURBSTONES,
+		DONE
+	};
+	
+	/// Generate the next plate
+	/// @return False if there are no more plates or an error occurred; otherwise true
+	Bool GetNextPlate(Element &element);
+	
+	/// Generate the next cobblestone, moving on to the next cell of cobblestones when the current one has no more
+	/// @return False if there are no more cobblestones or an error occurred; otherwise true
+	Bool GetNextCobblestone(Element &element);
+	
+	/// Generate the next patch of the dirt plane
+	/// @return False if there are no more patches or an error occurred; otherwise true
+	Bool GetNextDirtPatch(Element &element);
+	
+	/// Generate the next curbstone
+	/// @return False if there are no more curbstones; otherwise true
+	Bool GetNextCurbstone(Element &element);
+	
+	/// Prepare the buffers of the dirt plane patches
+	/// @return False if an error occurred; otherwise true
+	Bool InitDirtPlane();
+	
+	/// Create the curbstone prototype and prepare the row, see CurbstoneCursor
+	/// @return False if an error occurred; otherwise true
+	Bool InitCurbstones();
+	
+	/// End the stream because of an error
+	Bool Fail()
+	{
+		_failed = true;
+		_phase = PHASE::DONE;
+		return false;
+	}
+
+private:
+	Sidewalk _builder;
+	ArenaScope _arenaScope;            ///< Releases the dirt plane and curbstone buffers
+	AutoAlloc<BaseObject> _placement;  ///< Receives the matrices from the builder's placing functions
+	PHASE _phase;
+	Bool _failed;
+	
+	// Cells
+	AutoFree<PolygonObject> _platePrototype;
+	AutoFree<PolygonObject> _cobblePrototype;
+	CellCursor _plateCursor;
+	CellCursor _cobbleCursor;        ///< Its generator continues from stone to stone within a cell
+	Bool _inCobbleCell;              ///< True if the cobble cursor is on a cell whose stones are being generated
+	Int32 _stoneIndex;               ///< Next cobblestone of the current cell, see GetNextCobblestoneInside()
+	Matrix _cobbleMatrix;            ///< Matrix of the current cell's cobblestone group
+	
+	// Dirt plane
+	Int32 _patchIndex;               ///< Next patch, index is (patchX * patchCountZ + patchZ)
+	Vector *_patchPointArr;
+	CPolygon *_patchPolygonArr;
+	Int32 *_patchPointIndices;       ///< Point of each lattice index of the current patch, or NOTOK; index is relative to the patch's first lattice point
+	Matrix _planeMatrix;
+	
+	// Curbstones
+	AutoFree<PolygonObject> _curbPrototype;
+	Vector *_curbPointArr;
+	CurbstoneCursor _curbCursor;
 
 public:
-	/// Default constructor
-	Sidewalk()
+	/// Construct a stream that generates with a state. Call Init() before pulling elements.
+	/// @param[in,out] state State of a generator. Its last result can't be updated afterwards.
+	ElementStream(State &state, BaseDocument *doc) : _builder(state.params, state, doc), _arenaScope(state.arena), _placement(Onull), _phase(PHASE::DONE), _failed(false), _inCobbleCell(false), _stoneIndex(0), _patchIndex(0), _patchPointArr(nullptr), _patchPolygonArr(nullptr), _patchPointIndices(nullptr), _curbPointArr(nullptr)
 	{}
+	
+	/// Destructor, frees whatever the pool still holds
+	~ElementStream()
+	{
+		_builder._state.pool.Flush();
+	}
 };
 
 
-/// Make a generator object editable
-/// @return The editable object. Caller owns the pointed object.
+/// Make a generator object editable. It may be called from any thread, calls are serialized across all builds.
+/// @return The editable object; or nullptr if an error occurred. Caller owns the pointed object.
 BaseObject *MakeEditable(BaseObject *op, BaseDocument *doc);
 
 /// Return the normal vector for a vertex of a polygon object
 /// Needs an initialized Neighbor class
 Vector GetVertexNormal(PolygonObject *op, Neighbor *neighbor, Int32 pointIndex);
 
+/// Compute the normal vectors of all vertices of a polygon object at once
+/// @param[in] op The polygon object
+/// @param[out] normals Receives one normalized vector per point
+/// @param[in] quantize Store the normals with 16 bits per coordinate
+/// @param[in] arena Receives the temporary normal vectors
+/// @return False if an error occurred; otherwise true
+Bool GetVertexNormals(const PolygonObject *op, PointBuffer &normals, Bool quantize, Arena &arena);
+
+/// Compute the normal vectors of all vertices of a polygon object into a buffer
+/// @param[in] op The polygon object
+/// @param[out] normalArr Receives one normalized vector per point, must have room for all points
+void ComputeVertexNormals(const PolygonObject *op, Vector *normalArr);
+
 /// Crumple a geometry, using the vertex normals as displacement direction
-void CrumpleGeometry(PolygonObject *op, Float strength, Random &rnd);
+/// @param[in] arena Receives the temporary normals
+void CrumpleGeometry(PolygonObject *op, Float strength, Random &rnd, Arena &arena);
+
+/// Crumple points along precomputed normals
+void CrumplePoints(Vector *pointArr, const Vector *normalArr, Int32 pointCount, Float strength, Random &rnd);
+
+/// Crumple points along cached normals, one per point
+void CrumplePoints(Vector *pointArr, const PointBuffer &normals, Float strength, Random &rnd);
 
 /// Returns 0°, 90°, 180° or 270° in radians
 Float GetHardRndAngle(Random &rnd, RANDOMANGLE mode);
 
+/// Returns a random value between -1.0 and 1.0 that only depends on the seed and a 2D integer position
+Float GetPositionalRnd11(Int32 seed, Int32 x, Int32 z);
+
+/// Returns a seed for a random generator that only depends on the seed and a 2D integer position, e.g. a cell of the grid
+UInt32 GetPositionalSeed(Int32 seed, Int32 x, Int32 z);
+
 
 #endif //SIDEWALK_H__
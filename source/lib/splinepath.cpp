@@ -0,0 +1,154 @@
+#include "splinepath.h"
+
+
+// The spline is first sampled this much finer than the table, to measure its length
+static const Int32 MEASURE_OVERSAMPLING = 8;
+
+// The table never gets larger than this, longer splines get a larger step
+static const Int32 MAX_SAMPLES = 16384;
+
+// Number of samples for the first estimate of the length
+static const Int32 ESTIMATE_SAMPLES = 64;
+
+
+Bool SplinePath::Init(const SplineObject *spline, const Matrix &matrix, Float step)
+{
+	Flush();
+
+	if (!spline || spline->GetPointCount() < 2 || step <= 0.0)
+		return false;
+
+	SplineObject *splineData = const_cast<SplineObject*>(spline);
+
+	// Rough length, to decide how finely the spline has to be measured
+	Float estimatedLength = 0.0;
+	Vector previousPoint = matrix * splineData->GetSplinePoint(0.0, 0);
+	for (Int32 i = 1; i <= ESTIMATE_SAMPLES; ++i)
+	{
+		Vector point = matrix * splineData->GetSplinePoint((Float)i / (Float)ESTIMATE_SAMPLES, 0);
+		estimatedLength += (point - previousPoint).GetLength();
+		previousPoint = point;
+	}
+
+	if (estimatedLength <= 0.0)
+		return false;
+
+	step = Max(step, estimatedLength / (Float)(MAX_SAMPLES - 1));
+	Int32 measureCount = ClampValue(SAFEINT32(Ceil(estimatedLength / step)) * MEASURE_OVERSAMPLING, ESTIMATE_SAMPLES, MAX_SAMPLES * MEASURE_OVERSAMPLING);
+
+	// Measure the arc length at the spline parameter of each measuring point
+	maxon::BaseArray<Vector> measurePoints;
+	maxon::BaseArray<Float> measureLengths;
+	if (!measurePoints.Resize(measureCount + 1) || !measureLengths.Resize(measureCount + 1))
+		return false;
+
+	measurePoints[0] = matrix * splineData->GetSplinePoint(0.0, 0);
+	measureLengths[0] = 0.0;
+	for (Int32 i = 1; i <= measureCount; ++i)
+	{
+		measurePoints[i] = matrix * splineData->GetSplinePoint((Float)i / (Float)measureCount, 0);
+		measureLengths[i] = measureLengths[i - 1] + (measurePoints[i] - measurePoints[i - 1]).GetLength();
+	}
+
+	_length = measureLengths[measureCount];
+	if (_length <= 0.0)
+		return false;
+
+	// Samples at equal distances, the last one exactly at the end
+	Int32 sampleCount = ClampValue(SAFEINT32(Ceil(_length / step)) + 1, (Int32)2, MAX_SAMPLES);
+	_step = _length / (Float)(sampleCount - 1);
+	if (!_frames.Resize(sampleCount))
+	{
+		Flush();
+		return false;
+	}
+
+	// Walk both tables at once, the measured lengths are sorted
+	Int32 measureIndex = 0;
+	for (Int32 sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex)
+	{
+		Float distance = Min(_step * sampleIndex, _length);
+		while (measureIndex < measureCount - 1 && measureLengths[measureIndex + 1] < distance)
+			++measureIndex;
+
+		Float segmentLength = measureLengths[measureIndex + 1] - measureLengths[measureIndex];
+		Float blend = (segmentLength > 0.0) ? (distance - measureLengths[measureIndex]) / segmentLength : 0.0;
+		_frames[sampleIndex].off = measurePoints[measureIndex] + (measurePoints[measureIndex + 1] - measurePoints[measureIndex]) * blend;
+	}
+
+	// Frames from the tangents, with Y as up vector. Where the path goes straight up, the previous side direction is kept.
+	Vector side(1.0, 0.0, 0.0);
+	for (Int32 sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex)
+	{
+		Int32 before = Max(sampleIndex - 1, (Int32)0);
+		Int32 after = Min(sampleIndex + 1, sampleCount - 1);
+		Vector tangent = (_frames[after].off - _frames[before].off).GetNormalized();
+
+		Vector newSide = Cross(Vector(0.0, 1.0, 0.0), tangent);
+		if (newSide.GetLength() > 0.001)
+			side = newSide.GetNormalized();
+
+		Matrix &frame = _frames[sampleIndex];
+		frame.v3 = tangent;
+		frame.v2 = Cross(tangent, side).GetNormalized();
+		frame.v1 = Cross(frame.v2, tangent);
+	}
+
+	return true;
+}
+
+
+Matrix SplinePath::GetFrame(Float distance) const
+{
+	if (!IsValid())
+		return MatrixMove(Vector(0.0, 0.0, distance));
+
+	// Neighbouring samples. Beyond the ends, the first or last two samples are extrapolated.
+	Int32 lastIndex = (Int32)_frames.GetCount() - 1;
+	Float position = distance / _step;
+	Int32 index = ClampValue((Int32)Floor(position), (Int32)0, lastIndex - 1);
+	Float blend = position - (Float)index;
+
+	const Matrix &frameA = _frames[index];
+	const Matrix &frameB = _frames[index + 1];
+
+	// Beyond the ends, the path continues along the end tangent
+	Matrix frame;
+	if (blend < 0.0 || blend > 1.0)
+	{
+		const Matrix &endFrame = (blend < 0.0) ? frameA : frameB;
+		frame = endFrame;
+		frame.off = endFrame.off + endFrame.v3 * (distance - _step * ((blend < 0.0) ? index : index + 1));
+		return frame;
+	}
+
+	frame.off = frameA.off + (frameB.off - frameA.off) * blend;
+	frame.v3 = (frameA.v3 + (frameB.v3 - frameA.v3) * blend).GetNormalized();
+	frame.v1 = frameA.v1 + (frameB.v1 - frameA.v1) * blend;
+	frame.v1 = (frame.v1 - frame.v3 * Dot(frame.v1, frame.v3)).GetNormalized();
+	frame.v2 = Cross(frame.v3, frame.v1);
+	return frame;
+}
+
+
+Bool SplinePath::IsEqual(const SplinePath &other) const
+{
+	if (_frames.GetCount() != other._frames.GetCount() || _length != other._length)
+		return false;
+
+	for (Int i = 0; i < _frames.GetCount(); ++i)
+	{
+		if (_frames[i] != other._frames[i])
+			return false;
+	}
+
+	return true;
+}
+
+
+void SplinePath::Flush()
+{
+	_frames.Flush();
+	_step = 0.0;
+	_length = 0.0;
+}
@@ -0,0 +1,101 @@
+#ifndef SPLINEPATH_H__
+#define SPLINEPATH_H__
+
+#include "c4d.h"
+
+
+/// Arc length lookup table of a spline.
+/// The spline is sampled once at equal distances along its length, each sample stores a position and a frame.
+/// Looking up the frame at any distance only interpolates two neighbouring samples, it's O(1).
+/// Straight coordinates are mapped onto the path with Z as the distance along the path, X to the side and Y up.
+class SplinePath
+{
+public:
+	/// Sample the first segment of a spline
+	/// @param[in] spline The spline, e.g. from GetRealSpline()
+	/// @param[in] matrix Transforms the spline's points into the space the path is used in. Y of that space is up.
+	/// @param[in] step Distance between two samples. It's increased if the table would get too large.
+	/// @return False if the spline is too short or an error occurred; otherwise true
+	Bool Init(const SplineObject *spline, const Matrix &matrix, Float step);
+
+	/// Check if the path has been sampled
+	Bool IsValid() const
+	{
+		return _frames.GetCount() >= 2;
+	}
+
+	/// Get the length of the path
+	Float GetLength() const
+	{
+		return _length;
+	}
+
+	/// Get the frame at a distance along the path. Beyond its ends, the path continues straight.
+	/// @return Matrix with the position as offset, the side as v1, up as v2 and the tangent as v3
+	Matrix GetFrame(Float distance) const;
+
+	/// Map a matrix from straight coordinates onto the path. The result is rotated with the frame at its position, but not bent.
+	Matrix Follow(const Matrix &matrix) const
+	{
+		Matrix local = matrix;
+		local.off.z = 0.0;
+		return GetFrame(matrix.off.z) * local;
+	}
+
+	/// Map a point from straight coordinates onto the path
+	Vector Follow(const Vector &point) const
+	{
+		return GetFrame(point.z) * Vector(point.x, point.y, 0.0);
+	}
+
+	/// Check if two paths have the same samples
+	Bool IsEqual(const SplinePath &other) const;
+
+	/// Get the number of samples
+	Int GetSampleCount() const
+	{
+		return _frames.GetCount();
+	}
+
+	/// Get the samples, for hashing
+	const Matrix *GetSamples() const
+	{
+		return _frames.GetFirst();
+	}
+
+	/// Remove all samples
+	void Flush();
+
+private:
+	maxon::BaseArray<Matrix> _frames;  ///< One frame per sample, at equal distances
+	Float _step;                       ///< Distance between two samples
+	Float _length;
+
+public:
+	/// Default constructor
+	SplinePath() : _step(0.0), _length(0.0)
+	{}
+
+	/// Copy constructor. If there's not enough memory for the samples, the copy is invalid.
+	SplinePath(const SplinePath &src) : _step(0.0), _length(0.0)
+	{
+		*this = src;
+	}
+
+	/// Copy assignment. If there's not enough memory for the samples, the copy is invalid.
+	SplinePath &operator =(const SplinePath &src)
+	{
+		if (this == &src)
+			return *this;
+
+		_step = src._step;
+		_length = src._length;
+		if (!_frames.CopyFrom(src._frames))
+			Flush();
+
+		return *this;
+	}
+};
+
+
+#endif // SPLINEPATH_H__
@@ -0,0 +1,209 @@
+#ifndef TASKGRAPH_H__
+#define TASKGRAPH_H__
+
+#include "c4d.h"
+
+
+/// Runs member functions of an owner object as tasks on several threads.
+/// Each task starts as soon as all tasks it depends on are done, independent tasks run concurrently.
+/// @tparam OWNER Class the task functions are members of
+template <typename OWNER> class TaskGraph
+{
+	MAXON_DISALLOW_COPY_AND_ASSIGN(TaskGraph);
+
+public:
+	/// A task. It returns false if it failed.
+	typedef Bool (OWNER::*TaskFunction)();
+
+	/// Maximum number of tasks in a graph
+	static const Int32 MAX_TASKS = 32;
+
+	/// Add a task
+	/// @return Index of the new task; or NOTOK if the graph is full
+	Int32 AddTask(TaskFunction function)
+	{
+		if (!function || _taskCount >= MAX_TASKS)
+			return NOTOK;
+
+		_tasks[_taskCount].function = function;
+		_tasks[_taskCount].dependencyMask = 0;
+		return _taskCount++;
+	}
+
+	/// Make a task wait for another one. A task can only depend on tasks that were added before it, so there are no cycles.
+	/// @return False if one of the indices is invalid; otherwise true
+	Bool AddDependency(Int32 task, Int32 dependency)
+	{
+		if (task < 0 || task >= _taskCount || dependency < 0 || dependency >= task)
+			return false;
+
+		_tasks[task].dependencyMask |= (UInt32)1 << dependency;
+		return true;
+	}
+
+	/// Run all tasks. The calling thread works on them, too.
+	/// Returns when all tasks are done, or when one of them has failed and the ones that already started have finished.
+	/// @param[in] threadCount Maximum number of threads, including the calling one
+	/// @return False if a task failed; otherwise true
+	Bool Run(Int32 threadCount)
+	{
+		if (_taskCount == 0)
+			return true;
+
+		_startedMask = 0;
+		_doneMask = 0;
+		_failed = false;
+
+		// More threads than tasks would have nothing to do
+		Int32 workerCount = ClampValue(threadCount, (Int32)1, _taskCount) - 1;
+		_threadCount = workerCount + 1;
+
+		// Each thread sleeps on its own signal while it has nothing to do. The calling thread is index 0.
+		for (Int32 i = 0; i < _threadCount; ++i)
+		{
+			if (i >= _signalCount)
+			{
+				if (!_signals[i] || !_signals[i]->Init())
+					return false;
+				_signalCount = i + 1;
+			}
+			_waiting[i] = false;
+		}
+
+		Bool started[MAX_TASKS];
+		for (Int32 i = 0; i < workerCount; ++i)
+		{
+			_workers[i].graph = this;
+			_workers[i].threadIndex = i + 1;
+			started[i] = _workers[i].Start(THREADMODE_ASYNC, THREADPRIORITY_NORMAL);
+		}
+
+		Work(0);
+
+		for (Int32 i = 0; i < workerCount; ++i)
+		{
+			if (started[i])
+				_workers[i].Wait(false);
+		}
+
+		return !_failed && _doneMask == GetAllMask();
+	}
+
+private:
+	/// Take tasks that are ready and run them, until there are none left to start
+	/// @param[in] threadIndex Index of the calling thread's signal
+	void Work(Int32 threadIndex)
+	{
+		for (;;)
+		{
+			_lock.Lock();
+
+			if (_failed || _startedMask == GetAllMask())
+			{
+				_lock.Unlock();
+				return;
+			}
+
+			Int32 taskIndex = NOTOK;
+			for (Int32 i = 0; i < _taskCount; ++i)
+			{
+				UInt32 taskBit = (UInt32)1 << i;
+				if (!(_startedMask & taskBit) && (_tasks[i].dependencyMask & ~_doneMask) == 0)
+				{
+					taskIndex = i;
+					_startedMask |= taskBit;
+					break;
+				}
+			}
+
+			// All remaining tasks wait for running ones. Sleep until one of them is done.
+			// The signal is cleared while locked, so a task that's done right after unlocking still wakes this thread.
+			if (taskIndex == NOTOK)
+			{
+				_waiting[threadIndex] = true;
+				_signals[threadIndex]->Clear();
+				_lock.Unlock();
+				_signals[threadIndex]->Wait(-1);
+				continue;
+			}
+
+			_lock.Unlock();
+
+			Bool success = (_owner->*_tasks[taskIndex].function)();
+
+			_lock.Lock();
+			if (success)
+				_doneMask |= (UInt32)1 << taskIndex;
+			else
+				_failed = true;
+
+			// Tasks that depend on this one may be ready now. After a failure, the sleeping threads leave.
+			for (Int32 i = 0; i < _threadCount; ++i)
+			{
+				if (_waiting[i])
+				{
+					_waiting[i] = false;
+					_signals[i]->Set();
+				}
+			}
+			_lock.Unlock();
+		}
+	}
+
+	/// Get a mask with the bits of all tasks set
+	UInt32 GetAllMask() const
+	{
+		return (_taskCount >= MAX_TASKS) ? ~(UInt32)0 : (((UInt32)1 << _taskCount) - 1);
+	}
+
+	/// A task and the tasks it waits for
+	struct Task
+	{
+		TaskFunction function;
+		UInt32 dependencyMask;
+	};
+
+	/// Additional thread that works on the tasks
+	class Worker : public C4DThread
+	{
+	public:
+		TaskGraph *graph;
+		Int32 threadIndex;
+
+		Worker() : graph(nullptr), threadIndex(0)
+		{}
+
+		virtual void Main()
+		{
+			graph->Work(threadIndex);
+		}
+
+		virtual const Char *GetThreadName()
+		{
+			return "SidewalkTask";
+		}
+	};
+
+private:
+	OWNER *_owner;
+	Task _tasks[MAX_TASKS];
+	Int32 _taskCount;
+	Worker _workers[MAX_TASKS];
+	UInt32 _startedMask;
+	UInt32 _doneMask;
+	Bool _failed;
+	GeSpinlock _lock;                          ///< Protects the masks, the failure flag and the waiting flags
+	AutoAlloc<GeSignal> _signals[MAX_TASKS];   ///< One per thread, set when a task is done while the thread sleeps
+	Bool _waiting[MAX_TASKS];                  ///< True while a thread sleeps on its signal
+	Int32 _signalCount;                        ///< Number of signals that have been initialized
+	Int32 _threadCount;                        ///< Number of threads of the current run, including the calling one
+
+public:
+	/// Construct an empty graph
+	/// @param[in] owner The object the task functions are called on
+	explicit TaskGraph(OWNER *owner) : _owner(owner), _taskCount(0), _startedMask(0), _doneMask(0), _failed(false), _signalCount(0), _threadCount(0)
+	{}
+};
+
+
+#endif // TASKGRAPH_H__
@@ -4,7 +4,7 @@
 
 
 // Some string defines
-#define PLUGIN_VERSION String("Sidewalk 1.0.6")
+#define PLUGIN_VERSION String("Sidewalk 1.1.0")
 
 
 Bool PluginStart()
@@ -29,6 +29,9 @@ Bool PluginMessage(Int32 id, void *data)
 	{
 		case C4DPL_INIT_SYS:
 			return resource.Init();	// Don't start plugin without resource
+
+		case C4DPL_COMMANDLINEARGS:
+			return RunSidewalkBatch(static_cast<C4DPL_CommandLineArgs*>(data));
 	}
 
 	return false;
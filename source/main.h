@@ -6,5 +6,11 @@
 
 Bool RegisterSidewalkObject();
 
+/// Generate the variants of a sweep file if "-sidewalk-batch <sweepfile>" is on the command line.
+/// Optional arguments are "-sidewalk-output <directory>", "-sidewalk-threads <count>" and "-sidewalk-format ply".
+/// "-sidewalk-stress <copies>" builds each variant once alone and that many times concurrently instead, and reports copies whose points differ.
+/// @return True if the command line was handled
+Bool RunSidewalkBatch(C4DPL_CommandLineArgs *args);
+
 
 #endif // MAIN_H__
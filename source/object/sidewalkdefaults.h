@@ -11,6 +11,7 @@ const Float DEF_SIDEWALK_COUNT_Z = 20;
 const Float DEF_SIDEWALK_SHIFT = 15.0;
 const Float DEF_SIDEWALK_ELEMENT_SELBIAS = -0.5;
 const Int32 DEF_SIDEWALK_ELEMENT_SEED = 7979;
+const Int32 DEF_SIDEWALK_LAYOUT_VERSION = 1; // SIDEWALK_LAYOUT_VERSION_POSITIONAL, scenes saved before have none
 
 // Plates
 const Float DEF_SIDEWALK_PLATES_SPACE = 0.75;
@@ -57,6 +58,27 @@ const Float DEF_SIDEWALK_CURB_FILLET_RAD = 1.5;
 const Int32 DEF_SIDEWALK_CURB_FILLET_SUBD = 2;
 const Float DEF_SIDEWALK_CURB_MAT_SCALE = 1.0;
 
+// Tiles
+const Bool DEF_SIDEWALK_TILE_ENABLE = false;
+const Int32 DEF_SIDEWALK_TILE_SIZE = 8;
+const Int32 DEF_SIDEWALK_TILE_VARIATION = 0; // SIDEWALK_TILE_VARIATION_NONE
+const Int32 DEF_SIDEWALK_TILE_SEED = 1234;
+
+// Displacement Bake
+const Bool DEF_SIDEWALK_BAKE_ENABLE = false;
+const Int32 DEF_SIDEWALK_BAKE_RESOLUTION = 64;
+
+// Performance
+const Int32 DEF_SIDEWALK_NAMING = 0; // SIDEWALK_NAMING_FULL
+const Bool DEF_SIDEWALK_QUANTIZE = false;
+const Bool DEF_SIDEWALK_OPTIMIZE = true;
+const Int32 DEF_SIDEWALK_COLLISION = 0; // SIDEWALK_COLLISION_OFF
+const Int32 DEF_SIDEWALK_CACHE_SIZE = 0;
+const Bool DEF_SIDEWALK_CACHE_PREFETCH = true;
+const Bool DEF_SIDEWALK_CHUNK_ENABLE = false;
+const Int32 DEF_SIDEWALK_CHUNK_SIZE_X = 8;
+const Int32 DEF_SIDEWALK_CHUNK_SIZE_Z = 8;
+
 
 
 #endif // SIDEWALKDEFAULTS_H__
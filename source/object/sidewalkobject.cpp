@@ -7,6 +7,85 @@
 #include "osidewalk.h"
 
 
+// Number of frames before and after the current one that are prefetched
+static const Int32 PREFETCH_FRAMES = 2;
+
+
+/// Clamp a count to the range of a LONG parameter
+static Int32 ClampToInt32(Int value)
+{
+	return (Int32)ClampValue(value, (Int)0, (Int)LIMIT<Int32>::MAX);
+}
+
+
+/// True if the generator builds for a render, in the editor, the Picture Viewer or Team Render
+static Bool IsRendering(HierarchyHelp *hh)
+{
+	return (hh->GetBuildFlags() & (BUILDFLAGS_INTERNALRENDERER | BUILDFLAGS_EXTERNALRENDERER)) != BUILDFLAGS_0;
+}
+
+
+/// True if the generator builds for a conversion like Current State to Object or Make Editable.
+/// Conversions build a copy of the object in a document of their own. Renders use copies, too, but they're flagged.
+static Bool IsConversion(BaseDocument *doc, HierarchyHelp *hh)
+{
+	return doc != GetActiveDocument() && !IsRendering(hh);
+}
+
+
+/// True if other frames only differ in the animated parameters of the object, so the prefetcher may build them.
+/// Linked objects are sampled where they are at the current time, and linked materials must not be used by another thread.
+static Bool IsPrefetchable(const BaseContainer &bc, BaseDocument *doc)
+{
+	if (bc.GetObjectLink(SIDEWALK_SPLINE, doc) || bc.GetObjectLink(SIDEWALK_FOOTPRINT, doc) || bc.GetObjectLink(SIDEWALK_TERRAIN, doc))
+		return false;
+	
+	return !bc.GetMaterialLink(SIDEWALK_PLATES_MAT_LINK, doc) && !bc.GetMaterialLink(SIDEWALK_COBBLE_MAT_LINK, doc) &&
+	       !bc.GetMaterialLink(SIDEWALK_DIRT_MAT_LINK, doc) && !bc.GetMaterialLink(SIDEWALK_CURB_MAT_LINK, doc);
+}
+
+
+/// Write the values of all animated parameters at a certain time into a container
+/// @param[in,out] data A copy of the object's container
+static void EvaluateTracks(BaseObject *op, BaseDocument *doc, const BaseTime &time, BaseContainer &data)
+{
+	for (CTrack *track = op->GetFirstCTrack(); track; track = track->GetNext())
+	{
+		const DescID &trackId = track->GetDescriptionID();
+		Int32 id = trackId[0].id;
+		Float value = track->GetValue(doc, time, doc->GetFps());
+		
+		switch (data.GetType(id))
+		{
+			case DA_LONG:
+				data.SetInt32(id, SAFEINT32(Round(value)));
+				break;
+			
+			case DA_REAL:
+				data.SetFloat(id, value);
+				break;
+			
+			case DA_VECTOR:
+			{
+				// Vectors are animated per component
+				if (trackId.GetDepth() < 2)
+					break;
+				
+				Vector vectorValue = data.GetVector(id);
+				switch (trackId[1].id)
+				{
+					case VECTOR_X:  vectorValue.x = value;  break;
+					case VECTOR_Y:  vectorValue.y = value;  break;
+					case VECTOR_Z:  vectorValue.z = value;  break;
+				}
+				data.SetVector(id, vectorValue);
+				break;
+			}
+		}
+	}
+}
+
+
 Bool SidewalkObject::Init(GeListNode *node)
 {
 	if (!node)
@@ -25,6 +104,7 @@ Bool SidewalkObject::Init(GeListNode *node)
 	data->SetFloat(SIDEWALK_SHIFT, DEF_SIDEWALK_SHIFT);
 	data->SetFloat(SIDEWALK_ELEMENT_SELBIAS, DEF_SIDEWALK_ELEMENT_SELBIAS);
 	data->SetInt32(SIDEWALK_ELEMENT_SEED, DEF_SIDEWALK_ELEMENT_SEED);
+	data->SetInt32(SIDEWALK_LAYOUT_VERSION, DEF_SIDEWALK_LAYOUT_VERSION);
 	
 	// Plates
 	data->SetFloat(SIDEWALK_PLATES_SPACE, DEF_SIDEWALK_PLATES_SPACE);
@@ -71,20 +151,46 @@ Bool SidewalkObject::Init(GeListNode *node)
 	data->SetInt32(SIDEWALK_CURB_FILLET_SUBD, DEF_SIDEWALK_CURB_FILLET_SUBD);
 	data->SetFloat(SIDEWALK_CURB_MAT_SCALE, DEF_SIDEWALK_CURB_MAT_SCALE);
 	
+	// Tiles
+	data->SetBool(SIDEWALK_TILE_ENABLE, DEF_SIDEWALK_TILE_ENABLE);
+	data->SetInt32(SIDEWALK_TILE_SIZE, DEF_SIDEWALK_TILE_SIZE);
+	data->SetInt32(SIDEWALK_TILE_VARIATION, DEF_SIDEWALK_TILE_VARIATION);
+	data->SetInt32(SIDEWALK_TILE_SEED, DEF_SIDEWALK_TILE_SEED);
+	
+	// Displacement Bake
+	data->SetBool(SIDEWALK_BAKE_ENABLE, DEF_SIDEWALK_BAKE_ENABLE);
+	data->SetInt32(SIDEWALK_BAKE_RESOLUTION, DEF_SIDEWALK_BAKE_RESOLUTION);
+	
+	// Performance
+	data->SetInt32(SIDEWALK_NAMING, DEF_SIDEWALK_NAMING);
+	data->SetBool(SIDEWALK_QUANTIZE, DEF_SIDEWALK_QUANTIZE);
+	data->SetBool(SIDEWALK_OPTIMIZE, DEF_SIDEWALK_OPTIMIZE);
+	data->SetInt32(SIDEWALK_COLLISION, DEF_SIDEWALK_COLLISION);
+	data->SetInt32(SIDEWALK_CACHE_SIZE, DEF_SIDEWALK_CACHE_SIZE);
+	data->SetBool(SIDEWALK_CACHE_PREFETCH, DEF_SIDEWALK_CACHE_PREFETCH);
+	data->SetBool(SIDEWALK_CHUNK_ENABLE, DEF_SIDEWALK_CHUNK_ENABLE);
+	data->SetInt32(SIDEWALK_CHUNK_SIZE_X, DEF_SIDEWALK_CHUNK_SIZE_X);
+	data->SetInt32(SIDEWALK_CHUNK_SIZE_Z, DEF_SIDEWALK_CHUNK_SIZE_Z);
+	
 	return SUPER::Init(node);
 }
 
 
+void SidewalkObject::Free(GeListNode *node)
+{
+	// The prefetcher writes into the cache
+	_prefetcher.End(true);
+	_buildCache.Flush();
+	
+	SUPER::Free(node);
+}
+
+
 BaseObject *SidewalkObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 {
 	if (!op || !hh)
 		return nullptr;
 	
-	// Caching
-	Bool dirty = op->CheckCache(hh) || op->IsDirty(DIRTYFLAGS_DATA);
-	if (!dirty)
-		return op->GetCache(hh);
-
 	// Get object container
 	BaseContainer *bc = op->GetDataInstance();
 	if (!bc)
@@ -95,9 +201,328 @@ BaseObject *SidewalkObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 	if (!doc)
 		return nullptr;
 
-	// Create & return sidewalk
-	Sidewalk sidewalk;
-	return sidewalk.Build(bc, doc);
+	// Caching. A linked spline or terrain changes the result without changing the object.
+	UInt32 linkDirty = GetLinkDirty(op, *bc, doc);
+	Bool dirty = op->CheckCache(hh) || op->IsDirty(DIRTYFLAGS_DATA) || linkDirty != _linkDirty;
+	if (!dirty)
+		return op->GetCache(hh);
+	
+	_linkDirty = linkDirty;
+
+	// Take a snapshot of the parameters
+	Sidewalk::Parameters params;
+	Sidewalk::GetParametersFromContainer(*bc, *doc, params, op->GetMg());
+
+	// Files like the displacement atlas are only written for the document the user works in.
+	// Renders, conversions and other copies of the document use the files written before.
+	_state.writeFiles = doc == GetActiveDocument() && !IsRendering(hh);
+
+	// Results built before, e.g. for another frame, are taken from the build cache
+	_buildCache.SetMemoryLimit((Int)Max(bc->GetInt32(SIDEWALK_CACHE_SIZE), (Int32)0) * 1024 * 1024);
+	UInt64 hash = params.GetHash();
+	BaseObject *result = _buildCache.Get(hash, doc);
+	BaseObject *cache = op->GetCache(hh);
+	if (result)
+	{
+		Sidewalk::Adopt(params, _state, doc, result);
+	}
+	else if (cache && Sidewalk::Update(params, _state, doc, cache))
+	{
+		// If only crumple or random variation changed, the existing cache is rewritten in place.
+		// Updates are cheaper than copying the result into the build cache.
+		result = cache;
+	}
+	else
+	{
+		result = Sidewalk::Build(params, _state, doc, cache);  // Create sidewalk, reusing the objects of the previous cache
+
+		// A failed build leaves the previous cache intact, it's shown until the next build succeeds
+		if (!result)
+			return cache;
+
+		// Copying a result takes about as long as building it. Only animated results are built again for the same parameters.
+		if (result && (op->GetFirstCTrack() || _prefetcher.IsRunning()))
+			_buildCache.Put(hash, result, doc);
+	}
+
+	// Element names that were left out while building are needed in the converted result
+	if (params.namingPolicy == SIDEWALK_NAMING_LAZY && IsConversion(doc, hh))
+		Sidewalk::ResolveNames(params, result);
+
+	PrefetchFrames(op, doc);
+	return result;
+}
+
+
+Bool SidewalkObject::Message(GeListNode *node, Int32 type, void *data)
+{
+	if (!node)
+		return false;
+	
+	switch (type)
+	{
+		case MSG_SIDEWALK_QUERY:
+			if (!data)
+				return false;
+			return Query(static_cast<BaseObject*>(node), *static_cast<SidewalkQueryData*>(data));
+	}
+	
+	return SUPER::Message(node, type, data);
+}
+
+
+Bool SidewalkObject::GetDParameter(GeListNode *node, const DescID &id, GeData &t_data, DESCFLAGS_GET &flags)
+{
+	if (!node)
+		return false;
+	
+	// Statistics are not stored in the container, they're taken from the last build
+	switch (id[0].id)
+	{
+		case SIDEWALK_PERF_ALLOCATIONS:
+			t_data = GeData(ClampToInt32(_state.pool.GetAllocationCount()));
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_PERF_ACMR_ORIGINAL:
+			t_data = GeData(_state.originalCacheStats.GetACMR());
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_PERF_ACMR_OPTIMIZED:
+			t_data = GeData(_state.optimizedCacheStats.GetACMR());
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_SOURCE:
+			t_data = GeData((Int32)_state.statistics.source);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_OBJECTS:
+			t_data = GeData(ClampToInt32(_state.statistics.objectCount));
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_POINTS:
+			t_data = GeData(ClampToInt32(_state.statistics.pointCount));
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_POLYGONS:
+			t_data = GeData(ClampToInt32(_state.statistics.polygonCount));
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TAGS:
+			t_data = GeData(ClampToInt32(_state.statistics.tagCount));
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_MEMORY:
+			t_data = GeData((Float)_state.statistics.memorySize / 1048576.0);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TIME_TOTAL:
+			t_data = GeData(_state.statistics.totalTime);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TIME_PLATES:
+			t_data = GeData(_state.statistics.plateTime);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TIME_COBBLE:
+			t_data = GeData(_state.statistics.cobblestoneTime);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TIME_DIRT:
+			t_data = GeData(_state.statistics.dirtPlaneTime);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+		
+		case SIDEWALK_STAT_TIME_CURB:
+			t_data = GeData(_state.statistics.curbstoneTime);
+			flags |= DESCFLAGS_GET_PARAM_GET;
+			return true;
+	}
+	
+	return SUPER::GetDParameter(node, id, t_data, flags);
+}
+
+
+Bool SidewalkObject::GetDEnabling(GeListNode *node, const DescID &id, const GeData &t_data, DESCFLAGS_ENABLE flags, const BaseContainer *itemdesc)
+{
+	if (!node)
+		return false;
+	
+	// Statistics are read-only
+	switch (id[0].id)
+	{
+		case SIDEWALK_PERF_ALLOCATIONS:
+		case SIDEWALK_PERF_ACMR_ORIGINAL:
+		case SIDEWALK_PERF_ACMR_OPTIMIZED:
+		case SIDEWALK_STAT_SOURCE:
+		case SIDEWALK_STAT_OBJECTS:
+		case SIDEWALK_STAT_POINTS:
+		case SIDEWALK_STAT_POLYGONS:
+		case SIDEWALK_STAT_TAGS:
+		case SIDEWALK_STAT_MEMORY:
+		case SIDEWALK_STAT_TIME_TOTAL:
+		case SIDEWALK_STAT_TIME_PLATES:
+		case SIDEWALK_STAT_TIME_COBBLE:
+		case SIDEWALK_STAT_TIME_DIRT:
+		case SIDEWALK_STAT_TIME_CURB:
+			return false;
+		
+		// Along a spline, the number of rows is taken from its length. A footprint sets both counts.
+		case SIDEWALK_COUNT_X:
+		case SIDEWALK_COUNT_Z:
+		{
+			BaseContainer *bc = static_cast<BaseObject*>(node)->GetDataInstance();
+			if (bc && bc->GetObjectLink(SIDEWALK_FOOTPRINT, node->GetDocument()))
+				return false;
+			if (id[0].id == SIDEWALK_COUNT_Z && bc && bc->GetObjectLink(SIDEWALK_SPLINE, node->GetDocument()))
+				return false;
+			break;
+		}
+		
+		case SIDEWALK_CHUNK_SIZE_X:
+		case SIDEWALK_CHUNK_SIZE_Z:
+		{
+			BaseContainer *bc = static_cast<BaseObject*>(node)->GetDataInstance();
+			if (bc && !bc->GetBool(SIDEWALK_CHUNK_ENABLE))
+				return false;
+			break;
+		}
+	}
+	
+	return SUPER::GetDEnabling(node, id, t_data, flags, itemdesc);
+}
+
+
+Bool SidewalkObject::Query(BaseObject *op, SidewalkQueryData &query) const
+{
+	// Statistics are kept even if there's no valid result
+	if (query.type == SIDEWALKQUERY::STATISTICS)
+	{
+		query.statistics = _state.statistics;
+		return true;
+	}
+	
+	// The BVH belongs to the current cache
+	if (!_state.complete || !op->GetCache())
+		return false;
+	
+	// The BVH is in object space
+	Matrix mg = op->GetMg();
+	Matrix invMg = ~mg;
+	
+	switch (query.type)
+	{
+		case SIDEWALKQUERY::RAYCAST:
+		{
+			// Distances are measured in world space
+			Float rayScale = query.rayDirection.GetLength();
+			if (rayScale <= 0.0)
+				return false;
+			Vector worldDirection = query.rayDirection / rayScale;
+			
+			Vector origin = invMg * query.rayOrigin;
+			Vector direction = invMg * (query.rayOrigin + worldDirection) - origin;
+			
+			query.found = _state.bvh.Raycast(origin, direction, query.rayLength, query.hit);
+			if (query.found)
+			{
+				query.hit.position = query.rayOrigin + worldDirection * query.hit.distance;
+				query.hit.normal = (mg * (origin + query.hit.normal) - mg * origin).GetNormalized();
+			}
+			return true;
+		}
+		
+		case SIDEWALKQUERY::BOX:
+		{
+			if (!query.elements)
+				return false;
+			
+			// Object space box around the world space box
+			Vector boxMin(MAXVALUE_FLOAT), boxMax(MINVALUE_FLOAT);
+			for (Int32 corner = 0; corner < 8; ++corner)
+			{
+				Vector cornerPos((corner & 1) ? query.boxMax.x : query.boxMin.x, (corner & 2) ? query.boxMax.y : query.boxMin.y, (corner & 4) ? query.boxMax.z : query.boxMin.z);
+				cornerPos = invMg * cornerPos;
+				boxMin = Vector(Min(boxMin.x, cornerPos.x), Min(boxMin.y, cornerPos.y), Min(boxMin.z, cornerPos.z));
+				boxMax = Vector(Max(boxMax.x, cornerPos.x), Max(boxMax.y, cornerPos.y), Max(boxMax.z, cornerPos.z));
+			}
+			
+			return _state.bvh.GetElementsInBox(boxMin, boxMax, *query.elements);
+		}
+	}
+	
+	return false;
+}
+
+
+void SidewalkObject::PrefetchFrames(BaseObject *op, BaseDocument *doc)
+{
+	BaseContainer *bc = op->GetDataInstance();
+	if (!bc || !bc->GetBool(SIDEWALK_CACHE_PREFETCH) || bc->GetInt32(SIDEWALK_CACHE_SIZE) <= 0)
+		return;
+	
+	// Without animation, all frames are the same. A prefetch that's still running is left alone.
+	if (!op->GetFirstCTrack() || _prefetcher.IsRunning() || !IsPrefetchable(*bc, doc))
+		return;
+	
+	Int32 fps = doc->GetFps();
+	Int32 currentFrame = doc->GetTime().GetFrame(fps);
+	Int32 minFrame = doc->GetMinTime().GetFrame(fps);
+	Int32 maxFrame = doc->GetMaxTime().GetFrame(fps);
+	
+	// Nearest frames first, the next one before the previous one
+	maxon::BaseArray<Sidewalk::Parameters> paramsList;
+	for (Int32 distance = 1; distance <= PREFETCH_FRAMES; ++distance)
+	{
+		for (Int32 direction = 1; direction >= -1; direction -= 2)
+		{
+			Int32 frame = currentFrame + distance * direction;
+			if (frame < minFrame || frame > maxFrame)
+				continue;
+			
+			BaseContainer frameData = *bc;
+			EvaluateTracks(op, doc, BaseTime(frame, fps), frameData);
+			
+			Sidewalk::Parameters frameParams;
+			Sidewalk::GetParametersFromContainer(frameData, *doc, frameParams, op->GetMg());
+			if (!paramsList.Append(frameParams))
+				return;
+		}
+	}
+	
+	if (paramsList.GetCount() > 0)
+		_prefetcher.Prefetch(paramsList, &_buildCache);
+}
+
+
+UInt32 SidewalkObject::GetLinkDirty(BaseObject *op, const BaseContainer &bc, BaseDocument *doc)
+{
+	BaseObject *spline = bc.GetObjectLink(SIDEWALK_SPLINE, doc);
+	BaseObject *footprint = bc.GetObjectLink(SIDEWALK_FOOTPRINT, doc);
+	BaseObject *terrain = bc.GetObjectLink(SIDEWALK_TERRAIN, doc);
+	if (!spline && !footprint && !terrain)
+		return 0;
+	
+	// The linked objects are used relative to the generator, so moving any of them changes the result
+	UInt32 dirty = op->GetDirty(DIRTYFLAGS_MATRIX) + 1;
+	if (spline)
+		dirty += spline->GetDirty(DIRTYFLAGS_DATA | DIRTYFLAGS_MATRIX | DIRTYFLAGS_CACHE);
+	if (footprint)
+		dirty += footprint->GetDirty(DIRTYFLAGS_DATA | DIRTYFLAGS_MATRIX | DIRTYFLAGS_CACHE) * 31;
+	if (terrain)
+		dirty += terrain->GetDirty(DIRTYFLAGS_DATA | DIRTYFLAGS_MATRIX | DIRTYFLAGS_CACHE) * 37;
+	return dirty;
 }
 
 
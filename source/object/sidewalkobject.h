@@ -2,23 +2,87 @@
 #define SIDEWALKOBJECT_H__
 
 #include "c4d.h"
+#include "sidewalk.h"
+#include "buildcache.h"
 
 
 const Int32 ID_OSIDEWALK = 1024588;
 
 
+/// Send this message to a sidewalk object with a SidewalkQueryData, to query the elements of its cache
+const Int32 MSG_SIDEWALK_QUERY = ID_OSIDEWALK;
+
+
+/// Kinds of sidewalk queries
+enum class SIDEWALKQUERY
+{
+	RAYCAST =	0,    ///< Find the nearest polygon hit by a ray
+	BOX =	1,        ///< Find all elements whose bounding boxes overlap a box
+	STATISTICS =	2  ///< Get the statistics of the last result
+} ENUM_END_LIST(SIDEWALKQUERY);
+
+
+/// Input and output of MSG_SIDEWALK_QUERY. All coordinates are in world space.
+/// Object pointers point into the sidewalk's cache, they're only valid until the sidewalk is rebuilt.
+struct SidewalkQueryData
+{
+	SIDEWALKQUERY type;
+	
+	// Ray query
+	Vector rayOrigin;
+	Vector rayDirection;                      ///< Direction of the ray, does not need to be normalized
+	Float rayLength;
+	ElementHit hit;                           ///< Receives the nearest hit
+	Bool found;                               ///< Receives true if the ray hit anything
+	
+	// Box query
+	Vector boxMin;
+	Vector boxMax;
+	maxon::BaseArray<BaseObject*> *elements;  ///< Receives the elements, must be set by the caller
+	
+	// Statistics query
+	BuildStatistics statistics;               ///< Receives the statistics
+	
+	/// Default constructor
+	SidewalkQueryData() : type(SIDEWALKQUERY::RAYCAST), rayLength(0.0), found(false), elements(nullptr)
+	{}
+};
+
+
 class SidewalkObject : public ObjectData
 {
 	INSTANCEOF(SidewalkObject, ObjectData);
 	
 public:
 	virtual Bool Init(GeListNode *node);
+	virtual void Free(GeListNode *node);
 	virtual BaseObject* GetVirtualObjects(BaseObject *op, HierarchyHelp *hh);
+	virtual Bool Message(GeListNode *node, Int32 type, void *data);
+	virtual Bool GetDParameter(GeListNode *node, const DescID &id, GeData &t_data, DESCFLAGS_GET &flags);
+	virtual Bool GetDEnabling(GeListNode *node, const DescID &id, const GeData &t_data, DESCFLAGS_ENABLE flags, const BaseContainer *itemdesc);
 	
 	static NodeData *Alloc()
 	{
 		return NewObjClear(SidewalkObject);
 	}
+
+private:
+	/// Answer a MSG_SIDEWALK_QUERY from the element BVH of the last result
+	/// @return False if there's no valid result or an error occurred; otherwise true
+	Bool Query(BaseObject *op, SidewalkQueryData &query) const;
+	
+	/// Start building the neighbouring frames in the background, if any parameter is animated and nothing else changes between frames
+	void PrefetchFrames(BaseObject *op, BaseDocument *doc);
+	
+	/// Get a checksum of everything about the linked splines and terrain that affects the result
+	/// @return 0 if there's no linked object
+	static UInt32 GetLinkDirty(BaseObject *op, const BaseContainer &bc, BaseDocument *doc);
+	
+private:
+	Sidewalk::State _state;         ///< Kept alive between calls, so the last result can be updated in place
+	BuildCache _buildCache;         ///< Results of previous builds, e.g. of other frames
+	BuildPrefetcher _prefetcher;    ///< Fills the build cache with the neighbouring frames
+	UInt32 _linkDirty;              ///< Checksum of the linked objects at the last build, see GetLinkDirty()
 };
 
 